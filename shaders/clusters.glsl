@@ -0,0 +1,42 @@
+// Clustered light lists, filled in by ClusteredLighting (src/clustered_lighting.hpp).
+// Needs the Lights block from uniform_blocks.glsl.
+
+// five texels per light, see LightData
+uniform samplerBuffer lightData;
+// (offset, count) into lightIndices for every cluster
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer lightIndices;
+
+// A point or spot light. Point lights have a cone wide enough to cover every direction.
+struct Light {
+	vec3 position;
+	float constant;
+	vec3 ambient;
+	float linear;
+	vec3 diffuse;
+	float quadratic;
+	vec3 specular;
+	float cutOff;
+	vec3 direction;
+	float outerCutOff;
+};
+
+Light fetchLight(int index)
+{
+	int base = index * 5;
+	vec4 t0 = texelFetch(lightData, base);
+	vec4 t1 = texelFetch(lightData, base + 1);
+	vec4 t2 = texelFetch(lightData, base + 2);
+	vec4 t3 = texelFetch(lightData, base + 3);
+	vec4 t4 = texelFetch(lightData, base + 4);
+	return Light(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.xyz, t4.w);
+}
+
+// Find the part of the light index list that belongs to the cluster containing a fragment.
+uvec2 clusterLightRange(vec2 fragCoord, float viewDepth)
+{
+	float slice = clamp(log(viewDepth) * clusterDepth.x - clusterDepth.y, 0.0, float(clusterSize.z - 1u));
+	uvec2 tile = min(uvec2(fragCoord) / clusterSize.w, clusterSize.xy - 1u);
+	int cluster = int(tile.x + clusterSize.x * (tile.y + clusterSize.y * uint(slice)));
+	return texelFetch(clusterGrid, cluster).xy;
+}
@@ -0,0 +1,36 @@
+#version 330 core
+#include "uniform_blocks.glsl"
+#include "clusters.glsl"
+#include "gbuffer.glsl"
+#include "shading.glsl"
+
+out vec4 FragColor;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+// takes normalised device coordinates back to world space
+uniform mat4 inverseViewProj;
+uniform float shininess;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	// nothing was drawn here, so keep the clear colour
+	if (depth == 1.0)
+		discard;
+
+	vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+	vec4 position = inverseViewProj * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+	vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+
+	Surface surface;
+	surface.position = position.xyz / position.w;
+	surface.normal = decodeNormal(texelFetch(gNormal, pixel, 0).xy);
+	surface.albedo = albedoSpecular.rgb;
+	surface.specular = vec3(albedoSpecular.a);
+	surface.shininess = shininess;
+
+	FragColor = vec4(ShadeSurface(surface, gl_FragCoord.xy), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+#version 330 core
+// Depth only. The depth pre-pass writes no colour, so there is nothing to compute here.
+
+void main()
+{
+}
\ No newline at end of file
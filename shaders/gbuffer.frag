@@ -0,0 +1,25 @@
+#version 330 core
+#include "gbuffer.glsl"
+#include "material.glsl"
+
+in vec3 Normal;
+in vec3 FragPos;
+in vec2 TexCoords;
+flat in vec2 MaterialLayers;
+
+layout (location = 0) out vec4 AlbedoSpecular;
+layout (location = 1) out vec2 PackedNormal;
+
+uniform Material material;
+
+void main()
+{
+#ifdef SPECULAR_MAP
+	// the specular maps are grey, so one channel of them is enough
+	vec3 albedo = vec3(SampleMaterial(material.diffuse, TexCoords, MaterialLayers.x));
+	AlbedoSpecular = vec4(albedo, SampleMaterial(material.specular, TexCoords, MaterialLayers.y).r);
+#else
+	AlbedoSpecular = vec4(vec3(SampleMaterial(material.diffuse, TexCoords, MaterialLayers.x)), 0.0);
+#endif
+	PackedNormal = encodeNormal(normalize(Normal));
+}
\ No newline at end of file
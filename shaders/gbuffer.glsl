@@ -0,0 +1,26 @@
+// G-buffer layout and packing, written by gbuffer.frag and read by deferred_lighting.frag.
+// Keep the layout in sync with src/gbuffer.hpp.
+//     attachment 0  RGBA8   albedo, specular intensity
+//     attachment 1  RG16F   normal, octahedral encoded
+//     depth         D24S8   position is reconstructed from it
+
+// Fold the lower hemisphere of the octahedron over the upper one.
+vec2 octahedronWrap(vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Pack a unit normal into two components in [-1, 1].
+vec2 encodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	return n.z >= 0.0 ? n.xy : octahedronWrap(n.xy);
+}
+
+vec3 decodeNormal(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 330 core
+// Reduce a depth buffer to the base level of the hierarchical-Z pyramid. Each output texel keeps the
+// farthest depth of the block of pixels it covers, so anything behind it is hidden behind the whole block.
+
+// Keep in sync with HiZBuffer::kWIDTH and HiZBuffer::kHEIGHT.
+const ivec2 outputSize = ivec2(256, 128);
+
+uniform sampler2D depthTexture;
+
+out float MaxDepth;
+
+void main()
+{
+	ivec2 sourceSize = textureSize(depthTexture, 0);
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	ivec2 first = texel * sourceSize / outputSize;
+	ivec2 last = max((texel + 1) * sourceSize / outputSize, first + 1);
+	float depth = 0.0;
+	for (int y = first.y; y < last.y; y++)
+		for (int x = first.x; x < last.x; x++)
+			depth = max(depth, texelFetch(depthTexture, ivec2(x, y), 0).r);
+	MaxDepth = depth;
+}
\ No newline at end of file
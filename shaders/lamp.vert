@@ -1,11 +1,15 @@
 #version 330 core
+#include "uniform_blocks.glsl"
 layout (location = 0) in vec3 aPos;
+// per-instance data
+layout (location = 3) in mat4 aModel;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+// The depth pre-pass uses this shader too, and the colour passes only draw where their depth is
+// equal to it, so every program must compute the position the same way.
+invariant gl_Position;
 
 void main()
 {
-	gl_Position = proj * view * model * vec4(aPos, 1.0);
+	vec4 worldPos = aModel * vec4(aPos, 1.0);
+	gl_Position = proj * view * worldPos;
 }
\ No newline at end of file
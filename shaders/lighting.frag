@@ -1,130 +1,31 @@
 #version 330 core
-
-struct Material {
-	sampler2D diffuse;
-	sampler2D specular;
-	sampler2D emission;
-	float shininess;
-};
-
-struct DirLight {
-	vec3 direction;
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-
-struct PointLight {
-	vec3 position;
-	float constant;
-	float linear;
-	float quadratic;
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-
-struct SpotLight {
-	vec3 position;
-	vec3 direction;
-	float cutOff;
-	float outerCutOff;
-	float constant;
-	float linear;
-	float quadratic;
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-
+#include "uniform_blocks.glsl"
+#include "clusters.glsl"
+#include "shading.glsl"
+#include "material.glsl"
 
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
+flat in vec2 MaterialLayers;
 
 out vec4 FragColor;
 
 uniform Material material;
-uniform DirLight dirLight;
-#define NR_POINT_LIGHTS 4
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform vec3 viewPos;
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight spotLight, vec3 normal, vec3 fragPos, vec3 viewDir);
-
-/* lots of room for optimisation here */
 
 void main()
 {
-	vec3 norm = normalize(Normal);
-	vec3 viewDir = normalize(viewPos - FragPos);
-	// directional lighting
-	vec3 result = CalcDirLight(dirLight, norm, viewDir);
-	// point lights
-	for (int i = 0; i < NR_POINT_LIGHTS; i++)
-		result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
-	// Spot light
-	result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
-
-	FragColor = vec4(result, 1.0);
-}
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-	vec3 lightDir = normalize(-light.direction);
-	// diffuse shading
-	float diff = max(dot(normal, lightDir), 0.0);
-	// specular shading
-	vec3 reflectDir = reflect(-lightDir, normal);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-	// combine results
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-	return ambient + diffuse + specular;
-}
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-	vec3 lightDir = (normalize(light.position - fragPos));
-	// diffuse shading
-	float diff = max(dot(normal, lightDir), 0.0);
-	// specular shading
-	vec3 reflectDir = reflect(-lightDir, normal);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-	// attenuation
-	float d = length(light.position - fragPos);
-	float attenuation = 1.0 / (light.constant + light.linear * d + light.quadratic * (d*d));
-	// combine results
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-	ambient *= attenuation;
-	diffuse *= attenuation;
-	specular *= attenuation;
-	return (ambient + diffuse + specular);
-}
-
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-	vec3 lightDir = normalize(light.position - fragPos);
-	// diffuse shading
-	float diff = max(dot(normal, lightDir), 0.0);
-	// specular shading
-	vec3 reflectDir = reflect(-lightDir, normal);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-	// attenuation
-	float d = length(light.position - fragPos);
-	float attenuation = 1.0 / (light.constant + light.linear * d + light.quadratic * (d*d));
-	// combine results
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-	ambient *= attenuation;
-	diffuse *= attenuation;
-	specular *= attenuation;
-	return (ambient + diffuse + specular);
+	// sample the material once, every light shares the result
+	Surface surface;
+	surface.position = FragPos;
+	surface.normal = normalize(Normal);
+	surface.albedo = vec3(SampleMaterial(material.diffuse, TexCoords, MaterialLayers.x));
+#ifdef SPECULAR_MAP
+	surface.specular = vec3(SampleMaterial(material.specular, TexCoords, MaterialLayers.y));
+#else
+	surface.specular = vec3(0.0);
+#endif
+	surface.shininess = material.shininess;
+
+	FragColor = vec4(ShadeSurface(surface, gl_FragCoord.xy), 1.0);
 }
\ No newline at end of file
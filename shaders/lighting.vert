@@ -1,20 +1,26 @@
 #version 330 core
+#include "uniform_blocks.glsl"
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per-instance data
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
+layout (location = 10) in vec2 aMaterialLayers;
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+flat out vec2 MaterialLayers;
+// must match the depth pre-pass exactly, see lamp.vert
+invariant gl_Position;
 
 void main()
 {
-	gl_Position = proj * view * model * vec4(aPos, 1.0);
-	Normal = mat3(transpose(inverse(model))) * aNormal;  // in real life don't do this in the shader.
-	FragPos = vec3(model * vec4(aPos, 1.0));
+	vec4 worldPos = aModel * vec4(aPos, 1.0);
+	gl_Position = proj * view * worldPos;
+	Normal = aNormalMatrix * aNormal;
+	FragPos = vec3(worldPos);
 	TexCoords = aTexCoords;
+	MaterialLayers = aMaterialLayers;
 }
\ No newline at end of file
@@ -0,0 +1,16 @@
+// Material textures, kept as layers of texture arrays so that instances with different materials
+// can share a draw. Keep in sync with src/material_library.hpp.
+
+struct Material {
+	sampler2DArray diffuse;
+#ifdef SPECULAR_MAP
+	sampler2DArray specular;
+#endif
+	float shininess;
+};
+
+// Sample a layer of a material texture. A negative layer isn't resident yet and reads as mid grey.
+vec4 SampleMaterial(sampler2DArray textures, vec2 texCoords, float layer)
+{
+	return layer < 0.0 ? vec4(0.5, 0.5, 0.5, 1.0) : texture(textures, vec3(texCoords, layer));
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 330 core
+// Scale the scene up from the resolution it was rendered at to the output. Bilinear filtering fills
+// in the missing pixels, and an unsharp mask brings back some of the edges it softens.
+
+uniform sampler2D sceneTexture;
+uniform vec2 outputSize;
+// 0 for a plain bilinear upscale
+uniform float sharpness;
+
+out vec4 FragColor;
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy / outputSize;
+	vec2 texel = 1.0 / vec2(textureSize(sceneTexture, 0));
+	vec3 centre = texture(sceneTexture, uv).rgb;
+	vec3 neighbours = texture(sceneTexture, uv + vec2(texel.x, 0.0)).rgb
+	                + texture(sceneTexture, uv - vec2(texel.x, 0.0)).rgb
+	                + texture(sceneTexture, uv + vec2(0.0, texel.y)).rgb
+	                + texture(sceneTexture, uv - vec2(0.0, texel.y)).rgb;
+	vec3 colour = centre + (centre - 0.25 * neighbours) * sharpness;
+	FragColor = vec4(clamp(colour, 0.0, 1.0), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+// Lighting shared by the forward and deferred paths.
+// Needs uniform_blocks.glsl and clusters.glsl.
+// Each light type and the specular term is only compiled in when its feature is defined, see
+// ShaderFeature in src/shader_variants.hpp.
+
+// Everything the lighting needs to know about the surface at one pixel.
+struct Surface {
+	vec3 position;
+	vec3 normal;
+	vec3 albedo;
+	vec3 specular;
+	float shininess;
+};
+
+// The specular highlight of a light, nothing when the surface has no specular map.
+vec3 CalcSpecular(vec3 lightSpecular, vec3 lightDir, Surface surface, vec3 viewDir)
+{
+#ifdef SPECULAR_MAP
+	vec3 reflectDir = reflect(-lightDir, surface.normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), surface.shininess);
+	return lightSpecular * spec * surface.specular;
+#else
+	return vec3(0.0);
+#endif
+}
+
+vec3 CalcDirLight(DirLight light, Surface surface, vec3 viewDir)
+{
+	vec3 lightDir = normalize(-light.direction);
+	// diffuse shading
+	float diff = max(dot(surface.normal, lightDir), 0.0);
+	// combine results
+	vec3 ambient = light.ambient * surface.albedo;
+	vec3 diffuse = light.diffuse * diff * surface.albedo;
+	vec3 specular = CalcSpecular(light.specular, lightDir, surface, viewDir);
+	return ambient + diffuse + specular;
+}
+
+vec3 CalcLight(Light light, Surface surface, vec3 viewDir)
+{
+	vec3 lightDir = normalize(light.position - surface.position);
+	// diffuse shading
+	float diff = max(dot(surface.normal, lightDir), 0.0);
+	// attenuation
+	float d = length(light.position - surface.position);
+	float attenuation = 1.0 / (light.constant + light.linear * d + light.quadratic * (d*d));
+#ifdef SPOT_LIGHTS
+	// spot cone, always 1 for point lights
+	float theta = dot(lightDir, normalize(-light.direction));
+	float intensity = clamp((theta - light.outerCutOff) / (light.cutOff - light.outerCutOff), 0.0, 1.0);
+#else
+	float intensity = 1.0;
+#endif
+	// combine results
+	vec3 ambient = light.ambient * surface.albedo;
+	vec3 diffuse = light.diffuse * diff * surface.albedo;
+	vec3 specular = CalcSpecular(light.specular, lightDir, surface, viewDir);
+	ambient *= attenuation;
+	diffuse *= attenuation * intensity;
+	specular *= attenuation * intensity;
+	return (ambient + diffuse + specular);
+}
+
+// Light a surface with the directional light and the point and spot lights of its cluster.
+vec3 ShadeSurface(Surface surface, vec2 fragCoord)
+{
+	vec3 viewDir = normalize(viewPos - surface.position);
+	vec3 result = vec3(0.0);
+#ifdef DIRECTIONAL_LIGHT
+	result += CalcDirLight(dirLight, surface, viewDir);
+#endif
+#ifdef LOCAL_LIGHTS
+	float viewDepth = -(view * vec4(surface.position, 1.0)).z;
+	uvec2 lights = clusterLightRange(fragCoord, viewDepth);
+	for (uint i = 0u; i < lights.y; i++)
+	{
+		int index = int(texelFetch(lightIndices, int(lights.x + i)).r);
+		result += CalcLight(fetchLight(index), surface, viewDir);
+	}
+#endif
+	return result;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+// Uniform blocks shared by every shader program.
+// Keep in sync with the C++ mirrors in src/uniform_blocks.hpp.
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 proj;
+	vec3 viewPos;
+};
+
+struct DirLight {
+	vec3 direction;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+layout (std140) uniform Lights
+{
+	DirLight dirLight;
+	uvec4 clusterSize;	// tiles in x, tiles in y, depth slices, tile size in pixels
+	vec4 clusterDepth;	// depth slice scale, depth slice bias, near plane, far plane
+};
@@ -0,0 +1,268 @@
+#include "asset_streamer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+
+constexpr float AssetStreamer::kCHUNK_SIZE;
+constexpr float AssetStreamer::kSTREAM_DISTANCE;
+constexpr float AssetStreamer::kBEHIND_PENALTY;
+constexpr unsigned int AssetStreamer::kMAX_LOADS_IN_FLIGHT;
+constexpr std::size_t AssetStreamer::kDEFAULT_BUDGET;
+constexpr double AssetStreamer::kDEFAULT_UPLOAD_BUDGET;
+
+namespace
+{
+    const float kNOT_WANTED = std::numeric_limits<float>::max();
+
+    // 21 bits per axis, offset so that negative cells pack too
+    std::uint64_t cellKey(const glm::vec3& position, float cell_size)
+    {
+        const std::int64_t kOFFSET = 1 << 20;
+        std::uint64_t x = static_cast<std::uint64_t>(static_cast<std::int64_t>(std::floor(position.x / cell_size)) + kOFFSET) & 0x1FFFFF;
+        std::uint64_t y = static_cast<std::uint64_t>(static_cast<std::int64_t>(std::floor(position.y / cell_size)) + kOFFSET) & 0x1FFFFF;
+        std::uint64_t z = static_cast<std::uint64_t>(static_cast<std::int64_t>(std::floor(position.z / cell_size)) + kOFFSET) & 0x1FFFFF;
+        return (x << 42) | (y << 21) | z;
+    }
+
+    std::size_t meshBytes(const MeshView& view, VertexFormat format)
+    {
+        return view.VertexCount * getVertexLayout(format).Stride + view.IndexCount * sizeof(std::uint32_t);
+    }
+}
+
+AssetStreamer::AssetStreamer(ThreadPool& pool, MaterialLibrary& materials, std::size_t budget)
+    :   Pool(pool),
+        Materials(materials),
+        Budget(budget),
+        UploadBudget(kDEFAULT_UPLOAD_BUDGET),
+        Frame(0),
+        Stats(),
+        TasksInFlight(0)
+{
+}
+
+AssetStreamer::~AssetStreamer()
+{
+    std::unique_lock<std::mutex> lock(this->Mutex);
+    this->TasksFinished.wait(lock, [this] { return this->TasksInFlight == 0; });
+}
+
+AssetId AssetStreamer::addMesh(const char* path, VertexFormat format)
+{
+    std::unique_ptr<StreamedMesh> mesh(new StreamedMesh());
+    mesh->Path = path;
+    mesh->Format = format;
+    mesh->Stage = kUNLOADED;
+    mesh->Bytes = 0;
+    mesh->Generation = 0;
+    mesh->LastVisible = 0;
+    // wanted until the first update() ranks it, so nothing counts as loaded before then
+    mesh->Priority = 0.0f;
+    this->Meshes.push_back(std::move(mesh));
+    this->Stats.PendingMeshes++;
+    return static_cast<AssetId>(this->Meshes.size() - 1);
+}
+
+void AssetStreamer::addObject(const Bounds& world_bounds, AssetId mesh, MaterialId material)
+{
+    addObject(world_bounds, mesh);
+    // a chunk only lists each of its meshes and materials once, however many objects use them
+    Chunk& chunk = chunkOf(world_bounds);
+    if (std::find(chunk.Materials.begin(), chunk.Materials.end(), material) == chunk.Materials.end())
+        chunk.Materials.push_back(material);
+}
+
+void AssetStreamer::addObject(const Bounds& world_bounds, AssetId mesh)
+{
+    Chunk& chunk = chunkOf(world_bounds);
+    if (std::find(chunk.Meshes.begin(), chunk.Meshes.end(), mesh) == chunk.Meshes.end())
+        chunk.Meshes.push_back(mesh);
+}
+
+void AssetStreamer::update(const glm::vec3& eye, const glm::vec3& front)
+{
+    this->Frame++;
+    this->Stats.Uploads = 0;
+    this->Stats.UploadTime = 0.0;
+
+    // rank every mesh by the nearest chunk that needs it
+    for (std::size_t i = 0; i < this->Meshes.size(); i++)
+        this->Meshes[i]->Priority = kNOT_WANTED;
+    for (std::size_t i = 0; i < this->Chunks.size(); i++)
+    {
+        const Chunk& chunk = this->Chunks[i];
+        float distance = glm::length(glm::clamp(eye, chunk.Box.Min, chunk.Box.Max) - eye);
+        if (distance > kSTREAM_DISTANCE)
+            continue;
+        glm::vec3 to_centre = (chunk.Box.Min + chunk.Box.Max) * 0.5f - eye;
+        float centre_distance = glm::length(to_centre);
+        float facing = centre_distance > 0.0f ? glm::dot(front, to_centre / centre_distance) : 1.0f;
+        float priority = distance * (1.0f + kBEHIND_PENALTY * 0.5f * (1.0f - facing));
+        for (std::size_t j = 0; j < chunk.Meshes.size(); j++)
+        {
+            StreamedMesh& mesh = *this->Meshes[chunk.Meshes[j]];
+            mesh.Priority = std::min(mesh.Priority, priority);
+        }
+        for (std::size_t j = 0; j < chunk.Materials.size(); j++)
+            this->Materials.markUsed(chunk.Materials[j]);
+    }
+
+    FrameVector<AssetId> wanted;
+    for (std::size_t i = 0; i < this->Meshes.size(); i++)
+    {
+        if (this->Meshes[i]->Priority != kNOT_WANTED)
+            wanted.push_back(static_cast<AssetId>(i));
+    }
+    std::sort(wanted.begin(), wanted.end(), [this](AssetId a, AssetId b) {
+        return this->Meshes[a]->Priority < this->Meshes[b]->Priority;
+    });
+
+    // snapshot the stages so workers are never held up by uploads
+    FrameVector<LoadStage> stages(this->Meshes.size());
+    unsigned int loads_in_flight = 0;
+    {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        for (std::size_t i = 0; i < this->Meshes.size(); i++)
+        {
+            stages[i] = this->Meshes[i]->Stage;
+            if (stages[i] == kLOADING)
+                loads_in_flight++;
+        }
+    }
+
+    // meshes that loaded after they stopped being wanted aren't worth keeping in memory
+    for (std::size_t i = 0; i < this->Meshes.size(); i++)
+    {
+        if (stages[i] == kLOADED && this->Meshes[i]->Priority == kNOT_WANTED)
+        {
+            this->Meshes[i]->Source.reset();
+            stages[i] = kUNLOADED;
+            std::lock_guard<std::mutex> lock(this->Mutex);
+            this->Meshes[i]->Stage = kUNLOADED;
+        }
+    }
+
+    std::chrono::steady_clock::time_point upload_start = std::chrono::steady_clock::now();
+    bool upload_budget_spent = false;
+    this->Stats.PendingMeshes = 0;
+    for (std::size_t i = 0; i < wanted.size(); i++)
+    {
+        StreamedMesh& mesh = *this->Meshes[wanted[i]];
+        LoadStage stage = stages[wanted[i]];
+        if (stage == kUNLOADED && loads_in_flight < kMAX_LOADS_IN_FLIGHT)
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->Mutex);
+                mesh.Stage = kLOADING;
+                this->TasksInFlight++;
+            }
+            loads_in_flight++;
+            StreamedMesh* loading = &mesh;
+            this->Pool.submit([this, loading] { loadMesh(loading); });
+            stage = kLOADING;
+        }
+        else if (stage == kLOADED && !upload_budget_spent)
+        {
+            PROFILE_SCOPE("upload mesh");
+            if (uploadMesh(mesh))
+            {
+                stage = kRESIDENT;
+                this->Stats.Uploads++;
+            }
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - upload_start).count();
+            upload_budget_spent = elapsed >= this->UploadBudget;
+        }
+        if (stage != kRESIDENT && stage != kFAILED)
+            this->Stats.PendingMeshes++;
+    }
+    this->Stats.UploadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - upload_start).count();
+    this->Stats.StalledObjects = 0;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+AssetStreamer::Chunk& AssetStreamer::chunkOf(const Bounds& world_bounds)
+{
+    glm::vec3 centre = (world_bounds.Min + world_bounds.Max) * 0.5f;
+    std::uint64_t key = cellKey(centre, kCHUNK_SIZE);
+    std::map<std::uint64_t, std::size_t>::iterator cell = this->ChunkCells.find(key);
+    if (cell == this->ChunkCells.end())
+    {
+        Chunk chunk;
+        chunk.Box = world_bounds;
+        this->Chunks.push_back(chunk);
+        cell = this->ChunkCells.insert(std::make_pair(key, this->Chunks.size() - 1)).first;
+    }
+    Chunk& chunk = this->Chunks[cell->second];
+    chunk.Box.Min = glm::min(chunk.Box.Min, world_bounds.Min);
+    chunk.Box.Max = glm::max(chunk.Box.Max, world_bounds.Max);
+    return chunk;
+}
+
+void AssetStreamer::loadMesh(StreamedMesh* mesh)
+{
+    std::unique_ptr<MeshSource> source(new MeshSource());
+    bool loaded;
+    {
+        PROFILE_SCOPE("load mesh");
+        loaded = loadMeshSource(mesh->Path.c_str(), *source);
+    }
+    // the source is only handed over along with the stage, which the render thread reads under the lock
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    if (loaded)
+        mesh->Source = std::move(source);
+    mesh->Stage = loaded ? kLOADED : kFAILED;
+    this->TasksInFlight--;
+    this->TasksFinished.notify_all();
+}
+
+bool AssetStreamer::uploadMesh(StreamedMesh& mesh)
+{
+    if (!makeRoom(meshBytes(mesh.Source->View, mesh.Format), mesh.Priority))
+        return false;
+    mesh.GpuMesh.reset(new Mesh(mesh.Source->View, mesh.Format));
+    mesh.Source.reset();
+    mesh.Bytes = mesh.GpuMesh->vertexBufferSize() + mesh.GpuMesh->indexCount() * sizeof(std::uint32_t);
+    mesh.Generation++;
+    // a fresh upload counts as visible, so it isn't evicted before it has been drawn
+    mesh.LastVisible = this->Frame;
+    this->Stats.ResidentMeshes++;
+    this->Stats.ResidentBytes += mesh.Bytes;
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    mesh.Stage = kRESIDENT;
+    return true;
+}
+
+bool AssetStreamer::makeRoom(std::size_t bytes, float priority)
+{
+    while (this->Stats.ResidentBytes + bytes > this->Budget)
+    {
+        // only farther meshes that weren't visible last frame may go, the longest unseen first
+        StreamedMesh* oldest = NULL;
+        for (std::size_t i = 0; i < this->Meshes.size(); i++)
+        {
+            StreamedMesh* mesh = this->Meshes[i].get();
+            if (!mesh->GpuMesh || mesh->LastVisible + 1 >= this->Frame || mesh->Priority <= priority)
+                continue;
+            if (!oldest || mesh->LastVisible < oldest->LastVisible)
+                oldest = mesh;
+        }
+        if (!oldest)
+            return false;
+
+        oldest->GpuMesh.reset();
+        this->Stats.ResidentMeshes--;
+        this->Stats.ResidentBytes -= oldest->Bytes;
+        this->Stats.Evictions++;
+        oldest->Bytes = 0;
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        oldest->Stage = kUNLOADED;
+    }
+    return true;
+}
@@ -0,0 +1,176 @@
+#ifndef ASSET_STREAMER_HPP
+#define ASSET_STREAMER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "material_library.hpp"
+#include "model.hpp"
+
+class ThreadPool;
+
+/* Index of a mesh in an AssetStreamer. Meshes are numbered in the order they were added. */
+typedef std::uint32_t AssetId;
+
+/* Residency of the streamed meshes, and what streaming did in the last frame. */
+struct StreamingStats
+{
+    /* Meshes on the GPU and the size of their buffers in bytes. */
+    std::size_t ResidentMeshes;
+    std::size_t ResidentBytes;
+    /* Meshes near the camera that aren't on the GPU yet. */
+    std::size_t PendingMeshes;
+    /* Meshes uploaded in the last update(), and how long that took in milliseconds. */
+    unsigned int Uploads;
+    double UploadTime;
+    /* Meshes evicted to stay within the budget since the start. */
+    std::size_t Evictions;
+    /* Objects inside the view frustum that were skipped in the last frame because their mesh wasn't resident. */
+    unsigned int StalledObjects;
+};
+
+/*
+    Streams the meshes of the scene in and out of GPU memory around the camera.
+    Objects are put into the chunks of a uniform grid by the centre of their box. Every frame the
+    chunks within kSTREAM_DISTANCE of the camera are ranked by distance, with chunks behind the
+    camera counted as farther away. Their meshes are read, or imported the first time, on the
+    worker threads of a ThreadPool in that order. Loaded meshes are uploaded in the same order until
+    the frame's upload time budget is spent, always at least one per frame. The materials of those
+    chunks are marked used as well, so their textures are loaded before they come into view.
+    The meshes on the GPU are kept within a memory budget by evicting the meshes that have gone the
+    longest without being visible, among those ranked after the mesh that needs the room. A mesh
+    that was visible last frame is never evicted, so a budget that is too small leaves the farther
+    meshes waiting rather than thrashing. Objects are assumed to stay in the chunk they were added to.
+*/
+class AssetStreamer
+{
+public:
+    /* Size of a chunk along each axis, in world units. */
+    static constexpr float kCHUNK_SIZE = 16.0f;
+    /* Chunks farther than this from the camera are not loaded. */
+    static constexpr float kSTREAM_DISTANCE = 100.0f;
+    /* Share of its distance added to a chunk straight behind the camera when ranking it. */
+    static constexpr float kBEHIND_PENALTY = 1.0f;
+    /* Most meshes being read or imported at once. */
+    static constexpr unsigned int kMAX_LOADS_IN_FLIGHT = 4;
+    /* Bytes of mesh buffers kept on the GPU at most, unless setBudget() is called. */
+    static constexpr std::size_t kDEFAULT_BUDGET = 256 * 1024 * 1024;
+    /* Milliseconds of uploads per frame, unless setUploadBudget() is called. */
+    static constexpr double kDEFAULT_UPLOAD_BUDGET = 2.0;
+
+    /* Construct an empty AssetStreamer object that loads on the given pool and prefetches materials from a library. */
+    AssetStreamer(ThreadPool& pool, MaterialLibrary& materials, std::size_t budget = kDEFAULT_BUDGET);
+    /* Wait for any loads still running, then release the meshes. The GL context must be current. */
+    ~AssetStreamer();
+    AssetStreamer(const AssetStreamer&) = delete;
+    AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+    /* Add a mesh to stream from a model file, stored in the given vertex format. It is only loaded once a chunk near the camera needs it. */
+    AssetId addMesh(const char* path, VertexFormat format);
+    /* Add an object drawn with a mesh and a material to the chunk its world-space box is centred in. */
+    void addObject(const Bounds& world_bounds, AssetId mesh, MaterialId material);
+    /* Add an object drawn with a mesh and no material textures. */
+    void addObject(const Bounds& world_bounds, AssetId mesh);
+    /* Set how many bytes of mesh buffers may stay on the GPU. */
+    void setBudget(std::size_t bytes) { this->Budget = bytes; }
+    std::size_t budget() const { return this->Budget; }
+    /* Set how many milliseconds each frame may spend uploading meshes. */
+    void setUploadBudget(double milliseconds) { this->UploadBudget = milliseconds; }
+    double uploadBudget() const { return this->UploadBudget; }
+
+    /*
+        Rank the chunks around the camera, start loading the meshes they need, upload what has loaded
+        and evict what doesn't fit. Call once per frame on the render thread, before culling.
+    */
+    void update(const glm::vec3& eye, const glm::vec3& front);
+    /* Check if a mesh is on the GPU. Only changes in update(). */
+    bool isResident(AssetId mesh) const { return this->Meshes[mesh]->GpuMesh != NULL; }
+    /* Get the vertex format a mesh is stored in. */
+    VertexFormat format(AssetId mesh) const { return this->Meshes[mesh]->Format; }
+    /* Get a mesh that is resident. */
+    Mesh& mesh(AssetId mesh) { return *this->Meshes[mesh]->GpuMesh; }
+    const Mesh& mesh(AssetId mesh) const { return *this->Meshes[mesh]->GpuMesh; }
+    /* Get a number that changes whenever a mesh is uploaded, so vertex arrays made from an earlier upload can be made again. */
+    std::uint32_t generation(AssetId mesh) const { return this->Meshes[mesh]->Generation; }
+    /* Record that objects drawn with a mesh were visible this frame, which keeps it resident. */
+    void markVisible(AssetId mesh) { this->Meshes[mesh]->LastVisible = this->Frame; }
+    /* Record the number of objects skipped this frame because their mesh wasn't resident. */
+    void reportStalls(unsigned int objects) { this->Stats.StalledObjects = objects; }
+    /* Get the number of meshes near the camera that aren't on the GPU yet. */
+    std::size_t pendingCount() const { return this->Stats.PendingMeshes; }
+    const StreamingStats& stats() const { return this->Stats; }
+
+private:
+    /* Stage of a mesh in the streaming pipeline. */
+    enum LoadStage
+    {
+        kUNLOADED,
+        kLOADING,   // being read or imported on a worker
+        kLOADED,    // in memory and waiting to upload
+        kRESIDENT,
+        kFAILED
+    };
+
+    struct StreamedMesh
+    {
+        std::string Path;
+        VertexFormat Format;
+        LoadStage Stage;
+        std::unique_ptr<MeshSource> Source;
+        std::unique_ptr<Mesh> GpuMesh;
+        /* Size of the buffers of the resident mesh. */
+        std::size_t Bytes;
+        std::uint32_t Generation;
+        /* Last frame an object drawn with the mesh was visible. */
+        std::uint64_t LastVisible;
+        /* Rank of the nearest chunk that needs the mesh, lower first, or kNOT_WANTED. */
+        float Priority;
+    };
+
+    struct Chunk
+    {
+        /* Box around every object in the chunk, which can reach past the chunk's cell. */
+        Bounds Box;
+        std::vector<AssetId> Meshes;
+        std::vector<MaterialId> Materials;
+    };
+
+    /* Get the chunk an object with a world-space box goes in, grown to cover the box. */
+    Chunk& chunkOf(const Bounds& world_bounds);
+    /* Worker task: read the mesh's cache, or import the model file. */
+    void loadMesh(StreamedMesh* mesh);
+    /* Upload a loaded mesh, evicting others if it wouldn't fit the budget. Returns false if there was no room. */
+    bool uploadMesh(StreamedMesh& mesh);
+    /*
+        Evict the meshes that have gone the longest without being visible until bytes more would fit
+        the budget. Only meshes ranked after priority are evicted, so two meshes never take turns.
+    */
+    bool makeRoom(std::size_t bytes, float priority);
+
+private:
+    ThreadPool& Pool;
+    MaterialLibrary& Materials;
+    // each mesh keeps its address, since the workers hold on to it while loading
+    std::vector<std::unique_ptr<StreamedMesh>> Meshes;
+    std::vector<Chunk> Chunks;
+    /* Chunk index of each grid cell that has objects in it. */
+    std::map<std::uint64_t, std::size_t> ChunkCells;
+    std::size_t Budget;
+    double UploadBudget;
+    std::uint64_t Frame;
+    StreamingStats Stats;
+
+    /* Guards Stage of every mesh being loaded and TasksInFlight, which workers update. */
+    std::mutex Mutex;
+    std::condition_variable TasksFinished;
+    unsigned int TasksInFlight;
+};
+
+#endif  // ASSET_STREAMER_HPP
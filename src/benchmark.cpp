@@ -0,0 +1,256 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <glad/glad.h>
+
+constexpr unsigned int FrameTimer::kQUERY_LATENCY;
+
+namespace
+{
+    /* Nearest-rank percentile of sorted samples. */
+    double percentile(const std::vector<double>& sorted, double fraction)
+    {
+        std::size_t rank = static_cast<std::size_t>(std::ceil(fraction * sorted.size()));
+        if (rank > 0)
+            rank--;
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    /* Write a string as a JSON string literal. */
+    void writeJsonString(std::FILE* file, const std::string& text)
+    {
+        std::fputc('"', file);
+        for (std::size_t i = 0; i < text.size(); i++)
+        {
+            char c = text[i];
+            if (c == '"' || c == '\\')
+                std::fputc('\\', file);
+            if (static_cast<unsigned char>(c) >= 0x20)
+                std::fputc(c, file);
+        }
+        std::fputc('"', file);
+    }
+
+    void writeJsonSummary(std::FILE* file, const char* name, const FrameTimeSummary& summary, bool last)
+    {
+        std::fprintf(file, "  \"%s\": { \"count\": %zu, \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, "
+                           "\"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+                     name, summary.Count, summary.Mean, summary.Min, summary.P50, summary.P95, summary.P99,
+                     summary.Max, last ? "" : ",");
+    }
+
+    bool endsWith(const char* text, const char* suffix)
+    {
+        std::size_t length = std::strlen(text);
+        std::size_t suffix_length = std::strlen(suffix);
+        return length >= suffix_length && std::strcmp(text + length - suffix_length, suffix) == 0;
+    }
+}
+
+FrameTimeSummary summariseFrameTimes(std::vector<double> samples)
+{
+    FrameTimeSummary summary = {};
+    summary.Count = samples.size();
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    double total = 0.0;
+    for (std::size_t i = 0; i < samples.size(); i++)
+        total += samples[i];
+    summary.Mean = total / samples.size();
+    summary.Min = samples.front();
+    summary.P50 = percentile(samples, 0.50);
+    summary.P95 = percentile(samples, 0.95);
+    summary.P99 = percentile(samples, 0.99);
+    summary.Max = samples.back();
+    return summary;
+}
+
+FrameTimer::FrameTimer()
+    :   FramesBegun(0),
+        FramesCollected(0)
+{
+    glGenQueries(kQUERY_LATENCY, this->Queries);
+}
+
+FrameTimer::~FrameTimer()
+{
+    glDeleteQueries(kQUERY_LATENCY, this->Queries);
+}
+
+void FrameTimer::beginFrame()
+{
+    // the ring slot is about to be reused, so its old result must be read first
+    if (this->FramesBegun - this->FramesCollected >= kQUERY_LATENCY)
+        collect(this->FramesCollected, true);
+
+    this->FrameStart = std::chrono::steady_clock::now();
+    glBeginQuery(GL_TIME_ELAPSED, this->Queries[this->FramesBegun % kQUERY_LATENCY]);
+    this->FramesBegun++;
+}
+
+void FrameTimer::endFrame()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    std::chrono::duration<double, std::milli> cpu_time = std::chrono::steady_clock::now() - this->FrameStart;
+    this->CpuTimes.push_back(cpu_time.count());
+
+    // pick up any older results that are ready without waiting
+    while (this->FramesCollected < this->FramesBegun && collect(this->FramesCollected, false))
+    {
+    }
+}
+
+void FrameTimer::finish()
+{
+    while (this->FramesCollected < this->FramesBegun)
+        collect(this->FramesCollected, true);
+}
+
+void FrameTimer::reset()
+{
+    finish();
+    this->CpuTimes.clear();
+    this->GpuTimes.clear();
+}
+
+bool FrameTimer::collect(std::size_t frame, bool wait)
+{
+    unsigned int query = this->Queries[frame % kQUERY_LATENCY];
+    if (!wait)
+    {
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+    this->GpuTimes.push_back(static_cast<double>(nanoseconds) / 1.0e6);
+    this->FramesCollected++;
+    return true;
+}
+
+bool writeBenchmarkResults(const char* path, const BenchmarkInfo& info, const FrameTimer& timer)
+{
+    std::FILE* file = std::fopen(path, "w");
+    if (!file)
+        return false;
+
+    FrameTimeSummary cpu = summariseFrameTimes(timer.cpuTimes());
+    FrameTimeSummary gpu = summariseFrameTimes(timer.gpuTimes());
+    FrameTimeSummary visible = summariseFrameTimes(info.VisibleObjects);
+    FrameTimeSummary occluded = summariseFrameTimes(info.OccludedObjects);
+    FrameTimeSummary triangles = summariseFrameTimes(info.Triangles);
+    FrameTimeSummary issued = summariseFrameTimes(info.StateChanges);
+    FrameTimeSummary skipped = summariseFrameTimes(info.SkippedStateChanges);
+    FrameTimeSummary stall = summariseFrameTimes(info.StreamStallTimes);
+    FrameTimeSummary scale = summariseFrameTimes(info.ResolutionScales);
+    FrameTimeSummary allocations = summariseFrameTimes(info.HeapAllocations);
+    FrameTimeSummary stalled = summariseFrameTimes(info.StalledObjects);
+    FrameTimeSummary uploads = summariseFrameTimes(info.AssetUploadTimes);
+    if (endsWith(path, ".csv"))
+    {
+        std::fprintf(file, "metric,count,mean,min,p50,p95,p99,max\n");
+        std::fprintf(file, "cpu_ms,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", cpu.Count, cpu.Mean, cpu.Min, cpu.P50, cpu.P95, cpu.P99, cpu.Max);
+        std::fprintf(file, "gpu_ms,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", gpu.Count, gpu.Mean, gpu.Min, gpu.P50, gpu.P95, gpu.P99, gpu.Max);
+        std::fprintf(file, "visible_objects,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", visible.Count, visible.Mean, visible.Min,
+                     visible.P50, visible.P95, visible.P99, visible.Max);
+        std::fprintf(file, "occluded_objects,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", occluded.Count, occluded.Mean, occluded.Min,
+                     occluded.P50, occluded.P95, occluded.P99, occluded.Max);
+        std::fprintf(file, "triangles,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", triangles.Count, triangles.Mean, triangles.Min,
+                     triangles.P50, triangles.P95, triangles.P99, triangles.Max);
+        std::fprintf(file, "state_changes,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", issued.Count, issued.Mean, issued.Min,
+                     issued.P50, issued.P95, issued.P99, issued.Max);
+        std::fprintf(file, "skipped_state_changes,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", skipped.Count, skipped.Mean, skipped.Min,
+                     skipped.P50, skipped.P95, skipped.P99, skipped.Max);
+        std::fprintf(file, "stream_stall_ms,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", stall.Count, stall.Mean, stall.Min,
+                     stall.P50, stall.P95, stall.P99, stall.Max);
+        std::fprintf(file, "resolution_scale,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", scale.Count, scale.Mean, scale.Min,
+                     scale.P50, scale.P95, scale.P99, scale.Max);
+        std::fprintf(file, "stalled_objects,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", stalled.Count, stalled.Mean, stalled.Min,
+                     stalled.P50, stalled.P95, stalled.P99, stalled.Max);
+        std::fprintf(file, "asset_upload_ms,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", uploads.Count, uploads.Mean, uploads.Min,
+                     uploads.P50, uploads.P95, uploads.P99, uploads.Max);
+        std::fprintf(file, "heap_allocations,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", allocations.Count, allocations.Mean,
+                     allocations.Min, allocations.P50, allocations.P95, allocations.P99, allocations.Max);
+    }
+    else
+    {
+        std::fprintf(file, "{\n  \"renderer\": ");
+        writeJsonString(file, info.Renderer);
+        std::fprintf(file, ",\n  \"shading\": ");
+        writeJsonString(file, info.Shading);
+        std::fprintf(file, ",\n  \"depth_prepass\": %s,\n  \"occlusion_culling\": %s",
+                     info.DepthPrepass ? "true" : "false", info.OcclusionCulling ? "true" : "false");
+        std::fprintf(file, ",\n  \"target_frame_ms\": %.4f", info.TargetFrameTime);
+        std::fprintf(file, ",\n  \"vertex_format\": ");
+        writeJsonString(file, info.Vertices);
+        std::fprintf(file, ",\n  \"vertex_stride\": %zu,\n  \"vertex_buffer_bytes\": %zu", info.VertexStride, info.VertexBufferSize);
+        std::fprintf(file, ",\n  \"texture_array_bytes\": %zu,\n  \"texture_evictions\": %zu", info.TextureMemory, info.TextureEvictions);
+        std::fprintf(file, ",\n  \"resident_meshes\": %zu,\n  \"resident_mesh_bytes\": %zu,\n  \"mesh_evictions\": %zu",
+                     info.ResidentMeshes, info.ResidentMeshBytes, info.MeshEvictions);
+        std::fprintf(file, ",\n  \"camera_path\": ");
+        writeJsonString(file, info.CameraPath);
+        std::fprintf(file, ",\n  \"width\": %d,\n  \"height\": %d,\n  \"warmup_frames\": %u,\n  \"scene_objects\": %u,\n",
+                     info.Width, info.Height, info.WarmupFrames, info.SceneObjects);
+        writeJsonSummary(file, "cpu_ms", cpu, false);
+        writeJsonSummary(file, "gpu_ms", gpu, false);
+        writeJsonSummary(file, "visible_objects", visible, false);
+        writeJsonSummary(file, "occluded_objects", occluded, false);
+        writeJsonSummary(file, "triangles", triangles, false);
+        writeJsonSummary(file, "state_changes", issued, false);
+        writeJsonSummary(file, "skipped_state_changes", skipped, false);
+        writeJsonSummary(file, "stream_stall_ms", stall, false);
+        writeJsonSummary(file, "resolution_scale", scale, false);
+        writeJsonSummary(file, "stalled_objects", stalled, false);
+        writeJsonSummary(file, "asset_upload_ms", uploads, false);
+        writeJsonSummary(file, "heap_allocations", allocations, true);
+        std::fprintf(file, "}\n");
+    }
+    return std::fclose(file) == 0;
+}
+
+void printBenchmarkResults(const BenchmarkInfo& info, const FrameTimer& timer)
+{
+    FrameTimeSummary cpu = summariseFrameTimes(timer.cpuTimes());
+    FrameTimeSummary gpu = summariseFrameTimes(timer.gpuTimes());
+    std::printf("%s, %s shading, %dx%d, %zu frames\n", info.Renderer.c_str(), info.Shading.c_str(), info.Width, info.Height, cpu.Count);
+    std::printf("%s vertices, %zu bytes each, %zu bytes of vertex buffers\n", info.Vertices.c_str(), info.VertexStride,
+                info.VertexBufferSize);
+    std::printf("          mean      p50      p95      p99      max\n");
+    std::printf("cpu ms %8.3f %8.3f %8.3f %8.3f %8.3f\n", cpu.Mean, cpu.P50, cpu.P95, cpu.P99, cpu.Max);
+    std::printf("gpu ms %8.3f %8.3f %8.3f %8.3f %8.3f\n", gpu.Mean, gpu.P50, gpu.P95, gpu.P99, gpu.Max);
+    FrameTimeSummary visible = summariseFrameTimes(info.VisibleObjects);
+    std::printf("visible objects: mean %.1f, min %.0f, max %.0f of %u\n", visible.Mean, visible.Min, visible.Max, info.SceneObjects);
+    if (info.OcclusionCulling)
+    {
+        FrameTimeSummary occluded = summariseFrameTimes(info.OccludedObjects);
+        std::printf("occluded objects: mean %.1f, max %.0f\n", occluded.Mean, occluded.Max);
+    }
+    FrameTimeSummary triangles = summariseFrameTimes(info.Triangles);
+    std::printf("triangles: mean %.0f, max %.0f\n", triangles.Mean, triangles.Max);
+    FrameTimeSummary issued = summariseFrameTimes(info.StateChanges);
+    FrameTimeSummary skipped = summariseFrameTimes(info.SkippedStateChanges);
+    std::printf("state changes: mean %.1f issued, %.1f skipped\n", issued.Mean, skipped.Mean);
+    FrameTimeSummary stall = summariseFrameTimes(info.StreamStallTimes);
+    std::printf("stream buffer stalls: mean %.3f ms, max %.3f ms\n", stall.Mean, stall.Max);
+    if (info.TargetFrameTime > 0.0)
+    {
+        FrameTimeSummary scale = summariseFrameTimes(info.ResolutionScales);
+        std::printf("resolution scale for %.2f ms frames: mean %.2f, min %.2f\n", info.TargetFrameTime, scale.Mean, scale.Min);
+    }
+    FrameTimeSummary allocations = summariseFrameTimes(info.HeapAllocations);
+    std::printf("%zu bytes of material texture arrays, %zu layers evicted\n", info.TextureMemory, info.TextureEvictions);
+    FrameTimeSummary stalled = summariseFrameTimes(info.StalledObjects);
+    FrameTimeSummary uploads = summariseFrameTimes(info.AssetUploadTimes);
+    std::printf("%zu meshes streamed in, %zu bytes, %zu evicted; stalled objects: mean %.1f, max %.0f; uploads: max %.3f ms\n",
+                info.ResidentMeshes, info.ResidentMeshBytes, info.MeshEvictions, stalled.Mean, stalled.Max, uploads.Max);
+    std::printf("heap allocations per frame: mean %.2f, max %.0f\n", allocations.Mean, allocations.Max);
+    std::printf("%s", info.MemorySummary.c_str());
+}
@@ -0,0 +1,127 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* Summary statistics of a set of frame time samples, in milliseconds. */
+struct FrameTimeSummary
+{
+    std::size_t Count;
+    double Mean;
+    double Min;
+    double P50;
+    double P95;
+    double P99;
+    double Max;
+};
+
+/* Summarise samples using nearest-rank percentiles. */
+FrameTimeSummary summariseFrameTimes(std::vector<double> samples);
+
+/*
+    Measures the CPU and GPU time of each frame.
+    GPU time comes from GL_TIME_ELAPSED queries kept in a small ring, so results are collected a few
+    frames late instead of stalling the pipeline waiting for them.
+*/
+class FrameTimer
+{
+public:
+    /* Number of frames a GPU query may be in flight before its result is needed. */
+    static constexpr unsigned int kQUERY_LATENCY = 4;
+
+    /* Construct a FrameTimer object. The GL context must be current. */
+    FrameTimer();
+    ~FrameTimer();
+    FrameTimer(const FrameTimer&) = delete;
+    FrameTimer& operator=(const FrameTimer&) = delete;
+
+    /* Start timing a frame. */
+    void beginFrame();
+    /* Stop timing the current frame. */
+    void endFrame();
+    /* Wait for the results of any frames still in flight. */
+    void finish();
+    /* Forget every sample taken so far, such as those from warm-up frames. Call between frames. */
+    void reset();
+
+    /* Get the CPU time of each frame in milliseconds. */
+    const std::vector<double>& cpuTimes() const { return this->CpuTimes; }
+    /* Get the GPU time of each frame in milliseconds, in frame order. */
+    const std::vector<double>& gpuTimes() const { return this->GpuTimes; }
+
+private:
+    /* Read back the result of the query for a frame, waiting for it if wait is true. */
+    bool collect(std::size_t frame, bool wait);
+
+private:
+    unsigned int Queries[kQUERY_LATENCY];
+    std::chrono::steady_clock::time_point FrameStart;
+    /* Number of frames begun, and number whose GPU time has been collected. */
+    std::size_t FramesBegun;
+    std::size_t FramesCollected;
+    std::vector<double> CpuTimes;
+    std::vector<double> GpuTimes;
+};
+
+/* Description of a benchmark run, written alongside its results. */
+struct BenchmarkInfo
+{
+    std::string Renderer;
+    /* Shading path used, "forward" or "deferred". */
+    std::string Shading;
+    bool DepthPrepass;
+    bool OcclusionCulling;
+    /* GPU frame time in milliseconds that dynamic resolution aimed for, or 0 if it was off. */
+    double TargetFrameTime;
+    /* Vertex format of the meshes, its size in bytes and the total size of the vertex buffers. */
+    std::string Vertices;
+    std::size_t VertexStride;
+    std::size_t VertexBufferSize;
+    std::string CameraPath;
+    int Width;
+    int Height;
+    unsigned int WarmupFrames;
+    /* Number of objects in the scene, and how many of them survived culling in each measured frame. */
+    unsigned int SceneObjects;
+    std::vector<double> VisibleObjects;
+    /* Objects inside the view frustum that occlusion culling skipped in each measured frame. */
+    std::vector<double> OccludedObjects;
+    /* Triangles drawn in each measured frame, which falls as objects move to coarser levels of detail. */
+    std::vector<double> Triangles;
+    /* GL state changes issued and skipped as redundant in each measured frame. */
+    std::vector<double> StateChanges;
+    std::vector<double> SkippedStateChanges;
+    /* Time in milliseconds each measured frame waited for the GPU to release per-frame buffer space. */
+    std::vector<double> StreamStallTimes;
+    /* Scale of each side of the output that each measured frame was rendered at. */
+    std::vector<double> ResolutionScales;
+    /* Heap allocations made in each measured iteration of the frame loop, which should be 0 once it has warmed up. */
+    std::vector<double> HeapAllocations;
+    /* Bytes of material texture arrays allocated by the end of the run, and the layers evicted to stay within the budget. */
+    std::size_t TextureMemory;
+    std::size_t TextureEvictions;
+    /* Objects inside the view frustum skipped in each measured frame because their mesh wasn't resident yet. */
+    std::vector<double> StalledObjects;
+    /* Time in milliseconds each measured frame spent uploading streamed meshes. */
+    std::vector<double> AssetUploadTimes;
+    /* Streamed meshes and bytes of their buffers on the GPU at the end of the run, and the meshes evicted to stay within the budget. */
+    std::size_t ResidentMeshes;
+    std::size_t ResidentMeshBytes;
+    std::size_t MeshEvictions;
+    /* High-water marks of the frame arenas and object pools, one per line. */
+    std::string MemorySummary;
+};
+
+/*
+    Write benchmark results to a file. A ".csv" path gets one row per metric; anything else gets
+    a JSON object. Both hold the count, mean, min, p50, p95, p99 and max of each metric, including the
+    number of visible and occluded objects, triangles, state changes, stream buffer stalls, resolution scale and heap allocations.
+*/
+bool writeBenchmarkResults(const char* path, const BenchmarkInfo& info, const FrameTimer& timer);
+/* Print a short summary of benchmark results to standard output. */
+void printBenchmarkResults(const BenchmarkInfo& info, const FrameTimer& timer);
+
+#endif  // BENCHMARK_HPP
@@ -0,0 +1,302 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BVH_USE_SSE 1
+#include <xmmintrin.h>
+#else
+#define BVH_USE_SSE 0
+#endif
+
+constexpr unsigned int BoundingVolumeHierarchy::kNODE_WIDTH;
+constexpr std::uint32_t BoundingVolumeHierarchy::kNO_CHILD;
+
+namespace
+{
+    // a balanced tree of four-wide nodes over 2^32 objects is 16 levels deep, with up to 3 siblings waiting per level
+    const unsigned int kSTACK_SIZE = 64;
+    const unsigned int kALL_PLANES = (1u << Frustum::kPLANE_COUNT) - 1;
+
+    /* A frustum laid out for testing boxes: each plane normal picks the box corners to test. */
+    struct CullPlanes
+    {
+        float Normal[Frustum::kPLANE_COUNT][3];
+        float Distance[Frustum::kPLANE_COUNT];
+        // per axis, whether the normal is positive, so the far corner uses the box max
+        bool Positive[Frustum::kPLANE_COUNT][3];
+    };
+
+    struct StackEntry
+    {
+        std::uint32_t Node;
+        unsigned int Planes;
+    };
+
+    CullPlanes makeCullPlanes(const Frustum& frustum)
+    {
+        CullPlanes planes;
+        for (unsigned int i = 0; i < Frustum::kPLANE_COUNT; i++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                planes.Normal[i][axis] = frustum.Planes[i][axis];
+                planes.Positive[i][axis] = frustum.Planes[i][axis] > 0.0f;
+            }
+            planes.Distance[i] = frustum.Planes[i].w;
+        }
+        return planes;
+    }
+
+    /* Split Order[first, first + count) in half along the longest axis of its centres. Returns the split point. */
+    std::uint32_t splitRange(std::vector<std::uint32_t>& order, const std::vector<glm::vec3>& centres,
+                             std::uint32_t first, std::uint32_t count)
+    {
+        glm::vec3 low = centres[order[first]];
+        glm::vec3 high = low;
+        for (std::uint32_t i = first + 1; i < first + count; i++)
+        {
+            low = glm::min(low, centres[order[i]]);
+            high = glm::max(high, centres[order[i]]);
+        }
+        glm::vec3 extent = high - low;
+        int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+
+        // a median split keeps the tree balanced, which keeps the traversal stack small
+        std::uint32_t middle = first + count / 2;
+        std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + first + count,
+            [&centres, axis](std::uint32_t a, std::uint32_t b) { return centres[a][axis] < centres[b][axis]; });
+        return middle;
+    }
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{
+}
+
+void BoundingVolumeHierarchy::build(const Bounds* boxes, std::size_t count)
+{
+    this->Nodes.clear();
+    this->Order.resize(count);
+    if (count == 0)
+        return;
+
+    std::vector<glm::vec3> centres(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        this->Order[i] = static_cast<std::uint32_t>(i);
+        centres[i] = 0.5f * (boxes[i].Min + boxes[i].Max);
+    }
+    // roughly one node for every three objects
+    this->Nodes.reserve(count / (kNODE_WIDTH - 1) + 1);
+    this->Nodes.push_back(Node());
+    buildNode(0, boxes, centres, 0, static_cast<std::uint32_t>(count));
+}
+
+void BoundingVolumeHierarchy::refit(const Bounds* boxes)
+{
+    for (std::size_t node = this->Nodes.size(); node-- > 0;)
+    {
+        for (unsigned int slot = 0; slot < kNODE_WIDTH; slot++)
+        {
+            const Node& current = this->Nodes[node];
+            if (current.Count[slot] == 0)
+                continue;
+            if (current.Child[slot] == kNO_CHILD)
+                setChildBounds(static_cast<std::uint32_t>(node), slot, boxes[this->Order[current.First[slot]]]);
+            else
+                setChildBounds(static_cast<std::uint32_t>(node), slot, nodeBounds(current.Child[slot]));
+        }
+    }
+}
+
+CullStats BoundingVolumeHierarchy::cull(const Frustum& frustum, std::vector<std::uint32_t>& visible) const
+{
+    CullStats stats;
+    stats.Objects = static_cast<std::uint32_t>(this->Order.size());
+    stats.Visible = 0;
+    stats.NodesVisited = 0;
+    if (this->Nodes.empty())
+        return stats;
+
+    const CullPlanes planes = makeCullPlanes(frustum);
+    std::size_t visible_start = visible.size();
+    StackEntry stack[kSTACK_SIZE];
+    unsigned int stack_size = 0;
+    stack[stack_size++] = StackEntry{0, kALL_PLANES};
+
+    while (stack_size > 0)
+    {
+        StackEntry entry = stack[--stack_size];
+        const Node& node = this->Nodes[entry.Node];
+        stats.NodesVisited++;
+
+        // Test the four children against each plane still in play. Outside any plane means culled;
+        // inside a plane means that plane doesn't need testing again for the child's subtree.
+        unsigned int outside = 0;
+        unsigned int inside[Frustum::kPLANE_COUNT] = {};
+        for (unsigned int plane = 0; plane < Frustum::kPLANE_COUNT; plane++)
+        {
+            if (!(entry.Planes & (1u << plane)))
+                continue;
+            const float* far_x = planes.Positive[plane][0] ? node.MaxX : node.MinX;
+            const float* far_y = planes.Positive[plane][1] ? node.MaxY : node.MinY;
+            const float* far_z = planes.Positive[plane][2] ? node.MaxZ : node.MinZ;
+            const float* near_x = planes.Positive[plane][0] ? node.MinX : node.MaxX;
+            const float* near_y = planes.Positive[plane][1] ? node.MinY : node.MaxY;
+            const float* near_z = planes.Positive[plane][2] ? node.MinZ : node.MaxZ;
+#if BVH_USE_SSE
+            __m128 normal_x = _mm_set1_ps(planes.Normal[plane][0]);
+            __m128 normal_y = _mm_set1_ps(planes.Normal[plane][1]);
+            __m128 normal_z = _mm_set1_ps(planes.Normal[plane][2]);
+            __m128 distance = _mm_set1_ps(planes.Distance[plane]);
+            __m128 far_distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(normal_x, _mm_loadu_ps(far_x)), _mm_mul_ps(normal_y, _mm_loadu_ps(far_y))),
+                _mm_add_ps(_mm_mul_ps(normal_z, _mm_loadu_ps(far_z)), distance));
+            __m128 near_distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(normal_x, _mm_loadu_ps(near_x)), _mm_mul_ps(normal_y, _mm_loadu_ps(near_y))),
+                _mm_add_ps(_mm_mul_ps(normal_z, _mm_loadu_ps(near_z)), distance));
+            outside |= static_cast<unsigned int>(_mm_movemask_ps(_mm_cmplt_ps(far_distance, _mm_setzero_ps())));
+            inside[plane] = static_cast<unsigned int>(_mm_movemask_ps(_mm_cmpge_ps(near_distance, _mm_setzero_ps())));
+#else
+            for (unsigned int slot = 0; slot < kNODE_WIDTH; slot++)
+            {
+                float far_distance = planes.Normal[plane][0] * far_x[slot] + planes.Normal[plane][1] * far_y[slot]
+                                   + planes.Normal[plane][2] * far_z[slot] + planes.Distance[plane];
+                float near_distance = planes.Normal[plane][0] * near_x[slot] + planes.Normal[plane][1] * near_y[slot]
+                                    + planes.Normal[plane][2] * near_z[slot] + planes.Distance[plane];
+                outside |= (far_distance < 0.0f ? 1u : 0u) << slot;
+                inside[plane] |= (near_distance >= 0.0f ? 1u : 0u) << slot;
+            }
+#endif
+        }
+
+        for (unsigned int slot = 0; slot < kNODE_WIDTH; slot++)
+        {
+            if (node.Count[slot] == 0 || (outside & (1u << slot)))
+                continue;
+            unsigned int child_planes = entry.Planes;
+            for (unsigned int plane = 0; plane < Frustum::kPLANE_COUNT; plane++)
+            {
+                if (inside[plane] & (1u << slot))
+                    child_planes &= ~(1u << plane);
+            }
+
+            if (child_planes == 0 || node.Child[slot] == kNO_CHILD)
+            {
+                // fully inside, or a single object that wasn't culled
+                const std::uint32_t* first = this->Order.data() + node.First[slot];
+                visible.insert(visible.end(), first, first + node.Count[slot]);
+            }
+            else
+            {
+                stack[stack_size++] = StackEntry{node.Child[slot], child_planes};
+            }
+        }
+    }
+    stats.Visible = static_cast<std::uint32_t>(visible.size() - visible_start);
+    return stats;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void BoundingVolumeHierarchy::buildNode(std::uint32_t index, const Bounds* boxes, const std::vector<glm::vec3>& centres,
+                                        std::uint32_t first, std::uint32_t count)
+{
+    Node empty;
+    for (unsigned int slot = 0; slot < kNODE_WIDTH; slot++)
+    {
+        // unused children have an inverted box, so they fail every plane test
+        empty.MinX[slot] = empty.MinY[slot] = empty.MinZ[slot] = FLT_MAX;
+        empty.MaxX[slot] = empty.MaxY[slot] = empty.MaxZ[slot] = -FLT_MAX;
+        empty.Child[slot] = kNO_CHILD;
+        empty.First[slot] = 0;
+        empty.Count[slot] = 0;
+    }
+    this->Nodes[index] = empty;
+
+    // Split the range into up to four parts: one object each when they fit, otherwise two halving steps.
+    std::uint32_t range_first[kNODE_WIDTH];
+    std::uint32_t range_count[kNODE_WIDTH];
+    unsigned int ranges = 0;
+    if (count <= kNODE_WIDTH)
+    {
+        for (std::uint32_t i = 0; i < count; i++)
+        {
+            range_first[ranges] = first + i;
+            range_count[ranges++] = 1;
+        }
+    }
+    else
+    {
+        std::uint32_t middle = splitRange(this->Order, centres, first, count);
+        std::uint32_t halves_first[2] = {first, middle};
+        std::uint32_t halves_count[2] = {middle - first, first + count - middle};
+        for (int half = 0; half < 2; half++)
+        {
+            if (halves_count[half] < 2)
+            {
+                range_first[ranges] = halves_first[half];
+                range_count[ranges++] = halves_count[half];
+                continue;
+            }
+            std::uint32_t quarter = splitRange(this->Order, centres, halves_first[half], halves_count[half]);
+            range_first[ranges] = halves_first[half];
+            range_count[ranges++] = quarter - halves_first[half];
+            range_first[ranges] = quarter;
+            range_count[ranges++] = halves_first[half] + halves_count[half] - quarter;
+        }
+    }
+
+    // siblings are allocated next to each other, so the traversal reads them from neighbouring cache lines
+    for (unsigned int slot = 0; slot < ranges; slot++)
+    {
+        this->Nodes[index].First[slot] = range_first[slot];
+        this->Nodes[index].Count[slot] = range_count[slot];
+        if (range_count[slot] > 1)
+        {
+            this->Nodes[index].Child[slot] = static_cast<std::uint32_t>(this->Nodes.size());
+            this->Nodes.push_back(Node());
+        }
+    }
+    for (unsigned int slot = 0; slot < ranges; slot++)
+    {
+        // Nodes may reallocate while building children, so only hold on to indices
+        std::uint32_t child = this->Nodes[index].Child[slot];
+        if (child == kNO_CHILD)
+        {
+            setChildBounds(index, slot, boxes[this->Order[range_first[slot]]]);
+            continue;
+        }
+        buildNode(child, boxes, centres, range_first[slot], range_count[slot]);
+        setChildBounds(index, slot, nodeBounds(child));
+    }
+}
+
+Bounds BoundingVolumeHierarchy::nodeBounds(std::uint32_t node) const
+{
+    const Node& current = this->Nodes[node];
+    Bounds box;
+    box.Min = glm::vec3(FLT_MAX);
+    box.Max = glm::vec3(-FLT_MAX);
+    for (unsigned int slot = 0; slot < kNODE_WIDTH; slot++)
+    {
+        if (current.Count[slot] == 0)
+            continue;
+        box.Min = glm::min(box.Min, glm::vec3(current.MinX[slot], current.MinY[slot], current.MinZ[slot]));
+        box.Max = glm::max(box.Max, glm::vec3(current.MaxX[slot], current.MaxY[slot], current.MaxZ[slot]));
+    }
+    return box;
+}
+
+void BoundingVolumeHierarchy::setChildBounds(std::uint32_t node, unsigned int slot, const Bounds& box)
+{
+    Node& current = this->Nodes[node];
+    current.MinX[slot] = box.Min.x;
+    current.MinY[slot] = box.Min.y;
+    current.MinZ[slot] = box.Min.z;
+    current.MaxX[slot] = box.Max.x;
+    current.MaxY[slot] = box.Max.y;
+    current.MaxZ[slot] = box.Max.z;
+}
@@ -0,0 +1,87 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frustum.hpp"
+#include "mesh.hpp"
+
+/* Counts from a culling query, for reporting how much of the scene was drawn. */
+struct CullStats
+{
+    std::uint32_t Objects;
+    std::uint32_t Visible;
+    std::uint32_t NodesVisited;
+};
+
+/*
+    A bounding volume hierarchy over a set of object boxes, used to find the objects inside a view frustum.
+    Every node has four children whose boxes are stored as structure-of-arrays, so a single SIMD test
+    checks all four against a plane. Once a child is fully inside a plane that plane is skipped for
+    everything below it, and a child fully inside the frustum emits all of its objects without testing them.
+*/
+class BoundingVolumeHierarchy
+{
+public:
+    static constexpr unsigned int kNODE_WIDTH = 4;
+
+    /* Construct an empty BoundingVolumeHierarchy object. */
+    BoundingVolumeHierarchy();
+
+    /*
+        Build the hierarchy over a set of object boxes, replacing any previous contents.
+        Objects are referred to by their index in the array.
+    */
+    void build(const Bounds* boxes, std::size_t count);
+    /*
+        Recompute the node boxes after objects have moved, keeping the tree structure.
+        The boxes must be the same objects in the same order as the last build. Much cheaper than a
+        rebuild, but culling gets slower if objects move far from where they were built.
+    */
+    void refit(const Bounds* boxes);
+    /* Append the index of every object at least partly inside the frustum to visible. */
+    CullStats cull(const Frustum& frustum, std::vector<std::uint32_t>& visible) const;
+
+    /* Get the number of objects in the hierarchy. */
+    std::size_t objectCount() const { return this->Order.size(); }
+    /* Get the number of nodes in the hierarchy. */
+    std::size_t nodeCount() const { return this->Nodes.size(); }
+
+private:
+    /*
+        Four child boxes and what they hold. A child with Count 0 is unused. Otherwise it covers
+        Order[First, First + Count), and is either another node or, when Child is kNO_CHILD, a single object.
+    */
+    struct Node
+    {
+        float MinX[kNODE_WIDTH];
+        float MinY[kNODE_WIDTH];
+        float MinZ[kNODE_WIDTH];
+        float MaxX[kNODE_WIDTH];
+        float MaxY[kNODE_WIDTH];
+        float MaxZ[kNODE_WIDTH];
+        std::uint32_t Child[kNODE_WIDTH];
+        std::uint32_t First[kNODE_WIDTH];
+        std::uint32_t Count[kNODE_WIDTH];
+    };
+
+    static constexpr std::uint32_t kNO_CHILD = 0xFFFFFFFF;
+
+    /* Fill an allocated node with the objects in Order[first, first + count), building its children. */
+    void buildNode(std::uint32_t index, const Bounds* boxes, const std::vector<glm::vec3>& centres,
+                   std::uint32_t first, std::uint32_t count);
+    /* Get the box that covers every used child of a node. */
+    Bounds nodeBounds(std::uint32_t node) const;
+    /* Store the box of one child of a node. */
+    void setChildBounds(std::uint32_t node, unsigned int slot, const Bounds& box);
+
+private:
+    // parents always come before their children, so a reverse walk visits children first
+    std::vector<Node> Nodes;
+    /* Object indices, ordered so every node covers a contiguous range. */
+    std::vector<std::uint32_t> Order;
+};
+
+#endif  // BVH_HPP
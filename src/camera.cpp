@@ -3,6 +3,15 @@
 #include <glad/glad.h>
 #include <glm/gtc/matrix_transform.hpp>
 
+constexpr float Camera::kYAW;
+constexpr float Camera::kPITCH;
+constexpr float Camera::kSPEED;
+constexpr float Camera::kSENSITIVITY;
+constexpr float Camera::kFOV;
+constexpr float Camera::kMAXFOV;
+constexpr glm::vec3 Camera::kPOSITION;
+constexpr glm::vec3 Camera::kWORLDUP;
+
 Camera::Camera( glm::vec3 position, glm::vec3 world_up, float yaw, float pitch)
     :   MovementSpeed(kSPEED),
         LookSensitivity(kSENSITIVITY),
@@ -54,6 +63,14 @@ void Camera::UpdateFoV(float value)
     if (this->FoV > kMAXFOV) this->FoV = kMAXFOV;
 }
 
+void Camera::SetPose(glm::vec3 position, float yaw, float pitch)
+{
+    this->Position  = position;
+    this->Yaw       = yaw;
+    this->Pitch     = pitch;
+    updateCameraVectors();
+}
+
 // -------------------------------- Private Methods -----------------------------------
 void Camera::updateCameraVectors()
 {
@@ -31,6 +31,15 @@ public:
     /* Update FoV */
     void UpdateFoV(float value);
 
+    /* Place the camera at a position looking in the direction given by yaw and pitch, in degrees. */
+    void SetPose(glm::vec3 position, float yaw, float pitch);
+
+    /* Get the yaw of the camera in degrees. */
+    float GetYaw() const { return this->Yaw; }
+
+    /* Get the pitch of the camera in degrees. */
+    float GetPitch() const { return this->Pitch; }
+
 private:
     /* Recalculate the camera vectors based on changes to yaw and pitch. */
     void updateCameraVectors();
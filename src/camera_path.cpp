@@ -0,0 +1,132 @@
+#include "camera_path.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <glm/gtc/constants.hpp>
+
+#include "camera.hpp"
+
+namespace
+{
+    /* Interpolate between two angles in degrees along the shortest way round. */
+    float mixAngle(float a, float b, float t)
+    {
+        float difference = std::fmod(b - a, 360.0f);
+        if (difference > 180.0f)    difference -= 360.0f;
+        if (difference < -180.0f)   difference += 360.0f;
+        return a + difference * t;
+    }
+
+    bool keyTimeLess(const CameraKey& key, float time)
+    {
+        return key.Time < time;
+    }
+}
+
+CameraPath CameraPath::makeOrbit(glm::vec3 centre, float radius, float height, float duration, unsigned int key_count)
+{
+    CameraPath path;
+    if (key_count < 2)
+        key_count = 2;
+    for (unsigned int i = 0; i < key_count; i++)
+    {
+        float t = static_cast<float>(i) / (key_count - 1);
+        float angle = t * 2.0f * glm::pi<float>();
+
+        CameraKey key;
+        key.Time = t * duration;
+        key.Position = centre + glm::vec3(std::cos(angle) * radius, std::sin(angle * 2.0f) * height, std::sin(angle) * radius);
+        // face the centre; this is the inverse of the camera's yaw/pitch to front vector conversion
+        glm::vec3 direction = glm::normalize(centre - key.Position);
+        key.Yaw = glm::degrees(std::atan2(direction.z, direction.x));
+        key.Pitch = glm::degrees(std::asin(direction.y));
+        path.addKey(key);
+    }
+    return path;
+}
+
+bool CameraPath::load(const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    this->Keys.clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream stream(line);
+        CameraKey key;
+        if (stream >> key.Time >> key.Position.x >> key.Position.y >> key.Position.z >> key.Yaw >> key.Pitch)
+            addKey(key);
+    }
+    return !this->Keys.empty();
+}
+
+bool CameraPath::save(const char* path) const
+{
+    std::FILE* file = std::fopen(path, "w");
+    if (!file)
+        return false;
+    std::fprintf(file, "# time x y z yaw pitch\n");
+    for (std::size_t i = 0; i < this->Keys.size(); i++)
+    {
+        const CameraKey& key = this->Keys[i];
+        std::fprintf(file, "%.4f %.4f %.4f %.4f %.4f %.4f\n", key.Time,
+                     key.Position.x, key.Position.y, key.Position.z, key.Yaw, key.Pitch);
+    }
+    return std::fclose(file) == 0;
+}
+
+void CameraPath::addKey(const CameraKey& key)
+{
+    this->Keys.push_back(key);
+}
+
+void CameraPath::addKey(float time, const Camera& camera)
+{
+    CameraKey key;
+    key.Time = time;
+    key.Position = camera.Position;
+    key.Yaw = camera.GetYaw();
+    key.Pitch = camera.GetPitch();
+    addKey(key);
+}
+
+CameraKey CameraPath::sample(float time) const
+{
+    if (this->Keys.empty())
+    {
+        CameraKey key = { time, glm::vec3(0.0f), -90.0f, 0.0f };
+        return key;
+    }
+    if (time <= this->Keys.front().Time)
+        return this->Keys.front();
+    if (time >= this->Keys.back().Time)
+        return this->Keys.back();
+
+    std::vector<CameraKey>::const_iterator next = std::lower_bound(this->Keys.begin(), this->Keys.end(), time, keyTimeLess);
+    const CameraKey& b = *next;
+    const CameraKey& a = *(next - 1);
+    float span = b.Time - a.Time;
+    float t = span > 0.0f ? (time - a.Time) / span : 1.0f;
+
+    CameraKey key;
+    key.Time = time;
+    key.Position = glm::mix(a.Position, b.Position, t);
+    key.Yaw = mixAngle(a.Yaw, b.Yaw, t);
+    key.Pitch = a.Pitch + (b.Pitch - a.Pitch) * t;
+    return key;
+}
+
+void CameraPath::apply(float time, Camera& camera) const
+{
+    CameraKey key = sample(time);
+    camera.SetPose(key.Position, key.Yaw, key.Pitch);
+}
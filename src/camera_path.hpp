@@ -0,0 +1,51 @@
+#ifndef CAMERA_PATH_HPP
+#define CAMERA_PATH_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+class Camera;
+
+/* A camera pose at a point in time along a path. Angles are in degrees. */
+struct CameraKey
+{
+    float Time;
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+};
+
+/*
+    A camera path made of timed keys, used to drive the camera the same way on every run.
+    Paths are either recorded from the interactive camera or scripted, and are stored as text with
+    one "time x y z yaw pitch" key per line.
+*/
+class CameraPath
+{
+public:
+    /* Build a path that circles a point while looking at it, bobbing up and down. */
+    static CameraPath makeOrbit(glm::vec3 centre, float radius, float height, float duration, unsigned int key_count);
+
+    /* Read a path from a file, replacing any existing keys. Returns false if it can't be read or has no keys. */
+    bool load(const char* path);
+    /* Write the path to a file. */
+    bool save(const char* path) const;
+    /* Add a key. Keys must be added in time order. */
+    void addKey(const CameraKey& key);
+    /* Record the current pose of a camera at a point in time. */
+    void addKey(float time, const Camera& camera);
+    /* Get the pose at a point in time, interpolating between keys and clamping to the ends. */
+    CameraKey sample(float time) const;
+    /* Place a camera at the pose for a point in time. */
+    void apply(float time, Camera& camera) const;
+
+    /* Get the time of the last key. */
+    float duration() const { return this->Keys.empty() ? 0.0f : this->Keys.back().Time; }
+    /* Check if the path has no keys. */
+    bool empty() const { return this->Keys.empty(); }
+
+private:
+    std::vector<CameraKey> Keys;
+};
+
+#endif  // CAMERA_PATH_HPP
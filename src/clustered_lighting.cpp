@@ -0,0 +1,501 @@
+#include "clustered_lighting.hpp"
+#include "gl_state.hpp"
+#include "profiler.hpp"
+#include "shader_program.hpp"
+#include "stream_buffer.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glad/glad.h>
+
+constexpr unsigned int ClusteredLighting::kTILE_SIZE;
+constexpr unsigned int ClusteredLighting::kDEPTH_SLICES;
+constexpr unsigned int ClusteredLighting::kLIGHT_DATA_UNIT;
+constexpr unsigned int ClusteredLighting::kCLUSTER_GRID_UNIT;
+constexpr unsigned int ClusteredLighting::kLIGHT_INDEX_UNIT;
+
+// Cone cut-offs for point lights. Every direction passes, so the spot factor is always 1.
+static constexpr float kPOINT_LIGHT_CUT_OFF         = -2.0f;
+static constexpr float kPOINT_LIGHT_OUTER_CUT_OFF   = -3.0f;
+// Contributions below this are invisible in an 8-bit framebuffer.
+static constexpr float kLIGHT_INTENSITY_CUTOFF      = 1.0f / 256.0f;
+static constexpr std::size_t kINITIAL_LIGHT_CAPACITY = 64;
+
+LightData makePointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
+                         float constant, float linear, float quadratic)
+{
+    return makeSpotLight(position, glm::vec3(0.0f, 0.0f, -1.0f), ambient, diffuse, specular,
+                         constant, linear, quadratic, kPOINT_LIGHT_CUT_OFF, kPOINT_LIGHT_OUTER_CUT_OFF);
+}
+
+LightData makeSpotLight(glm::vec3 position, glm::vec3 direction, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
+                        float constant, float linear, float quadratic, float cut_off, float outer_cut_off)
+{
+    LightData light;
+    light.Position      = position;
+    light.Constant      = constant;
+    light.Ambient       = ambient;
+    light.Linear        = linear;
+    light.Diffuse       = diffuse;
+    light.Quadratic     = quadratic;
+    light.Specular      = specular;
+    light.CutOff        = cut_off;
+    light.Direction     = direction;
+    light.OuterCutOff   = outer_cut_off;
+    return light;
+}
+
+bool isSpotLight(const LightData& light)
+{
+    // point lights have cut-offs below any cosine
+    return light.OuterCutOff >= -1.0f;
+}
+
+float lightRange(const LightData& light)
+{
+    float brightest = 0.0f;
+    for (int i = 0; i < 3; i++)
+        brightest = std::max(brightest, std::max(light.Ambient[i], std::max(light.Diffuse[i], light.Specular[i])));
+
+    // solve constant + linear * d + quadratic * d^2 = brightest / cutoff for d
+    float target = brightest / kLIGHT_INTENSITY_CUTOFF;
+    if (target <= light.Constant)
+        return 0.0f;
+    if (light.Quadratic > 0.0f)
+    {
+        float discriminant = light.Linear * light.Linear - 4.0f * light.Quadratic * (light.Constant - target);
+        return (-light.Linear + std::sqrt(discriminant)) / (2.0f * light.Quadratic);
+    }
+    if (light.Linear > 0.0f)
+        return (target - light.Constant) / light.Linear;
+    return 1.0e30f;
+}
+
+ClusteredLighting::ClusteredLighting(ThreadPool& thread_pool, StreamBuffer& stream)
+    :   Pool(thread_pool),
+        Stream(stream),
+        TextureBufferRange(GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3) || GLAD_GL_ARB_texture_buffer_range),
+        TextureBufferAlignment(1),
+        ListsInStream(false),
+        Slices(kDEPTH_SLICES),
+        VisibleLights(0),
+        DirtyBegin(0),
+        DirtyEnd(0),
+        LightCapacity(kINITIAL_LIGHT_CAPACITY),
+        ViewportWidth(0),
+        ViewportHeight(0),
+        TilesX(0),
+        TilesY(0),
+        ClusterProj(0.0f),
+        NearPlane(0.0f),
+        FarPlane(0.0f),
+        SliceScale(0.0f),
+        SliceBias(0.0f)
+{
+    if (this->TextureBufferRange)
+    {
+        GLint alignment = 1;
+        glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        this->TextureBufferAlignment = static_cast<std::size_t>(std::max(alignment, 1));
+    }
+
+    // light records, four floats per texel
+    glGenBuffers(1, &this->LightBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->LightBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->LightCapacity * sizeof(LightData), NULL, GL_DYNAMIC_DRAW);
+    glGenTextures(1, &this->LightTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, this->LightTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->LightBuffer);
+
+    // (offset, count) into the light index list for every cluster
+    glGenBuffers(1, &this->GridBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->GridBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, 2 * sizeof(std::uint32_t), NULL, GL_STREAM_DRAW);
+    glGenTextures(1, &this->GridTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, this->GridTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, this->GridBuffer);
+
+    // light indices of all clusters back to back
+    glGenBuffers(1, &this->IndexBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->IndexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(std::uint32_t), NULL, GL_STREAM_DRAW);
+    glGenTextures(1, &this->IndexTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, this->IndexTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, this->IndexBuffer);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+    glDeleteTextures(1, &this->LightTexture);
+    glDeleteTextures(1, &this->GridTexture);
+    glDeleteTextures(1, &this->IndexTexture);
+    glDeleteBuffers(1, &this->LightBuffer);
+    glDeleteBuffers(1, &this->GridBuffer);
+    glDeleteBuffers(1, &this->IndexBuffer);
+}
+
+unsigned int ClusteredLighting::addLight(const LightData& light)
+{
+    this->Lights.push_back(light);
+    std::size_t index = this->Lights.size() - 1;
+    this->DirtyBegin = std::min(this->DirtyBegin, index);
+    this->DirtyEnd = this->Lights.size();
+    return static_cast<unsigned int>(index);
+}
+
+void ClusteredLighting::setLight(unsigned int index, const LightData& light)
+{
+    if (std::memcmp(&this->Lights[index], &light, sizeof(LightData)) == 0)
+        return;
+    this->Lights[index] = light;
+    if (this->DirtyBegin >= this->DirtyEnd)
+    {
+        this->DirtyBegin = index;
+        this->DirtyEnd = index + 1;
+    }
+    else
+    {
+        this->DirtyBegin = std::min(this->DirtyBegin, static_cast<std::size_t>(index));
+        this->DirtyEnd = std::max(this->DirtyEnd, static_cast<std::size_t>(index) + 1);
+    }
+}
+
+void ClusteredLighting::update(const glm::mat4& view, const glm::mat4& proj, float near_plane, float far_plane,
+                               int viewport_width, int viewport_height, LightBlock& light_block)
+{
+    rebuildClusters(proj, near_plane, far_plane, viewport_width, viewport_height);
+    uploadLights();
+
+    // 1. find the cluster range each light can touch
+    this->Bounds.resize(this->Lights.size());
+    this->Pool.parallelFor(this->Lights.size(), 256, [this, &view](std::size_t begin, std::size_t end) {
+        PROFILE_SCOPE("bound lights");
+        for (std::size_t i = begin; i < end; i++)
+            boundLight(i, view);
+    });
+
+    // 2. bin the lights slice by slice, each slice is only ever touched by one thread
+    this->Pool.parallelFor(kDEPTH_SLICES, 1, [this](std::size_t begin, std::size_t end) {
+        PROFILE_SCOPE("bin slice");
+        for (std::size_t slice = begin; slice < end; slice++)
+            binSlice(static_cast<unsigned int>(slice));
+    });
+
+    // 3. stitch the slices together into one grid and one index list
+    std::size_t tiles_per_slice = this->TilesX * this->TilesY;
+    std::size_t total = 0;
+    for (unsigned int slice = 0; slice < kDEPTH_SLICES; slice++)
+        total += this->Slices[slice].Indices.size();
+    this->LightIndices.resize(total);
+    this->ClusterGrid.resize(2 * tiles_per_slice * kDEPTH_SLICES);
+
+    std::uint32_t base = 0;
+    for (unsigned int slice = 0; slice < kDEPTH_SLICES; slice++)
+    {
+        const SliceBin& bin = this->Slices[slice];
+        std::uint32_t* grid = &this->ClusterGrid[2 * tiles_per_slice * slice];
+        for (std::size_t tile = 0; tile < tiles_per_slice; tile++)
+        {
+            grid[2 * tile]      = base + bin.Offsets[tile];
+            grid[2 * tile + 1]  = bin.Counts[tile];
+        }
+        if (!bin.Indices.empty())
+            std::memcpy(&this->LightIndices[base], &bin.Indices[0], bin.Indices.size() * sizeof(std::uint32_t));
+        base += static_cast<std::uint32_t>(bin.Indices.size());
+    }
+
+    this->VisibleLights = 0;
+    for (std::size_t i = 0; i < this->Bounds.size(); i++)
+    {
+        if (this->Bounds[i].MinSlice <= this->Bounds[i].MaxSlice)
+            this->VisibleLights++;
+    }
+
+    uploadLists();
+
+    light_block.ClusterSize = glm::uvec4(this->TilesX, this->TilesY, kDEPTH_SLICES, kTILE_SIZE);
+    light_block.ClusterDepth = glm::vec4(this->SliceScale, this->SliceBias, this->NearPlane, this->FarPlane);
+}
+
+void ClusteredLighting::bind(GLStateCache& state) const
+{
+    state.bindTexture(kLIGHT_DATA_UNIT, GL_TEXTURE_BUFFER, this->LightTexture);
+    state.bindTexture(kCLUSTER_GRID_UNIT, GL_TEXTURE_BUFFER, this->GridTexture);
+    state.bindTexture(kLIGHT_INDEX_UNIT, GL_TEXTURE_BUFFER, this->IndexTexture);
+}
+
+void ClusteredLighting::setSamplerUnits(const ShaderProgram& program)
+{
+    program.getUniform<int>("lightData").set(kLIGHT_DATA_UNIT);
+    program.getUniform<int>("clusterGrid").set(kCLUSTER_GRID_UNIT);
+    program.getUniform<int>("lightIndices").set(kLIGHT_INDEX_UNIT);
+}
+
+// --------------------------------- Private Methods ------------------------------
+
+void ClusteredLighting::uploadLists()
+{
+    std::size_t grid_size = this->ClusterGrid.size() * sizeof(std::uint32_t);
+    // a buffer texture can't view an empty range
+    std::size_t index_size = std::max<std::size_t>(this->LightIndices.size(), 1) * sizeof(std::uint32_t);
+    if (this->TextureBufferRange)
+    {
+        // the lists change every frame, so they are written into this frame's region like the instances
+        StreamAllocation grid = this->Stream.allocate(grid_size, this->TextureBufferAlignment);
+        StreamAllocation indices = this->Stream.allocate(index_size, this->TextureBufferAlignment);
+        if (grid.Data && indices.Data)
+        {
+            std::memcpy(grid.Data, &this->ClusterGrid[0], grid_size);
+            if (!this->LightIndices.empty())
+                std::memcpy(indices.Data, &this->LightIndices[0], this->LightIndices.size() * sizeof(std::uint32_t));
+            glBindTexture(GL_TEXTURE_BUFFER, this->GridTexture);
+            glTexBufferRange(GL_TEXTURE_BUFFER, GL_RG32UI, this->Stream.id(), grid.Offset, grid_size);
+            glBindTexture(GL_TEXTURE_BUFFER, this->IndexTexture);
+            glTexBufferRange(GL_TEXTURE_BUFFER, GL_R32UI, this->Stream.id(), indices.Offset, index_size);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            this->ListsInStream = true;
+            return;
+        }
+    }
+
+    if (this->ListsInStream)
+    {
+        glBindTexture(GL_TEXTURE_BUFFER, this->GridTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, this->GridBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, this->IndexTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, this->IndexBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        this->ListsInStream = false;
+    }
+    // without ranges, orphan the old storage instead of waiting on it
+    glBindBuffer(GL_TEXTURE_BUFFER, this->GridBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, grid_size, &this->ClusterGrid[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->IndexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, index_size, this->LightIndices.empty() ? NULL : &this->LightIndices[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLighting::rebuildClusters(const glm::mat4& proj, float near_plane, float far_plane, int viewport_width, int viewport_height)
+{
+    unsigned int tiles_x = (static_cast<unsigned int>(std::max(viewport_width, 1)) + kTILE_SIZE - 1) / kTILE_SIZE;
+    unsigned int tiles_y = (static_cast<unsigned int>(std::max(viewport_height, 1)) + kTILE_SIZE - 1) / kTILE_SIZE;
+    if (proj == this->ClusterProj && viewport_width == this->ViewportWidth && viewport_height == this->ViewportHeight &&
+        near_plane == this->NearPlane && far_plane == this->FarPlane)
+        return;
+
+    this->ClusterProj = proj;
+    this->ViewportWidth = viewport_width;
+    this->ViewportHeight = viewport_height;
+    this->TilesX = tiles_x;
+    this->TilesY = tiles_y;
+    this->NearPlane = near_plane;
+    this->FarPlane = far_plane;
+    // slice = log(depth / near) / log(far / near) * slices, written as log(depth) * scale - bias
+    float log_depth_range = std::log(far_plane / near_plane);
+    this->SliceScale = kDEPTH_SLICES / log_depth_range;
+    this->SliceBias = kDEPTH_SLICES * std::log(near_plane) / log_depth_range;
+
+    this->SliceDepths.resize(kDEPTH_SLICES + 1);
+    for (unsigned int slice = 0; slice <= kDEPTH_SLICES; slice++)
+        this->SliceDepths[slice] = near_plane * std::pow(far_plane / near_plane, static_cast<float>(slice) / kDEPTH_SLICES);
+
+    std::size_t tiles_per_slice = tiles_x * tiles_y;
+    this->Clusters.resize(tiles_per_slice * kDEPTH_SLICES);
+    for (unsigned int slice = 0; slice < kDEPTH_SLICES; slice++)
+    {
+        this->Slices[slice].Counts.resize(tiles_per_slice);
+        this->Slices[slice].Offsets.resize(tiles_per_slice);
+    }
+
+    // view-space points on the near plane under each tile corner, scaled out to the slice depths
+    glm::mat4 inv_proj = glm::inverse(proj);
+    for (unsigned int y = 0; y < tiles_y; y++)
+    {
+        for (unsigned int x = 0; x < tiles_x; x++)
+        {
+            glm::vec3 corners[4];
+            for (int corner = 0; corner < 4; corner++)
+            {
+                float px = static_cast<float>(std::min((x + (corner & 1)) * kTILE_SIZE, static_cast<unsigned int>(viewport_width)));
+                float py = static_cast<float>(std::min((y + (corner >> 1)) * kTILE_SIZE, static_cast<unsigned int>(viewport_height)));
+                glm::vec4 ndc(px / viewport_width * 2.0f - 1.0f, py / viewport_height * 2.0f - 1.0f, -1.0f, 1.0f);
+                glm::vec4 view_point = inv_proj * ndc;
+                corners[corner] = glm::vec3(view_point) / view_point.w;
+            }
+            for (unsigned int slice = 0; slice < kDEPTH_SLICES; slice++)
+            {
+                float slice_near = this->SliceDepths[slice];
+                float slice_far = this->SliceDepths[slice + 1];
+                ClusterBounds& bounds = this->Clusters[slice * tiles_per_slice + y * tiles_x + x];
+                bounds.Min = glm::vec3(1.0e30f);
+                bounds.Max = glm::vec3(-1.0e30f);
+                for (int corner = 0; corner < 4; corner++)
+                {
+                    glm::vec3 near_corner = corners[corner] * (slice_near / -corners[corner].z);
+                    glm::vec3 far_corner = corners[corner] * (slice_far / -corners[corner].z);
+                    bounds.Min = glm::min(bounds.Min, glm::min(near_corner, far_corner));
+                    bounds.Max = glm::max(bounds.Max, glm::max(near_corner, far_corner));
+                }
+            }
+        }
+    }
+}
+
+void ClusteredLighting::boundLight(std::size_t index, const glm::mat4& view)
+{
+    LightBounds& bounds = this->Bounds[index];
+    bounds.Range = lightRange(this->Lights[index]);
+    bounds.ViewPosition = glm::vec3(view * glm::vec4(this->Lights[index].Position, 1.0f));
+    // an empty slice range marks the light as invisible
+    bounds.MinSlice = 1;
+    bounds.MaxSlice = 0;
+
+    float depth = -bounds.ViewPosition.z;
+    float range = bounds.Range;
+    if (range <= 0.0f || depth + range < this->NearPlane || depth - range > this->FarPlane)
+        return;
+
+    int min_tile_x = 0;
+    int max_tile_x = static_cast<int>(this->TilesX) - 1;
+    int min_tile_y = 0;
+    int max_tile_y = static_cast<int>(this->TilesY) - 1;
+    if (depth - range > this->NearPlane)
+    {
+        // the sphere is entirely in front of the near plane, so its bounding box can be projected
+        glm::vec3 extent(range, range, range);
+        if (!projectTiles(bounds.ViewPosition - extent, bounds.ViewPosition + extent, min_tile_x, max_tile_x, min_tile_y, max_tile_y))
+            return;
+    }
+
+    bounds.MinTileX = min_tile_x;
+    bounds.MaxTileX = max_tile_x;
+    bounds.MinTileY = min_tile_y;
+    bounds.MaxTileY = max_tile_y;
+    bounds.MinSlice = depthSlice(std::max(depth - range, this->NearPlane));
+    bounds.MaxSlice = depthSlice(std::min(depth + range, this->FarPlane));
+}
+
+void ClusteredLighting::binSlice(unsigned int slice)
+{
+    SliceBin& bin = this->Slices[slice];
+    std::size_t tiles_per_slice = this->TilesX * this->TilesY;
+    const ClusterBounds* clusters = &this->Clusters[slice * tiles_per_slice];
+
+    std::fill(bin.Counts.begin(), bin.Counts.end(), 0u);
+    bin.Pairs.clear();
+    for (std::size_t light = 0; light < this->Bounds.size(); light++)
+    {
+        const LightBounds& bounds = this->Bounds[light];
+        if (static_cast<int>(slice) < bounds.MinSlice || static_cast<int>(slice) > bounds.MaxSlice)
+            continue;
+
+        // the part of the sphere inside this slice is narrower than the whole sphere unless the
+        // centre lies within the slice, so tighten the tile range to that cross-section first
+        float depth = -bounds.ViewPosition.z;
+        float slice_near = this->SliceDepths[slice];
+        float slice_far = this->SliceDepths[slice + 1];
+        float range_squared = bounds.Range * bounds.Range;
+        float gap = depth < slice_near ? slice_near - depth : (depth > slice_far ? depth - slice_far : 0.0f);
+        if (gap * gap >= range_squared)
+            continue;
+        int min_tile_x = bounds.MinTileX;
+        int max_tile_x = bounds.MaxTileX;
+        int min_tile_y = bounds.MinTileY;
+        int max_tile_y = bounds.MaxTileY;
+        float section = std::sqrt(range_squared - gap * gap);
+        glm::vec3 section_min(bounds.ViewPosition.x - section, bounds.ViewPosition.y - section, -std::min(slice_far, depth + bounds.Range));
+        glm::vec3 section_max(bounds.ViewPosition.x + section, bounds.ViewPosition.y + section, -std::max(slice_near, depth - bounds.Range));
+        if (!projectTiles(section_min, section_max, min_tile_x, max_tile_x, min_tile_y, max_tile_y))
+            continue;
+
+        for (int y = min_tile_y; y <= max_tile_y; y++)
+        {
+            for (int x = min_tile_x; x <= max_tile_x; x++)
+            {
+                // sphere against the cluster's bounding box
+                std::uint32_t tile = y * this->TilesX + x;
+                glm::vec3 closest = glm::clamp(bounds.ViewPosition, clusters[tile].Min, clusters[tile].Max);
+                glm::vec3 delta = closest - bounds.ViewPosition;
+                if (glm::dot(delta, delta) > range_squared)
+                    continue;
+                bin.Pairs.push_back(tile);
+                bin.Pairs.push_back(static_cast<std::uint32_t>(light));
+                bin.Counts[tile]++;
+            }
+        }
+    }
+
+    // counting sort of the (tile, light) pairs into per-tile lists
+    std::uint32_t offset = 0;
+    for (std::size_t tile = 0; tile < tiles_per_slice; tile++)
+    {
+        bin.Offsets[tile] = offset;
+        offset += bin.Counts[tile];
+        bin.Counts[tile] = 0;
+    }
+    bin.Indices.resize(offset);
+    for (std::size_t pair = 0; pair < bin.Pairs.size(); pair += 2)
+    {
+        std::uint32_t tile = bin.Pairs[pair];
+        bin.Indices[bin.Offsets[tile] + bin.Counts[tile]++] = bin.Pairs[pair + 1];
+    }
+}
+
+bool ClusteredLighting::projectTiles(const glm::vec3& view_min, const glm::vec3& view_max,
+                                     int& min_tile_x, int& max_tile_x, int& min_tile_y, int& max_tile_y) const
+{
+    // the box is in front of the near plane, so the projection of its corners bounds it on screen
+    glm::vec2 ndc_min(1.0e30f, 1.0e30f);
+    glm::vec2 ndc_max(-1.0e30f, -1.0e30f);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 point((corner & 1) ? view_max.x : view_min.x, (corner & 2) ? view_max.y : view_min.y,
+                        (corner & 4) ? view_max.z : view_min.z, 1.0f);
+        glm::vec4 clip = this->ClusterProj * point;
+        ndc_min.x = std::min(ndc_min.x, clip.x / clip.w);
+        ndc_min.y = std::min(ndc_min.y, clip.y / clip.w);
+        ndc_max.x = std::max(ndc_max.x, clip.x / clip.w);
+        ndc_max.y = std::max(ndc_max.y, clip.y / clip.w);
+    }
+    if (ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f || ndc_min.y > 1.0f)
+        return false;
+
+    float tile_scale_x = this->ViewportWidth * 0.5f / kTILE_SIZE;
+    float tile_scale_y = this->ViewportHeight * 0.5f / kTILE_SIZE;
+    min_tile_x = std::max(min_tile_x, static_cast<int>(std::floor((ndc_min.x + 1.0f) * tile_scale_x)));
+    max_tile_x = std::min(max_tile_x, static_cast<int>(std::floor((ndc_max.x + 1.0f) * tile_scale_x)));
+    min_tile_y = std::max(min_tile_y, static_cast<int>(std::floor((ndc_min.y + 1.0f) * tile_scale_y)));
+    max_tile_y = std::min(max_tile_y, static_cast<int>(std::floor((ndc_max.y + 1.0f) * tile_scale_y)));
+    return min_tile_x <= max_tile_x && min_tile_y <= max_tile_y;
+}
+
+int ClusteredLighting::depthSlice(float depth) const
+{
+    int slice = static_cast<int>(std::floor(std::log(depth) * this->SliceScale - this->SliceBias));
+    return std::max(0, std::min(slice, static_cast<int>(kDEPTH_SLICES) - 1));
+}
+
+void ClusteredLighting::uploadLights()
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, this->LightBuffer);
+    if (this->Lights.size() > this->LightCapacity)
+    {
+        this->LightCapacity = std::max(this->Lights.size(), 2 * this->LightCapacity);
+        glBufferData(GL_TEXTURE_BUFFER, this->LightCapacity * sizeof(LightData), NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, this->Lights.size() * sizeof(LightData), &this->Lights[0]);
+    }
+    else if (this->DirtyBegin < this->DirtyEnd)
+    {
+        glBufferSubData(GL_TEXTURE_BUFFER, this->DirtyBegin * sizeof(LightData),
+                        (this->DirtyEnd - this->DirtyBegin) * sizeof(LightData), &this->Lights[this->DirtyBegin]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    this->DirtyBegin = this->Lights.size();
+    this->DirtyEnd = this->Lights.size();
+}
@@ -0,0 +1,181 @@
+#ifndef CLUSTERED_LIGHTING_HPP
+#define CLUSTERED_LIGHTING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "uniform_blocks.hpp"
+
+class GLStateCache;
+class ShaderProgram;
+class StreamBuffer;
+class ThreadPool;
+
+/*
+    A point or spot light as stored in the light buffer texture, five RGBA32F texels per light.
+    Point lights are spot lights whose cone covers every direction, so the shader treats both the same.
+    Keep in sync with fetchLight() in shaders/clusters.glsl.
+*/
+struct LightData
+{
+    glm::vec3 Position;
+    float Constant;
+    glm::vec3 Ambient;
+    float Linear;
+    glm::vec3 Diffuse;
+    float Quadratic;
+    glm::vec3 Specular;
+    float CutOff;
+    glm::vec3 Direction;
+    float OuterCutOff;
+};
+
+static_assert(sizeof(LightData) == 5 * 4 * sizeof(float), "LightData must be exactly five vec4 texels");
+
+/* Build a point light. */
+LightData makePointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
+                         float constant, float linear, float quadratic);
+/* Build a spot light. The cut-offs are cosines of the inner and outer cone angles. */
+LightData makeSpotLight(glm::vec3 position, glm::vec3 direction, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
+                        float constant, float linear, float quadratic, float cut_off, float outer_cut_off);
+/* Check if a light has a cone, as opposed to a point light lighting every direction. */
+bool isSpotLight(const LightData& light);
+/* Distance at which a light's contribution drops below what an 8-bit framebuffer can show. */
+float lightRange(const LightData& light);
+
+/*
+    Clustered forward lighting.
+    The view frustum is split into screen tiles and exponentially spaced depth slices. Every frame the
+    lights are binned into the clusters they touch on the CPU, and the per-cluster light lists are
+    uploaded to buffer textures so each fragment only shades the lights that can reach it.
+    Where GL_ARB_texture_buffer_range is supported, the lists are written into the frame's region
+    of a StreamBuffer and the buffer textures view them there. Otherwise, or if the region is full,
+    they go to buffers of their own, orphaned every frame.
+*/
+class ClusteredLighting
+{
+public:
+    static constexpr unsigned int kTILE_SIZE            = 64;   // in pixels
+    static constexpr unsigned int kDEPTH_SLICES         = 24;
+    // texture units the light buffers are bound to
+    static constexpr unsigned int kLIGHT_DATA_UNIT      = 2;
+    static constexpr unsigned int kCLUSTER_GRID_UNIT    = 3;
+    static constexpr unsigned int kLIGHT_INDEX_UNIT     = 4;
+
+    /* Construct a ClusteredLighting object. Light binning is spread across the given thread pool, and the light lists are written to a stream buffer. */
+    ClusteredLighting(ThreadPool& thread_pool, StreamBuffer& stream);
+    ~ClusteredLighting();
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+    /* Add a light and return its index. */
+    unsigned int addLight(const LightData& light);
+    /* Replace a light. Only lights that actually change are uploaded again. */
+    void setLight(unsigned int index, const LightData& light);
+    /* Get a light by index. */
+    const LightData& getLight(unsigned int index) const { return this->Lights[index]; }
+    /* Get the number of lights. */
+    std::size_t lightCount() const { return this->Lights.size(); }
+
+    /*
+        Assign the lights to clusters for the current camera and upload the light lists.
+        Also fills in the cluster parameters of the light block so the shaders can find their cluster.
+        Must be called between the stream's beginFrame() and commit().
+    */
+    void update(const glm::mat4& view, const glm::mat4& proj, float near_plane, float far_plane,
+                int viewport_width, int viewport_height, LightBlock& light_block);
+    /* Bind the light buffer textures to their texture units. */
+    void bind(GLStateCache& state) const;
+    /* Point a program's light buffer samplers at the texture units used by bind(). The program must be in use. */
+    static void setSamplerUnits(const ShaderProgram& program);
+
+    /* Number of lights that touched at least one cluster in the last update. */
+    std::size_t visibleLightCount() const { return this->VisibleLights; }
+    /* Total number of light references across all clusters in the last update. */
+    std::size_t lightIndexCount() const { return this->LightIndices.size(); }
+
+private:
+    /* View-space axis aligned bounds of a cluster. */
+    struct ClusterBounds
+    {
+        glm::vec3 Min;
+        glm::vec3 Max;
+    };
+    /* The range of clusters a light may touch; empty when the light is outside the frustum. */
+    struct LightBounds
+    {
+        glm::vec3 ViewPosition;
+        float Range;
+        int MinTileX, MaxTileX, MinTileY, MaxTileY, MinSlice, MaxSlice;
+    };
+    /* Per depth slice scratch space, reused every frame. */
+    struct SliceBin
+    {
+        std::vector<std::uint32_t> Counts;
+        std::vector<std::uint32_t> Offsets;
+        std::vector<std::uint32_t> Pairs;       // (tile, light) pairs, two entries each
+        std::vector<std::uint32_t> Indices;
+    };
+
+    /* Recalculate the cluster grid and bounds when the projection or viewport changes. */
+    void rebuildClusters(const glm::mat4& proj, float near_plane, float far_plane, int viewport_width, int viewport_height);
+    /* Work out which tiles and slices a light can touch. */
+    void boundLight(std::size_t index, const glm::mat4& view);
+    /* Bin the visible lights into the clusters of one depth slice. */
+    void binSlice(unsigned int slice);
+    /*
+        Narrow a tile range to the screen footprint of a view-space box in front of the near plane.
+        Returns false if the box is off screen.
+    */
+    bool projectTiles(const glm::vec3& view_min, const glm::vec3& view_max,
+                      int& min_tile_x, int& max_tile_x, int& min_tile_y, int& max_tile_y) const;
+    /* Map a positive view-space depth to its depth slice. */
+    int depthSlice(float depth) const;
+    /* Upload the light records that changed since the last upload. */
+    void uploadLights();
+    /* Upload this frame's cluster grid and light index list, and point the buffer textures at them. */
+    void uploadLists();
+
+private:
+    ThreadPool& Pool;
+    StreamBuffer& Stream;
+    // whether the buffer textures can view part of the stream buffer, and the offset alignment that needs
+    bool TextureBufferRange;
+    std::size_t TextureBufferAlignment;
+    // whether the grid and index textures view the stream buffer rather than their own buffers
+    bool ListsInStream;
+
+    std::vector<LightData> Lights;
+    std::vector<LightBounds> Bounds;
+    std::vector<ClusterBounds> Clusters;
+    std::vector<float> SliceDepths;             // view-space depth of each slice boundary
+    std::vector<SliceBin> Slices;
+    std::vector<std::uint32_t> ClusterGrid;     // (offset, count) per cluster
+    std::vector<std::uint32_t> LightIndices;
+    std::size_t VisibleLights;
+
+    // lights changed since the last upload, as a range of light indices
+    std::size_t DirtyBegin;
+    std::size_t DirtyEnd;
+    std::size_t LightCapacity;
+
+    // cluster grid parameters
+    int ViewportWidth;
+    int ViewportHeight;
+    unsigned int TilesX;
+    unsigned int TilesY;
+    glm::mat4 ClusterProj;
+    float NearPlane;
+    float FarPlane;
+    float SliceScale;
+    float SliceBias;
+
+    // buffer objects and the buffer textures that view them
+    unsigned int LightBuffer, LightTexture;
+    unsigned int GridBuffer, GridTexture;
+    unsigned int IndexBuffer, IndexTexture;
+};
+
+#endif  // CLUSTERED_LIGHTING_HPP
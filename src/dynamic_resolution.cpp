@@ -0,0 +1,163 @@
+#include "dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+
+constexpr unsigned int DynamicResolution::kQUERY_LATENCY;
+constexpr float DynamicResolution::kSCALE_STEP;
+constexpr float DynamicResolution::kMAX_SCALE_CHANGE;
+constexpr double DynamicResolution::kTIME_SMOOTHING;
+constexpr float DynamicResolution::kMAX_SHARPNESS;
+
+namespace
+{
+    // 60 frames per second, until told otherwise
+    const double kDEFAULT_TARGET_FRAME_TIME = 1000.0 / 60.0;
+    const float kDEFAULT_MIN_SCALE = 0.5f;
+}
+
+DynamicResolution::DynamicResolution()
+    :   Enabled(false),
+        TargetFrameTime(kDEFAULT_TARGET_FRAME_TIME),
+        MinScale(kDEFAULT_MIN_SCALE),
+        MaxScale(1.0f),
+        Scale(1.0f),
+        Target(1, 1),
+        ResolveShader("../../shaders/fullscreen.vert", "../../shaders/resolve.frag"),
+        VertexArray(0),
+        OutputWidth(0),
+        OutputHeight(0),
+        FramesBegun(0),
+        FramesCollected(0),
+        AverageFrameTime(0.0),
+        Measured(false)
+{
+    this->ResolveShader.use();
+    this->ResolveShader.getUniform<int>("sceneTexture").set(0);
+    this->OutputSize = this->ResolveShader.getUniform<glm::vec2>("outputSize");
+    this->Sharpness = this->ResolveShader.getUniform<float>("sharpness");
+    glGenVertexArrays(1, &this->VertexArray);
+    glGenQueries(2 * kQUERY_LATENCY, &this->Queries[0][0]);
+    for (unsigned int i = 0; i < kQUERY_LATENCY; i++)
+        this->QueryScales[i] = 0.0f;
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    glDeleteQueries(2 * kQUERY_LATENCY, &this->Queries[0][0]);
+    glDeleteVertexArrays(1, &this->VertexArray);
+}
+
+void DynamicResolution::setEnabled(bool enabled)
+{
+    this->Enabled = enabled;
+    this->Scale = this->MaxScale;
+    this->Measured = false;
+}
+
+void DynamicResolution::setScaleBounds(float min_scale, float max_scale)
+{
+    this->MinScale = std::min(min_scale, max_scale);
+    this->MaxScale = max_scale;
+    this->Scale = std::min(std::max(this->Scale, this->MinScale), this->MaxScale);
+}
+
+void DynamicResolution::beginFrame(int output_width, int output_height, int& width, int& height)
+{
+    this->OutputWidth = output_width;
+    this->OutputHeight = output_height;
+    if (!this->Enabled)
+    {
+        width = output_width;
+        height = output_height;
+        return;
+    }
+    width = std::max(1, static_cast<int>(output_width * this->Scale + 0.5f));
+    height = std::max(1, static_cast<int>(output_height * this->Scale + 0.5f));
+    this->Target.resize(width, height);
+    this->Target.bind();
+
+    // the ring is full, so the oldest frame has to be waited for before its queries are reused
+    if (this->FramesBegun - this->FramesCollected >= kQUERY_LATENCY)
+    {
+        GLuint64 ignored = 0;
+        glGetQueryObjectui64v(this->Queries[this->FramesCollected % kQUERY_LATENCY][1], GL_QUERY_RESULT, &ignored);
+        collectQueries();
+    }
+    unsigned int slot = this->FramesBegun % kQUERY_LATENCY;
+    this->QueryScales[slot] = this->Scale;
+    glQueryCounter(this->Queries[slot][0], GL_TIMESTAMP);
+}
+
+void DynamicResolution::endFrame(unsigned int output_framebuffer)
+{
+    if (!this->Enabled)
+        return;
+
+    // scale the scene up to the output, sharpening more the further it is scaled
+    glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+    glViewport(0, 0, this->OutputWidth, this->OutputHeight);
+    glDisable(GL_DEPTH_TEST);
+    this->ResolveShader.use();
+    this->OutputSize.set(glm::vec2(static_cast<float>(this->OutputWidth), static_cast<float>(this->OutputHeight)));
+    float upscale = this->MinScale < 1.0f ? (1.0f - this->Scale) / (1.0f - this->MinScale) : 0.0f;
+    this->Sharpness.set(kMAX_SHARPNESS * std::min(std::max(upscale, 0.0f), 1.0f));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, this->Target.colourTexture());
+    glBindVertexArray(this->VertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+
+    // the resolve is part of the frame's cost, so it is timed too
+    glQueryCounter(this->Queries[this->FramesBegun % kQUERY_LATENCY][1], GL_TIMESTAMP);
+    this->FramesBegun++;
+    collectQueries();
+    adjustScale();
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void DynamicResolution::collectQueries()
+{
+    while (this->FramesCollected < this->FramesBegun)
+    {
+        unsigned int slot = this->FramesCollected % kQUERY_LATENCY;
+        GLint available = 0;
+        glGetQueryObjectiv(this->Queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(this->Queries[slot][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(this->Queries[slot][1], GL_QUERY_RESULT, &end);
+        this->FramesCollected++;
+
+        // frames rendered before the last change say nothing about the current scale
+        if (this->QueryScales[slot] != this->Scale)
+            continue;
+        double time = static_cast<double>(end - start) / 1.0e6;
+        this->AverageFrameTime = this->Measured ? this->AverageFrameTime + (time - this->AverageFrameTime) * kTIME_SMOOTHING : time;
+        this->Measured = true;
+    }
+}
+
+void DynamicResolution::adjustScale()
+{
+    // wait for a frame at the current scale before changing it again
+    if (!this->Measured || this->AverageFrameTime <= 0.0)
+        return;
+    // GPU time mostly follows the pixel count, which goes with the square of the scale
+    float wanted = this->Scale * static_cast<float>(std::sqrt(this->TargetFrameTime / this->AverageFrameTime));
+    wanted = std::min(std::max(wanted, this->Scale - kMAX_SCALE_CHANGE), this->Scale + kMAX_SCALE_CHANGE);
+    wanted = std::round(wanted / kSCALE_STEP) * kSCALE_STEP;
+    wanted = std::min(std::max(wanted, this->MinScale), this->MaxScale);
+    if (std::fabs(wanted - this->Scale) < 0.5f * kSCALE_STEP)
+        return;
+
+    // until the first frame at the new scale comes back, expect the time to follow the pixel count
+    float ratio = wanted / this->Scale;
+    this->AverageFrameTime *= ratio * ratio;
+    this->Scale = wanted;
+    this->Measured = false;
+}
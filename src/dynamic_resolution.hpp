@@ -0,0 +1,93 @@
+#ifndef DYNAMIC_RESOLUTION_HPP
+#define DYNAMIC_RESOLUTION_HPP
+
+#include <cstddef>
+
+#include "framebuffer.hpp"
+#include "shader_program.hpp"
+
+/*
+    Renders the scene below the output resolution when the GPU can't keep up, to hold a target frame time.
+    The scene is drawn into an offscreen target whose size is the output size times a scale. The GPU
+    time of each frame is measured with a pair of GL_TIMESTAMP queries, read back kQUERY_LATENCY
+    frames later so nothing waits on them. Since GPU time mostly follows the number of pixels, the
+    scale moves by the square root of the ratio of the target time to the measured time. The target
+    is then scaled up to the output with bilinear filtering and some sharpening.
+    When disabled, the scene is drawn straight into the output and nothing is measured.
+*/
+class DynamicResolution
+{
+public:
+    /* Number of frames a GPU query may be in flight before its result is needed. */
+    static constexpr unsigned int kQUERY_LATENCY = 4;
+    /* Scales are rounded to steps of this size, so small changes in frame time don't resize the target every frame. */
+    static constexpr float kSCALE_STEP = 0.05f;
+    /* Largest change of the scale in one step, so one slow frame can't halve the resolution. */
+    static constexpr float kMAX_SCALE_CHANGE = 0.15f;
+    /* Weight of the newest measured time in the running average the scale follows. */
+    static constexpr double kTIME_SMOOTHING = 0.2;
+    /* Amount of sharpening at the smallest scale. None is applied at full resolution. */
+    static constexpr float kMAX_SHARPNESS = 0.5f;
+
+    /* Construct a DynamicResolution object, disabled. The GL context must be current. */
+    DynamicResolution();
+    ~DynamicResolution();
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    /* Choose whether the resolution is scaled. Turning it off goes back to full resolution. */
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return this->Enabled; }
+    /* Set the GPU time in milliseconds that each frame should take. */
+    void setTargetFrameTime(double milliseconds) { this->TargetFrameTime = milliseconds; }
+    double targetFrameTime() const { return this->TargetFrameTime; }
+    /* Set the smallest and largest scale of each side of the output, such as 0.5 and 1. */
+    void setScaleBounds(float min_scale, float max_scale);
+
+    /*
+        Start a frame for an output of the given size. Binds the scaled target, if enabled, and returns
+        the size to render the scene at in width and height. Draws are timed until endFrame().
+    */
+    void beginFrame(int output_width, int output_height, int& width, int& height);
+    /* Stop timing the frame and scale the scene up into the output framebuffer, then adjust the scale. */
+    void endFrame(unsigned int output_framebuffer);
+
+    /* Get the scale of each side of the output that the last frame was rendered at. */
+    float scale() const { return this->Scale; }
+    /* Get the running average of the measured GPU frame time in milliseconds, or 0 if nothing was measured yet. */
+    double gpuFrameTime() const { return this->AverageFrameTime; }
+
+private:
+    /* Read back any finished queries, oldest first, without waiting. */
+    void collectQueries();
+    /* Move the scale towards the target frame time. */
+    void adjustScale();
+
+private:
+    bool Enabled;
+    double TargetFrameTime;
+    float MinScale;
+    float MaxScale;
+    float Scale;
+
+    Framebuffer Target;
+    ShaderProgram ResolveShader;
+    Uniform<glm::vec2> OutputSize;
+    Uniform<float> Sharpness;
+    // empty, since the full screen triangle is made in the vertex shader
+    unsigned int VertexArray;
+    int OutputWidth;
+    int OutputHeight;
+
+    /* A pair of timestamp queries around each frame in flight. */
+    unsigned int Queries[kQUERY_LATENCY][2];
+    std::size_t FramesBegun;
+    std::size_t FramesCollected;
+    /* Scale each frame in flight was rendered at. */
+    float QueryScales[kQUERY_LATENCY];
+    double AverageFrameTime;
+    /* Set once a frame rendered at the current scale has been measured. */
+    bool Measured;
+};
+
+#endif  // DYNAMIC_RESOLUTION_HPP
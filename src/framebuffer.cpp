@@ -0,0 +1,62 @@
+#include "framebuffer.hpp"
+
+#include <iostream>
+
+#include <glad/glad.h>
+
+Framebuffer::Framebuffer(int width, int height)
+    :   Width(0),
+        Height(0),
+        Complete(false)
+{
+    glGenFramebuffers(1, &this->FramebufferID);
+    glGenTextures(1, &this->ColourTextureID);
+    glGenRenderbuffers(1, &this->DepthBufferID);
+    resize(width, height);
+}
+
+Framebuffer::~Framebuffer()
+{
+    glDeleteFramebuffers(1, &this->FramebufferID);
+    glDeleteTextures(1, &this->ColourTextureID);
+    glDeleteRenderbuffers(1, &this->DepthBufferID);
+}
+
+bool Framebuffer::resize(int width, int height)
+{
+    if (width == this->Width && height == this->Height)
+        return this->Complete;
+    this->Width = width;
+    this->Height = height;
+
+    glBindTexture(GL_TEXTURE_2D, this->ColourTextureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    // sampled with filtering when it is scaled up to another size
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->DepthBufferID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->FramebufferID);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->ColourTextureID, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->DepthBufferID);
+    this->Complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!this->Complete)
+        std::cerr << "Framebuffer is not complete." << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return this->Complete;
+}
+
+void Framebuffer::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, this->FramebufferID);
+}
+
+void Framebuffer::bindDefault()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
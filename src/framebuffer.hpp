@@ -0,0 +1,43 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+/*
+    An offscreen render target with a colour and a depth/stencil attachment.
+    The colour attachment is a texture, so a later pass can sample what was drawn.
+*/
+class Framebuffer
+{
+public:
+    /* Construct a Framebuffer object of the given size in pixels. */
+    Framebuffer(int width, int height);
+    ~Framebuffer();
+    Framebuffer(const Framebuffer&) = delete;
+    Framebuffer& operator=(const Framebuffer&) = delete;
+
+    /* Make sure the attachments are the given size in pixels, recreating them if not. Returns isComplete(). */
+    bool resize(int width, int height);
+    /* Make this the target of draw calls. */
+    void bind() const;
+    /* Make the window the target of draw calls again. */
+    static void bindDefault();
+    /* Check if the driver accepted the attachments. */
+    bool isComplete() const { return this->Complete; }
+
+    /* Get the OpenGL name of the framebuffer. */
+    unsigned int id() const { return this->FramebufferID; }
+    /* Get the OpenGL name of the colour texture. */
+    unsigned int colourTexture() const { return this->ColourTextureID; }
+    int width() const { return this->Width; }
+    int height() const { return this->Height; }
+
+private:
+    /* Hold the IDs of the objects used by OpenGL */
+    unsigned int FramebufferID;
+    unsigned int ColourTextureID;
+    unsigned int DepthBufferID;
+    int Width;
+    int Height;
+    bool Complete;
+};
+
+#endif  // FRAMEBUFFER_HPP
@@ -0,0 +1,61 @@
+#include "frustum.hpp"
+
+#include <cmath>
+
+constexpr unsigned int Frustum::kPLANE_COUNT;
+
+Frustum extractFrustum(const glm::mat4& view_proj)
+{
+    // Gribb/Hartmann: each plane is the last row of the matrix plus or minus one of the others
+    glm::vec4 row_x(view_proj[0][0], view_proj[1][0], view_proj[2][0], view_proj[3][0]);
+    glm::vec4 row_y(view_proj[0][1], view_proj[1][1], view_proj[2][1], view_proj[3][1]);
+    glm::vec4 row_z(view_proj[0][2], view_proj[1][2], view_proj[2][2], view_proj[3][2]);
+    glm::vec4 row_w(view_proj[0][3], view_proj[1][3], view_proj[2][3], view_proj[3][3]);
+
+    Frustum frustum;
+    frustum.Planes[0] = row_w + row_x;
+    frustum.Planes[1] = row_w - row_x;
+    frustum.Planes[2] = row_w + row_y;
+    frustum.Planes[3] = row_w - row_y;
+    frustum.Planes[4] = row_w + row_z;
+    frustum.Planes[5] = row_w - row_z;
+    for (unsigned int i = 0; i < Frustum::kPLANE_COUNT; i++)
+    {
+        // normalised so plane distances are in world units
+        float length = glm::length(glm::vec3(frustum.Planes[i]));
+        if (length > 0.0f)
+            frustum.Planes[i] /= length;
+    }
+    return frustum;
+}
+
+bool intersectsFrustum(const Frustum& frustum, const Bounds& box)
+{
+    for (unsigned int i = 0; i < Frustum::kPLANE_COUNT; i++)
+    {
+        // the corner furthest along the plane normal is the last one to leave the frustum
+        const glm::vec4& plane = frustum.Planes[i];
+        glm::vec3 corner(plane.x > 0.0f ? box.Max.x : box.Min.x,
+                         plane.y > 0.0f ? box.Max.y : box.Min.y,
+                         plane.z > 0.0f ? box.Max.z : box.Min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+Bounds transformBounds(const Bounds& box, const glm::mat4& transform)
+{
+    // transform the centre and grow the half extent by the absolute value of the rotation and scale
+    glm::vec3 centre = 0.5f * (box.Min + box.Max);
+    glm::vec3 extent = 0.5f * (box.Max - box.Min);
+    glm::vec3 new_centre = glm::vec3(transform * glm::vec4(centre, 1.0f));
+    glm::vec3 new_extent(0.0f);
+    for (int column = 0; column < 3; column++)
+        new_extent += glm::abs(glm::vec3(transform[column])) * extent[column];
+
+    Bounds result;
+    result.Min = new_centre - new_extent;
+    result.Max = new_centre + new_extent;
+    return result;
+}
@@ -0,0 +1,32 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+
+/*
+    The planes of a view frustum, in the order left, right, bottom, top, near, far.
+    Normals point into the frustum, so a point p is on the inside of a plane when
+    dot(plane.xyz, p) + plane.w >= 0.
+*/
+struct Frustum
+{
+    static constexpr unsigned int kPLANE_COUNT = 6;
+
+    glm::vec4 Planes[kPLANE_COUNT];
+};
+
+/* Extract the world-space frustum planes from a projection * view matrix. The planes are normalised. */
+Frustum extractFrustum(const glm::mat4& view_proj);
+
+/*
+    Check if a box is at least partly inside the frustum.
+    The test is conservative: a box just outside a corner of the frustum may still pass.
+*/
+bool intersectsFrustum(const Frustum& frustum, const Bounds& box);
+
+/* Get the world-space bounding box of a model-space box moved by a transform. */
+Bounds transformBounds(const Bounds& box, const glm::mat4& transform);
+
+#endif  // FRUSTUM_HPP
@@ -0,0 +1,111 @@
+#include "gbuffer.hpp"
+
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+#include "shader_program.hpp"
+
+constexpr unsigned int GBuffer::kALBEDO_SPECULAR_UNIT;
+constexpr unsigned int GBuffer::kNORMAL_UNIT;
+constexpr unsigned int GBuffer::kDEPTH_UNIT;
+
+namespace
+{
+    unsigned int createTarget(GLint internal_format, GLenum format, GLenum type, int width, int height)
+    {
+        unsigned int texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+        // the lighting pass reads exactly one texel per pixel
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+}
+
+GBuffer::GBuffer()
+    :   AlbedoSpecularTexture(0),
+        NormalTexture(0),
+        DepthTexture(0),
+        Width(0),
+        Height(0),
+        Complete(false)
+{
+    glGenFramebuffers(1, &this->FramebufferID);
+}
+
+GBuffer::~GBuffer()
+{
+    release();
+    glDeleteFramebuffers(1, &this->FramebufferID);
+}
+
+bool GBuffer::resize(int width, int height)
+{
+    if (width == this->Width && height == this->Height)
+        return this->Complete;
+    release();
+    this->Width = width;
+    this->Height = height;
+
+    this->AlbedoSpecularTexture = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    this->NormalTexture = createTarget(GL_RG16F, GL_RG, GL_FLOAT, width, height);
+    this->DepthTexture = createTarget(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->FramebufferID);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->AlbedoSpecularTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->NormalTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, this->DepthTexture, 0);
+    const GLenum draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, draw_buffers);
+    this->Complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!this->Complete)
+        std::cerr << "G-buffer is not complete." << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return this->Complete;
+}
+
+void GBuffer::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, this->FramebufferID);
+}
+
+void GBuffer::bindTextures(GLStateCache& state) const
+{
+    state.bindTexture(kALBEDO_SPECULAR_UNIT, GL_TEXTURE_2D, this->AlbedoSpecularTexture);
+    state.bindTexture(kNORMAL_UNIT, GL_TEXTURE_2D, this->NormalTexture);
+    state.bindTexture(kDEPTH_UNIT, GL_TEXTURE_2D, this->DepthTexture);
+}
+
+void GBuffer::copyDepthTo(unsigned int framebuffer) const
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->FramebufferID);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, this->Width, this->Height, 0, 0, this->Width, this->Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void GBuffer::setSamplerUnits(const ShaderProgram& program)
+{
+    program.getUniform<int>("gAlbedoSpecular").set(kALBEDO_SPECULAR_UNIT);
+    program.getUniform<int>("gNormal").set(kNORMAL_UNIT);
+    program.getUniform<int>("gDepth").set(kDEPTH_UNIT);
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void GBuffer::release()
+{
+    glDeleteTextures(1, &this->AlbedoSpecularTexture);
+    glDeleteTextures(1, &this->NormalTexture);
+    glDeleteTextures(1, &this->DepthTexture);
+    this->AlbedoSpecularTexture = 0;
+    this->NormalTexture = 0;
+    this->DepthTexture = 0;
+}
@@ -0,0 +1,54 @@
+#ifndef GBUFFER_HPP
+#define GBUFFER_HPP
+
+class GLStateCache;
+class ShaderProgram;
+
+/*
+    The render targets of the deferred path's geometry pass, laid out as in shaders/gbuffer.glsl:
+        attachment 0  RGBA8   albedo, specular intensity
+        attachment 1  RG16F   normal, octahedral encoded
+        depth         D24S8   world position is reconstructed from it in the lighting pass
+    The textures are created on the first resize() and recreated whenever the size changes.
+*/
+class GBuffer
+{
+public:
+    /* Texture units the lighting pass reads the G-buffer from. Units 2-4 hold the clustered light lists. */
+    static constexpr unsigned int kALBEDO_SPECULAR_UNIT = 0;
+    static constexpr unsigned int kNORMAL_UNIT          = 1;
+    static constexpr unsigned int kDEPTH_UNIT           = 5;
+
+    /* Construct an empty GBuffer object. The GL context must be current. */
+    GBuffer();
+    ~GBuffer();
+    GBuffer(const GBuffer&) = delete;
+    GBuffer& operator=(const GBuffer&) = delete;
+
+    /* Make sure the targets are the given size in pixels. Returns false if the driver rejects them. */
+    bool resize(int width, int height);
+    /* Make the G-buffer the target of draw calls. */
+    void bind() const;
+    /* Bind the G-buffer textures to their texture units for the lighting pass. */
+    void bindTextures(GLStateCache& state) const;
+    /* Copy the depth buffer into another framebuffer of the same size, so forward draws are depth tested against the scene. */
+    void copyDepthTo(unsigned int framebuffer) const;
+    /* Point a program's G-buffer samplers at the texture units used by bindTextures(). The program must be in use. */
+    static void setSamplerUnits(const ShaderProgram& program);
+
+private:
+    /* Delete the textures, leaving the framebuffer without attachments. */
+    void release();
+
+private:
+    /* Hold the IDs of the objects used by OpenGL */
+    unsigned int FramebufferID;
+    unsigned int AlbedoSpecularTexture;
+    unsigned int NormalTexture;
+    unsigned int DepthTexture;
+    int Width;
+    int Height;
+    bool Complete;
+};
+
+#endif  // GBUFFER_HPP
@@ -0,0 +1,81 @@
+#include "gl_state.hpp"
+
+#include <glad/glad.h>
+
+constexpr unsigned int GLStateCache::kMAX_TEXTURE_UNITS;
+
+namespace
+{
+    // no object or enum has this name, so an unknown binding never matches
+    const unsigned int kUNKNOWN = 0xFFFFFFFFu;
+}
+
+GLStateCache::GLStateCache()
+{
+    invalidate();
+    resetStats();
+}
+
+void GLStateCache::invalidate()
+{
+    this->Program = kUNKNOWN;
+    this->VertexArray = kUNKNOWN;
+    this->ActiveUnit = kUNKNOWN;
+    for (unsigned int i = 0; i < kMAX_TEXTURE_UNITS; i++)
+    {
+        this->Textures[i].Target = kUNKNOWN;
+        this->Textures[i].Texture = kUNKNOWN;
+    }
+}
+
+void GLStateCache::resetStats()
+{
+    this->Stats.Issued = 0;
+    this->Stats.Skipped = 0;
+}
+
+void GLStateCache::useProgram(unsigned int program)
+{
+    if (program == this->Program)
+    {
+        this->Stats.Skipped++;
+        return;
+    }
+    glUseProgram(program);
+    this->Program = program;
+    this->Stats.Issued++;
+}
+
+void GLStateCache::bindVertexArray(unsigned int vao)
+{
+    if (vao == this->VertexArray)
+    {
+        this->Stats.Skipped++;
+        return;
+    }
+    glBindVertexArray(vao);
+    this->VertexArray = vao;
+    this->Stats.Issued++;
+}
+
+void GLStateCache::bindTexture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+    if (unit < kMAX_TEXTURE_UNITS && this->Textures[unit].Target == target && this->Textures[unit].Texture == texture)
+    {
+        this->Stats.Skipped++;
+        return;
+    }
+    if (unit != this->ActiveUnit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        this->ActiveUnit = unit;
+        this->Stats.Issued++;
+    }
+    glBindTexture(target, texture);
+    if (unit < kMAX_TEXTURE_UNITS)
+    {
+        this->Textures[unit].Target = target;
+        this->Textures[unit].Texture = texture;
+    }
+    this->Stats.Issued++;
+}
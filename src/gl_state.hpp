@@ -0,0 +1,58 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+/* Number of state changes issued to the driver and skipped as redundant since the last resetStats(). */
+struct StateChangeStats
+{
+    unsigned int Issued;
+    unsigned int Skipped;
+};
+
+/*
+    A shadow copy of the GL bindings that change between draws.
+    Each bind goes through the cache and only reaches the driver when it changes the bound object.
+    Code that binds these objects directly, such as texture uploads, must be followed by
+    invalidate() so the cache doesn't skip a bind that is needed.
+*/
+class GLStateCache
+{
+public:
+    /* Number of texture units tracked. Binds to higher units are always issued. */
+    static constexpr unsigned int kMAX_TEXTURE_UNITS = 16;
+
+    /* Construct a GLStateCache object that assumes nothing about the current GL state. */
+    GLStateCache();
+    GLStateCache(const GLStateCache&) = delete;
+    GLStateCache& operator=(const GLStateCache&) = delete;
+
+    /* Forget the tracked state, so the next bind of everything is issued. */
+    void invalidate();
+    /* Start counting state changes from zero. */
+    void resetStats();
+
+    /* Make a program current. */
+    void useProgram(unsigned int program);
+    /* Bind a vertex array object. */
+    void bindVertexArray(unsigned int vao);
+    /* Bind a texture to a target of a texture unit, switching the active unit if needed. */
+    void bindTexture(unsigned int unit, unsigned int target, unsigned int texture);
+
+    /* Get the number of state changes since the last resetStats(). */
+    const StateChangeStats& stats() const { return this->Stats; }
+
+private:
+    /* A texture binding of one unit. Only the last target bound on the unit is remembered. */
+    struct TextureBinding
+    {
+        unsigned int Target;
+        unsigned int Texture;
+    };
+
+    unsigned int Program;
+    unsigned int VertexArray;
+    unsigned int ActiveUnit;
+    TextureBinding Textures[kMAX_TEXTURE_UNITS];
+    StateChangeStats Stats;
+};
+
+#endif  // GL_STATE_HPP
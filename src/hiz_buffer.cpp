@@ -0,0 +1,249 @@
+#include "hiz_buffer.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+#include "shader_program.hpp"
+
+constexpr int HiZBuffer::kWIDTH;
+constexpr int HiZBuffer::kHEIGHT;
+constexpr unsigned int HiZBuffer::kREADBACK_LATENCY;
+
+namespace
+{
+    const std::size_t kBASE_LEVEL_SIZE = HiZBuffer::kWIDTH * HiZBuffer::kHEIGHT;
+
+    int levelWidth(std::size_t level) { return std::max(HiZBuffer::kWIDTH >> level, 1); }
+    int levelHeight(std::size_t level) { return std::max(HiZBuffer::kHEIGHT >> level, 1); }
+}
+
+HiZBuffer::HiZBuffer()
+    :   DepthTexture(0),
+        DepthWidth(0),
+        DepthHeight(0),
+        NextReadback(0),
+        OldestReadback(0),
+        ViewProj(1.0f),
+        Valid(false)
+{
+    glGenFramebuffers(1, &this->DepthFramebuffer);
+
+    // base level target, one float per texel
+    glGenTextures(1, &this->ReduceTexture);
+    glBindTexture(GL_TEXTURE_2D, this->ReduceTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, kWIDTH, kHEIGHT, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &this->ReduceFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->ReduceFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->ReduceTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Hi-Z framebuffer is not complete." << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (unsigned int i = 0; i < kREADBACK_LATENCY; i++)
+    {
+        glGenBuffers(1, &this->Readbacks[i].PixelBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->Readbacks[i].PixelBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, kBASE_LEVEL_SIZE * sizeof(float), NULL, GL_STREAM_READ);
+        this->Readbacks[i].Fence = NULL;
+        this->Readbacks[i].ViewProj = glm::mat4(1.0f);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (std::size_t level = 0; levelWidth(level) > 1 || levelHeight(level) > 1; level++)
+        this->Levels.push_back(std::vector<float>(static_cast<std::size_t>(levelWidth(level) * levelHeight(level))));
+    this->Levels.push_back(std::vector<float>(1));
+}
+
+HiZBuffer::~HiZBuffer()
+{
+    for (unsigned int i = 0; i < kREADBACK_LATENCY; i++)
+    {
+        if (this->Readbacks[i].Fence)
+            glDeleteSync(static_cast<GLsync>(this->Readbacks[i].Fence));
+        glDeleteBuffers(1, &this->Readbacks[i].PixelBuffer);
+    }
+    glDeleteFramebuffers(1, &this->ReduceFramebuffer);
+    glDeleteTextures(1, &this->ReduceTexture);
+    glDeleteFramebuffers(1, &this->DepthFramebuffer);
+    glDeleteTextures(1, &this->DepthTexture);
+}
+
+void HiZBuffer::capture(GLStateCache& state, const ShaderProgram& reduce_shader, unsigned int vao, unsigned int framebuffer,
+                        int width, int height, const glm::mat4& view_proj)
+{
+    resizeDepthCopy(width, height);
+
+    // the depth buffer may be a renderbuffer or the window's, so copy it into a texture the shader can read
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->DepthFramebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->ReduceFramebuffer);
+    glViewport(0, 0, kWIDTH, kHEIGHT);
+    glDisable(GL_DEPTH_TEST);
+    state.useProgram(reduce_shader.id());
+    state.bindTexture(0, GL_TEXTURE_2D, this->DepthTexture);
+    state.bindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+
+    // with every slot still in flight, the oldest readback is given up on
+    Readback& readback = this->Readbacks[this->NextReadback];
+    if (readback.Fence)
+    {
+        glDeleteSync(static_cast<GLsync>(readback.Fence));
+        readback.Fence = NULL;
+        this->OldestReadback = (this->OldestReadback + 1) % kREADBACK_LATENCY;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PixelBuffer);
+    glReadPixels(0, 0, kWIDTH, kHEIGHT, GL_RED, GL_FLOAT, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.ViewProj = view_proj;
+    this->NextReadback = (this->NextReadback + 1) % kREADBACK_LATENCY;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+}
+
+void HiZBuffer::collect()
+{
+    // readbacks finish in order, so skip to the newest one that is done
+    Readback* newest = NULL;
+    while (this->Readbacks[this->OldestReadback].Fence)
+    {
+        Readback& readback = this->Readbacks[this->OldestReadback];
+        GLenum status = glClientWaitSync(static_cast<GLsync>(readback.Fence), 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            break;
+        glDeleteSync(static_cast<GLsync>(readback.Fence));
+        readback.Fence = NULL;
+        if (status != GL_WAIT_FAILED)
+            newest = &readback;
+        this->OldestReadback = (this->OldestReadback + 1) % kREADBACK_LATENCY;
+    }
+    if (!newest)
+        return;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, newest->PixelBuffer);
+    const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, kBASE_LEVEL_SIZE * sizeof(float), GL_MAP_READ_BIT);
+    if (data)
+    {
+        std::memcpy(this->Levels[0].data(), data, kBASE_LEVEL_SIZE * sizeof(float));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!data)
+        return;
+    this->ViewProj = newest->ViewProj;
+    buildPyramid();
+    this->Valid = true;
+}
+
+bool HiZBuffer::isOccluded(const Bounds& box) const
+{
+    if (!this->Valid)
+        return false;
+
+    // screen rectangle and nearest depth of the box, in normalised device coordinates
+    float min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX;
+    float max_x = -FLT_MAX, max_y = -FLT_MAX;
+    for (unsigned int corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 point((corner & 1) ? box.Max.x : box.Min.x,
+                        (corner & 2) ? box.Max.y : box.Min.y,
+                        (corner & 4) ? box.Max.z : box.Min.z, 1.0f);
+        glm::vec4 clip = this->ViewProj * point;
+        // a corner in front of the near plane could be anywhere on screen
+        if (clip.w <= 0.0f || clip.z < -clip.w)
+            return false;
+        float x = clip.x / clip.w, y = clip.y / clip.w, z = clip.z / clip.w;
+        min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+        min_z = std::min(min_z, z);
+    }
+    if (max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f)
+        return false;
+
+    // base level texels under the rectangle
+    int x0 = std::max(static_cast<int>((min_x * 0.5f + 0.5f) * kWIDTH), 0);
+    int x1 = std::min(static_cast<int>((max_x * 0.5f + 0.5f) * kWIDTH), kWIDTH - 1);
+    int y0 = std::max(static_cast<int>((min_y * 0.5f + 0.5f) * kHEIGHT), 0);
+    int y1 = std::min(static_cast<int>((max_y * 0.5f + 0.5f) * kHEIGHT), kHEIGHT - 1);
+    // go up the pyramid until the rectangle covers at most two texels each way
+    std::size_t level = 0;
+    while (level + 1 < this->Levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        level++;
+
+    int width = levelWidth(level);
+    int height = levelHeight(level);
+    const std::vector<float>& depths = this->Levels[level];
+    float max_depth = 0.0f;
+    for (int y = std::min(y0 >> level, height - 1); y <= std::min(y1 >> level, height - 1); y++)
+    {
+        for (int x = std::min(x0 >> level, width - 1); x <= std::min(x1 >> level, width - 1); x++)
+            max_depth = std::max(max_depth, depths[y * width + x]);
+    }
+    // hidden if even the nearest point of the box is behind the farthest depth it could be seen through
+    return min_z * 0.5f + 0.5f > max_depth;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void HiZBuffer::resizeDepthCopy(int width, int height)
+{
+    if (width == this->DepthWidth && height == this->DepthHeight)
+        return;
+    this->DepthWidth = width;
+    this->DepthHeight = height;
+
+    // the same format as the frame's depth buffer, which blitting requires
+    glDeleteTextures(1, &this->DepthTexture);
+    glGenTextures(1, &this->DepthTexture);
+    glBindTexture(GL_TEXTURE_2D, this->DepthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->DepthFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, this->DepthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Hi-Z depth framebuffer is not complete." << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void HiZBuffer::buildPyramid()
+{
+    for (std::size_t level = 1; level < this->Levels.size(); level++)
+    {
+        const std::vector<float>& below = this->Levels[level - 1];
+        std::vector<float>& depths = this->Levels[level];
+        int below_width = levelWidth(level - 1);
+        int below_height = levelHeight(level - 1);
+        int width = levelWidth(level);
+        int height = levelHeight(level);
+        for (int y = 0; y < height; y++)
+        {
+            int y0 = std::min(2 * y, below_height - 1);
+            int y1 = std::min(2 * y + 1, below_height - 1);
+            for (int x = 0; x < width; x++)
+            {
+                int x0 = std::min(2 * x, below_width - 1);
+                int x1 = std::min(2 * x + 1, below_width - 1);
+                depths[y * width + x] = std::max(std::max(below[y0 * below_width + x0], below[y0 * below_width + x1]),
+                                                 std::max(below[y1 * below_width + x0], below[y1 * below_width + x1]));
+            }
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef HIZ_BUFFER_HPP
+#define HIZ_BUFFER_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+
+class GLStateCache;
+class ShaderProgram;
+
+/*
+    A hierarchical-Z pyramid of an earlier frame's depth buffer, used to skip objects hidden behind
+    others before they are drawn.
+    The GPU reduces the depth buffer to a small base level where each texel holds the farthest depth
+    of the pixels it covers. The base level is read back without stalling, kREADBACK_LATENCY frames
+    at most, and the rest of the pyramid is built from it on the CPU. Objects are tested with the
+    view of the frame the depth came from, so an object uncovered by a fast camera move can be
+    missing for the frame or two until a newer pyramid arrives.
+*/
+class HiZBuffer
+{
+public:
+    /* Size of the base level of the pyramid. Keep in sync with shaders/hiz_reduce.frag. */
+    static constexpr int kWIDTH = 256;
+    static constexpr int kHEIGHT = 128;
+    /* Number of readbacks that can be in flight at once. */
+    static constexpr unsigned int kREADBACK_LATENCY = 3;
+
+    /* Construct a HiZBuffer object with no pyramid yet. The GL context must be current. */
+    HiZBuffer();
+    ~HiZBuffer();
+    HiZBuffer(const HiZBuffer&) = delete;
+    HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+    /*
+        Reduce the depth buffer of a framebuffer and start reading the result back.
+        Call once the frame's opaque draws are done. The reduce shader reads the depth from texture
+        unit 0 and is drawn as a full screen triangle with the given vertex array. The framebuffer
+        and a viewport of the frame's size are bound again afterwards.
+    */
+    void capture(GLStateCache& state, const ShaderProgram& reduce_shader, unsigned int vao, unsigned int framebuffer,
+                 int width, int height, const glm::mat4& view_proj);
+    /*
+        Build the pyramid from the newest readback that has finished, without waiting for any.
+        Call on the GL thread while no occlusion tests are running.
+    */
+    void collect();
+    /* Forget the pyramid, such as when the camera jumps, so nothing is culled until the next one arrives. */
+    void invalidate() { this->Valid = false; }
+    /* Check if a pyramid is available. */
+    bool isValid() const { return this->Valid; }
+    /*
+        Check if a world space box is certainly hidden behind the captured depth.
+        Boxes that cross the near plane or leave the screen are never reported hidden.
+        Only reads the pyramid, so any number of threads can test at once.
+    */
+    bool isOccluded(const Bounds& box) const;
+
+private:
+    struct Readback
+    {
+        unsigned int PixelBuffer;
+        /* GLsync object signalled when the readback has finished, or NULL if the slot is free. */
+        void* Fence;
+        glm::mat4 ViewProj;
+    };
+
+    /* Make the full resolution depth copy match the size of the frame. */
+    void resizeDepthCopy(int width, int height);
+    /* Build every level above the base level, each texel keeping the farthest of the four below it. */
+    void buildPyramid();
+
+private:
+    /* Hold the IDs of the objects used by OpenGL */
+    unsigned int DepthFramebuffer;
+    unsigned int DepthTexture;
+    unsigned int ReduceFramebuffer;
+    unsigned int ReduceTexture;
+    int DepthWidth;
+    int DepthHeight;
+
+    Readback Readbacks[kREADBACK_LATENCY];
+    /* Next readback slot to fill, and the oldest one still pending. */
+    unsigned int NextReadback;
+    unsigned int OldestReadback;
+
+    /* Farthest depth of each texel, level 0 first, each level half the size of the one before. */
+    std::vector<std::vector<float>> Levels;
+    /* View-projection of the frame the pyramid was captured from. */
+    glm::mat4 ViewProj;
+    bool Valid;
+};
+
+#endif  // HIZ_BUFFER_HPP
@@ -0,0 +1,90 @@
+#include "instance_buffer.hpp"
+
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "stream_buffer.hpp"
+
+constexpr unsigned int InstanceBuffer::kMODEL_ATTRIBUTE;
+constexpr unsigned int InstanceBuffer::kNORMAL_MATRIX_ATTRIBUTE;
+constexpr unsigned int InstanceBuffer::kMATERIAL_LAYERS_ATTRIBUTE;
+
+namespace
+{
+    // the attributes only need float alignment, but 16 keeps the copies into mapped memory aligned
+    const std::size_t kINSTANCE_ALIGNMENT = 16;
+}
+
+InstanceData makeInstanceData(const glm::mat4& model)
+{
+    InstanceData instance;
+    instance.Model = model;
+    instance.NormalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    instance.MaterialLayers = glm::vec2(-1.0f);
+    return instance;
+}
+
+InstanceBuffer::InstanceBuffer(StreamBuffer& stream)
+    :   Stream(stream),
+        Offset(0),
+        Count(0)
+{
+}
+
+void InstanceBuffer::attach(unsigned int vao)
+{
+    this->VertexArrays.push_back(vao);
+    glBindVertexArray(vao);
+    for (unsigned int location = kMODEL_ATTRIBUTE; location <= kMATERIAL_LAYERS_ATTRIBUTE; location++)
+    {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    glBindVertexArray(0);
+    pointAttributes(vao, this->Offset);
+}
+
+void InstanceBuffer::upload(const InstanceData* instances, std::size_t count)
+{
+    this->Count = 0;
+    if (count == 0)
+        return;
+    StreamAllocation allocation = this->Stream.allocate(count * sizeof(InstanceData), kINSTANCE_ALIGNMENT);
+    if (!allocation.Data)
+        return;
+    std::memcpy(allocation.Data, instances, count * sizeof(InstanceData));
+    // the attribute offsets are part of the vertex array state, so they only change when the data moves
+    if (allocation.Offset != this->Offset)
+    {
+        for (std::size_t i = 0; i < this->VertexArrays.size(); i++)
+            pointAttributes(this->VertexArrays[i], allocation.Offset);
+        this->Offset = allocation.Offset;
+    }
+    this->Count = count;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void InstanceBuffer::pointAttributes(unsigned int vao, std::size_t offset)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, this->Stream.id());
+
+    // a mat4 attribute takes one location per column
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        std::size_t column_offset = offset + offsetof(InstanceData, Model) + column * sizeof(glm::vec4);
+        glVertexAttribPointer(kMODEL_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)column_offset);
+    }
+    for (unsigned int column = 0; column < 3; column++)
+    {
+        std::size_t column_offset = offset + offsetof(InstanceData, NormalMatrix) + column * sizeof(glm::vec3);
+        glVertexAttribPointer(kNORMAL_MATRIX_ATTRIBUTE + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)column_offset);
+    }
+    std::size_t layers_offset = offset + offsetof(InstanceData, MaterialLayers);
+    glVertexAttribPointer(kMATERIAL_LAYERS_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)layers_offset);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
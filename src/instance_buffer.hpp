@@ -0,0 +1,71 @@
+#ifndef INSTANCE_BUFFER_HPP
+#define INSTANCE_BUFFER_HPP
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+class StreamBuffer;
+
+/*
+    Per-instance vertex data for instanced draws.
+    The normal matrix is computed once on the CPU so the vertex shader doesn't have to invert the
+    model matrix for every vertex.
+*/
+struct InstanceData
+{
+    glm::mat4 Model;
+    glm::mat3 NormalMatrix;
+    /* Texture array layers of the instance's diffuse and specular maps, negative for the placeholder. */
+    glm::vec2 MaterialLayers;
+};
+
+/* Build the instance data for a model matrix, including its normal matrix, with no material. */
+InstanceData makeInstanceData(const glm::mat4& model);
+
+/*
+    Per-instance data that is rewritten every frame.
+    The instances are written straight into the current frame's region of a StreamBuffer, and the
+    attributes of the attached vertex arrays are pointed at wherever they were written.
+*/
+class InstanceBuffer
+{
+public:
+    /* Vertex attribute locations used by the per-instance data in every instanced shader. */
+    static constexpr unsigned int kMODEL_ATTRIBUTE          = 3;    // 4 locations, one per column
+    static constexpr unsigned int kNORMAL_MATRIX_ATTRIBUTE  = 7;    // 3 locations, one per column
+    static constexpr unsigned int kMATERIAL_LAYERS_ATTRIBUTE = 10;
+
+    /* Construct an empty InstanceBuffer object that allocates from a stream buffer. */
+    explicit InstanceBuffer(StreamBuffer& stream);
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    /*
+        Add the per-instance attributes to a vertex array object.
+        The attributes advance once per instance, so the VAO can then be drawn with
+        glDrawArraysInstanced / glDrawElementsInstanced.
+    */
+    void attach(unsigned int vao);
+    /*
+        Write this frame's instances into the stream buffer. Binds the attached vertex arrays if the
+        instances moved within the buffer. Must be called between the stream's beginFrame() and commit().
+    */
+    void upload(const InstanceData* instances, std::size_t count);
+    /* Get the number of instances last uploaded. */
+    std::size_t count() const { return this->Count; }
+
+private:
+    /* Point the instance attributes of a vertex array at an offset of the stream buffer. */
+    void pointAttributes(unsigned int vao, std::size_t offset);
+
+private:
+    StreamBuffer& Stream;
+    std::vector<unsigned int> VertexArrays;
+    /* Offset in the stream buffer the attributes currently read from. */
+    std::size_t Offset;
+    /* Number of instances last uploaded. */
+    std::size_t Count;
+};
+
+#endif  // INSTANCE_BUFFER_HPP
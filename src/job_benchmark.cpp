@@ -0,0 +1,108 @@
+#include "job_benchmark.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace
+{
+    const unsigned int kREPEATS = 5;
+    const unsigned int kEMPTY_JOBS = 100000;
+    const unsigned int kCHAIN_LENGTH = 1000;
+    const std::size_t kWORK_ITEMS = 1 << 22;
+    const std::size_t kWORK_GRAIN = 1 << 14;
+    const unsigned int kWORK_ROUNDS = 8;
+
+    typedef std::chrono::steady_clock Clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    /* Run a measurement a few times and keep the median, so one descheduled run doesn't skew it. */
+    template <typename Fn>
+    double median(Fn measure)
+    {
+        std::vector<double> samples;
+        for (unsigned int i = 0; i < kREPEATS; i++)
+            samples.push_back(measure());
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    /* Nanoseconds to create, queue and finish one empty child job. */
+    double measureEmptyJobs(ThreadPool& pool)
+    {
+        Clock::time_point start = Clock::now();
+        ThreadPool::Job* root = pool.createJob(std::function<void()>());
+        for (unsigned int i = 0; i < kEMPTY_JOBS; i++)
+            pool.run(pool.createJob(std::function<void()>(), root));
+        pool.run(root);
+        pool.wait(root);
+        return millisecondsSince(start) * 1.0e6 / kEMPTY_JOBS;
+    }
+
+    /* Nanoseconds from one job finishing to its continuation finishing. */
+    double measureChain(ThreadPool& pool)
+    {
+        std::atomic<unsigned int> steps(0);
+        std::function<void()> step = [&steps]() { steps++; };
+        std::vector<ThreadPool::Job*> chain;
+        for (unsigned int i = 0; i < kCHAIN_LENGTH; i++)
+        {
+            chain.push_back(pool.createJob(step));
+            if (i > 0)
+                pool.addContinuation(chain[i - 1], chain[i]);
+        }
+        Clock::time_point start = Clock::now();
+        pool.run(chain.front());
+        pool.wait(chain.back());
+        return millisecondsSince(start) * 1.0e6 / kCHAIN_LENGTH;
+    }
+
+    /* Milliseconds for a parallelFor over a fixed amount of arithmetic. */
+    double measureParallelFor(ThreadPool& pool, std::vector<float>& values)
+    {
+        Clock::time_point start = Clock::now();
+        pool.parallelFor(values.size(), kWORK_GRAIN, [&values](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                float value = values[i];
+                for (unsigned int round = 0; round < kWORK_ROUNDS; round++)
+                    value = std::sqrt(value * 1.0001f + 1.0f);
+                values[i] = value;
+            }
+        });
+        return millisecondsSince(start);
+    }
+}
+
+void runJobBenchmarks(unsigned int max_threads)
+{
+    if (max_threads == 0)
+        max_threads = 1;
+    std::vector<float> values(kWORK_ITEMS, 1.0f);
+
+    std::printf("%u empty jobs, chain of %u, parallel for over %zu items, median of %u runs\n",
+                kEMPTY_JOBS, kCHAIN_LENGTH, kWORK_ITEMS, kREPEATS);
+    std::printf("threads  empty job ns  chain step ns  parallel for ms  speedup\n");
+    double single_thread_time = 0.0;
+    for (unsigned int threads = 1; threads <= max_threads; threads++)
+    {
+        // the calling thread is one of the threads doing the work
+        ThreadPool pool(threads - 1);
+        double empty_job = median([&pool]() { return measureEmptyJobs(pool); });
+        double chain_step = median([&pool]() { return measureChain(pool); });
+        double parallel_for = median([&pool, &values]() { return measureParallelFor(pool, values); });
+        if (threads == 1)
+            single_thread_time = parallel_for;
+        std::printf("%7u  %12.1f  %13.1f  %15.3f  %7.2f\n", threads, empty_job, chain_step, parallel_for,
+                    single_thread_time / parallel_for);
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef JOB_BENCHMARK_HPP
+#define JOB_BENCHMARK_HPP
+
+/*
+    Measure the job system with 1 to max_threads threads and print the results: the cost of
+    scheduling an empty job, the latency of each step of a chain of continuations, and the time and
+    speedup of a parallelFor over a fixed amount of work.
+*/
+void runJobBenchmarks(unsigned int max_threads);
+
+#endif  // JOB_BENCHMARK_HPP
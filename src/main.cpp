@@ -1,15 +1,44 @@
 // std library stuff
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include <stbi/stb_image.h>
 
-#include "shader_program.hpp"
+#include "benchmark.hpp"
+#include "bvh.hpp"
 #include "camera.hpp"
+#include "camera_path.hpp"
+#include "dynamic_resolution.hpp"
+#include "framebuffer.hpp"
+#include "frustum.hpp"
+#include "job_benchmark.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "renderer.hpp"
+#include "simulation.hpp"
+#include "thread_pool.hpp"
 
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
+// frames rendered by --bench when no count is given
+#define BENCH_FRAMES 600
+#define BENCH_WARMUP_FRAMES 60
+// upper limit on how long --bench waits for textures to finish streaming in
+#define BENCH_LOAD_TIMEOUT 30.0
+// objects culled by --cull-bench when no count is given, spread through a cube of space this far from the origin
+#define CULL_BENCH_OBJECTS 1000000
+#define CULL_BENCH_EXTENT 500.0f
+#define CULL_BENCH_FAR_PLANE 300.0f
+// seconds between updates of the profiler summary in the window title
+#define PROFILER_TITLE_INTERVAL 0.5
 
 // ---------------------------- Globals ----------------------------
 
@@ -19,26 +48,111 @@ static Camera camera;
 static bool grabbed_mouse = false;
 static float mouse_last_x = 400.0f;
 static float mouse_last_y = 300.0f;
-// time between current frame and last frame
-static float delta_time;
-// time of the last frame
-static float last_frame_time;
+// steps the camera from the input queued by the callbacks, while the interactive loop is running
+static Simulation* simulation = NULL;
+// current size of the framebuffer in pixels
+static int framebuffer_width = WINDOW_WIDTH;
+static int framebuffer_height = WINDOW_HEIGHT;
+// light the scene with the deferred path instead of the forward one, toggled with tab
+static bool deferred_shading = false;
+
+// Options from the command line.
+struct Options
+{
+    // run the benchmark instead of the interactive window
+    bool Benchmark = false;
+    // time frustum culling of a large random scene on the CPU, without creating a window
+    bool CullBenchmark = false;
+    // measure the job system's scheduling overhead and scaling, without creating a window
+    bool JobBenchmark = false;
+    // most threads the job benchmark scales up to; every hardware thread if 0
+    unsigned int Threads = 0;
+    // create the context through EGL, which works without a display on Mesa
+    bool UseEGL = false;
+    // start with the deferred shading path instead of the forward one
+    bool Deferred = false;
+    // fill the depth buffer before shading, and cull objects hidden behind an earlier frame's depth
+    bool DepthPrepass = false;
+    bool Occlusion = false;
+    // how mesh vertices are stored on the GPU
+    VertexFormat Vertices = kVERTEX_FORMAT_COMPACT;
+    // scale the resolution to hold this GPU frame time in milliseconds, or render at full resolution if 0
+    double TargetFrameTime = 0.0;
+    float MinScale = 0.5f;
+    // bytes of texture arrays the materials may allocate
+    std::size_t TextureBudget = MaterialLibrary::kDEFAULT_BUDGET;
+    // bytes of streamed mesh buffers kept on the GPU
+    std::size_t MeshBudget = AssetStreamer::kDEFAULT_BUDGET;
+    unsigned int Frames = BENCH_FRAMES;
+    unsigned int WarmupFrames = BENCH_WARMUP_FRAMES;
+    unsigned int Objects = CULL_BENCH_OBJECTS;
+    int Width = WINDOW_WIDTH;
+    int Height = WINDOW_HEIGHT;
+    // camera path played back by the benchmark; a scripted orbit if empty
+    std::string CameraPathFile;
+    // where the benchmark writes its results, as .json or .csv
+    std::string OutputFile;
+    // where the interactive camera path is recorded to
+    std::string RecordFile;
+    // where a Chrome trace of the run is written to
+    std::string TraceFile;
+};
 
 // ---------------------------- Forward Declarations ----------------------------
 
 void resizeViewportCallback(GLFWwindow* window, int width, int height);
 void mouseMovementCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
-void processKeyboardInput(GLFWwindow* window);
-unsigned int loadTexture(const char* path);
-
-int main()
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void queueInput(InputEvent::Type type, Camera::CameraMovement movement, float x, float y);
+bool parseOptions(int argc, char** argv, Options& options);
+int run(GLFWwindow* window, const Options& options);
+int runBenchmark(const Options& options);
+int runCullingBenchmark(const Options& options);
+void writeTrace(const Options& options);
+
+int main(int argc, char** argv)
 {
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cout << "usage: Engine [--record path.txt] [--trace trace.json] [--deferred] [--depth-prepass] [--occlusion]\n"
+                     "              [--vertex-format float|compact] [--dynamic-resolution ms] [--min-scale F]\n"
+                     "              [--texture-budget MB] [--mesh-budget MB]\n"
+                     "       Engine --bench [--frames N] [--warmup N] [--size WxH] [--path path.txt] [--deferred]\n"
+                     "                      [--depth-prepass] [--occlusion] [--vertex-format float|compact]\n"
+                     "                      [--dynamic-resolution ms] [--min-scale F] [--texture-budget MB]\n"
+                     "                      [--mesh-budget MB]\n"
+                     "                      [--output results.json|results.csv] [--trace trace.json] [--egl]\n"
+                     "       Engine --cull-bench [--objects N] [--frames N] [--warmup N] [--size WxH]\n"
+                     "       Engine --job-bench [--threads N]" << std::endl;
+        return -1;
+    }
+    if (options.CullBenchmark)
+        return runCullingBenchmark(options);
+    if (options.JobBenchmark)
+    {
+        runJobBenchmarks(options.Threads > 0 ? options.Threads : std::thread::hardware_concurrency());
+        return 0;
+    }
+
     // ---------------------------- GLFW Instantiation ----------------------------
+#ifdef GLFW_PLATFORM_NULL
+    // without a display server the null platform can still create an EGL context
+    if (options.UseEGL)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (options.Benchmark)
+    {
+        // the benchmark renders offscreen, so the window is only there to own the context
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+    if (options.UseEGL)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
 
     GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Engine", NULL, NULL);
     if (!window)
@@ -60,257 +174,344 @@ int main()
     glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
     glfwSetFramebufferSizeCallback(window, resizeViewportCallback);
 
-    // ---------------------------- Shader Program Setup ----------------------------
-    ShaderProgram lightingShader("../../shaders/lighting.vert", "../../shaders/lighting.frag");
-    ShaderProgram lampShader("../../shaders/lamp.vert", "../../shaders/lamp.frag");
+    // GL objects are owned by run() so they are released before the context goes away
+    int result = options.Benchmark ? runBenchmark(options) : run(window, options);
+
+    glfwTerminate();
+    return result;
+}
+
+/* Set up the scene and run the interactive frame loop until the window is closed. */
+int run(GLFWwindow* window, const Options& options)
+{
+    // ---------------------------- Scene Setup ----------------------------
+    // Worker threads for texture decoding and per-frame CPU work such as binning lights into clusters.
+    ThreadPool threadPool;
+    Renderer renderer(threadPool, options.Vertices);
+    if (!renderer.isLoaded())
+        return -1;
 
     // ---------------------------- Camera Setup ----------------------------
     camera = Camera();
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouseMovementCallback);
     glfwSetScrollCallback(window, scrollCallback);
-    // ---------------------------- OpenGL Buffers Setup ----------------------------
-    // TODO(iain): tidy all this up into a model class when we introduce model loading
-
-    // cube
-    float vertices[] = {
-        // positions          // normals           // texture coords
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 0.0f,
-
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f
-    };
-
-    glm::vec3 cubePositions[] = {
-        glm::vec3(0.0f,  0.0f,  0.0f),
-        glm::vec3(2.0f,  5.0f, -15.0f),
-        glm::vec3(-1.5f, -2.2f, -2.5f),
-        glm::vec3(-3.8f, -2.0f, -12.3f),
-        glm::vec3(2.4f, -0.4f, -3.5f),
-        glm::vec3(-1.7f,  3.0f, -7.5f),
-        glm::vec3(1.3f, -2.0f, -2.5f),
-        glm::vec3(1.5f,  2.0f, -2.5f),
-        glm::vec3(1.5f,  0.2f, -1.5f),
-        glm::vec3(-1.3f,  1.0f, -1.5f)
-    };
-
-    glm::vec3 pointLightPositions[] = {
-        glm::vec3(0.7f,  0.2f,  2.0f),
-        glm::vec3(2.3f, -3.3f, -4.0f),
-        glm::vec3(-4.0f,  2.0f, -12.0f),
-        glm::vec3(0.0f,  0.0f, -3.0f)
-    };
-
-
-    // Buffer objects
-
-    // cube
-    unsigned int VAO, VBO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-    // light source
-    unsigned int lightVAO;
-    glGenVertexArrays(1, &lightVAO);
-    glBindVertexArray(lightVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO); // already contains the data
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // ---------------------------- Textures Setup ----------------------------
-
-    unsigned int diffuseMap = loadTexture("../../textures/box.png");
-    unsigned int specularMap = loadTexture("../../textures/box_specular.png");
-
-    // Tell openGL to test depth so it knows when something is behind something else.
-    glEnable(GL_DEPTH_TEST);
+    glfwSetKeyCallback(window, keyCallback);
+    deferred_shading = options.Deferred;
+    renderer.setDepthPrepass(options.DepthPrepass);
+    renderer.setOcclusionCulling(options.Occlusion);
+    renderer.setTextureBudget(options.TextureBudget);
+    renderer.setMeshBudget(options.MeshBudget);
+    DynamicResolution resolution;
+    resolution.setEnabled(options.TargetFrameTime > 0.0);
+    if (resolution.isEnabled())
+        resolution.setTargetFrameTime(options.TargetFrameTime);
+    resolution.setScaleBounds(options.MinScale, 1.0f);
+    // the camera path can be recorded and played back later by the benchmark
+    CameraPath recording;
+    float record_start_time = static_cast<float>(glfwGetTime());
+    // input moves the simulated camera on its own thread, and each frame draws it interpolated between ticks
+    Simulation camera_simulation(camera);
+    simulation = &camera_simulation;
+    camera_simulation.start();
+    // time from an input event to the end of the swap of the first frame that shows it, in milliseconds
+    std::vector<double> input_latencies;
+
+#if ENGINE_PROFILER
+    if (!options.TraceFile.empty())
+        Profiler::instance().startCapture();
+    double title_update_time = 0.0;
+#endif
 
     // ---------------------------- Loop Begin ----------------------------
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_BEGIN_FRAME();
         float current_frame_time = static_cast<float>(glfwGetTime());
-        delta_time = current_frame_time - last_frame_time;
-        last_frame_time = current_frame_time;
-
-        // Rendering Commands
-        glClearColor(0.01f, 0.01f, 0.01f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // TODO(iain): this needs to be cleaned up badly
-
-        // Lights
-        lightingShader.use();
-        lightingShader.setUniformVec3("viewPos", camera.Position);
-        lightingShader.setUniformFloat("material.shininess", 32.0f);
-        // directional light
-        lightingShader.setUniformVec3("dirLight.direction", glm::vec3(-0.2f, -1.0f, -0.3f));
-        lightingShader.setUniformVec3("dirLight.ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        lightingShader.setUniformVec3("dirLight.diffuse", glm::vec3(0.4f, 0.4f, 0.4f));
-        lightingShader.setUniformVec3("dirLight.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        // point light 0
-        lightingShader.setUniformVec3("pointLights[0].position", pointLightPositions[0]);
-        lightingShader.setUniformVec3("pointLights[0].ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        lightingShader.setUniformVec3("pointLights[0].diffuse", glm::vec3(0.8f, 0.8f, 0.8f));
-        lightingShader.setUniformVec3("pointLights[0].specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        lightingShader.setUniformFloat("pointLights[0].constant", 1.0f);
-        lightingShader.setUniformFloat("pointLights[0].linear", 0.09f);
-        lightingShader.setUniformFloat("pointLights[0].quadratic", 0.032f);
-        // point light 1
-        lightingShader.setUniformVec3("pointLights[1].position", pointLightPositions[1]);
-        lightingShader.setUniformVec3("pointLights[1].ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        lightingShader.setUniformVec3("pointLights[1].diffuse", glm::vec3(0.8f, 0.8f, 0.8f));
-        lightingShader.setUniformVec3("pointLights[1].specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        lightingShader.setUniformFloat("pointLights[1].constant", 1.0f);
-        lightingShader.setUniformFloat("pointLights[1].linear", 0.09f);
-        lightingShader.setUniformFloat("pointLights[1].quadratic", 0.032f);
-        // point light 2
-        lightingShader.setUniformVec3("pointLights[2].position", pointLightPositions[2]);
-        lightingShader.setUniformVec3("pointLights[2].ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        lightingShader.setUniformVec3("pointLights[2].diffuse", glm::vec3(0.8f, 0.8f, 0.8f));
-        lightingShader.setUniformVec3("pointLights[2].specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        lightingShader.setUniformFloat("pointLights[2].constant", 1.0f);
-        lightingShader.setUniformFloat("pointLights[2].linear", 0.09f);
-        lightingShader.setUniformFloat("pointLights[2].quadratic", 0.032f);
-        // point light 3
-        lightingShader.setUniformVec3("pointLights[3].position", pointLightPositions[3]);
-        lightingShader.setUniformVec3("pointLights[3].ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        lightingShader.setUniformVec3("pointLights[3].diffuse", glm::vec3(0.8f, 0.8f, 0.8f));
-        lightingShader.setUniformVec3("pointLights[3].specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        lightingShader.setUniformFloat("pointLights[3].constant", 1.0f);
-        lightingShader.setUniformFloat("pointLights[3].linear", 0.09f);
-        lightingShader.setUniformFloat("pointLights[3].quadratic", 0.032f);
-        // spot light
-        lightingShader.setUniformVec3("spotLight.position", camera.Position);
-        lightingShader.setUniformVec3("spotLight.direction", camera.Front);
-        lightingShader.setUniformVec3("spotLight.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        lightingShader.setUniformVec3("spotLight.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
-        lightingShader.setUniformVec3("spotLight.specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        lightingShader.setUniformFloat("spotLight.constant", 1.0f);
-        lightingShader.setUniformFloat("spotLight.linear", 0.09f);
-        lightingShader.setUniformFloat("spotLight.quadratic", 0.032f);
-        lightingShader.setUniformFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-        lightingShader.setUniformFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-
-        // view/projection transforms
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 proj = glm::perspective(glm::radians(camera.FoV), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f);
-        lightingShader.setUniformMat4("proj", proj);
-        lightingShader.setUniformMat4("view", view);
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        lightingShader.setUniformMat4("model", model);
-
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-
-        // render containers
-        glBindVertexArray(VAO);
-        for (unsigned int i = 0; i < 10; i++)
+        double input_time = camera_simulation.interpolate(Simulation::now(), camera);
+
+        renderer.setShadingPath(deferred_shading ? Renderer::kSHADING_DEFERRED : Renderer::kSHADING_FORWARD);
+        int render_width = 0, render_height = 0;
+        resolution.beginFrame(framebuffer_width, framebuffer_height, render_width, render_height);
+        renderer.render(camera, render_width, render_height);
+        resolution.endFrame(0);
+        if (!options.RecordFile.empty())
+            recording.addKey(current_frame_time - record_start_time, camera);
+
+        {
+            PROFILE_SCOPE("swap buffers");
+            glfwSwapBuffers(window);
+        }
+        // the end of the swap is as close to the photons leaving the screen as can be seen from here
+        if (input_time > 0.0)
+            input_latencies.push_back((Simulation::now() - input_time) * 1000.0);
+        glfwPollEvents();
+        PROFILE_END_FRAME();
+        // every frame job has been waited on, so nothing still points into the frame arenas
+        MemorySystem::instance().endFrame();
+
+#if ENGINE_PROFILER
+        // there is no text rendering yet, so the summary goes in the window title
+        if (current_frame_time - title_update_time > PROFILER_TITLE_INTERVAL)
         {
-            // calculate model matrix
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            lightingShader.setUniformMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            const CullStats& cull_stats = renderer.cullStats();
+            const StateChangeStats& state_stats = renderer.stateChangeStats();
+            std::string title = std::string("Engine | ") + (deferred_shading ? "deferred" : "forward") + " | "
+                              + std::to_string(cull_stats.Visible) + "/" + std::to_string(cull_stats.Objects)
+                              + " visible | " + std::to_string(state_stats.Issued) + " state changes, "
+                              + std::to_string(state_stats.Skipped) + " skipped | "
+                              + (input_latencies.empty() ? std::string() : "input " + std::to_string(static_cast<int>(input_latencies.back())) + " ms | ")
+                              + (resolution.isEnabled() ? std::to_string(static_cast<int>(resolution.scale() * 100.0f + 0.5f)) + "% resolution | " : std::string())
+                              + Profiler::instance().summary();
+            glfwSetWindowTitle(window, title.c_str());
+            title_update_time = current_frame_time;
         }
+#endif
+    }
+    // ---------------------------- Loop End----------------------------
+
+    // ---------------------------- Finish and Clean Up ----------------------------
+
+    camera_simulation.stop();
+    simulation = NULL;
+    if (!input_latencies.empty())
+    {
+        FrameTimeSummary latency = summariseFrameTimes(input_latencies);
+        std::printf("                  mean      p50      p95      p99      max\n");
+        std::printf("input latency ms %8.2f %8.2f %8.2f %8.2f %8.2f\n", latency.Mean, latency.P50, latency.P95,
+                    latency.P99, latency.Max);
+    }
+    if (!options.RecordFile.empty() && !recording.save(options.RecordFile.c_str()))
+        std::cerr << "Failed to save camera path: " << options.RecordFile << std::endl;
+    writeTrace(options);
+
+    // buffers and vertex arrays are released by the objects that own them
+    return 0;
+}
 
-        // also draw the lamp objects
-        lampShader.use();
-        lampShader.setUniformVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
-        lampShader.setUniformMat4("proj", proj);
-        lampShader.setUniformMat4("view", view);
-        // draw as many as there are point lights
-        glBindVertexArray(lightVAO);
-        for (unsigned int i = 0; i < 4; i++)
+/*
+    Render the scene offscreen along a camera path for a fixed number of frames and report the
+    CPU and GPU frame times. Every run renders exactly the same frames, so results can be compared.
+*/
+int runBenchmark(const Options& options)
+{
+    // ---------------------------- Scene Setup ----------------------------
+    ThreadPool threadPool;
+    Renderer renderer(threadPool, options.Vertices);
+    if (!renderer.isLoaded())
+        return -1;
+    renderer.setShadingPath(options.Deferred ? Renderer::kSHADING_DEFERRED : Renderer::kSHADING_FORWARD);
+    renderer.setDepthPrepass(options.DepthPrepass);
+    renderer.setOcclusionCulling(options.Occlusion);
+    renderer.setTextureBudget(options.TextureBudget);
+    renderer.setMeshBudget(options.MeshBudget);
+    Framebuffer target(options.Width, options.Height);
+    DynamicResolution resolution;
+    resolution.setEnabled(options.TargetFrameTime > 0.0);
+    if (resolution.isEnabled())
+        resolution.setTargetFrameTime(options.TargetFrameTime);
+    resolution.setScaleBounds(options.MinScale, 1.0f);
+    if (!target.isComplete())
+        return -1;
+    // don't let vsync hide the real frame time
+    glfwSwapInterval(0);
+
+    CameraPath path;
+    BenchmarkInfo info;
+    info.Renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    info.Shading = options.Deferred ? "deferred" : "forward";
+    info.Vertices = getVertexFormatName(renderer.vertexFormat());
+    info.VertexStride = getVertexLayout(renderer.vertexFormat()).Stride;
+    info.DepthPrepass = options.DepthPrepass;
+    info.OcclusionCulling = options.Occlusion;
+    info.TargetFrameTime = options.TargetFrameTime;
+    info.Width = options.Width;
+    info.Height = options.Height;
+    info.WarmupFrames = options.WarmupFrames;
+    info.SceneObjects = 0;
+    if (!options.CameraPathFile.empty())
+    {
+        if (!path.load(options.CameraPathFile.c_str()))
         {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f));
-            lampShader.setUniformMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            std::cerr << "Failed to load camera path: " << options.CameraPathFile << std::endl;
+            return -1;
         }
+        info.CameraPath = options.CameraPathFile;
+    }
+    else
+    {
+        // circle the cubes, looking at the middle of the group
+        path = CameraPath::makeOrbit(glm::vec3(0.0f, 0.0f, -6.0f), 10.0f, 3.0f, 20.0f, 64);
+        info.CameraPath = "orbit";
+    }
+
+    // every measured frame should draw the final meshes and textures, not placeholders
+    target.bind();
+    double load_start_time = glfwGetTime();
+    while ((renderer.pendingTextureCount() > 0 || renderer.pendingAssetCount() > 0) && glfwGetTime() - load_start_time < BENCH_LOAD_TIMEOUT)
+    {
+        PROFILE_BEGIN_FRAME();
+        path.apply(0.0f, camera);
+        renderer.render(camera, options.Width, options.Height);
+        glFinish();
+        PROFILE_END_FRAME();
+        MemorySystem::instance().endFrame();
+    }
+    // the mesh is streamed in, so its buffers only have a size once it is resident
+    info.VertexBufferSize = renderer.vertexBufferSize();
 
-        processKeyboardInput(window);
-        glfwSwapBuffers(window);
+    // ---------------------------- Loop Begin ----------------------------
+    // the path is stepped by frame number, not wall time, so every run renders the same frames
+    FrameTimer timer;
+    unsigned int total_frames = options.WarmupFrames + options.Frames;
+    for (unsigned int frame = 0; frame < total_frames; frame++)
+    {
+        if (frame == options.WarmupFrames)
+        {
+            timer.reset();
+#if ENGINE_PROFILER
+            if (!options.TraceFile.empty())
+                Profiler::instance().startCapture();
+#endif
+        }
+        // every allocation from here to the end of the frame's arena counts, not just those made while rendering
+        std::uint64_t heap_allocations = MemorySystem::instance().heapAllocationCount();
+        path.apply(path.duration() * frame / total_frames, camera);
+
+        PROFILE_BEGIN_FRAME();
+        timer.beginFrame();
+        target.bind();
+        int render_width = 0, render_height = 0;
+        resolution.beginFrame(options.Width, options.Height, render_width, render_height);
+        renderer.render(camera, render_width, render_height);
+        resolution.endFrame(target.id());
+        timer.endFrame();
+        PROFILE_END_FRAME();
         glfwPollEvents();
+        MemorySystem::instance().endFrame();
+        heap_allocations = MemorySystem::instance().heapAllocationCount() - heap_allocations;
+        if (frame >= options.WarmupFrames)
+        {
+            info.SceneObjects = renderer.cullStats().Objects;
+            info.VisibleObjects.push_back(renderer.cullStats().Visible);
+            info.OccludedObjects.push_back(renderer.occludedCount());
+            info.Triangles.push_back(static_cast<double>(renderer.triangleCount()));
+            info.StateChanges.push_back(renderer.stateChangeStats().Issued);
+            info.SkippedStateChanges.push_back(renderer.stateChangeStats().Skipped);
+            info.StreamStallTimes.push_back(renderer.streamStallTime());
+            info.HeapAllocations.push_back(static_cast<double>(heap_allocations));
+            info.ResolutionScales.push_back(resolution.scale());
+            info.StalledObjects.push_back(renderer.streamingStats().StalledObjects);
+            info.AssetUploadTimes.push_back(renderer.streamingStats().UploadTime);
+        }
     }
+    timer.finish();
+    info.MemorySummary = MemorySystem::instance().summary();
+    info.TextureMemory = renderer.textureMemory();
+    info.TextureEvictions = renderer.textureEvictions();
+    info.ResidentMeshes = renderer.streamingStats().ResidentMeshes;
+    info.ResidentMeshBytes = renderer.streamingStats().ResidentBytes;
+    info.MeshEvictions = renderer.streamingStats().Evictions;
     // ---------------------------- Loop End----------------------------
 
-    // ---------------------------- Finish and Clean Up ----------------------------
+    printBenchmarkResults(info, timer);
+#if ENGINE_PROFILER
+    std::cout << Profiler::instance().summary() << std::endl;
+#endif
+    writeTrace(options);
+    if (!options.OutputFile.empty() && !writeBenchmarkResults(options.OutputFile.c_str(), info, timer))
+    {
+        std::cerr << "Failed to write benchmark results: " << options.OutputFile << std::endl;
+        return -1;
+    }
+    Framebuffer::bindDefault();
+    return 0;
+}
 
-    // de-allocate all resources
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+/*
+    Cull a large scene of random boxes from a camera orbiting through it, and report the time of each
+    query and the number of visible objects. Only the CPU is involved, so no window or context is created.
+*/
+int runCullingBenchmark(const Options& options)
+{
+    // ---------------------------- Scene Setup ----------------------------
+    // a fixed seed so every run culls the same scene
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-CULL_BENCH_EXTENT, CULL_BENCH_EXTENT);
+    std::uniform_real_distribution<float> half_size(0.25f, 1.0f);
+    std::vector<Bounds> boxes(options.Objects);
+    for (std::size_t i = 0; i < boxes.size(); i++)
+    {
+        glm::vec3 centre(position(random), position(random), position(random));
+        glm::vec3 extent(half_size(random), half_size(random), half_size(random));
+        boxes[i].Min = centre - extent;
+        boxes[i].Max = centre + extent;
+    }
 
-    glfwTerminate();
+    std::chrono::steady_clock::time_point build_start = std::chrono::steady_clock::now();
+    BoundingVolumeHierarchy hierarchy;
+    hierarchy.build(boxes.data(), boxes.size());
+    double build_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+    Camera view;
+    CameraPath path = CameraPath::makeOrbit(glm::vec3(0.0f), 0.5f * CULL_BENCH_EXTENT, 0.1f * CULL_BENCH_EXTENT, 20.0f, 64);
+    std::vector<std::uint32_t> visible;
+    visible.reserve(boxes.size());
+    std::vector<double> cull_times;
+    std::vector<double> visible_counts;
+
+    // ---------------------------- Loop Begin ----------------------------
+    unsigned int total_frames = options.WarmupFrames + options.Frames;
+    for (unsigned int frame = 0; frame < total_frames; frame++)
+    {
+        path.apply(path.duration() * frame / total_frames, view);
+        glm::mat4 proj = glm::perspective(glm::radians(view.FoV), (float)options.Width / (float)options.Height,
+                                          Renderer::kNEAR_PLANE, CULL_BENCH_FAR_PLANE);
+        Frustum frustum = extractFrustum(proj * view.GetViewMatrix());
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        visible.clear();
+        CullStats stats = hierarchy.cull(frustum, visible);
+        double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (frame >= options.WarmupFrames)
+        {
+            cull_times.push_back(time);
+            visible_counts.push_back(stats.Visible);
+        }
+    }
+    // ---------------------------- Loop End----------------------------
+
+    FrameTimeSummary cull = summariseFrameTimes(cull_times);
+    FrameTimeSummary seen = summariseFrameTimes(visible_counts);
+    std::printf("%zu objects, %zu nodes, built in %.1f ms, %zu queries\n", hierarchy.objectCount(),
+                hierarchy.nodeCount(), build_time, cull.Count);
+    std::printf("           mean      p50      p95      p99      max\n");
+    std::printf("cull ms %8.3f %8.3f %8.3f %8.3f %8.3f\n", cull.Mean, cull.P50, cull.P95, cull.P99, cull.Max);
+    std::printf("visible %8.0f %8.0f %8.0f %8.0f %8.0f\n", seen.Mean, seen.P50, seen.P95, seen.P99, seen.Max);
     return 0;
 }
 
+/* Write the profiler capture to the trace file, if one was asked for, and release the GPU queries. */
+void writeTrace(const Options& options)
+{
+#if ENGINE_PROFILER
+    if (!options.TraceFile.empty() && !Profiler::instance().writeChromeTrace(options.TraceFile.c_str()))
+        std::cerr << "Failed to write trace: " << options.TraceFile << std::endl;
+    Profiler::instance().releaseGpuResources();
+#else
+    if (!options.TraceFile.empty())
+        std::cerr << "Tracing is not available, the profiler was compiled out." << std::endl;
+#endif
+}
+
 // ---------------------------- Helper Functions ----------------------------
 
 /* Resize the OpenGL viewport when the window has been resized. */
 void resizeViewportCallback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    framebuffer_width = width;
+    framebuffer_height = height;
 }
 
 /* Capture movement of the mouse. */
@@ -327,64 +528,171 @@ void mouseMovementCallback(GLFWwindow* window, double xpos, double ypos)
     mouse_last_x = static_cast<float>(xpos);
     mouse_last_y = static_cast<float>(ypos);
 
-    camera.UpdateLookDirection(xoffset, yoffset);
+    queueInput(InputEvent::kLOOK, Camera::FORWARD, xoffset, yoffset);
 }
 
 /* Capture mouse scroll. */
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.UpdateFoV(static_cast<float>(yoffset));
+    queueInput(InputEvent::kZOOM, Camera::FORWARD, 0.0f, static_cast<float>(yoffset));
 }
 
 /* Capture keyboard input from the user. */
-void processKeyboardInput(GLFWwindow* window)
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
-
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.Move(Camera::FORWARD, delta_time);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.Move(Camera::BACKWARD, delta_time);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.Move(Camera::LEFT, delta_time);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.Move(Camera::RIGHT, delta_time);
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
-        camera.Move(Camera::UP, delta_time);
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
-        camera.Move(Camera::DOWN, delta_time);
+    // switch between the forward and deferred shading paths
+    if (key == GLFW_KEY_TAB && action == GLFW_PRESS)
+        deferred_shading = !deferred_shading;
+
+    // the simulation keeps moving while a key is held, so only presses and releases are sent
+    if (action == GLFW_REPEAT)
+        return;
+    InputEvent::Type type = action == GLFW_PRESS ? InputEvent::kMOVE_START : InputEvent::kMOVE_STOP;
+    switch (key)
+    {
+        case GLFW_KEY_W:    { queueInput(type, Camera::FORWARD, 0.0f, 0.0f); } break;
+        case GLFW_KEY_S:    { queueInput(type, Camera::BACKWARD, 0.0f, 0.0f); } break;
+        case GLFW_KEY_A:    { queueInput(type, Camera::LEFT, 0.0f, 0.0f); } break;
+        case GLFW_KEY_D:    { queueInput(type, Camera::RIGHT, 0.0f, 0.0f); } break;
+        case GLFW_KEY_UP:   { queueInput(type, Camera::UP, 0.0f, 0.0f); } break;
+        case GLFW_KEY_DOWN: { queueInput(type, Camera::DOWN, 0.0f, 0.0f); } break;
+        default: break;
+    }
 }
 
-/* Load a 2D texture from a file. */
-unsigned int loadTexture(const char* path)
+/* Timestamp an input event and pass it to the simulation thread. */
+void queueInput(InputEvent::Type type, Camera::CameraMovement movement, float x, float y)
 {
-    unsigned int texture;
-    glGenTextures(1, &texture);
+    if (!simulation)
+        return;
+    InputEvent event;
+    event.EventType = type;
+    event.Movement = movement;
+    event.X = x;
+    event.Y = y;
+    event.Time = Simulation::now();
+    if (!simulation->pushInput(event))
+        std::cerr << "Input queue is full, dropping input." << std::endl;
+}
 
-    int width, height, nr_channels;
-    unsigned char* data = stbi_load(path, &width, &height, &nr_channels, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nr_channels == 1)       format = GL_RED;
-        else if (nr_channels == 3)  format = GL_RGB;
-        else if (nr_channels == 4)  format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    }
-    else
+/* Read the command line into options. Returns false if it is not understood. */
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++)
     {
-        std::cerr << "Failed to load texture." << std::endl;
+        const char* arg = argv[i];
+        // options that take a value
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (std::strcmp(arg, "--bench") == 0)
+        {
+            options.Benchmark = true;
+        }
+        else if (std::strcmp(arg, "--cull-bench") == 0)
+        {
+            options.CullBenchmark = true;
+        }
+        else if (std::strcmp(arg, "--job-bench") == 0)
+        {
+            options.JobBenchmark = true;
+        }
+        else if (std::strcmp(arg, "--threads") == 0 && value)
+        {
+            options.Threads = static_cast<unsigned int>(std::strtoul(value, NULL, 10));
+            i++;
+        }
+        else if (std::strcmp(arg, "--objects") == 0 && value)
+        {
+            options.Objects = static_cast<unsigned int>(std::strtoul(value, NULL, 10));
+            i++;
+        }
+        else if (std::strcmp(arg, "--egl") == 0)
+        {
+            options.UseEGL = true;
+        }
+        else if (std::strcmp(arg, "--deferred") == 0)
+        {
+            options.Deferred = true;
+        }
+        else if (std::strcmp(arg, "--vertex-format") == 0 && value)
+        {
+            if (!findVertexFormat(value, options.Vertices))
+                return false;
+            i++;
+        }
+        else if (std::strcmp(arg, "--depth-prepass") == 0)
+        {
+            options.DepthPrepass = true;
+        }
+        else if (std::strcmp(arg, "--occlusion") == 0)
+        {
+            options.Occlusion = true;
+        }
+        else if (std::strcmp(arg, "--dynamic-resolution") == 0 && value)
+        {
+            options.TargetFrameTime = std::strtod(value, NULL);
+            if (options.TargetFrameTime <= 0.0)
+                return false;
+            i++;
+        }
+        else if (std::strcmp(arg, "--min-scale") == 0 && value)
+        {
+            options.MinScale = static_cast<float>(std::strtod(value, NULL));
+            if (options.MinScale <= 0.0f || options.MinScale > 1.0f)
+                return false;
+            i++;
+        }
+        else if (std::strcmp(arg, "--texture-budget") == 0 && value)
+        {
+            options.TextureBudget = static_cast<std::size_t>(std::strtoul(value, NULL, 10)) * 1024 * 1024;
+            i++;
+        }
+        else if (std::strcmp(arg, "--mesh-budget") == 0 && value)
+        {
+            options.MeshBudget = static_cast<std::size_t>(std::strtoul(value, NULL, 10)) * 1024 * 1024;
+            i++;
+        }
+        else if (std::strcmp(arg, "--frames") == 0 && value)
+        {
+            options.Frames = static_cast<unsigned int>(std::strtoul(value, NULL, 10));
+            i++;
+        }
+        else if (std::strcmp(arg, "--warmup") == 0 && value)
+        {
+            options.WarmupFrames = static_cast<unsigned int>(std::strtoul(value, NULL, 10));
+            i++;
+        }
+        else if (std::strcmp(arg, "--size") == 0 && value)
+        {
+            if (std::sscanf(value, "%dx%d", &options.Width, &options.Height) != 2 || options.Width <= 0 || options.Height <= 0)
+                return false;
+            i++;
+        }
+        else if (std::strcmp(arg, "--path") == 0 && value)
+        {
+            options.CameraPathFile = value;
+            i++;
+        }
+        else if (std::strcmp(arg, "--output") == 0 && value)
+        {
+            options.OutputFile = value;
+            i++;
+        }
+        else if (std::strcmp(arg, "--record") == 0 && value)
+        {
+            options.RecordFile = value;
+            i++;
+        }
+        else if (std::strcmp(arg, "--trace") == 0 && value)
+        {
+            options.TraceFile = value;
+            i++;
+        }
+        else
+        {
+            return false;
+        }
     }
-    stbi_image_free(data);
-
-    return texture;
+    return options.Frames > 0;
 }
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "mapped_file.hpp"
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool readFileStamp(const char* path, FileStamp& stamp)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+    stamp.Size = static_cast<std::uint64_t>(info.st_size);
+    stamp.ModifiedTime = static_cast<std::int64_t>(info.st_mtime);
+    return true;
+}
+
+bool createDirectory(const char* path)
+{
+#ifdef _WIN32
+    int result = _mkdir(path);
+#else
+    int result = mkdir(path, 0755);
+#endif
+    return result == 0 || errno == EEXIST;
+}
+
+std::string makeTempPath(const char* path)
+{
+    // the process id tells apart other processes, the counter the threads of this one
+    static std::atomic<unsigned int> next_id(0);
+#ifdef _WIN32
+    long process = static_cast<long>(_getpid());
+#else
+    long process = static_cast<long>(getpid());
+#endif
+    return std::string(path) + "." + std::to_string(process) + "." + std::to_string(next_id++) + ".tmp";
+}
+
+bool replaceFile(const std::string& temp_path, const char* path, bool written)
+{
+    if (written)
+    {
+        if (std::rename(temp_path.c_str(), path) == 0)
+            return true;
+        // rename won't replace an existing file on every platform, so make way only now the new file is complete
+        std::remove(path);
+        if (std::rename(temp_path.c_str(), path) == 0)
+            return true;
+    }
+    std::remove(temp_path.c_str());
+    return false;
+}
+
+MappedFile::MappedFile()
+    :   Data(NULL),
+        Size(0)
+#ifdef _WIN32
+        , FileHandle(INVALID_HANDLE_VALUE),
+        MappingHandle(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path)
+{
+    close();
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    this->FileHandle = file;
+    this->MappingHandle = mapping;
+    this->Data = static_cast<const unsigned char*>(view);
+    this->Size = static_cast<std::size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (this->Data)
+        UnmapViewOfFile(this->Data);
+    if (this->MappingHandle)
+        CloseHandle(this->MappingHandle);
+    if (this->FileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(this->FileHandle);
+    this->Data = NULL;
+    this->Size = 0;
+    this->MappingHandle = NULL;
+    this->FileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const char* path)
+{
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(NULL, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    // the whole file is about to be read front to back
+    madvise(view, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+
+    this->Data = static_cast<const unsigned char*>(view);
+    this->Size = static_cast<std::size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (this->Data)
+        munmap(const_cast<unsigned char*>(this->Data), this->Size);
+    this->Data = NULL;
+    this->Size = 0;
+}
+
+#endif
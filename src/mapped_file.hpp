@@ -0,0 +1,66 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* Size and modification time of a file, used to tell if a cached file is out of date. */
+struct FileStamp
+{
+    std::uint64_t Size;
+    std::int64_t ModifiedTime;
+};
+
+/* Read the stamp of a file. Returns false if the file does not exist. */
+bool readFileStamp(const char* path, FileStamp& stamp);
+
+/* Create a directory if it does not already exist. Parent directories must exist. */
+bool createDirectory(const char* path);
+
+/*
+    Get a temporary path next to a file for writing a new version of it. The name is different for
+    every call, in this process and any other, so writers of the same file never share one.
+*/
+std::string makeTempPath(const char* path);
+
+/*
+    Finish writing a file through the temporary file from makeTempPath(). If the write succeeded,
+    the temporary file replaces the file at path. Otherwise it is removed and the file at path is
+    left as it was. Returns false if the file wasn't replaced.
+*/
+bool replaceFile(const std::string& temp_path, const char* path, bool written);
+
+/*
+    A read-only memory mapping of a whole file.
+    The contents are paged in by the OS on first access instead of being copied through a read buffer.
+*/
+class MappedFile
+{
+public:
+    /* Construct an empty MappedFile object. */
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /* Map a file into memory, replacing any previous mapping. Returns false if the file can't be mapped. */
+    bool open(const char* path);
+    /* Unmap the file. */
+    void close();
+
+    /* Get the start of the mapped contents, or NULL if nothing is mapped. */
+    const unsigned char* data() const { return this->Data; }
+    /* Get the size of the mapped contents in bytes. */
+    std::size_t size() const { return this->Size; }
+
+private:
+    const unsigned char* Data;
+    std::size_t Size;
+#ifdef _WIN32
+    void* FileHandle;
+    void* MappingHandle;
+#endif
+};
+
+#endif  // MAPPED_FILE_HPP
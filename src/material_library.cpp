@@ -0,0 +1,249 @@
+#include "material_library.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include <glad/glad.h>
+
+// not in every GL 3.3 loader, but core since 4.2
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+constexpr float MaterialLibrary::kPLACEHOLDER_LAYER;
+constexpr std::size_t MaterialLibrary::kDEFAULT_BUDGET;
+constexpr unsigned int MaterialLibrary::kMAX_ARRAY_LAYERS;
+constexpr std::uint64_t MaterialLibrary::kRETRY_FRAMES;
+
+namespace
+{
+    const std::uint32_t kFREE_LAYER = 0xFFFFFFFFu;
+
+    // size of one level in video memory, which for images the driver compresses is not the size uploaded
+    std::size_t levelBytes(std::uint32_t internal_format, std::uint32_t width, std::uint32_t height)
+    {
+        std::size_t blocks = static_cast<std::size_t>((width + 3) / 4) * ((height + 3) / 4);
+        std::size_t texels = static_cast<std::size_t>(width) * height;
+        switch (internal_format)
+        {
+        case GL_COMPRESSED_RED_RGTC1:
+            return blocks * 8;
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            return blocks * 16;
+        case GL_RED:
+            return texels;
+        case GL_RG:
+            return texels * 2;
+        default:
+            // three channel texels are padded to four by most drivers
+            return texels * 4;
+        }
+    }
+}
+
+MaterialLibrary::MaterialLibrary(TextureManager& textures, std::size_t budget)
+    :   Textures(textures),
+        Budget(budget),
+        AllocatedBytes(0),
+        Evictions(0),
+        Frame(0)
+{
+}
+
+MaterialLibrary::~MaterialLibrary()
+{
+    for (std::size_t i = 0; i < this->Arrays.size(); i++)
+        glDeleteTextures(1, &this->Arrays[i].Texture);
+}
+
+MaterialId MaterialLibrary::create(const char* diffuse_path, const char* specular_path)
+{
+    MaterialId id = static_cast<MaterialId>(this->Materials.size());
+    Material material;
+    const char* paths[kMATERIAL_SLOT_COUNT] = { diffuse_path, specular_path };
+    for (unsigned int slot = 0; slot < kMATERIAL_SLOT_COUNT; slot++)
+    {
+        MaterialTexture& texture = material.Textures[slot];
+        texture.Path = paths[slot];
+        texture.Array = -1;
+        texture.Layer = 0;
+        texture.Loading = false;
+        texture.RetryFrame = 0;
+        texture.Reported = false;
+    }
+    material.LastUsed = this->Frame;
+    material.Batch = 0;
+    this->Materials.push_back(material);
+    updateBatch(id);
+    for (unsigned int slot = 0; slot < kMATERIAL_SLOT_COUNT; slot++)
+        requestLoad(id, slot);
+    return id;
+}
+
+void MaterialLibrary::markUsed(MaterialId material)
+{
+    Material& used = this->Materials[material];
+    used.LastUsed = this->Frame;
+    for (unsigned int slot = 0; slot < kMATERIAL_SLOT_COUNT; slot++)
+    {
+        const MaterialTexture& texture = used.Textures[slot];
+        if (texture.Array < 0 && !texture.Loading && this->Frame >= texture.RetryFrame)
+            requestLoad(material, slot);
+    }
+}
+
+glm::vec2 MaterialLibrary::layers(MaterialId material) const
+{
+    const Material& used = this->Materials[material];
+    glm::vec2 result;
+    for (unsigned int slot = 0; slot < kMATERIAL_SLOT_COUNT; slot++)
+    {
+        const MaterialTexture& texture = used.Textures[slot];
+        result[slot] = texture.Array < 0 ? kPLACEHOLDER_LAYER : static_cast<float>(texture.Layer);
+    }
+    return result;
+}
+
+bool MaterialLibrary::placeLayer(std::uint32_t request, const TextureImage& image, unsigned int& texture, unsigned int& layer)
+{
+    MaterialId material = request / kMATERIAL_SLOT_COUNT;
+    MaterialTexture& placed = this->Materials[material].Textures[request % kMATERIAL_SLOT_COUNT];
+    int array = findArray(image);
+    if (array < 0 || !acquireLayer(static_cast<unsigned int>(array), request, layer))
+    {
+        if (!placed.Reported)
+            std::cerr << "No room in the texture budget for: " << placed.Path << std::endl;
+        placed.Reported = true;
+        placed.RetryFrame = this->Frame + kRETRY_FRAMES;
+        return false;
+    }
+    placed.Array = array;
+    placed.Layer = layer;
+    texture = this->Arrays[array].Texture;
+    updateBatch(material);
+    return true;
+}
+
+void MaterialLibrary::layerLoaded(std::uint32_t request, bool loaded)
+{
+    MaterialTexture& texture = this->Materials[request / kMATERIAL_SLOT_COUNT].Textures[request % kMATERIAL_SLOT_COUNT];
+    texture.Loading = false;
+    // a texture that failed to load keeps the placeholder, and is only tried again after a while
+    if (!loaded)
+        texture.RetryFrame = std::max(texture.RetryFrame, this->Frame + kRETRY_FRAMES);
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void MaterialLibrary::requestLoad(MaterialId material, unsigned int slot)
+{
+    MaterialTexture& texture = this->Materials[material].Textures[slot];
+    texture.Loading = true;
+    this->Textures.loadLayer(texture.Path.c_str(), *this, material * kMATERIAL_SLOT_COUNT + slot);
+}
+
+int MaterialLibrary::findArray(const TextureImage& image)
+{
+    const TextureLevel& base = image.Levels[0];
+    for (std::size_t i = 0; i < this->Arrays.size(); i++)
+    {
+        const TextureArray& array = this->Arrays[i];
+        if (array.InternalFormat == image.InternalFormat && array.Width == base.Width && array.Height == base.Height
+            && array.Levels == image.Levels.size())
+            return static_cast<int>(i);
+    }
+
+    // size the new array to what is left of the budget
+    std::size_t layer_bytes = 0;
+    for (std::size_t i = 0; i < image.Levels.size(); i++)
+        layer_bytes += levelBytes(image.InternalFormat, image.Levels[i].Width, image.Levels[i].Height);
+    GLint max_layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    std::size_t available = this->Budget > this->AllocatedBytes ? this->Budget - this->AllocatedBytes : 0;
+    std::size_t layers = std::min(available / layer_bytes, static_cast<std::size_t>(kMAX_ARRAY_LAYERS));
+    layers = std::min(layers, static_cast<std::size_t>(std::max(max_layers, 0)));
+    if (layers == 0)
+        return -1;
+
+    TextureArray array;
+    array.InternalFormat = image.InternalFormat;
+    array.Width = base.Width;
+    array.Height = base.Height;
+    array.Levels = image.Levels.size();
+    array.LayerBytes = layer_bytes;
+    array.Owners.assign(layers, kFREE_LAYER);
+    glGenTextures(1, &array.Texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.Texture);
+    // the storage of every level and layer is allocated now and filled as textures arrive
+    for (std::size_t i = 0; i < image.Levels.size(); i++)
+    {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(i), image.InternalFormat, image.Levels[i].Width,
+                     image.Levels[i].Height, static_cast<GLsizei>(layers), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.Levels.size() - 1));
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    this->AllocatedBytes += layers * layer_bytes;
+    this->Arrays.push_back(array);
+    return static_cast<int>(this->Arrays.size() - 1);
+}
+
+bool MaterialLibrary::acquireLayer(unsigned int array, std::uint32_t request, unsigned int& layer)
+{
+    TextureArray& textures = this->Arrays[array];
+    // Only textures that weren't drawn last frame can be evicted. The current frame hasn't marked
+    // anything yet when textures are placed, so its materials are protected by last frame's marks.
+    bool found = false;
+    std::uint64_t oldest = 0;
+    for (unsigned int i = 0; i < textures.Owners.size(); i++)
+    {
+        std::uint32_t owner = textures.Owners[i];
+        if (owner == kFREE_LAYER)
+        {
+            layer = i;
+            textures.Owners[i] = request;
+            return true;
+        }
+        std::uint64_t last_used = this->Materials[owner / kMATERIAL_SLOT_COUNT].LastUsed;
+        if (last_used + 1 < this->Frame && (!found || last_used < oldest))
+        {
+            layer = i;
+            oldest = last_used;
+            found = true;
+        }
+    }
+    if (!found)
+        return false;
+
+    MaterialId evicted = textures.Owners[layer] / kMATERIAL_SLOT_COUNT;
+    this->Materials[evicted].Textures[textures.Owners[layer] % kMATERIAL_SLOT_COUNT].Array = -1;
+    updateBatch(evicted);
+    this->Evictions++;
+    textures.Owners[layer] = request;
+    return true;
+}
+
+void MaterialLibrary::updateBatch(MaterialId material)
+{
+    Material& changed = this->Materials[material];
+    MaterialBatch wanted;
+    for (unsigned int slot = 0; slot < kMATERIAL_SLOT_COUNT; slot++)
+    {
+        int array = changed.Textures[slot].Array;
+        wanted.Textures[slot] = array < 0 ? 0 : this->Arrays[array].Texture;
+    }
+    for (std::size_t i = 0; i < this->Batches.size(); i++)
+    {
+        if (std::equal(wanted.Textures, wanted.Textures + kMATERIAL_SLOT_COUNT, this->Batches[i].Textures))
+        {
+            changed.Batch = static_cast<unsigned int>(i);
+            return;
+        }
+    }
+    changed.Batch = static_cast<unsigned int>(this->Batches.size());
+    this->Batches.push_back(wanted);
+}
@@ -0,0 +1,139 @@
+#ifndef MATERIAL_LIBRARY_HPP
+#define MATERIAL_LIBRARY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "texture_manager.hpp"
+
+/* Index of a material in a MaterialLibrary. Materials are numbered in the order they were created. */
+typedef std::uint32_t MaterialId;
+
+/* Textures of a material. Each is bound to the texture unit of the same number. */
+enum MaterialSlot
+{
+    kMATERIAL_DIFFUSE = 0,
+    kMATERIAL_SPECULAR = 1,
+    kMATERIAL_SLOT_COUNT = 2
+};
+
+/* Texture arrays that a group of materials is drawn with, one per slot, or 0 where the texture isn't resident. */
+struct MaterialBatch
+{
+    unsigned int Textures[kMATERIAL_SLOT_COUNT];
+};
+
+/*
+    Material textures packed into the layers of GL_TEXTURE_2D_ARRAY textures, so that objects with
+    different materials can share one instanced draw.
+    Textures with the same format, size and number of mip levels share an array. Each instance
+    passes the layers of its material's textures as a vertex attribute. Materials whose textures
+    are in the same arrays form a batch and are drawn together.
+    Arrays are created as textures arrive, and all their storage is allocated at once and counted
+    against a memory budget. When an array is full, the layer of the material drawn least recently
+    is evicted. That material shows the placeholder until it is drawn again and reloaded.
+*/
+class MaterialLibrary : public TextureLayerTarget
+{
+public:
+    /* Layer passed to the shaders for a texture that isn't resident, sampled as a mid grey placeholder. */
+    static constexpr float kPLACEHOLDER_LAYER = -1.0f;
+    /* Bytes of texture arrays allocated at most, unless setBudget() is called. */
+    static constexpr std::size_t kDEFAULT_BUDGET = 64 * 1024 * 1024;
+    /* Most layers an array is created with. Fewer are used if the budget has less room left. */
+    static constexpr unsigned int kMAX_ARRAY_LAYERS = 16;
+    /* Frames to wait before loading a texture again after it found no room. */
+    static constexpr std::uint64_t kRETRY_FRAMES = 60;
+
+    /* Construct an empty MaterialLibrary object that loads through a TextureManager. */
+    explicit MaterialLibrary(TextureManager& textures, std::size_t budget = kDEFAULT_BUDGET);
+    /* Release the texture arrays. The GL context must be current. */
+    ~MaterialLibrary();
+    MaterialLibrary(const MaterialLibrary&) = delete;
+    MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+    /* Add a material and start loading its textures. */
+    MaterialId create(const char* diffuse_path, const char* specular_path);
+    /* Set how many bytes of texture arrays may be allocated. Arrays that already exist are kept. */
+    void setBudget(std::size_t bytes) { this->Budget = bytes; }
+    std::size_t budget() const { return this->Budget; }
+
+    /* Start a new frame. Call before the TextureManager's update(), which places the textures that have loaded. */
+    void beginFrame() { this->Frame++; }
+    /* Record that a material is drawn this frame, and reload any of its textures that were evicted. Render thread only. */
+    void markUsed(MaterialId material);
+
+    /* Get the layer of each of a material's textures in slot order, or kPLACEHOLDER_LAYER where it isn't resident. */
+    glm::vec2 layers(MaterialId material) const;
+    /* Get the index of the batch a material is drawn in. Batches are never removed, so indices stay valid. */
+    unsigned int batchOf(MaterialId material) const { return this->Materials[material].Batch; }
+    const MaterialBatch& batch(unsigned int index) const { return this->Batches[index]; }
+    std::size_t batchCount() const { return this->Batches.size(); }
+    std::size_t materialCount() const { return this->Materials.size(); }
+    /* Get the number of bytes allocated to texture arrays. */
+    std::size_t allocatedBytes() const { return this->AllocatedBytes; }
+    /* Get the number of layers evicted to make room for other textures. */
+    std::size_t evictionCount() const { return this->Evictions; }
+
+    bool placeLayer(std::uint32_t request, const TextureImage& image, unsigned int& texture, unsigned int& layer) override;
+    void layerLoaded(std::uint32_t request, bool loaded) override;
+
+private:
+    /* One texture array and the texture held in each of its layers. */
+    struct TextureArray
+    {
+        unsigned int Texture;
+        std::uint32_t InternalFormat;
+        std::uint32_t Width;
+        std::uint32_t Height;
+        std::size_t Levels;
+        std::size_t LayerBytes;
+        /* Load request of the texture in each layer, or kFREE_LAYER. */
+        std::vector<std::uint32_t> Owners;
+    };
+
+    struct MaterialTexture
+    {
+        std::string Path;
+        /* Index of the array holding the texture, or -1 if it isn't resident. */
+        int Array;
+        unsigned int Layer;
+        bool Loading;
+        /* Frame from which a texture that found no room may be loaded again. */
+        std::uint64_t RetryFrame;
+        /* Whether running out of budget has been reported for this texture. */
+        bool Reported;
+    };
+
+    struct Material
+    {
+        MaterialTexture Textures[kMATERIAL_SLOT_COUNT];
+        /* Last frame the material was drawn in. */
+        std::uint64_t LastUsed;
+        unsigned int Batch;
+    };
+
+    /* Start loading one texture of a material. */
+    void requestLoad(MaterialId material, unsigned int slot);
+    /* Find the array that holds images like this one, creating it if the budget allows. Returns -1 if there is none. */
+    int findArray(const TextureImage& image);
+    /* Find a free layer of an array, evicting the least recently drawn texture if needed. Returns false if every layer is in use. */
+    bool acquireLayer(unsigned int array, std::uint32_t request, unsigned int& layer);
+    /* Move a material to the batch that matches where its textures are now. */
+    void updateBatch(MaterialId material);
+
+private:
+    TextureManager& Textures;
+    std::vector<TextureArray> Arrays;
+    std::vector<Material> Materials;
+    std::vector<MaterialBatch> Batches;
+    std::size_t Budget;
+    std::size_t AllocatedBytes;
+    std::size_t Evictions;
+    std::uint64_t Frame;
+};
+
+#endif  // MATERIAL_LIBRARY_HPP
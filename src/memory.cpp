@@ -0,0 +1,235 @@
+#include "memory.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+constexpr std::size_t MemorySystem::kFRAME_ARENA_SIZE;
+
+namespace
+{
+    std::atomic<std::uint64_t> heap_allocations(0);
+
+    /* The arena of the current thread, once it has asked for one. It goes back to the memory system when the thread exits. */
+    struct ThreadFrameArena
+    {
+        FrameArena* Arena;
+
+        ThreadFrameArena() : Arena(NULL) {}
+        ~ThreadFrameArena()
+        {
+            if (this->Arena)
+                MemorySystem::instance().releaseFrameArena(this->Arena);
+        }
+    };
+    thread_local ThreadFrameArena current_frame_arena;
+
+    void* countedAllocate(std::size_t size)
+    {
+        heap_allocations.fetch_add(1, std::memory_order_relaxed);
+        // malloc(0) may return NULL, which operator new must not
+        return std::malloc(size > 0 ? size : 1);
+    }
+}
+
+#if ENGINE_MEMORY_STATS
+// Every heap allocation made through new is counted, so the benchmark can check frames make none.
+void* operator new(std::size_t size)
+{
+    void* memory = countedAllocate(size);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+void* operator new[](std::size_t size)
+{
+    void* memory = countedAllocate(size);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(size);
+}
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+#endif
+
+TrackedAllocator::TrackedAllocator(const char* name)
+    :   Name(name)
+{
+    MemorySystem::instance().registerAllocator(this);
+}
+
+TrackedAllocator::~TrackedAllocator()
+{
+    MemorySystem::instance().unregisterAllocator(this);
+}
+
+FrameArena::FrameArena(const char* name, std::size_t capacity)
+    :   TrackedAllocator(name),
+        Block(new unsigned char[capacity]),
+        Capacity(capacity),
+        Used(0),
+        HighWater(0),
+        Overflows(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    reset();
+}
+
+void* FrameArena::allocate(std::size_t size, std::size_t alignment)
+{
+    std::uintptr_t base = reinterpret_cast<std::uintptr_t>(this->Block.get());
+    std::size_t offset = ((base + this->Used + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1)) - base;
+    if (offset + size > this->Capacity)
+    {
+        // the arena is full, so fall back to the heap until the next reset rather than fail
+        this->Overflows++;
+        void* block = ::operator new(size + alignment);
+        this->OverflowBlocks.push_back(block);
+        // operator new only guarantees the fundamental alignment, so align within the block
+        std::uintptr_t start = reinterpret_cast<std::uintptr_t>(block);
+        return reinterpret_cast<void*>((start + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1));
+    }
+    this->Used = offset + size;
+    this->HighWater = std::max(this->HighWater, this->Used);
+    return this->Block.get() + offset;
+}
+
+void FrameArena::reset()
+{
+    this->Used = 0;
+    for (std::size_t i = 0; i < this->OverflowBlocks.size(); i++)
+        ::operator delete(this->OverflowBlocks[i]);
+    this->OverflowBlocks.clear();
+}
+
+AllocatorStats FrameArena::stats() const
+{
+    AllocatorStats stats;
+    stats.Name = this->Name;
+    stats.Used = this->Used;
+    stats.HighWater = this->HighWater;
+    stats.Capacity = this->Capacity;
+    stats.Overflows = this->Overflows;
+    return stats;
+}
+
+MemorySystem& MemorySystem::instance()
+{
+    static MemorySystem memory;
+    return memory;
+}
+
+FrameArena& MemorySystem::frameArena()
+{
+    if (!current_frame_arena.Arena)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->Mutex);
+            if (!this->FreeArenas.empty())
+            {
+                current_frame_arena.Arena = this->FreeArenas.back();
+                this->FreeArenas.pop_back();
+                return *current_frame_arena.Arena;
+            }
+        }
+        // created outside the lock, since the arena registers itself under it
+        std::unique_ptr<FrameArena> arena(new FrameArena("frame arena", kFRAME_ARENA_SIZE));
+        current_frame_arena.Arena = arena.get();
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        this->Arenas.push_back(std::move(arena));
+    }
+    return *current_frame_arena.Arena;
+}
+
+void MemorySystem::releaseFrameArena(FrameArena* arena)
+{
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->FreeArenas.push_back(arena);
+}
+
+void MemorySystem::endFrame()
+{
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    for (std::size_t i = 0; i < this->Arenas.size(); i++)
+        this->Arenas[i]->reset();
+}
+
+std::uint64_t MemorySystem::heapAllocationCount() const
+{
+    return heap_allocations.load(std::memory_order_relaxed);
+}
+
+std::vector<AllocatorStats> MemorySystem::stats() const
+{
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    std::vector<AllocatorStats> stats;
+    for (std::size_t i = 0; i < this->Allocators.size(); i++)
+        stats.push_back(this->Allocators[i]->stats());
+    return stats;
+}
+
+std::string MemorySystem::summary() const
+{
+    std::vector<AllocatorStats> stats = this->stats();
+    std::string summary;
+    for (std::size_t i = 0; i < stats.size(); i++)
+    {
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-16s high water %10zu of %10zu, %zu overflows\n", stats[i].Name,
+                      stats[i].HighWater, stats[i].Capacity, stats[i].Overflows);
+        summary += line;
+    }
+    return summary;
+}
+
+void MemorySystem::registerAllocator(TrackedAllocator* allocator)
+{
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Allocators.push_back(allocator);
+}
+
+void MemorySystem::unregisterAllocator(TrackedAllocator* allocator)
+{
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Allocators.erase(std::remove(this->Allocators.begin(), this->Allocators.end(), allocator), this->Allocators.end());
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+MemorySystem::MemorySystem()
+{
+}
@@ -0,0 +1,250 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+    Memory for the hot path, so frames in the steady state make no heap allocations.
+        FrameArena      a linear allocator per thread, emptied at the end of every frame, for data
+                        that only lives for one frame.
+        ObjectPool<T>   fixed size blocks for objects that come and go, such as textures in flight.
+    Every arena and pool keeps a high-water mark, and MemorySystem collects them into one summary
+    together with the number of heap allocations made through operator new.
+    Building with ENGINE_MEMORY_STATS=0 leaves operator new alone, and the count stays at 0.
+*/
+#ifndef ENGINE_MEMORY_STATS
+#define ENGINE_MEMORY_STATS 1
+#endif
+
+/* Usage of one arena or pool, in bytes for arenas and objects for pools. */
+struct AllocatorStats
+{
+    const char* Name;
+    std::size_t Used;
+    std::size_t HighWater;
+    std::size_t Capacity;
+    /* Allocations that didn't fit and went to the heap instead. */
+    std::size_t Overflows;
+};
+
+/* Something that reports AllocatorStats to the MemorySystem for as long as it exists. */
+class TrackedAllocator
+{
+public:
+    explicit TrackedAllocator(const char* name);
+    virtual ~TrackedAllocator();
+    TrackedAllocator(const TrackedAllocator&) = delete;
+    TrackedAllocator& operator=(const TrackedAllocator&) = delete;
+
+    virtual AllocatorStats stats() const = 0;
+
+protected:
+    const char* Name;
+};
+
+/*
+    A linear allocator. Allocating moves a pointer through one fixed block, and nothing is freed
+    until reset() empties the whole arena at once. Allocations that don't fit go to the heap, are
+    freed by reset() too, and are counted so the arena can be made larger.
+    Only the thread that owns an arena may allocate from it.
+*/
+class FrameArena : public TrackedAllocator
+{
+public:
+    /* Construct a FrameArena object with a block of the given size in bytes. */
+    FrameArena(const char* name, std::size_t capacity);
+    ~FrameArena();
+
+    /* Allocate memory with the given alignment, which must be a power of two. Never returns NULL. */
+    void* allocate(std::size_t size, std::size_t alignment);
+    /* Free everything allocated since the last reset. Destructors are not run. */
+    void reset();
+    /* Allocate and construct an object that is dropped, without its destructor running, at the next reset. */
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    AllocatorStats stats() const override;
+
+private:
+    std::unique_ptr<unsigned char[]> Block;
+    std::size_t Capacity;
+    std::size_t Used;
+    std::size_t HighWater;
+    /* Heap blocks of the allocations that didn't fit, as allocated before aligning, freed at the next reset. */
+    std::vector<void*> OverflowBlocks;
+    std::size_t Overflows;
+};
+
+/*
+    Owns the frame arenas of every thread and the list of tracked allocators.
+    A thread's arena is created the first time it asks for one, and is handed on to the next thread
+    that asks once its thread exits, so pools that start new threads don't pile up arenas.
+    endFrame() empties every arena, so
+    it must only be called while no other thread is using its arena, such as at the end of the frame
+    loop once every frame job has been waited on. Background tasks must not use the frame arenas.
+*/
+class MemorySystem
+{
+public:
+    /* Size of each thread's frame arena. */
+    static constexpr std::size_t kFRAME_ARENA_SIZE = 1024 * 1024;
+
+    /* Get the memory system. */
+    static MemorySystem& instance();
+
+    /* Get the frame arena of the calling thread. */
+    FrameArena& frameArena();
+    /* Take back the arena of a thread that is exiting, for the next thread to reuse. Called as the thread exits. */
+    void releaseFrameArena(FrameArena* arena);
+    /* Empty the frame arena of every thread. */
+    void endFrame();
+    /* Get the number of heap allocations made through operator new since the program started, by every thread. */
+    std::uint64_t heapAllocationCount() const;
+    /* Get the current stats of every arena and pool. */
+    std::vector<AllocatorStats> stats() const;
+    /* Get a summary of the high-water marks of every arena and pool, one per line. */
+    std::string summary() const;
+
+    void registerAllocator(TrackedAllocator* allocator);
+    void unregisterAllocator(TrackedAllocator* allocator);
+
+private:
+    MemorySystem();
+
+private:
+    mutable std::mutex Mutex;
+    std::vector<TrackedAllocator*> Allocators;
+    std::vector<std::unique_ptr<FrameArena> > Arenas;
+    // arenas of threads that have exited, waiting for a new thread
+    std::vector<FrameArena*> FreeArenas;
+};
+
+/*
+    A standard allocator that takes its memory from a frame arena, so containers built during a frame
+    don't touch the heap. Deallocation does nothing; the memory comes back when the arena is reset,
+    so containers using it must not outlive the frame.
+*/
+template <typename T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+
+    /* Use the frame arena of the calling thread. */
+    FrameAllocator() : Arena(&MemorySystem::instance().frameArena()) {}
+    explicit FrameAllocator(FrameArena& arena) : Arena(&arena) {}
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : Arena(other.Arena) {}
+
+    T* allocate(std::size_t count) { return static_cast<T*>(this->Arena->allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T*, std::size_t) {}
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const { return this->Arena == other.Arena; }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const { return this->Arena != other.Arena; }
+
+public:
+    FrameArena* Arena;
+};
+
+/* A vector whose storage lives in a frame arena until the end of the frame. */
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+/*
+    Fixed size blocks for objects of one type, carved out of chunks of kCHUNK_SIZE blocks.
+    Freed blocks go on a free list and are reused before a new chunk is allocated, so once the pool
+    has grown to its high-water mark creating and destroying objects never touches the heap. Not
+    thread safe.
+*/
+template <typename T>
+class ObjectPool : public TrackedAllocator
+{
+public:
+    static constexpr std::size_t kCHUNK_SIZE = 64;
+
+    explicit ObjectPool(const char* name) : TrackedAllocator(name), FreeList(NULL), Used(0), HighWater(0), Overflows(0) {}
+    /* Objects still alive are not destroyed, only their memory is released. */
+    ~ObjectPool() {}
+
+    /* Construct an object in a free block. */
+    template <typename... Args>
+    T* create(Args&&... args)
+    {
+        if (!this->FreeList)
+            grow();
+        Block* block = this->FreeList;
+        this->FreeList = block->Next;
+        this->Used++;
+        if (this->Used > this->HighWater)
+            this->HighWater = this->Used;
+        return new (block->Storage) T(std::forward<Args>(args)...);
+    }
+    /* Destroy an object made by create() and return its block to the free list. */
+    void destroy(T* object)
+    {
+        if (!object)
+            return;
+        object->~T();
+        Block* block = reinterpret_cast<Block*>(object);
+        block->Next = this->FreeList;
+        this->FreeList = block;
+        this->Used--;
+    }
+
+    AllocatorStats stats() const override
+    {
+        AllocatorStats stats;
+        stats.Name = this->Name;
+        stats.Used = this->Used;
+        stats.HighWater = this->HighWater;
+        stats.Capacity = this->Chunks.size() * kCHUNK_SIZE;
+        // every chunk after the first is a heap allocation made after startup
+        stats.Overflows = this->Overflows;
+        return stats;
+    }
+
+private:
+    union Block
+    {
+        Block* Next;
+        alignas(T) unsigned char Storage[sizeof(T)];
+    };
+
+    /* Add a chunk of blocks to the free list. */
+    void grow()
+    {
+        if (!this->Chunks.empty())
+            this->Overflows++;
+        this->Chunks.push_back(std::unique_ptr<Block[]>(new Block[kCHUNK_SIZE]));
+        Block* chunk = this->Chunks.back().get();
+        for (std::size_t i = 0; i < kCHUNK_SIZE; i++)
+        {
+            chunk[i].Next = this->FreeList;
+            this->FreeList = &chunk[i];
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<Block[]> > Chunks;
+    Block* FreeList;
+    std::size_t Used;
+    std::size_t HighWater;
+    std::size_t Overflows;
+};
+
+template <typename T>
+constexpr std::size_t ObjectPool<T>::kCHUNK_SIZE;
+
+#endif  // MEMORY_HPP
@@ -0,0 +1,153 @@
+#include "mesh.hpp"
+
+#include <algorithm>
+
+#include <glad/glad.h>
+
+constexpr unsigned int Mesh::kPOSITION_ATTRIBUTE;
+constexpr unsigned int Mesh::kNORMAL_ATTRIBUTE;
+constexpr unsigned int Mesh::kTEX_COORDS_ATTRIBUTE;
+constexpr unsigned int Mesh::kMAX_LODS;
+constexpr float Mesh::kLOD_HYSTERESIS;
+
+MeshView makeMeshView(const MeshData& data)
+{
+    MeshView view;
+    view.Vertices = data.Vertices.data();
+    view.VertexCount = data.Vertices.size();
+    view.Indices = data.Indices.data();
+    view.IndexCount = data.Indices.size();
+    view.SubMeshes = data.SubMeshes.data();
+    view.SubMeshCount = data.SubMeshes.size();
+    view.Lods = data.Lods.data();
+    view.LodCount = data.Lods.size();
+    view.Box = data.Box;
+    return view;
+}
+
+Bounds computeBounds(const Vertex* vertices, std::size_t count)
+{
+    Bounds box;
+    box.Min = glm::vec3(0.0f);
+    box.Max = glm::vec3(0.0f);
+    if (count == 0)
+        return box;
+
+    box.Min = vertices[0].Position;
+    box.Max = vertices[0].Position;
+    for (std::size_t i = 1; i < count; i++)
+    {
+        box.Min = glm::min(box.Min, vertices[i].Position);
+        box.Max = glm::max(box.Max, vertices[i].Position);
+    }
+    return box;
+}
+
+Mesh::Mesh(const MeshView& view, VertexFormat format)
+    :   IndexCount(view.IndexCount),
+        SubMeshes(view.SubMeshes, view.SubMeshes + view.SubMeshCount),
+        Lods(view.Lods, view.Lods + std::min<std::size_t>(view.LodCount, kMAX_LODS)),
+        Box(view.Box),
+        Format(format),
+        PositionTransform(getPositionTransform(format, view.Box)),
+        VertexBufferSize(view.VertexCount * getVertexLayout(format).Stride)
+{
+    glGenBuffers(1, &this->VertexBufferID);
+    glGenBuffers(1, &this->IndexBufferID);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->VertexBufferID);
+    if (format == kVERTEX_FORMAT_FLOAT)
+    {
+        glBufferData(GL_ARRAY_BUFFER, this->VertexBufferSize, view.Vertices, GL_STATIC_DRAW);
+    }
+    else
+    {
+        std::vector<unsigned char> packed;
+        packVertices(view.Vertices, view.VertexCount, format, view.Box, packed);
+        glBufferData(GL_ARRAY_BUFFER, this->VertexBufferSize, packed.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // the element array binding is VAO state, so make sure no VAO picks this one up by accident
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->IndexBufferID);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, view.IndexCount * sizeof(std::uint32_t), view.Indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // a mesh without explicit sub-meshes is drawn as one range
+    if (this->SubMeshes.empty() && this->IndexCount > 0)
+    {
+        SubMesh whole = { 0, static_cast<std::uint32_t>(this->IndexCount) };
+        this->SubMeshes.push_back(whole);
+    }
+    // likewise a mesh without levels of detail only has the full mesh
+    if (this->Lods.empty())
+    {
+        MeshLod full = { 0, static_cast<std::uint32_t>(this->IndexCount), 0.0f };
+        this->Lods.push_back(full);
+    }
+}
+
+Mesh::~Mesh()
+{
+    if (!this->VertexArrays.empty())
+        glDeleteVertexArrays(static_cast<GLsizei>(this->VertexArrays.size()), this->VertexArrays.data());
+    glDeleteBuffers(1, &this->VertexBufferID);
+    glDeleteBuffers(1, &this->IndexBufferID);
+}
+
+unsigned int Mesh::createVertexArray()
+{
+    unsigned int vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->VertexBufferID);
+    const VertexLayout& layout = getVertexLayout(this->Format);
+    for (unsigned int i = 0; i < layout.AttributeCount; i++)
+    {
+        const VertexAttributeLayout& attribute = layout.Attributes[i];
+        glVertexAttribPointer(attribute.Location, attribute.Components, attribute.Type,
+                              attribute.Normalized ? GL_TRUE : GL_FALSE, static_cast<GLsizei>(layout.Stride), (void*)attribute.Offset);
+        glEnableVertexAttribArray(attribute.Location);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // the element array binding is stored in the VAO, so it must stay bound until the VAO is unbound
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->IndexBufferID);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    this->VertexArrays.push_back(vao);
+    return vao;
+}
+
+void Mesh::drawInstanced(unsigned int vao, std::size_t instance_count) const
+{
+    glBindVertexArray(vao);
+    drawInstanced(instance_count);
+}
+
+void Mesh::drawInstanced(std::size_t instance_count, unsigned int lod) const
+{
+    if (instance_count == 0 || lod >= this->Lods.size() || this->Lods[lod].IndexCount == 0)
+        return;
+    // sub-meshes are contiguous and share one material for now, so each level is one draw
+    const MeshLod& range = this->Lods[lod];
+    glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(range.IndexCount), GL_UNSIGNED_INT,
+                            (void*)(range.IndexOffset * sizeof(std::uint32_t)), static_cast<GLsizei>(instance_count));
+}
+
+unsigned int Mesh::selectLod(float pixels_per_unit, float max_pixel_error, unsigned int current) const
+{
+    // the error only grows from one level to the next, so stop at the first level that is too coarse
+    unsigned int lod = 0;
+    for (unsigned int i = 1; i < this->Lods.size(); i++)
+    {
+        float allowed = i > current ? max_pixel_error * kLOD_HYSTERESIS : max_pixel_error;
+        if (this->Lods[i].Error * pixels_per_unit > allowed)
+            break;
+        lod = i;
+    }
+    return lod;
+}
@@ -0,0 +1,158 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "vertex_format.hpp"
+
+/* Vertex layout shared by every mesh. Matches attribute locations 0-2 of the lighting shaders. */
+struct Vertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+/* A contiguous range of the index buffer, one per object/group/material in the source file. */
+struct SubMesh
+{
+    std::uint32_t IndexOffset;
+    std::uint32_t IndexCount;
+};
+
+/*
+    A level of detail: a range of the index buffer that draws a simplified version of the whole mesh
+    with the same vertices. Level 0 is the full mesh.
+*/
+struct MeshLod
+{
+    std::uint32_t IndexOffset;
+    std::uint32_t IndexCount;
+    /* Farthest the simplified surface can be from the full mesh, in model space units. */
+    float Error;
+};
+
+/* Axis aligned bounding box in model space. */
+struct Bounds
+{
+    glm::vec3 Min;
+    glm::vec3 Max;
+};
+
+/* Indexed mesh data on the CPU, as produced by an importer. */
+struct MeshData
+{
+    std::vector<Vertex> Vertices;
+    std::vector<std::uint32_t> Indices;
+    std::vector<SubMesh> SubMeshes;
+    /* Levels of detail, finest first. The sub-meshes only cover level 0. */
+    std::vector<MeshLod> Lods;
+    Bounds Box;
+};
+
+/*
+    A read-only view of indexed mesh data that lives somewhere else, such as a MeshData object or
+    a memory mapped mesh cache.
+*/
+struct MeshView
+{
+    const Vertex* Vertices;
+    std::size_t VertexCount;
+    const std::uint32_t* Indices;
+    std::size_t IndexCount;
+    const SubMesh* SubMeshes;
+    std::size_t SubMeshCount;
+    const MeshLod* Lods;
+    std::size_t LodCount;
+    Bounds Box;
+};
+
+/* Get a view of a MeshData object. The view is only valid while the object is unchanged. */
+MeshView makeMeshView(const MeshData& data);
+
+/* Compute the bounding box of a set of vertices. */
+Bounds computeBounds(const Vertex* vertices, std::size_t count);
+
+/*
+    An indexed mesh stored in GPU buffers.
+    The vertex and index buffers can be shared by several vertex array objects, so the same mesh
+    can be drawn with different per-instance data. The vertices are stored in any VertexFormat, and
+    the vertex arrays convert them back to the attributes the shaders read.
+*/
+class Mesh
+{
+public:
+    /* Vertex attribute locations used by the Vertex layout. */
+    static constexpr unsigned int kPOSITION_ATTRIBUTE   = 0;
+    static constexpr unsigned int kNORMAL_ATTRIBUTE     = 1;
+    static constexpr unsigned int kTEX_COORDS_ATTRIBUTE = 2;
+    /* Most levels of detail a mesh can have, including the full mesh. */
+    static constexpr unsigned int kMAX_LODS = 4;
+    /*
+        Share of the pixel error allowed when switching to a coarser level of detail. An object at
+        the distance where two levels meet keeps the one it has instead of switching every frame.
+    */
+    static constexpr float kLOD_HYSTERESIS = 0.75f;
+
+    /*
+        Construct a Mesh object, uploading the viewed vertices and indices to the GPU. Float vertices
+        are uploaded straight from the view, other formats are packed first.
+    */
+    Mesh(const MeshView& view, VertexFormat format = kVERTEX_FORMAT_FLOAT);
+    ~Mesh();
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    /*
+        Create a vertex array object that reads from this mesh's buffers.
+        The mesh owns the returned VAO and deletes it along with the buffers.
+    */
+    unsigned int createVertexArray();
+    /* Draw the whole mesh with a vertex array created by this mesh. */
+    void drawInstanced(unsigned int vao, std::size_t instance_count) const;
+    /* Draw a level of detail of the mesh with a vertex array created by this mesh that is already bound. */
+    void drawInstanced(std::size_t instance_count, unsigned int lod = 0) const;
+    /*
+        Pick the coarsest level of detail whose error covers at most max_pixel_error pixels on screen.
+        pixels_per_unit is the size on screen of one model space unit at the object's distance.
+        current is the level the object was last drawn with.
+    */
+    unsigned int selectLod(float pixels_per_unit, float max_pixel_error, unsigned int current) const;
+
+    /* Get the number of indices in the mesh, over every level of detail. */
+    std::size_t indexCount() const { return this->IndexCount; }
+    /* Get the sub-mesh ranges of the index buffer. */
+    const std::vector<SubMesh>& subMeshes() const { return this->SubMeshes; }
+    /* Get the levels of detail of the mesh, finest first. There is always at least the full mesh. */
+    const std::vector<MeshLod>& lods() const { return this->Lods; }
+    /* Get the model space bounding box of the mesh. */
+    const Bounds& bounds() const { return this->Box; }
+    /* Get the format the vertices are stored in. */
+    VertexFormat vertexFormat() const { return this->Format; }
+    /*
+        Get the matrix that takes the stored positions back to model space. Multiply it onto the
+        model matrix of each instance, but not into the normal matrix.
+    */
+    const glm::mat4& positionTransform() const { return this->PositionTransform; }
+    /* Get the size of the vertex buffer in bytes. */
+    std::size_t vertexBufferSize() const { return this->VertexBufferSize; }
+
+private:
+    /* Hold the IDs of the buffer objects used by OpenGL */
+    unsigned int VertexBufferID;
+    unsigned int IndexBufferID;
+    /* Vertex array objects created for this mesh. */
+    std::vector<unsigned int> VertexArrays;
+    std::size_t IndexCount;
+    std::vector<SubMesh> SubMeshes;
+    std::vector<MeshLod> Lods;
+    Bounds Box;
+    VertexFormat Format;
+    glm::mat4 PositionTransform;
+    std::size_t VertexBufferSize;
+};
+
+#endif  // MESH_HPP
@@ -0,0 +1,851 @@
+#include "mesh_import.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+
+#include "mapped_file.hpp"
+
+// ---------------------------- OBJ Import ----------------------------
+
+namespace
+{
+    /* One corner of a face, as 0-based indices into the position/tex coord/normal lists (-1 if absent). */
+    struct ObjCorner
+    {
+        int Position;
+        int TexCoords;
+        int Normal;
+
+        bool operator==(const ObjCorner& other) const
+        {
+            return this->Position == other.Position && this->TexCoords == other.TexCoords && this->Normal == other.Normal;
+        }
+    };
+
+    struct ObjCornerHash
+    {
+        std::size_t operator()(const ObjCorner& corner) const
+        {
+            std::size_t hash = static_cast<std::size_t>(corner.Position) * 73856093u;
+            hash ^= static_cast<std::size_t>(corner.TexCoords) * 19349663u;
+            hash ^= static_cast<std::size_t>(corner.Normal) * 83492791u;
+            return hash;
+        }
+    };
+
+    /* Skip spaces and tabs. */
+    const char* skipBlanks(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        return p;
+    }
+
+    // longer than any number written in a model file, including exponents
+    const std::size_t kMAX_NUMBER_LENGTH = 63;
+
+    /*
+        Copy the bytes a number could be read from into a NUL-terminated buffer, since the mapped
+        file isn't terminated and strtof/strtol would read on past its end. Returns the number copied.
+    */
+    std::size_t copyNumber(const char* p, const char* end, char (&buffer)[kMAX_NUMBER_LENGTH + 1])
+    {
+        std::size_t length = std::min(static_cast<std::size_t>(end - p), kMAX_NUMBER_LENGTH);
+        std::memcpy(buffer, p, length);
+        buffer[length] = '\0';
+        return length;
+    }
+
+    /*
+        Check a number read from a buffer filled by copyNumber(), and advance p past it. A number that
+        fills the whole buffer may carry on past it, so it is rejected rather than split in two.
+    */
+    bool endNumber(const char*& p, const char* end, const char* buffer, const char* number_end, std::size_t length)
+    {
+        std::size_t parsed = static_cast<std::size_t>(number_end - buffer);
+        if (parsed == 0 || (parsed == length && p + length < end))
+            return false;
+        p += parsed;
+        return true;
+    }
+
+    /* Parse a float, advancing past it. Returns false if there isn't one. */
+    bool parseFloat(const char*& p, const char* end, float& value)
+    {
+        p = skipBlanks(p, end);
+        char buffer[kMAX_NUMBER_LENGTH + 1];
+        std::size_t length = copyNumber(p, end, buffer);
+        char* number_end;
+        value = std::strtof(buffer, &number_end);
+        return endNumber(p, end, buffer, number_end, length);
+    }
+
+    /* Parse a decimal integer, advancing past it. Returns false if there isn't one. */
+    bool parseInteger(const char*& p, const char* end, long& value)
+    {
+        char buffer[kMAX_NUMBER_LENGTH + 1];
+        std::size_t length = copyNumber(p, end, buffer);
+        char* number_end;
+        value = std::strtol(buffer, &number_end, 10);
+        return endNumber(p, end, buffer, number_end, length);
+    }
+
+    /*
+        Convert an OBJ index (1-based, or negative relative to the end of the list) to a 0-based index.
+        Returns -1 if it is out of range.
+    */
+    int resolveIndex(long index, std::size_t list_size)
+    {
+        long resolved = index > 0 ? index - 1 : static_cast<long>(list_size) + index;
+        if (index == 0 || resolved < 0 || resolved >= static_cast<long>(list_size))
+            return -1;
+        return static_cast<int>(resolved);
+    }
+
+    /* Parse one "v", "v/vt", "v//vn" or "v/vt/vn" corner, advancing past it. */
+    bool parseCorner(const char*& p, const char* end, std::size_t positions, std::size_t tex_coords,
+                     std::size_t normals, ObjCorner& corner)
+    {
+        p = skipBlanks(p, end);
+        long index;
+        if (!parseInteger(p, end, index))
+            return false;
+        corner.Position = resolveIndex(index, positions);
+        corner.TexCoords = -1;
+        corner.Normal = -1;
+        if (corner.Position < 0)
+            return false;
+
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p != '/' && parseInteger(p, end, index))
+                corner.TexCoords = resolveIndex(index, tex_coords);
+            if (p < end && *p == '/')
+            {
+                p++;
+                if (parseInteger(p, end, index))
+                    corner.Normal = resolveIndex(index, normals);
+            }
+        }
+        return true;
+    }
+
+    /* Close the current sub-mesh if it has any indices. */
+    void endSubMesh(MeshData& mesh, std::uint32_t& sub_mesh_start)
+    {
+        std::uint32_t index_count = static_cast<std::uint32_t>(mesh.Indices.size());
+        if (index_count > sub_mesh_start)
+        {
+            SubMesh sub_mesh = { sub_mesh_start, index_count - sub_mesh_start };
+            mesh.SubMeshes.push_back(sub_mesh);
+        }
+        sub_mesh_start = index_count;
+    }
+
+    /* Fill in area weighted smooth normals for vertices that had none in the file. */
+    void generateNormals(MeshData& mesh, const std::vector<bool>& needs_normal)
+    {
+        for (std::size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+        {
+            Vertex& a = mesh.Vertices[mesh.Indices[i]];
+            Vertex& b = mesh.Vertices[mesh.Indices[i + 1]];
+            Vertex& c = mesh.Vertices[mesh.Indices[i + 2]];
+            // the cross product's length is twice the triangle area, which weights the average
+            glm::vec3 face_normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+            if (needs_normal[mesh.Indices[i]])      a.Normal += face_normal;
+            if (needs_normal[mesh.Indices[i + 1]])  b.Normal += face_normal;
+            if (needs_normal[mesh.Indices[i + 2]])  c.Normal += face_normal;
+        }
+        for (std::size_t i = 0; i < mesh.Vertices.size(); i++)
+        {
+            if (!needs_normal[i])
+                continue;
+            float length = glm::length(mesh.Vertices[i].Normal);
+            mesh.Vertices[i].Normal = length > 0.0f ? mesh.Vertices[i].Normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    }
+}
+
+bool importObj(const char* path, MeshData& mesh)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    const char* p = reinterpret_cast<const char*>(file.data());
+    const char* end = p + file.size();
+
+    mesh.Vertices.clear();
+    mesh.Indices.clear();
+    mesh.SubMeshes.clear();
+
+    // vertices without a normal in the file are smoothed once every face is known
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> tex_coords;
+    std::vector<glm::vec3> normals;
+    std::unordered_map<ObjCorner, std::uint32_t, ObjCornerHash> unique_corners;
+    std::vector<bool> needs_normal;
+    std::vector<std::uint32_t> face;
+    std::uint32_t sub_mesh_start = 0;
+    bool missing_normals = false;
+    unsigned int line_number = 0;
+
+    while (p < end)
+    {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!line_end)
+            line_end = end;
+        line_number++;
+
+        p = skipBlanks(p, line_end);
+        if (p + 1 < line_end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            glm::vec3 position;
+            p++;
+            if (parseFloat(p, line_end, position.x) && parseFloat(p, line_end, position.y) && parseFloat(p, line_end, position.z))
+                positions.push_back(position);
+            else
+                std::cerr << "Bad vertex position in " << path << ":" << line_number << std::endl;
+        }
+        else if (p + 2 < line_end && p[0] == 'v' && p[1] == 't')
+        {
+            glm::vec2 uv(0.0f);
+            p += 2;
+            if (parseFloat(p, line_end, uv.x))
+            {
+                // the second coordinate is optional for 1D textures
+                parseFloat(p, line_end, uv.y);
+                tex_coords.push_back(uv);
+            }
+            else
+            {
+                std::cerr << "Bad texture coordinates in " << path << ":" << line_number << std::endl;
+            }
+        }
+        else if (p + 2 < line_end && p[0] == 'v' && p[1] == 'n')
+        {
+            glm::vec3 normal;
+            p += 2;
+            if (parseFloat(p, line_end, normal.x) && parseFloat(p, line_end, normal.y) && parseFloat(p, line_end, normal.z))
+                normals.push_back(normal);
+            else
+                std::cerr << "Bad vertex normal in " << path << ":" << line_number << std::endl;
+        }
+        else if (p + 1 < line_end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            p++;
+            face.clear();
+            ObjCorner corner;
+            while (parseCorner(p, line_end, positions.size(), tex_coords.size(), normals.size(), corner))
+            {
+                std::unordered_map<ObjCorner, std::uint32_t, ObjCornerHash>::iterator found = unique_corners.find(corner);
+                if (found == unique_corners.end())
+                {
+                    Vertex vertex;
+                    vertex.Position = positions[corner.Position];
+                    vertex.Normal = corner.Normal >= 0 ? normals[corner.Normal] : glm::vec3(0.0f);
+                    vertex.TexCoords = corner.TexCoords >= 0 ? tex_coords[corner.TexCoords] : glm::vec2(0.0f);
+                    std::uint32_t index = static_cast<std::uint32_t>(mesh.Vertices.size());
+                    mesh.Vertices.push_back(vertex);
+                    needs_normal.push_back(corner.Normal < 0);
+                    missing_normals = missing_normals || corner.Normal < 0;
+                    found = unique_corners.insert(std::make_pair(corner, index)).first;
+                }
+                face.push_back(found->second);
+            }
+            if (face.size() < 3)
+            {
+                std::cerr << "Bad face in " << path << ":" << line_number << std::endl;
+            }
+            // polygons are triangulated as a fan, which is correct for the convex faces exporters write
+            for (std::size_t i = 2; i < face.size(); i++)
+            {
+                mesh.Indices.push_back(face[0]);
+                mesh.Indices.push_back(face[i - 1]);
+                mesh.Indices.push_back(face[i]);
+            }
+        }
+        else if (p < line_end && (p[0] == 'o' || p[0] == 'g'))
+        {
+            endSubMesh(mesh, sub_mesh_start);
+        }
+        else if (line_end - p >= 6 && std::strncmp(p, "usemtl", 6) == 0)
+        {
+            endSubMesh(mesh, sub_mesh_start);
+        }
+        // comments, smoothing groups, material libraries and anything else are ignored
+
+        p = line_end + 1;
+    }
+    endSubMesh(mesh, sub_mesh_start);
+
+    if (mesh.Indices.empty())
+    {
+        std::cerr << "Model file has no faces: " << path << std::endl;
+        return false;
+    }
+    if (missing_normals)
+        generateNormals(mesh, needs_normal);
+    mesh.Box = computeBounds(mesh.Vertices.data(), mesh.Vertices.size());
+    return true;
+}
+
+// ---------------------------- Level of Detail Generation ----------------------------
+
+namespace
+{
+    // each level aims for this share of the triangles of the level before it
+    const float kLOD_TRIANGLE_RATIO = 0.5f;
+    // a last level that saves less than this share of the triangles isn't worth its memory
+    const float kLOD_MIN_SAVING = 0.2f;
+    // meshes this small are cheap enough at full detail
+    const std::size_t kLOD_MIN_TRIANGLES = 32;
+    // a collapse must not turn any remaining triangle further than this cosine, or it could fold over
+    const double kLOD_MIN_NORMAL_DOT = 0.25;
+
+    /* Sum of squared distances to a set of planes, as the upper triangle of a symmetric 4x4 matrix. */
+    struct Quadric
+    {
+        double A[10];
+    };
+
+    void addPlane(Quadric& quadric, const glm::dvec3& normal, double distance)
+    {
+        double* a = quadric.A;
+        a[0] += normal.x * normal.x; a[1] += normal.x * normal.y; a[2] += normal.x * normal.z; a[3] += normal.x * distance;
+        a[4] += normal.y * normal.y; a[5] += normal.y * normal.z; a[6] += normal.y * distance;
+        a[7] += normal.z * normal.z; a[8] += normal.z * distance;
+        a[9] += distance * distance;
+    }
+
+    void addQuadric(Quadric& quadric, const Quadric& other)
+    {
+        for (int i = 0; i < 10; i++)
+            quadric.A[i] += other.A[i];
+    }
+
+    double quadricError(const Quadric& quadric, const glm::dvec3& p)
+    {
+        const double* a = quadric.A;
+        double error = a[0] * p.x * p.x + 2.0 * a[1] * p.x * p.y + 2.0 * a[2] * p.x * p.z + 2.0 * a[3] * p.x
+                     + a[4] * p.y * p.y + 2.0 * a[5] * p.y * p.z + 2.0 * a[6] * p.y
+                     + a[7] * p.z * p.z + 2.0 * a[8] * p.z
+                     + a[9];
+        // rounding can take an error of zero slightly below it
+        return std::max(error, 0.0);
+    }
+
+    /* Moving one position onto a neighbour, removing the triangles between them. */
+    struct Collapse
+    {
+        double Cost;
+        std::uint32_t From;
+        std::uint32_t To;
+        /* Versions of both positions when the cost was computed. The collapse is stale if either changed. */
+        std::uint32_t FromVersion;
+        std::uint32_t ToVersion;
+
+        bool operator>(const Collapse& other) const { return this->Cost > other.Cost; }
+    };
+
+    struct PositionHash
+    {
+        std::size_t operator()(const glm::vec3& position) const
+        {
+            std::uint32_t bits[3];
+            std::memcpy(bits, &position, sizeof(bits));
+            return bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u;
+        }
+    };
+
+    /*
+        Simplifies a mesh by collapsing edges in order of the quadric error metric (Garland and
+        Heckbert). Collapses move a position onto one of its neighbours, so the simplified triangles
+        reuse the mesh's vertices. Positions on open borders or on seams in the normals or texture
+        coordinates are never moved, which keeps the outline and the seams in place.
+    */
+    class Simplifier
+    {
+    public:
+        explicit Simplifier(const MeshData& mesh);
+
+        /* Collapse edges until at most target triangles are left. Returns false if no more collapses are possible. */
+        bool reduce(std::size_t target);
+        /* Get the number of triangles left. */
+        std::size_t triangleCount() const { return this->LiveTriangles; }
+        /* Get the farthest the simplified surface can be from the original, in model space units. */
+        float error() const { return static_cast<float>(std::sqrt(this->MaxCost)); }
+        /* Add the indices of the remaining triangles to an index buffer. */
+        void appendIndices(std::vector<std::uint32_t>& indices) const;
+
+    private:
+        /* Queue the collapses of every edge around a position. */
+        void queueEdges(std::uint32_t position);
+        void queueCollapse(std::uint32_t from, std::uint32_t to);
+        /* Carry out a queued collapse if it is still valid. Returns false if it wasn't. */
+        bool collapse(const Collapse& candidate);
+
+    private:
+        std::vector<glm::dvec3> Points;
+        std::vector<Quadric> Quadrics;
+        std::vector<std::uint8_t> Locked;
+        std::vector<std::uint8_t> Removed;
+        std::vector<std::uint32_t> Versions;
+        /* Triangles using each position. Includes triangles that have since been removed. */
+        std::vector<std::vector<std::uint32_t>> PositionTriangles;
+        /* Corners of every triangle, as positions and as the vertices the mesh draws them with. */
+        std::vector<std::uint32_t> CornerPositions;
+        std::vector<std::uint32_t> CornerVertices;
+        std::vector<std::uint8_t> TriangleAlive;
+        std::size_t LiveTriangles;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> Queue;
+        double MaxCost;
+    };
+
+    Simplifier::Simplifier(const MeshData& mesh)
+        :   CornerVertices(mesh.Indices),
+            TriangleAlive(mesh.Indices.size() / 3, 1),
+            LiveTriangles(mesh.Indices.size() / 3),
+            MaxCost(0.0)
+    {
+        // vertices split by a seam share a position, and the simplification works on positions
+        std::unordered_map<glm::vec3, std::uint32_t, PositionHash> unique_positions;
+        std::vector<std::uint32_t> vertex_position(mesh.Vertices.size());
+        std::vector<std::uint32_t> wedges;
+        for (std::size_t i = 0; i < mesh.Vertices.size(); i++)
+        {
+            // adding zero turns -0 into 0, so both hash the same
+            glm::vec3 position = mesh.Vertices[i].Position + glm::vec3(0.0f);
+            std::unordered_map<glm::vec3, std::uint32_t, PositionHash>::iterator found = unique_positions.find(position);
+            if (found == unique_positions.end())
+            {
+                found = unique_positions.insert(std::make_pair(position, static_cast<std::uint32_t>(this->Points.size()))).first;
+                this->Points.push_back(glm::dvec3(position));
+                wedges.push_back(0);
+            }
+            vertex_position[i] = found->second;
+            wedges[found->second]++;
+        }
+
+        std::size_t position_count = this->Points.size();
+        Quadric zero = {};
+        this->Quadrics.assign(position_count, zero);
+        this->Locked.assign(position_count, 0);
+        this->Removed.assign(position_count, 0);
+        this->Versions.assign(position_count, 0);
+        this->PositionTriangles.resize(position_count);
+        for (std::size_t p = 0; p < position_count; p++)
+            this->Locked[p] = wedges[p] > 1;
+
+        // each triangle's plane goes into the quadrics of its corners, and each edge counts its triangles
+        std::unordered_map<std::uint64_t, std::uint32_t> edge_uses;
+        this->CornerPositions.resize(this->CornerVertices.size());
+        for (std::size_t t = 0; t < this->TriangleAlive.size(); t++)
+        {
+            std::uint32_t* corners = this->CornerPositions.data() + t * 3;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                corners[corner] = vertex_position[this->CornerVertices[t * 3 + corner]];
+                this->PositionTriangles[corners[corner]].push_back(static_cast<std::uint32_t>(t));
+            }
+            glm::dvec3 normal = glm::cross(this->Points[corners[1]] - this->Points[corners[0]],
+                                           this->Points[corners[2]] - this->Points[corners[0]]);
+            double length = glm::length(normal);
+            if (length > 0.0)
+            {
+                normal /= length;
+                double distance = -glm::dot(normal, this->Points[corners[0]]);
+                for (int corner = 0; corner < 3; corner++)
+                    addPlane(this->Quadrics[corners[corner]], normal, distance);
+            }
+            for (int corner = 0; corner < 3; corner++)
+            {
+                std::uint64_t a = corners[corner];
+                std::uint64_t b = corners[(corner + 1) % 3];
+                edge_uses[std::min(a, b) << 32 | std::max(a, b)]++;
+            }
+        }
+        // an edge with one triangle is on an open border
+        for (std::unordered_map<std::uint64_t, std::uint32_t>::const_iterator edge = edge_uses.begin(); edge != edge_uses.end(); ++edge)
+        {
+            if (edge->second == 1)
+            {
+                this->Locked[edge->first >> 32] = 1;
+                this->Locked[edge->first & 0xFFFFFFFFu] = 1;
+            }
+        }
+
+        for (std::size_t p = 0; p < position_count; p++)
+        {
+            if (!this->Locked[p])
+                queueEdges(static_cast<std::uint32_t>(p));
+        }
+    }
+
+    bool Simplifier::reduce(std::size_t target)
+    {
+        while (this->LiveTriangles > target)
+        {
+            if (this->Queue.empty())
+                return false;
+            Collapse candidate = this->Queue.top();
+            this->Queue.pop();
+            collapse(candidate);
+        }
+        return true;
+    }
+
+    void Simplifier::appendIndices(std::vector<std::uint32_t>& indices) const
+    {
+        for (std::size_t t = 0; t < this->TriangleAlive.size(); t++)
+        {
+            if (this->TriangleAlive[t])
+                indices.insert(indices.end(), this->CornerVertices.begin() + t * 3, this->CornerVertices.begin() + t * 3 + 3);
+        }
+    }
+
+    void Simplifier::queueEdges(std::uint32_t position)
+    {
+        const std::vector<std::uint32_t>& triangles = this->PositionTriangles[position];
+        for (std::size_t i = 0; i < triangles.size(); i++)
+        {
+            std::uint32_t t = triangles[i];
+            if (!this->TriangleAlive[t])
+                continue;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                std::uint32_t other = this->CornerPositions[t * 3 + corner];
+                if (other == position)
+                    continue;
+                queueCollapse(position, other);
+                queueCollapse(other, position);
+            }
+        }
+    }
+
+    void Simplifier::queueCollapse(std::uint32_t from, std::uint32_t to)
+    {
+        if (this->Locked[from])
+            return;
+        Quadric combined = this->Quadrics[from];
+        addQuadric(combined, this->Quadrics[to]);
+        Collapse candidate = { quadricError(combined, this->Points[to]), from, to, this->Versions[from], this->Versions[to] };
+        this->Queue.push(candidate);
+    }
+
+    bool Simplifier::collapse(const Collapse& candidate)
+    {
+        std::uint32_t from = candidate.From;
+        std::uint32_t to = candidate.To;
+        if (this->Removed[from] || this->Removed[to]
+            || this->Versions[from] != candidate.FromVersion || this->Versions[to] != candidate.ToVersion)
+            return false;
+
+        // the triangles left around the position must keep facing the same way once it has moved
+        const std::vector<std::uint32_t>& triangles = this->PositionTriangles[from];
+        std::uint32_t to_vertex = 0xFFFFFFFFu;
+        for (std::size_t i = 0; i < triangles.size(); i++)
+        {
+            std::uint32_t t = triangles[i];
+            if (!this->TriangleAlive[t])
+                continue;
+            const std::uint32_t* corners = this->CornerPositions.data() + t * 3;
+            if (corners[0] == to || corners[1] == to || corners[2] == to)
+            {
+                // a seam can split the position being moved onto, so use its vertex on this side
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    if (corners[corner] == to && to_vertex == 0xFFFFFFFFu)
+                        to_vertex = this->CornerVertices[t * 3 + corner];
+                }
+                continue;
+            }
+            glm::dvec3 before[3], after[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                before[corner] = this->Points[corners[corner]];
+                after[corner] = corners[corner] == from ? this->Points[to] : before[corner];
+            }
+            glm::dvec3 normal_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::dvec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+            double lengths = glm::length(normal_before) * glm::length(normal_after);
+            if (lengths <= 0.0 || glm::dot(normal_before, normal_after) < kLOD_MIN_NORMAL_DOT * lengths)
+                return false;
+        }
+        // the positions no longer share an edge
+        if (to_vertex == 0xFFFFFFFFu)
+            return false;
+
+        for (std::size_t i = 0; i < triangles.size(); i++)
+        {
+            std::uint32_t t = triangles[i];
+            if (!this->TriangleAlive[t])
+                continue;
+            std::uint32_t* corners = this->CornerPositions.data() + t * 3;
+            if (corners[0] == to || corners[1] == to || corners[2] == to)
+            {
+                this->TriangleAlive[t] = 0;
+                this->LiveTriangles--;
+                continue;
+            }
+            for (int corner = 0; corner < 3; corner++)
+            {
+                if (corners[corner] == from)
+                {
+                    corners[corner] = to;
+                    this->CornerVertices[t * 3 + corner] = to_vertex;
+                }
+            }
+            this->PositionTriangles[to].push_back(t);
+        }
+        addQuadric(this->Quadrics[to], this->Quadrics[from]);
+        this->Removed[from] = 1;
+        this->Versions[to]++;
+        this->MaxCost = std::max(this->MaxCost, candidate.Cost);
+        queueEdges(to);
+        return true;
+    }
+}
+
+void buildLods(MeshData& mesh)
+{
+    mesh.Lods.clear();
+    MeshLod full = { 0, static_cast<std::uint32_t>(mesh.Indices.size()), 0.0f };
+    mesh.Lods.push_back(full);
+    if (mesh.Indices.size() / 3 < kLOD_MIN_TRIANGLES)
+        return;
+
+    // one simplification runs down the whole chain, and each level is a snapshot of it
+    Simplifier simplifier(mesh);
+    std::vector<std::uint32_t> lod_indices;
+    while (mesh.Lods.size() < Mesh::kMAX_LODS)
+    {
+        std::size_t previous = simplifier.triangleCount();
+        std::size_t target = static_cast<std::size_t>(previous * kLOD_TRIANGLE_RATIO);
+        if (target < kLOD_MIN_TRIANGLES)
+            break;
+        bool reached = simplifier.reduce(target);
+        if (!reached && simplifier.triangleCount() > previous * (1.0f - kLOD_MIN_SAVING))
+            break;
+
+        MeshLod lod;
+        lod.IndexOffset = static_cast<std::uint32_t>(mesh.Indices.size() + lod_indices.size());
+        simplifier.appendIndices(lod_indices);
+        lod.IndexCount = static_cast<std::uint32_t>(mesh.Indices.size() + lod_indices.size()) - lod.IndexOffset;
+        lod.Error = simplifier.error();
+        mesh.Lods.push_back(lod);
+        if (!reached)
+            break;
+    }
+    mesh.Indices.insert(mesh.Indices.end(), lod_indices.begin(), lod_indices.end());
+}
+
+// ---------------------------- Vertex Cache Optimization ----------------------------
+
+namespace
+{
+    // Simulated LRU cache size. Larger than most real FIFO caches, which is what Forsyth recommends
+    // since the ordering degrades gracefully on smaller caches.
+    const int kCACHE_SIZE = 32;
+    const float kCACHE_DECAY_POWER = 1.5f;
+    const float kLAST_TRIANGLE_SCORE = 0.75f;
+    const float kVALENCE_BOOST_SCALE = 2.0f;
+    const float kVALENCE_BOOST_POWER = 0.5f;
+
+    /* Score a vertex by how recently it was used and how few triangles still need it. */
+    float vertexScore(int cache_position, unsigned int remaining_triangles)
+    {
+        if (remaining_triangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cache_position >= 0)
+        {
+            if (cache_position < 3)
+            {
+                // the triangle just emitted; a fixed score stops it being favoured too much
+                score = kLAST_TRIANGLE_SCORE;
+            }
+            else
+            {
+                const float scaler = 1.0f / (kCACHE_SIZE - 3);
+                score = 1.0f - (cache_position - 3) * scaler;
+                score = std::pow(score, kCACHE_DECAY_POWER);
+            }
+        }
+        // vertices with few triangles left are finished off early so they can leave the cache
+        score += kVALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining_triangles), -kVALENCE_BOOST_POWER);
+        return score;
+    }
+}
+
+void optimizeVertexCache(std::uint32_t* indices, std::size_t index_count, std::size_t vertex_count)
+{
+    std::size_t triangle_count = index_count / 3;
+    if (triangle_count < 2)
+        return;
+
+    // triangle adjacency for each vertex, as offsets into one flat list
+    std::vector<unsigned int> remaining(vertex_count, 0);
+    for (std::size_t i = 0; i < triangle_count * 3; i++)
+        remaining[indices[i]]++;
+    std::vector<std::size_t> adjacency_offset(vertex_count + 1, 0);
+    for (std::size_t v = 0; v < vertex_count; v++)
+        adjacency_offset[v + 1] = adjacency_offset[v] + remaining[v];
+    std::vector<std::uint32_t> adjacency(triangle_count * 3);
+    {
+        std::vector<std::size_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+        for (std::size_t t = 0; t < triangle_count; t++)
+            for (int corner = 0; corner < 3; corner++)
+                adjacency[fill[indices[t * 3 + corner]]++] = static_cast<std::uint32_t>(t);
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (std::size_t v = 0; v < vertex_count; v++)
+        vertex_scores[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangle_scores(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (std::size_t t = 0; t < triangle_count; t++)
+    {
+        triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]]
+                           + vertex_scores[indices[t * 3 + 2]];
+    }
+
+    std::vector<std::uint32_t> output;
+    output.reserve(triangle_count * 3);
+    // the cache holds up to 3 extra entries while a new triangle is pushed in
+    std::vector<std::uint32_t> cache;
+    std::vector<std::uint32_t> next_cache;
+    cache.reserve(kCACHE_SIZE + 3);
+    next_cache.reserve(kCACHE_SIZE + 3);
+
+    std::size_t best_triangle = 0;
+    for (std::size_t t = 1; t < triangle_count; t++)
+        if (triangle_scores[t] > triangle_scores[best_triangle])
+            best_triangle = t;
+    std::size_t scan_start = 0;
+
+    for (std::size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+    {
+        if (best_triangle == triangle_count)
+        {
+            // nothing in the cache touches an unemitted triangle, so start again from the next free one
+            while (emitted[scan_start])
+                scan_start++;
+            best_triangle = scan_start;
+        }
+
+        // emit the triangle and take it out of its vertices' remaining counts
+        emitted[best_triangle] = true;
+        const std::uint32_t* triangle = indices + best_triangle * 3;
+        next_cache.clear();
+        for (int corner = 0; corner < 3; corner++)
+        {
+            std::uint32_t v = triangle[corner];
+            output.push_back(v);
+            next_cache.push_back(v);
+            remaining[v]--;
+            // drop the triangle from the vertex's adjacency so later scans skip it
+            std::uint32_t* first = adjacency.data() + adjacency_offset[v];
+            std::uint32_t* last = first + remaining[v];
+            for (std::uint32_t* a = first; a <= last; a++)
+            {
+                if (*a == best_triangle)
+                {
+                    *a = *last;
+                    break;
+                }
+            }
+        }
+        // the rest of the old cache moves back behind the new triangle
+        for (std::size_t i = 0; i < cache.size(); i++)
+        {
+            std::uint32_t v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                next_cache.push_back(v);
+        }
+        for (std::size_t i = kCACHE_SIZE; i < next_cache.size(); i++)
+        {
+            cache_position[next_cache[i]] = -1;
+            vertex_scores[next_cache[i]] = vertexScore(-1, remaining[next_cache[i]]);
+        }
+        if (next_cache.size() > static_cast<std::size_t>(kCACHE_SIZE))
+            next_cache.resize(kCACHE_SIZE);
+        cache.swap(next_cache);
+
+        // only vertices in the cache changed score, so only their triangles need to be re-scored
+        for (std::size_t i = 0; i < cache.size(); i++)
+        {
+            std::uint32_t v = cache[i];
+            cache_position[v] = static_cast<int>(i);
+            vertex_scores[v] = vertexScore(static_cast<int>(i), remaining[v]);
+        }
+        best_triangle = triangle_count;
+        float best_score = -1.0f;
+        for (std::size_t i = 0; i < cache.size(); i++)
+        {
+            std::uint32_t v = cache[i];
+            for (std::size_t a = 0; a < remaining[v]; a++)
+            {
+                std::uint32_t t = adjacency[adjacency_offset[v] + a];
+                float score = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]]
+                            + vertex_scores[indices[t * 3 + 2]];
+                triangle_scores[t] = score;
+                if (score > best_score)
+                {
+                    best_score = score;
+                    best_triangle = t;
+                }
+            }
+        }
+    }
+
+    std::memcpy(indices, output.data(), output.size() * sizeof(std::uint32_t));
+}
+
+void optimizeVertexCache(MeshData& mesh)
+{
+    for (std::size_t i = 0; i < mesh.SubMeshes.size(); i++)
+    {
+        const SubMesh& sub_mesh = mesh.SubMeshes[i];
+        optimizeVertexCache(mesh.Indices.data() + sub_mesh.IndexOffset, sub_mesh.IndexCount, mesh.Vertices.size());
+    }
+    // the sub-meshes already cover level 0
+    for (std::size_t i = 1; i < mesh.Lods.size(); i++)
+    {
+        const MeshLod& lod = mesh.Lods[i];
+        optimizeVertexCache(mesh.Indices.data() + lod.IndexOffset, lod.IndexCount, mesh.Vertices.size());
+    }
+}
+
+void optimizeVertexFetch(MeshData& mesh)
+{
+    const std::uint32_t kUNUSED = 0xFFFFFFFFu;
+    std::vector<std::uint32_t> remap(mesh.Vertices.size(), kUNUSED);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.Vertices.size());
+
+    for (std::size_t i = 0; i < mesh.Indices.size(); i++)
+    {
+        std::uint32_t& index = mesh.Indices[i];
+        if (remap[index] == kUNUSED)
+        {
+            remap[index] = static_cast<std::uint32_t>(vertices.size());
+            vertices.push_back(mesh.Vertices[index]);
+        }
+        index = remap[index];
+    }
+    // vertices no face uses are dropped
+    mesh.Vertices.swap(vertices);
+}
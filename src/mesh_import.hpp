@@ -0,0 +1,42 @@
+#ifndef MESH_IMPORT_HPP
+#define MESH_IMPORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.hpp"
+
+/*
+    Import a Wavefront OBJ file.
+    Faces are triangulated and every unique position/texture coordinate/normal combination becomes one
+    vertex, so the result is an indexed mesh. Objects, groups and material changes start new sub-meshes.
+    Normals are generated if the file has none. Returns false if the file can't be read or has no faces.
+*/
+bool importObj(const char* path, MeshData& mesh);
+
+/*
+    Build up to Mesh::kMAX_LODS - 1 simplified levels of detail, each with about half the triangles
+    of the one before, using quadric error metric edge collapses. The levels reuse the mesh's
+    vertices, so only their indices are added, after those of the full mesh. Run this before
+    optimizeVertexCache, which also reorders the levels.
+*/
+void buildLods(MeshData& mesh);
+
+/*
+    Reorder triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm).
+    Triangles that reuse recently transformed vertices are emitted first, so fewer vertices are
+    shaded more than once. Each sub-mesh is reordered separately.
+*/
+void optimizeVertexCache(MeshData& mesh);
+
+/*
+    Reorder vertices into the order the index buffer first uses them, so vertex fetches walk
+    through memory mostly forwards. Run this after optimizeVertexCache.
+*/
+void optimizeVertexFetch(MeshData& mesh);
+
+/* Reorder the triangles of one index range in place. Exposed for meshes that don't use MeshData. */
+void optimizeVertexCache(std::uint32_t* indices, std::size_t index_count, std::size_t vertex_count);
+
+#endif  // MESH_IMPORT_HPP
@@ -0,0 +1,164 @@
+#include "model.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "mapped_file.hpp"
+#include "mesh_import.hpp"
+
+namespace
+{
+    const char kMESH_CACHE_MAGIC[4] = { 'E', 'M', 'S', 'H' };
+    // bump whenever MeshCacheHeader, Vertex, the optimizations or the level of detail generation change
+    const std::uint32_t kMESH_CACHE_VERSION = 2;
+    const char* kMESH_CACHE_EXTENSION = ".meshcache";
+    // sections start on a 16 byte boundary so the mapped arrays are suitably aligned
+    const std::uint64_t kSECTION_ALIGNMENT = 16;
+
+    std::uint64_t alignSection(std::uint64_t offset)
+    {
+        return (offset + kSECTION_ALIGNMENT - 1) & ~(kSECTION_ALIGNMENT - 1);
+    }
+
+    /* Check that a section lies inside the file. */
+    bool sectionFits(std::uint64_t offset, std::uint64_t size, std::uint64_t file_size)
+    {
+        return offset % kSECTION_ALIGNMENT == 0 && offset <= file_size && size <= file_size - offset;
+    }
+
+    bool writeSection(std::FILE* file, std::uint64_t& position, std::uint64_t offset, const void* data, std::size_t size)
+    {
+        static const char padding[kSECTION_ALIGNMENT] = {};
+        if (offset > position && std::fwrite(padding, 1, static_cast<std::size_t>(offset - position), file) != offset - position)
+            return false;
+        if (size > 0 && std::fwrite(data, 1, size, file) != size)
+            return false;
+        position = offset + size;
+        return true;
+    }
+
+    /* Import the source file, build its levels of detail, optimize it and write the cache. */
+    bool importAndCache(const char* path, const std::string& cache_path, const FileStamp& source, MeshData& data)
+    {
+        if (!importObj(path, data))
+            return false;
+        buildLods(data);
+        optimizeVertexCache(data);
+        optimizeVertexFetch(data);
+
+        // the mesh is still usable if the cache can't be written, it just gets imported again next time
+        if (!writeMeshCache(cache_path.c_str(), data, source))
+            std::cerr << "Failed to write mesh cache: " << cache_path << std::endl;
+        return true;
+    }
+}
+
+bool writeMeshCache(const char* path, const MeshData& mesh, const FileStamp& source)
+{
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.Magic, kMESH_CACHE_MAGIC, sizeof(header.Magic));
+    header.Version = kMESH_CACHE_VERSION;
+    header.SourceSize = source.Size;
+    header.SourceModifiedTime = source.ModifiedTime;
+    header.VertexStride = sizeof(Vertex);
+    header.VertexCount = static_cast<std::uint32_t>(mesh.Vertices.size());
+    header.IndexCount = static_cast<std::uint32_t>(mesh.Indices.size());
+    header.SubMeshCount = static_cast<std::uint32_t>(mesh.SubMeshes.size());
+    header.LodCount = static_cast<std::uint32_t>(mesh.Lods.size());
+    header.SubMeshOffset = alignSection(sizeof(MeshCacheHeader));
+    header.LodOffset = alignSection(header.SubMeshOffset + header.SubMeshCount * sizeof(SubMesh));
+    header.VertexOffset = alignSection(header.LodOffset + header.LodCount * sizeof(MeshLod));
+    header.IndexOffset = alignSection(header.VertexOffset + header.VertexCount * sizeof(Vertex));
+    for (int i = 0; i < 3; i++)
+    {
+        header.BoundsMin[i] = mesh.Box.Min[i];
+        header.BoundsMax[i] = mesh.Box.Max[i];
+    }
+
+    // write to a temporary file first so a failed write never leaves a truncated cache behind
+    std::string temp_path = makeTempPath(path);
+    std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file)
+        return false;
+    std::uint64_t position = 0;
+    bool written = writeSection(file, position, 0, &header, sizeof(header))
+                && writeSection(file, position, header.SubMeshOffset, mesh.SubMeshes.data(), mesh.SubMeshes.size() * sizeof(SubMesh))
+                && writeSection(file, position, header.LodOffset, mesh.Lods.data(), mesh.Lods.size() * sizeof(MeshLod))
+                && writeSection(file, position, header.VertexOffset, mesh.Vertices.data(), mesh.Vertices.size() * sizeof(Vertex))
+                && writeSection(file, position, header.IndexOffset, mesh.Indices.data(), mesh.Indices.size() * sizeof(std::uint32_t));
+    written = (std::fclose(file) == 0) && written;
+    return replaceFile(temp_path, path, written);
+}
+
+bool readMeshCache(const MappedFile& file, const FileStamp& source, MeshView& view)
+{
+    if (file.size() < sizeof(MeshCacheHeader))
+        return false;
+    MeshCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.Magic, kMESH_CACHE_MAGIC, sizeof(header.Magic)) != 0
+        || header.Version != kMESH_CACHE_VERSION
+        || header.VertexStride != sizeof(Vertex))
+        return false;
+    if (header.SourceSize != source.Size || header.SourceModifiedTime != source.ModifiedTime)
+        return false;
+
+    std::uint64_t file_size = file.size();
+    if (!sectionFits(header.SubMeshOffset, std::uint64_t(header.SubMeshCount) * sizeof(SubMesh), file_size)
+        || !sectionFits(header.LodOffset, std::uint64_t(header.LodCount) * sizeof(MeshLod), file_size)
+        || !sectionFits(header.VertexOffset, std::uint64_t(header.VertexCount) * sizeof(Vertex), file_size)
+        || !sectionFits(header.IndexOffset, std::uint64_t(header.IndexCount) * sizeof(std::uint32_t), file_size))
+        return false;
+    // a level of detail outside the index buffer would draw garbage
+    const MeshLod* lods = reinterpret_cast<const MeshLod*>(file.data() + header.LodOffset);
+    for (std::uint32_t i = 0; i < header.LodCount; i++)
+    {
+        if (lods[i].IndexOffset > header.IndexCount || lods[i].IndexCount > header.IndexCount - lods[i].IndexOffset)
+            return false;
+    }
+
+    view.SubMeshes = reinterpret_cast<const SubMesh*>(file.data() + header.SubMeshOffset);
+    view.SubMeshCount = header.SubMeshCount;
+    view.Lods = reinterpret_cast<const MeshLod*>(file.data() + header.LodOffset);
+    view.LodCount = header.LodCount;
+    view.Vertices = reinterpret_cast<const Vertex*>(file.data() + header.VertexOffset);
+    view.VertexCount = header.VertexCount;
+    view.Indices = reinterpret_cast<const std::uint32_t*>(file.data() + header.IndexOffset);
+    view.IndexCount = header.IndexCount;
+    view.Box.Min = glm::vec3(header.BoundsMin[0], header.BoundsMin[1], header.BoundsMin[2]);
+    view.Box.Max = glm::vec3(header.BoundsMax[0], header.BoundsMax[1], header.BoundsMax[2]);
+    return true;
+}
+
+bool loadMeshSource(const char* path, MeshSource& source)
+{
+    FileStamp stamp;
+    if (!readFileStamp(path, stamp))
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    std::string cache_path = std::string(path) + kMESH_CACHE_EXTENSION;
+    if (source.Cache.open(cache_path.c_str()) && readMeshCache(source.Cache, stamp, source.View))
+        return true;
+    source.Cache.close();
+    if (!importAndCache(path, cache_path, stamp, source.Data))
+        return false;
+    source.View = makeMeshView(source.Data);
+    return true;
+}
+
+Model::Model(const char* path, VertexFormat format)
+{
+    MeshSource source;
+    if (loadMeshSource(path, source))
+        this->ModelMesh.reset(new Mesh(source.View, format));
+}
+
+Model::~Model()
+{
+}
@@ -0,0 +1,92 @@
+#ifndef MODEL_HPP
+#define MODEL_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+
+/*
+    Header of a binary mesh cache file.
+    The header is followed by the sub-mesh table, the level of detail table, the vertices and the
+    indices of every level, each at the offset
+    given here and in exactly the layout the GPU buffers use, so a mapped cache can be uploaded as is.
+*/
+struct MeshCacheHeader
+{
+    char Magic[4];
+    std::uint32_t Version;
+    /* Stamp of the source file the cache was built from. */
+    std::uint64_t SourceSize;
+    std::int64_t SourceModifiedTime;
+    std::uint32_t VertexStride;
+    std::uint32_t VertexCount;
+    std::uint32_t IndexCount;
+    std::uint32_t SubMeshCount;
+    std::uint32_t LodCount;
+    std::uint32_t Padding;
+    std::uint64_t SubMeshOffset;
+    std::uint64_t LodOffset;
+    std::uint64_t VertexOffset;
+    std::uint64_t IndexOffset;
+    float BoundsMin[3];
+    float BoundsMax[3];
+};
+
+/* Write a mesh to a cache file, tagged with the stamp of its source file. */
+bool writeMeshCache(const char* path, const MeshData& mesh, const FileStamp& source);
+/*
+    Validate a mapped cache file and get a view of the mesh inside it.
+    Returns false if the file is not a mesh cache, was written by a different version, or is out of
+    date with the source file.
+*/
+bool readMeshCache(const MappedFile& file, const FileStamp& source, MeshView& view);
+
+/* A model file loaded into memory and ready to upload, from its mapped cache or freshly imported. */
+struct MeshSource
+{
+    MappedFile Cache;
+    /* The imported mesh, empty if the cache was used. */
+    MeshData Data;
+    /* View of the mesh in Cache or Data. */
+    MeshView View;
+};
+
+/*
+    Load a model file into memory without touching GL. The first load imports the file, builds its
+    levels of detail, optimizes it and writes "<path>.meshcache" next to it. Later loads map that
+    cache. Can run on any thread.
+*/
+bool loadMeshSource(const char* path, MeshSource& source);
+
+/*
+    A mesh loaded from a model file.
+    The first load imports the file, builds its levels of detail, optimizes it and writes
+    "<path>.meshcache" next to it. Later
+    loads map that cache and upload it straight to the GPU without parsing anything.
+*/
+class Model
+{
+public:
+    /*
+        Construct a Model object by loading the model file at the given path. The cache always holds
+        float vertices, which are converted to the vertex format as they are uploaded.
+    */
+    Model(const char* path, VertexFormat format = kVERTEX_FORMAT_FLOAT);
+    ~Model();
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    /* Check if the model was loaded. */
+    bool isLoaded() const { return this->ModelMesh != NULL; }
+    /* Get the mesh of the model. Only valid if isLoaded() is true. */
+    Mesh& mesh() { return *this->ModelMesh; }
+    const Mesh& mesh() const { return *this->ModelMesh; }
+
+private:
+    std::unique_ptr<Mesh> ModelMesh;
+};
+
+#endif  // MODEL_HPP
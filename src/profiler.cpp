@@ -0,0 +1,301 @@
+#include "profiler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+#include <glad/glad.h>
+
+constexpr std::uint32_t Profiler::kRING_SIZE;
+constexpr unsigned int Profiler::kGPU_FRAME_LATENCY;
+constexpr std::uint32_t Profiler::kGPU_THREAD;
+constexpr std::size_t Profiler::kMAX_CAPTURED_EVENTS;
+
+namespace
+{
+    // weight of the newest frame in the running averages
+    const double kAVERAGE_WEIGHT = 0.05;
+    // queries are created in batches to keep glGenQueries out of most frames
+    const unsigned int kQUERY_BATCH = 64;
+    // thread id used for the GPU timeline in Chrome traces
+    const unsigned int kTRACE_GPU_THREAD = 1000;
+
+    thread_local void* current_thread_ring = NULL;
+
+    std::uint64_t steadyNanoseconds()
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+    :   Epoch(steadyNanoseconds()),
+        FrameIndex(0),
+        GpuDepth(0),
+        InFrame(false),
+        FrameStart(0),
+        FrameMilliseconds(0.0),
+        DroppedEvents(0),
+        Capturing(false)
+{
+    for (unsigned int i = 0; i < kGPU_FRAME_LATENCY; i++)
+        this->GpuFrames[i].ClockOffset = 0;
+}
+
+std::uint64_t Profiler::now() const
+{
+    return steadyNanoseconds() - this->Epoch;
+}
+
+void Profiler::beginFrame()
+{
+    // the slot being reused was last filled kGPU_FRAME_LATENCY frames ago, so its queries are done
+    GpuFrame& frame = this->GpuFrames[this->FrameIndex % kGPU_FRAME_LATENCY];
+    collectGpuFrame(frame);
+
+    // GPU timestamps are on their own clock; line them up with the CPU clock once per frame
+    GLint64 gpu_now = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    frame.ClockOffset = static_cast<std::int64_t>(now()) - static_cast<std::int64_t>(gpu_now);
+
+    this->FrameStart = now();
+    this->InFrame = true;
+}
+
+void Profiler::endFrame()
+{
+    this->InFrame = false;
+    this->FrameIndex++;
+    std::uint64_t frame_end = now();
+
+    {
+        std::lock_guard<std::mutex> lock(this->RingsMutex);
+        for (std::size_t i = 0; i < this->Rings.size(); i++)
+        {
+            ThreadRing& ring = *this->Rings[i];
+            std::uint32_t read = ring.Read.load(std::memory_order_relaxed);
+            std::uint32_t write = ring.Write.load(std::memory_order_acquire);
+            for (; read != write; read++)
+                consume(ring.Events[read % kRING_SIZE]);
+            // hand the slots back to the producer only after they have been read
+            ring.Read.store(read, std::memory_order_release);
+            this->DroppedEvents += ring.Dropped.exchange(0, std::memory_order_relaxed);
+        }
+    }
+
+    double frame_milliseconds = static_cast<double>(frame_end - this->FrameStart) / 1.0e6;
+    this->FrameMilliseconds += (frame_milliseconds - this->FrameMilliseconds) * kAVERAGE_WEIGHT;
+    ScopeAverages* timelines[2] = { &this->CpuAverages, &this->GpuAverages };
+    for (int t = 0; t < 2; t++)
+    {
+        std::unordered_map<const char*, ScopeAverage>& scopes = timelines[t]->Scopes;
+        for (std::unordered_map<const char*, ScopeAverage>::iterator it = scopes.begin(); it != scopes.end(); ++it)
+        {
+            ScopeAverage& average = it->second;
+            average.Milliseconds += (average.FrameTotal - average.Milliseconds) * kAVERAGE_WEIGHT;
+            average.FrameTotal = 0.0;
+        }
+    }
+}
+
+void Profiler::releaseGpuResources()
+{
+    for (unsigned int i = 0; i < kGPU_FRAME_LATENCY; i++)
+    {
+        std::vector<GpuScope>& scopes = this->GpuFrames[i].Scopes;
+        for (std::size_t j = 0; j < scopes.size(); j++)
+        {
+            this->FreeQueries.push_back(scopes[j].Queries[0]);
+            this->FreeQueries.push_back(scopes[j].Queries[1]);
+        }
+        scopes.clear();
+    }
+    if (!this->FreeQueries.empty())
+        glDeleteQueries(static_cast<GLsizei>(this->FreeQueries.size()), this->FreeQueries.data());
+    this->FreeQueries.clear();
+}
+
+void Profiler::startCapture()
+{
+    this->Captured.clear();
+    this->Capturing = true;
+}
+
+bool Profiler::writeChromeTrace(const char* path) const
+{
+    std::FILE* file = std::fopen(path, "w");
+    if (!file)
+        return false;
+
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", kTRACE_GPU_THREAD);
+    for (std::size_t i = 0; i < this->Captured.size(); i++)
+    {
+        const ProfileEvent& event = this->Captured[i];
+        unsigned int thread = event.Thread == kGPU_THREAD ? kTRACE_GPU_THREAD : event.Thread;
+        // complete events with microsecond times; names are string literals so need no escaping
+        std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                     event.Name, event.Thread == kGPU_THREAD ? "gpu" : "cpu", thread,
+                     static_cast<double>(event.Start) / 1000.0, static_cast<double>(event.End - event.Start) / 1000.0);
+    }
+    std::fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return std::fclose(file) == 0;
+}
+
+std::string Profiler::summary() const
+{
+    std::ostringstream stream;
+    stream.setf(std::ios::fixed);
+    stream.precision(2);
+    stream << "frame " << this->FrameMilliseconds << " ms";
+
+    const char* labels[2] = { " | cpu", " | gpu" };
+    const ScopeAverages* timelines[2] = { &this->CpuAverages, &this->GpuAverages };
+    for (int t = 0; t < 2; t++)
+    {
+        const ScopeAverages& averages = *timelines[t];
+        bool first = true;
+        for (std::size_t i = 0; i < averages.Order.size(); i++)
+        {
+            const ScopeAverage& average = averages.Scopes.find(averages.Order[i])->second;
+            // only the outer scopes fit on one line
+            if (average.Depth > 1)
+                continue;
+            stream << (first ? labels[t] : ",") << " " << averages.Order[i] << " " << average.Milliseconds;
+            first = false;
+        }
+    }
+    if (this->DroppedEvents > 0)
+        stream << " | " << this->DroppedEvents << " dropped";
+    return stream.str();
+}
+
+void Profiler::recordCpu(const char* name, std::uint64_t start, std::uint64_t end, std::uint32_t depth)
+{
+    ThreadRing& ring = threadRing();
+    std::uint32_t write = ring.Write.load(std::memory_order_relaxed);
+    std::uint32_t read = ring.Read.load(std::memory_order_acquire);
+    if (write - read >= kRING_SIZE)
+    {
+        // never block the thread being measured; the loss shows up in the summary
+        ring.Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ProfileEvent& event = ring.Events[write % kRING_SIZE];
+    event.Name = name;
+    event.Start = start;
+    event.End = end;
+    event.Thread = ring.Index;
+    event.Depth = depth;
+    // publish the event only once it has been written
+    ring.Write.store(write + 1, std::memory_order_release);
+}
+
+std::uint32_t& Profiler::threadDepth()
+{
+    return threadRing().Depth;
+}
+
+int Profiler::beginGpuScope(const char* name)
+{
+    if (!this->InFrame)
+        return -1;
+    GpuFrame& frame = this->GpuFrames[this->FrameIndex % kGPU_FRAME_LATENCY];
+    GpuScope scope;
+    scope.Name = name;
+    scope.Depth = this->GpuDepth++;
+    acquireQueries(scope.Queries);
+    // timestamps rather than GL_TIME_ELAPSED, because elapsed time queries can't be nested
+    glQueryCounter(scope.Queries[0], GL_TIMESTAMP);
+    frame.Scopes.push_back(scope);
+    return static_cast<int>(frame.Scopes.size() - 1);
+}
+
+void Profiler::endGpuScope(int scope)
+{
+    if (scope < 0 || !this->InFrame)
+        return;
+    GpuFrame& frame = this->GpuFrames[this->FrameIndex % kGPU_FRAME_LATENCY];
+    glQueryCounter(frame.Scopes[scope].Queries[1], GL_TIMESTAMP);
+    this->GpuDepth--;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+Profiler::ThreadRing& Profiler::threadRing()
+{
+    if (!current_thread_ring)
+    {
+        std::unique_ptr<ThreadRing> ring(new ThreadRing());
+        ring->Write.store(0);
+        ring->Read.store(0);
+        ring->Dropped.store(0);
+        ring->Depth = 0;
+
+        std::lock_guard<std::mutex> lock(this->RingsMutex);
+        ring->Index = static_cast<std::uint32_t>(this->Rings.size());
+        current_thread_ring = ring.get();
+        this->Rings.push_back(std::move(ring));
+    }
+    return *static_cast<ThreadRing*>(current_thread_ring);
+}
+
+void Profiler::consume(const ProfileEvent& event)
+{
+    ScopeAverages& averages = event.Thread == kGPU_THREAD ? this->GpuAverages : this->CpuAverages;
+    std::unordered_map<const char*, ScopeAverage>::iterator it = averages.Scopes.find(event.Name);
+    if (it == averages.Scopes.end())
+    {
+        ScopeAverage average = { 0.0, 0.0, event.Depth };
+        it = averages.Scopes.insert(std::make_pair(event.Name, average)).first;
+        averages.Order.push_back(event.Name);
+    }
+    it->second.FrameTotal += static_cast<double>(event.End - event.Start) / 1.0e6;
+
+    if (this->Capturing && this->Captured.size() < kMAX_CAPTURED_EVENTS)
+        this->Captured.push_back(event);
+}
+
+void Profiler::collectGpuFrame(GpuFrame& frame)
+{
+    for (std::size_t i = 0; i < frame.Scopes.size(); i++)
+    {
+        GpuScope& scope = frame.Scopes[i];
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(scope.Queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(scope.Queries[1], GL_QUERY_RESULT, &end);
+
+        ProfileEvent event;
+        event.Name = scope.Name;
+        event.Start = static_cast<std::uint64_t>(static_cast<std::int64_t>(start) + frame.ClockOffset);
+        event.End = static_cast<std::uint64_t>(static_cast<std::int64_t>(end) + frame.ClockOffset);
+        event.Thread = kGPU_THREAD;
+        event.Depth = scope.Depth;
+        consume(event);
+
+        this->FreeQueries.push_back(scope.Queries[0]);
+        this->FreeQueries.push_back(scope.Queries[1]);
+    }
+    frame.Scopes.clear();
+}
+
+void Profiler::acquireQueries(unsigned int* queries)
+{
+    if (this->FreeQueries.size() < 2)
+    {
+        std::size_t old_size = this->FreeQueries.size();
+        this->FreeQueries.resize(old_size + kQUERY_BATCH);
+        glGenQueries(kQUERY_BATCH, &this->FreeQueries[old_size]);
+    }
+    queries[1] = this->FreeQueries.back();
+    this->FreeQueries.pop_back();
+    queries[0] = this->FreeQueries.back();
+    this->FreeQueries.pop_back();
+}
@@ -0,0 +1,216 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Profiling scopes. Each one times the enclosing block from where it is declared until the end
+    of the block. Names must be string literals.
+        PROFILE_SCOPE("name")       CPU time, on any thread.
+        PROFILE_GPU_SCOPE("name")   CPU time and GPU time, on the render thread only.
+    PROFILE_BEGIN_FRAME() and PROFILE_END_FRAME() bracket each frame on the render thread.
+    Building with ENGINE_PROFILER=0 removes them entirely.
+*/
+#ifndef ENGINE_PROFILER
+#define ENGINE_PROFILER 1
+#endif
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#if ENGINE_PROFILER
+#define PROFILE_SCOPE(name) CpuProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_BEGIN_FRAME() Profiler::instance().beginFrame()
+#define PROFILE_END_FRAME() Profiler::instance().endFrame()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#define PROFILE_BEGIN_FRAME() ((void)0)
+#define PROFILE_END_FRAME() ((void)0)
+#endif
+
+/* A timed scope. Times are in nanoseconds since the profiler started. */
+struct ProfileEvent
+{
+    const char* Name;
+    std::uint64_t Start;
+    std::uint64_t End;
+    /* Index of the thread that recorded the event, or kGPU_THREAD for GPU events. */
+    std::uint32_t Thread;
+    std::uint32_t Depth;
+};
+
+/*
+    Collects profiling scopes from every thread and the GPU.
+    Each thread writes its scopes into its own single-producer ring buffer with no locking; the
+    render thread drains the rings once per frame in endFrame(). GPU scopes use pairs of
+    GL_TIMESTAMP queries that are read back several frames later, so the GPU is never waited on.
+*/
+class Profiler
+{
+public:
+    /* Number of events a thread can record between two endFrame() calls before events are dropped. */
+    static constexpr std::uint32_t kRING_SIZE = 4096;
+    /* Number of frames GPU queries are given to complete before they are read back. */
+    static constexpr unsigned int kGPU_FRAME_LATENCY = 3;
+    /* Thread index used for GPU events. */
+    static constexpr std::uint32_t kGPU_THREAD = 0xFFFFFFFFu;
+    /* Upper limit on the number of events kept by a capture. */
+    static constexpr std::size_t kMAX_CAPTURED_EVENTS = 4 * 1024 * 1024;
+
+    /* Get the profiler. */
+    static Profiler& instance();
+
+    /* Start a frame. Collects GPU results from earlier frames. Call on the render thread. */
+    void beginFrame();
+    /* End a frame. Drains the thread rings and updates the running averages. Call on the render thread. */
+    void endFrame();
+    /* Release the GPU queries. Call before the GL context is destroyed. */
+    void releaseGpuResources();
+
+    /* Start keeping every event for a Chrome trace, discarding any previous capture. */
+    void startCapture();
+    /* Write the captured events as Chrome trace_event JSON, viewable in chrome://tracing or Perfetto. */
+    bool writeChromeTrace(const char* path) const;
+    /* Get a one line summary of the average frame, CPU and GPU scope times in milliseconds. */
+    std::string summary() const;
+
+    /* Get the time in nanoseconds since the profiler started. */
+    std::uint64_t now() const;
+    /* Record a finished CPU scope for the calling thread. */
+    void recordCpu(const char* name, std::uint64_t start, std::uint64_t end, std::uint32_t depth);
+    /* Get the nesting depth counter of the calling thread. */
+    std::uint32_t& threadDepth();
+    /* Start a GPU scope, returning its index for endGpuScope(). */
+    int beginGpuScope(const char* name);
+    /* End a GPU scope. */
+    void endGpuScope(int scope);
+
+private:
+    /* A single-producer, single-consumer ring of events for one thread. */
+    struct ThreadRing
+    {
+        ProfileEvent Events[kRING_SIZE];
+        std::atomic<std::uint32_t> Write;
+        std::atomic<std::uint32_t> Read;
+        std::atomic<std::uint32_t> Dropped;
+        std::uint32_t Depth;
+        std::uint32_t Index;
+    };
+
+    /* A GPU scope recorded in a frame, with its pair of timestamp queries. */
+    struct GpuScope
+    {
+        const char* Name;
+        unsigned int Queries[2];
+        std::uint32_t Depth;
+    };
+
+    /* GPU scopes recorded in one frame, and the clock offset at the start of that frame. */
+    struct GpuFrame
+    {
+        std::vector<GpuScope> Scopes;
+        std::int64_t ClockOffset;
+    };
+
+    /* Running average time per frame of a named scope. */
+    struct ScopeAverage
+    {
+        double Milliseconds;
+        double FrameTotal;
+        std::uint32_t Depth;
+    };
+
+    /* Running averages of every scope seen on one timeline, in the order they first appeared. */
+    struct ScopeAverages
+    {
+        std::unordered_map<const char*, ScopeAverage> Scopes;
+        std::vector<const char*> Order;
+    };
+
+    Profiler();
+    /* Get the ring of the calling thread, creating it on first use. */
+    ThreadRing& threadRing();
+    /* Take a finished event into the averages and the capture. */
+    void consume(const ProfileEvent& event);
+    /* Read back the GPU scopes of a frame slot. */
+    void collectGpuFrame(GpuFrame& frame);
+    /* Get a pair of timestamp queries from the free list. */
+    void acquireQueries(unsigned int* queries);
+
+private:
+    std::uint64_t Epoch;
+
+    std::mutex RingsMutex;
+    std::vector<std::unique_ptr<ThreadRing> > Rings;
+
+    GpuFrame GpuFrames[kGPU_FRAME_LATENCY];
+    std::vector<unsigned int> FreeQueries;
+    std::size_t FrameIndex;
+    std::uint32_t GpuDepth;
+    bool InFrame;
+
+    std::uint64_t FrameStart;
+    double FrameMilliseconds;
+    ScopeAverages CpuAverages;
+    ScopeAverages GpuAverages;
+    std::uint64_t DroppedEvents;
+
+    bool Capturing;
+    std::vector<ProfileEvent> Captured;
+};
+
+/* Times a block on the CPU. Use through PROFILE_SCOPE. */
+class CpuProfileScope
+{
+public:
+    explicit CpuProfileScope(const char* name)
+        :   Name(name),
+            Depth(Profiler::instance().threadDepth()++),
+            Start(Profiler::instance().now())
+    {
+    }
+    ~CpuProfileScope()
+    {
+        Profiler& profiler = Profiler::instance();
+        profiler.recordCpu(this->Name, this->Start, profiler.now(), this->Depth);
+        profiler.threadDepth()--;
+    }
+    CpuProfileScope(const CpuProfileScope&) = delete;
+    CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+private:
+    const char* Name;
+    std::uint32_t Depth;
+    std::uint64_t Start;
+};
+
+/* Times a block on the CPU and the GPU. Use through PROFILE_GPU_SCOPE. */
+class GpuProfileScope
+{
+public:
+    explicit GpuProfileScope(const char* name)
+        :   Cpu(name),
+            Scope(Profiler::instance().beginGpuScope(name))
+    {
+    }
+    ~GpuProfileScope()
+    {
+        Profiler::instance().endGpuScope(this->Scope);
+    }
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+    CpuProfileScope Cpu;
+    int Scope;
+};
+
+#endif  // PROFILER_HPP
@@ -0,0 +1,111 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+#include "mesh.hpp"
+
+constexpr unsigned int DrawCommand::kMAX_TEXTURES;
+constexpr unsigned int RenderQueue::kPASS_BITS;
+constexpr unsigned int RenderQueue::kPROGRAM_BITS;
+constexpr unsigned int RenderQueue::kMATERIAL_BITS;
+constexpr unsigned int RenderQueue::kVERTEX_ARRAY_BITS;
+constexpr unsigned int RenderQueue::kDEPTH_BITS;
+
+namespace
+{
+    std::uint64_t keyField(unsigned int value, unsigned int bits)
+    {
+        return static_cast<std::uint64_t>(value) & ((std::uint64_t(1) << bits) - 1);
+    }
+}
+
+std::uint64_t RenderQueue::makeSortKey(const DrawCommand& command)
+{
+    float depth = std::min(std::max(command.Depth, 0.0f), 1.0f);
+    // translucent draws blend over what is behind them, so they go far to near
+    if (command.Pass == kPASS_TRANSLUCENT)
+        depth = 1.0f - depth;
+    unsigned int max_depth = (1u << kDEPTH_BITS) - 1;
+    unsigned int quantised_depth = static_cast<unsigned int>(depth * max_depth);
+
+    std::uint64_t key = keyField(command.Pass, kPASS_BITS);
+    key = (key << kPROGRAM_BITS) | keyField(command.Program, kPROGRAM_BITS);
+    key = (key << kMATERIAL_BITS) | keyField(command.Material, kMATERIAL_BITS);
+    key = (key << kVERTEX_ARRAY_BITS) | keyField(command.VertexArray, kVERTEX_ARRAY_BITS);
+    key = (key << kDEPTH_BITS) | keyField(quantised_depth, kDEPTH_BITS);
+    return key;
+}
+
+RenderQueue::RenderQueue()
+{
+}
+
+void RenderQueue::clear()
+{
+    this->Commands.clear();
+    this->Order.clear();
+}
+
+void RenderQueue::submit(const DrawCommand& command)
+{
+    SortEntry entry;
+    entry.Key = makeSortKey(command);
+    entry.Index = static_cast<std::uint32_t>(this->Commands.size());
+    this->Commands.push_back(command);
+    this->Order.push_back(entry);
+}
+
+void RenderQueue::sort()
+{
+    // the index breaks ties, so equal keys keep their submission order without a stable sort
+    std::sort(this->Order.begin(), this->Order.end(), [](const SortEntry& a, const SortEntry& b) {
+        if (a.Key != b.Key)
+            return a.Key < b.Key;
+        return a.Index < b.Index;
+    });
+}
+
+std::size_t RenderQueue::execute(GLStateCache& state) const
+{
+    std::size_t draws = 0;
+    for (std::size_t i = 0; i < this->Order.size(); i++)
+    {
+        if (issue(this->Commands[this->Order[i].Index], state))
+            draws++;
+    }
+    return draws;
+}
+
+std::size_t RenderQueue::execute(GLStateCache& state, RenderPass pass) const
+{
+    // the pass is the top field of the key, so each pass is one contiguous run of the sorted draws
+    std::size_t draws = 0;
+    for (std::size_t i = 0; i < this->Order.size(); i++)
+    {
+        const DrawCommand& command = this->Commands[this->Order[i].Index];
+        if (command.Pass < pass)
+            continue;
+        if (command.Pass > pass)
+            break;
+        if (issue(command, state))
+            draws++;
+    }
+    return draws;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+bool RenderQueue::issue(const DrawCommand& command, GLStateCache& state)
+{
+    if (command.InstanceCount == 0 || !command.DrawMesh)
+        return false;
+    state.useProgram(command.Program);
+    for (unsigned int unit = 0; unit < command.TextureCount && unit < DrawCommand::kMAX_TEXTURES; unit++)
+        state.bindTexture(unit, command.TextureTarget, command.Textures[unit]);
+    state.bindVertexArray(command.VertexArray);
+    command.DrawMesh->drawInstanced(command.InstanceCount, command.Lod);
+    return true;
+}
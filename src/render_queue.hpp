@@ -0,0 +1,101 @@
+#ifndef RENDER_QUEUE_HPP
+#define RENDER_QUEUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class GLStateCache;
+class Mesh;
+
+/* Groups of draws, submitted in this order. */
+enum RenderPass
+{
+    /* Depth only, so the colour passes only shade the nearest surface of each pixel. */
+    kPASS_DEPTH_PREPASS = 0,
+    /* Opaque surfaces written to the G-buffer by the deferred path. */
+    kPASS_GBUFFER = 1,
+    kPASS_OPAQUE = 2,
+    kPASS_TRANSLUCENT = 3
+};
+
+/* Everything needed to issue one instanced draw of a mesh. */
+struct DrawCommand
+{
+    /* Maximum number of textures a draw can bind, on units 0 and up. */
+    static constexpr unsigned int kMAX_TEXTURES = 4;
+
+    RenderPass Pass;
+    unsigned int Program;
+    /* Identifies the set of textures for sorting. Draws with the same material must bind the same textures. */
+    unsigned int Material;
+    unsigned int Textures[kMAX_TEXTURES];
+    unsigned int TextureCount;
+    /* Target every texture is bound to, such as GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY. */
+    unsigned int TextureTarget;
+    unsigned int VertexArray;
+    /* View depth of the draw, 0 at the near plane and 1 at the far plane. */
+    float Depth;
+    const Mesh* DrawMesh;
+    /* Level of detail of the mesh to draw. */
+    unsigned int Lod;
+    std::size_t InstanceCount;
+};
+
+/*
+    Draws recorded during a frame and submitted in sorted order.
+    Each command gets a 64-bit sort key holding, from the most significant bits down, its pass,
+    program, material, vertex array and depth. Sorting by the key groups draws that share state,
+    so the state cache can skip most binds, and orders opaque draws front to back and translucent
+    draws back to front.
+*/
+class RenderQueue
+{
+public:
+    /* Width of each field of the sort key. Together they fill the 64 bits. */
+    static constexpr unsigned int kPASS_BITS         = 4;
+    static constexpr unsigned int kPROGRAM_BITS      = 12;
+    static constexpr unsigned int kMATERIAL_BITS     = 16;
+    static constexpr unsigned int kVERTEX_ARRAY_BITS = 12;
+    static constexpr unsigned int kDEPTH_BITS        = 20;
+
+    /*
+        Build the sort key of a draw. Object names wider than their field are truncated, which only
+        makes sorting group the draws less well.
+    */
+    static std::uint64_t makeSortKey(const DrawCommand& command);
+
+    RenderQueue();
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    /* Remove every command, keeping the storage for the next frame. */
+    void clear();
+    /* Record a draw. */
+    void submit(const DrawCommand& command);
+    /* Sort the recorded draws by their keys. Draws with equal keys keep their submission order. */
+    void sort();
+    /* Issue the draws in sorted order through a state cache. Returns the number of draw calls made. */
+    std::size_t execute(GLStateCache& state) const;
+    /* Issue only the draws of one pass, so other work can go between the passes. Call after sort(). */
+    std::size_t execute(GLStateCache& state, RenderPass pass) const;
+    /* Get the number of recorded draws. */
+    std::size_t size() const { return this->Commands.size(); }
+
+private:
+    /* Bind the state of a draw and issue it. Returns false if there was nothing to draw. */
+    static bool issue(const DrawCommand& command, GLStateCache& state);
+
+private:
+    struct SortEntry
+    {
+        std::uint64_t Key;
+        std::uint32_t Index;
+    };
+
+    std::vector<DrawCommand> Commands;
+    /* Keys and command indices, sorted instead of the larger commands themselves. */
+    std::vector<SortEntry> Order;
+};
+
+#endif  // RENDER_QUEUE_HPP
@@ -0,0 +1,545 @@
+#include "renderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+
+constexpr float Renderer::kNEAR_PLANE;
+constexpr float Renderer::kFAR_PLANE;
+
+namespace
+{
+    const glm::vec3 kCUBE_POSITIONS[] = {
+        glm::vec3(0.0f,  0.0f,  0.0f),
+        glm::vec3(2.0f,  5.0f, -15.0f),
+        glm::vec3(-1.5f, -2.2f, -2.5f),
+        glm::vec3(-3.8f, -2.0f, -12.3f),
+        glm::vec3(2.4f, -0.4f, -3.5f),
+        glm::vec3(-1.7f,  3.0f, -7.5f),
+        glm::vec3(1.3f, -2.0f, -2.5f),
+        glm::vec3(1.5f,  2.0f, -2.5f),
+        glm::vec3(1.5f,  0.2f, -1.5f),
+        glm::vec3(-1.3f,  1.0f, -1.5f)
+    };
+    const unsigned int kCUBE_COUNT = sizeof(kCUBE_POSITIONS) / sizeof(kCUBE_POSITIONS[0]);
+
+    const glm::vec3 kPOINT_LIGHT_POSITIONS[] = {
+        glm::vec3(0.7f,  0.2f,  2.0f),
+        glm::vec3(2.3f, -3.3f, -4.0f),
+        glm::vec3(-4.0f,  2.0f, -12.0f),
+        glm::vec3(0.0f,  0.0f, -3.0f)
+    };
+    const unsigned int kPOINT_LIGHT_COUNT = sizeof(kPOINT_LIGHT_POSITIONS) / sizeof(kPOINT_LIGHT_POSITIONS[0]);
+
+    const char* const kCUBE_MODEL_PATH = "../../models/cube.obj";
+
+    // material ids used to sort draws, one per set of textures, followed by one per material batch
+    const unsigned int kNO_MATERIAL          = 0;
+    const unsigned int kFIRST_BATCH_MATERIAL = 1;
+    const float kBOX_SHININESS = 32.0f;
+    // shader features the box textures need on top of the scene's lights
+    const unsigned int kBOX_SHADER_FEATURES = kSHADER_SPECULAR_MAP;
+
+    // coarser levels of detail are used while their error covers at most this many pixels
+    const float kLOD_PIXEL_ERROR = 1.0f;
+
+    // space for one frame of per-frame data in the stream buffer
+    const std::size_t kSTREAM_FRAME_SIZE = 4 * 1024 * 1024;
+}
+
+Renderer::Renderer(ThreadPool& thread_pool, VertexFormat vertex_format)
+    :   Pool(thread_pool),
+        Textures(thread_pool),
+        Materials(Textures),
+        BoxMaterial(Materials.create("../../textures/box.png", "../../textures/box_specular.png")),
+        // material properties and sampler units never change, so they are set once on each variant
+        LightingShaders("../../shaders/lighting.vert", "../../shaders/lighting.frag", [](ShaderProgram& program) {
+            program.getUniform<int>("material.diffuse").set(0);
+            program.getUniform<int>("material.specular").set(1);
+            program.getUniform<float>("material.shininess").set(kBOX_SHININESS);
+            ClusteredLighting::setSamplerUnits(program);
+        }),
+        LampShader("../../shaders/lamp.vert", "../../shaders/lamp.frag", ShaderProgram::kBUILD_DEFERRED),
+        LightingProgram(0),
+        GBufferShaders("../../shaders/lighting.vert", "../../shaders/gbuffer.frag", [](ShaderProgram& program) {
+            program.getUniform<int>("material.diffuse").set(0);
+            program.getUniform<int>("material.specular").set(1);
+        }),
+        // the G-buffer has no room for the shininess, and every surface shares it for now
+        DeferredLightingShaders("../../shaders/fullscreen.vert", "../../shaders/deferred_lighting.frag", [](ShaderProgram& program) {
+            program.getUniform<float>("shininess").set(kBOX_SHININESS);
+            GBuffer::setSamplerUnits(program);
+            ClusteredLighting::setSamplerUnits(program);
+        }),
+        GBufferProgram(0),
+        DeferredLightingProgram(0),
+        FullscreenVAO(0),
+        Shading(kSHADING_FORWARD),
+        DepthShader("../../shaders/lamp.vert", "../../shaders/depth.frag", ShaderProgram::kBUILD_DEFERRED),
+        HiZShader("../../shaders/fullscreen.vert", "../../shaders/hiz_reduce.frag", ShaderProgram::kBUILD_DEFERRED),
+        DepthPrepass(false),
+        OcclusionCulling(false),
+        Stream(kSTREAM_FRAME_SIZE),
+        LightBuffer(sizeof(LightBlock), kLIGHT_BLOCK_BINDING),
+        Lighting(thread_pool, Stream),
+        Streamer(thread_pool, Materials),
+        CubeMesh(Streamer.addMesh(kCUBE_MODEL_PATH, vertex_format)),
+        CubeMeshGeneration(0),
+        Loaded(false),
+        LampDraw(),
+        LastCullStats(),
+        LastOccludedCount(0),
+        LastStalledCount(0),
+        LastTriangleCount(0),
+        SpotLightIndex(0)
+{
+    // the lights decide which variants of the lit programs are needed, so start those compiling alongside the rest
+    setupLights(Camera());
+    unsigned int scene_features = sceneShaderFeatures();
+    this->LightingShaders.prepare(scene_features | kBOX_SHADER_FEATURES);
+    this->GBufferShaders.prepare(kBOX_SHADER_FEATURES);
+    this->DeferredLightingShaders.prepare(scene_features | kSHADER_SPECULAR_MAP);
+
+    // the programs compile in the background while the model loads, so only wait for them now
+    this->LampShader.finishBuild();
+    this->DepthShader.finishBuild();
+    this->HiZShader.finishBuild();
+    selectShaderVariants();
+
+    this->LampShader.use();
+    this->LampShader.getUniform<glm::vec3>("lightColor").set(glm::vec3(1.0f, 1.0f, 1.0f));
+    this->HiZShader.use();
+    this->HiZShader.getUniform<int>("depthTexture").set(0);
+    glGenVertexArrays(1, &this->FullscreenVAO);
+
+    // The scene index needs the mesh's box now, but the mesh itself is streamed in later. This also
+    // imports and caches the model the first time, so streaming it only reads the cache.
+    MeshSource cube_source;
+    if (!loadMeshSource(kCUBE_MODEL_PATH, cube_source))
+        return;
+    this->Loaded = true;
+    // The cubes and lamps share the mesh buffers but have their own instance data. The lamps and each
+    // level of detail of the cubes in each material batch are separate instanced draws with their own
+    // instances, created once the streamed mesh arrives.
+    setupInstances(cube_source.View.Box);
+
+    // Tell openGL to test depth so it knows when something is behind something else.
+    glEnable(GL_DEPTH_TEST);
+}
+
+Renderer::~Renderer()
+{
+    glDeleteVertexArrays(1, &this->FullscreenVAO);
+}
+
+void Renderer::setOcclusionCulling(bool enabled)
+{
+    this->OcclusionCulling = enabled;
+    // a pyramid kept from before it was turned off would be out of date when it is turned back on
+    if (!enabled)
+        this->OcclusionBuffer.invalidate();
+}
+
+void Renderer::render(Camera& camera, int width, int height)
+{
+    PROFILE_GPU_SCOPE("render");
+    {
+        // upload any textures that finished loading, without waiting on the ones that haven't
+        PROFILE_SCOPE("texture streaming");
+        this->Materials.beginFrame();
+        this->Textures.update();
+    }
+    {
+        // load the meshes around the camera and upload what has arrived, within the frame's budget
+        PROFILE_SCOPE("asset streaming");
+        this->Streamer.update(camera.Position, camera.Front);
+    }
+    // textures that arrived can move materials to batches that need draws of their own, and a mesh
+    // that was uploaded or evicted needs its draws made again or dropped
+    createCubeDraws();
+    // a new variant is built and set up here, before the state cache starts tracking the program binding
+    selectShaderVariants();
+    // the G-buffer is only created once the deferred path is used, and follows the size of the frame
+    bool deferred = this->Shading == kSHADING_DEFERRED && this->GeometryBuffer.resize(width, height);
+    // the frame goes to whatever framebuffer was bound when render() was called
+    GLint target = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    if (this->OcclusionCulling)
+    {
+        // pick up the depth of an earlier frame before culling starts testing against it
+        PROFILE_SCOPE("hi-z readback");
+        this->OcclusionBuffer.collect();
+    }
+
+    glViewport(0, 0, width, height);
+    glClearColor(0.01f, 0.01f, 0.01f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // per-frame data is written straight into this frame's part of the stream buffer
+    this->Stream.beginFrame();
+
+    // per-frame camera data, one block for every program
+    CameraBlock cameraData;
+    cameraData.View = camera.GetViewMatrix();
+    cameraData.Proj = glm::perspective(glm::radians(camera.FoV), (float)width / (float)height, kNEAR_PLANE, kFAR_PLANE);
+    cameraData.ViewPos = camera.Position;
+    cameraData.Padding = 0.0f;
+    StreamAllocation camera_block = this->Stream.allocate(sizeof(cameraData), this->Stream.uniformAlignment());
+    if (camera_block.Data)
+    {
+        std::memcpy(camera_block.Data, &cameraData, sizeof(cameraData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, kCAMERA_BLOCK_BINDING, this->Stream.id(), camera_block.Offset, sizeof(cameraData));
+    }
+
+    // Transform updates and culling only touch CPU data, so they run as jobs on the worker threads
+    // while this thread clusters the lights. Only the finished instance lists are uploaded here.
+    // The cull job's inputs are too big to capture without a heap allocation, so they go in the frame arena.
+    CullParameters* cull = MemorySystem::instance().frameArena().create<CullParameters>();
+    cull->ViewProj = cameraData.Proj * cameraData.View;
+    cull->Eye = camera.Position;
+    cull->LodScale = height / (2.0f * std::tan(glm::radians(camera.FoV) * 0.5f));
+    const glm::mat4& view_proj = cull->ViewProj;
+    ThreadPool::Job* scene_job = this->Pool.createJob([this]() {
+        // recompute the transforms of anything that moved, then fit the scene index around them
+        PROFILE_SCOPE("scene update");
+        if (this->Scene.update(this->Pool))
+            this->SceneIndex.refit(this->Scene.worldBounds().data());
+    });
+    ThreadPool::Job* cull_job = this->Pool.createJob([this, cull]() {
+        // only objects inside the view frustum are drawn
+        PROFILE_SCOPE("frustum culling");
+        cullInstances(cull->ViewProj, cull->Eye, cull->LodScale);
+    });
+    this->Pool.addContinuation(scene_job, cull_job);
+    this->Pool.run(scene_job);
+
+    // light data, only what changed is uploaded
+    this->SpotLight.Position = camera.Position;
+    this->SpotLight.Direction = camera.Front;
+    {
+        PROFILE_SCOPE("light clustering");
+        this->Lighting.setLight(this->SpotLightIndex, this->SpotLight);
+        this->Lighting.update(cameraData.View, cameraData.Proj, kNEAR_PLANE, kFAR_PLANE, width, height, this->Lights);
+        this->LightBuffer.update(&this->Lights, sizeof(this->Lights));
+    }
+    {
+        PROFILE_SCOPE("wait for culling");
+        this->Pool.wait(cull_job);
+        for (std::size_t i = 0; i < this->CubeDraws.size(); i++)
+            this->CubeDraws[i].Instances->upload(this->CubeDraws[i].Visible.data(), this->CubeDraws[i].Visible.size());
+        if (this->LampDraw.Instances)
+            this->LampDraw.Instances->upload(this->LampDraw.Visible.data(), this->LampDraw.Visible.size());
+    }
+    // a mesh that was drawn stays resident
+    this->Streamer.reportStalls(this->LastStalledCount);
+    bool cube_mesh_visible = !this->LampDraw.Visible.empty();
+    for (std::size_t i = 0; i < this->CubeDraws.size(); i++)
+        cube_mesh_visible = cube_mesh_visible || !this->CubeDraws[i].Visible.empty();
+    if (cube_mesh_visible)
+        this->Streamer.markVisible(this->CubeMesh);
+    // materials that were drawn stay resident, and any that were evicted are loaded again
+    for (MaterialId material = 0; material < this->VisibleMaterials.size(); material++)
+    {
+        if (this->VisibleMaterials[material])
+            this->Materials.markUsed(material);
+        this->VisibleMaterials[material] = 0;
+    }
+    this->Stream.commit();
+
+    // texture uploads and instance buffers bind objects directly, so start the draws with nothing assumed
+    this->State.invalidate();
+    this->State.resetStats();
+
+    // Record the draws. Instanced batches cover many depths, so they are sorted by their state alone.
+    // Every material in a batch reads the same texture arrays, so each batch is one draw per level.
+    this->Queue.clear();
+    FrameVector<DrawCommand> draws;
+    draws.reserve(this->CubeDraws.size() + 1);
+    // the cube and lamp draws only exist while the cube mesh is resident
+    Mesh* cube_mesh = this->Streamer.isResident(this->CubeMesh) ? &this->Streamer.mesh(this->CubeMesh) : NULL;
+    std::size_t cube_lods = cube_mesh ? cube_mesh->lods().size() : 0;
+    for (std::size_t i = 0; i < this->CubeDraws.size(); i++)
+    {
+        if (this->CubeDraws[i].Instances->count() == 0)
+            continue;
+        unsigned int batch = static_cast<unsigned int>(i / cube_lods);
+        const MaterialBatch& textures = this->Materials.batch(batch);
+        draws.push_back(DrawCommand());
+        DrawCommand& cubes = draws.back();
+        cubes.Pass = deferred ? kPASS_GBUFFER : kPASS_OPAQUE;
+        cubes.Program = deferred ? this->GBufferProgram : this->LightingProgram;
+        cubes.Material = kFIRST_BATCH_MATERIAL + batch;
+        cubes.Textures[0] = textures.Textures[kMATERIAL_DIFFUSE];
+        cubes.Textures[1] = textures.Textures[kMATERIAL_SPECULAR];
+        cubes.TextureCount = kMATERIAL_SLOT_COUNT;
+        cubes.TextureTarget = GL_TEXTURE_2D_ARRAY;
+        cubes.VertexArray = this->CubeDraws[i].VAO;
+        cubes.DrawMesh = cube_mesh;
+        cubes.Lod = static_cast<unsigned int>(i % cube_lods);
+        cubes.InstanceCount = this->CubeDraws[i].Instances->count();
+    }
+    // the lamps are plain cubes, one instance per point light, too small to need a coarser level
+    if (this->LampDraw.Instances && this->LampDraw.Instances->count() > 0)
+    {
+        draws.push_back(DrawCommand());
+        DrawCommand& lamps = draws.back();
+        lamps.Pass = kPASS_OPAQUE;
+        lamps.Program = this->LampShader.id();
+        lamps.Material = kNO_MATERIAL;
+        lamps.VertexArray = this->LampDraw.VAO;
+        lamps.DrawMesh = cube_mesh;
+        lamps.InstanceCount = this->LampDraw.Instances->count();
+    }
+    this->LastTriangleCount = 0;
+    for (std::size_t i = 0; i < draws.size(); i++)
+    {
+        this->Queue.submit(draws[i]);
+        this->LastTriangleCount += draws[i].InstanceCount * draws[i].DrawMesh->lods()[draws[i].Lod].IndexCount / 3;
+    }
+    if (this->DepthPrepass)
+    {
+        // the same draws again, depth only, ahead of every colour pass
+        for (std::size_t i = 0; i < draws.size(); i++)
+        {
+            DrawCommand depth_only = draws[i];
+            depth_only.Pass = kPASS_DEPTH_PREPASS;
+            depth_only.Program = this->DepthShader.id();
+            depth_only.Material = kNO_MATERIAL;
+            depth_only.TextureCount = 0;
+            this->Queue.submit(depth_only);
+        }
+    }
+
+    this->Queue.sort();
+    this->Lighting.bind(this->State);
+    if (deferred)
+    {
+        renderDeferred(target, view_proj);
+    }
+    else
+    {
+        if (this->DepthPrepass)
+            renderDepthPrepass();
+        PROFILE_GPU_SCOPE("forward pass");
+        this->Queue.execute(this->State, kPASS_OPAQUE);
+    }
+    if (this->DepthPrepass)
+    {
+        // back to normal depth testing, which the next frame's clear relies on to reset the depth buffer
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    if (this->OcclusionCulling)
+    {
+        PROFILE_GPU_SCOPE("hi-z capture");
+        this->OcclusionBuffer.capture(this->State, this->HiZShader, this->FullscreenVAO, target, width, height, view_proj);
+    }
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void Renderer::setupLights(const Camera& camera)
+{
+    // Light block contents. The directional light never changes, so it is only uploaded once.
+    this->Lights = LightBlock();
+    this->Lights.DirLight.Direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    this->Lights.DirLight.Ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+    this->Lights.DirLight.Diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+    this->Lights.DirLight.Specular = glm::vec3(0.5f, 0.5f, 0.5f);
+    // point and spot lights are binned into clusters, so any number of them can be added
+    for (unsigned int i = 0; i < kPOINT_LIGHT_COUNT; i++)
+    {
+        this->Lighting.addLight(makePointLight(kPOINT_LIGHT_POSITIONS[i],
+            glm::vec3(0.05f, 0.05f, 0.05f), glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3(1.0f, 1.0f, 1.0f),
+            1.0f, 0.09f, 0.032f));
+    }
+    // the spot light follows the camera and is updated every frame
+    this->SpotLight = makeSpotLight(camera.Position, camera.Front,
+        glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f),
+        1.0f, 0.09f, 0.032f, glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(15.0f)));
+    this->SpotLightIndex = this->Lighting.addLight(this->SpotLight);
+}
+
+void Renderer::setupInstances(const Bounds& cube_bounds)
+{
+    // Entity transforms. The cubes are created first, so their entity ids are 0 to kCUBE_COUNT - 1.
+    for (unsigned int i = 0; i < kCUBE_COUNT; i++)
+    {
+        float angle = 20.0f * i;
+        glm::quat rotation = glm::angleAxis(glm::radians(angle), glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f)));
+        this->Scene.create(kCUBE_POSITIONS[i], rotation, glm::vec3(1.0f), cube_bounds);
+    }
+    for (unsigned int i = 0; i < kPOINT_LIGHT_COUNT; i++)
+        this->Scene.create(kPOINT_LIGHT_POSITIONS[i], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.2f), cube_bounds);
+
+    // world-space boxes of every object, for the scene index
+    this->Scene.update(this->Pool);
+    this->SceneIndex.build(this->Scene.worldBounds().data(), this->Scene.size());
+
+    this->ObjectLods.assign(this->Scene.size(), 0);
+    this->ObjectMaterials.assign(kCUBE_COUNT, this->BoxMaterial);
+    this->VisibleMaterials.assign(this->Materials.materialCount(), 0);
+
+    // the streamer loads the mesh and textures of each object once the chunk it is in is near the camera
+    for (unsigned int i = 0; i < kCUBE_COUNT; i++)
+        this->Streamer.addObject(this->Scene.worldBounds()[i], this->CubeMesh, this->ObjectMaterials[i]);
+    for (unsigned int i = kCUBE_COUNT; i < this->Scene.size(); i++)
+        this->Streamer.addObject(this->Scene.worldBounds()[i], this->CubeMesh);
+}
+
+void Renderer::createCubeDraws()
+{
+    // the vertex arrays belong to the mesh, so they went with it if it was evicted
+    if (!this->Streamer.isResident(this->CubeMesh) || this->Streamer.generation(this->CubeMesh) != this->CubeMeshGeneration)
+    {
+        this->CubeDraws.clear();
+        this->LampDraw.Instances.reset();
+        this->LampDraw.VAO = 0;
+    }
+    if (!this->Streamer.isResident(this->CubeMesh))
+        return;
+    this->CubeMeshGeneration = this->Streamer.generation(this->CubeMesh);
+
+    // instance data, one buffer per instanced draw, filled with the visible instances every frame
+    Mesh& cube_mesh = this->Streamer.mesh(this->CubeMesh);
+    if (!this->LampDraw.Instances)
+    {
+        this->LampDraw.VAO = cube_mesh.createVertexArray();
+        this->LampDraw.Instances.reset(new InstanceBuffer(this->Stream));
+        this->LampDraw.Instances->attach(this->LampDraw.VAO);
+    }
+    std::size_t cube_lods = cube_mesh.lods().size();
+    while (this->CubeDraws.size() < this->Materials.batchCount() * cube_lods)
+    {
+        CubeDraw draw;
+        draw.VAO = cube_mesh.createVertexArray();
+        draw.Instances.reset(new InstanceBuffer(this->Stream));
+        draw.Instances->attach(draw.VAO);
+        this->CubeDraws.push_back(std::move(draw));
+    }
+}
+
+unsigned int Renderer::sceneShaderFeatures() const
+{
+    // the directional light is always there, even if it is black
+    unsigned int features = kSHADER_DIRECTIONAL_LIGHT;
+    for (unsigned int i = 0; i < this->Lighting.lightCount(); i++)
+    {
+        features |= kSHADER_LOCAL_LIGHTS;
+        if (isSpotLight(this->Lighting.getLight(i)))
+            features |= kSHADER_SPOT_LIGHTS;
+    }
+    return features;
+}
+
+void Renderer::selectShaderVariants()
+{
+    unsigned int scene_features = sceneShaderFeatures();
+    this->LightingProgram = this->LightingShaders.get(scene_features | kBOX_SHADER_FEATURES).id();
+    this->GBufferProgram = this->GBufferShaders.get(kBOX_SHADER_FEATURES).id();
+    // the lighting pass only sees the G-buffer, which always has a specular channel
+    ShaderProgram& deferred_lighting = this->DeferredLightingShaders.get(scene_features | kSHADER_SPECULAR_MAP);
+    if (deferred_lighting.id() != this->DeferredLightingProgram)
+    {
+        this->DeferredLightingProgram = deferred_lighting.id();
+        this->InverseViewProj = deferred_lighting.getUniform<glm::mat4>("inverseViewProj");
+    }
+}
+
+void Renderer::renderDeferred(unsigned int target, const glm::mat4& view_proj)
+{
+    this->GeometryBuffer.bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (this->DepthPrepass)
+        renderDepthPrepass();
+    {
+        PROFILE_GPU_SCOPE("geometry pass");
+        this->Queue.execute(this->State, kPASS_GBUFFER);
+    }
+    {
+        // One triangle covers the screen, so each visible pixel is lit once by the lights of its cluster.
+        PROFILE_GPU_SCOPE("lighting pass");
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glDisable(GL_DEPTH_TEST);
+        this->State.useProgram(this->DeferredLightingProgram);
+        this->InverseViewProj.set(glm::inverse(view_proj));
+        this->GeometryBuffer.bindTextures(this->State);
+        this->State.bindVertexArray(this->FullscreenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+        // the lamps are drawn forward on top, so they need the scene's depth
+        this->GeometryBuffer.copyDepthTo(target);
+    }
+    {
+        PROFILE_GPU_SCOPE("forward pass");
+        this->Queue.execute(this->State, kPASS_OPAQUE);
+    }
+}
+
+void Renderer::renderDepthPrepass()
+{
+    PROFILE_GPU_SCOPE("depth pre-pass");
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    this->Queue.execute(this->State, kPASS_DEPTH_PREPASS);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    // the depth buffer is final, so only the fragments that match it are shaded
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+}
+
+void Renderer::cullInstances(const glm::mat4& view_proj, const glm::vec3& eye, float lod_scale)
+{
+    this->VisibleObjects.clear();
+    this->LastCullStats = this->SceneIndex.cull(extractFrustum(view_proj), this->VisibleObjects);
+
+    for (std::size_t i = 0; i < this->CubeDraws.size(); i++)
+        this->CubeDraws[i].Visible.clear();
+    this->LampDraw.Visible.clear();
+    // objects whose mesh hasn't been streamed in yet are skipped and counted as stalled
+    const Mesh* cube_mesh = this->Streamer.isResident(this->CubeMesh) ? &this->Streamer.mesh(this->CubeMesh) : NULL;
+    this->LastOccludedCount = 0;
+    this->LastStalledCount = 0;
+    bool occlusion = this->OcclusionCulling && this->OcclusionBuffer.isValid();
+    for (std::size_t i = 0; i < this->VisibleObjects.size(); i++)
+    {
+        std::uint32_t object = this->VisibleObjects[i];
+        if (occlusion && this->OcclusionBuffer.isOccluded(this->Scene.worldBounds()[object]))
+        {
+            this->LastOccludedCount++;
+            continue;
+        }
+        if (!cube_mesh)
+        {
+            this->LastStalledCount++;
+            continue;
+        }
+        InstanceData instance = this->Scene.instances()[object];
+        // compact positions are stored relative to the mesh's box, which the model matrix puts back
+        instance.Model = instance.Model * cube_mesh->positionTransform();
+        if (object < kCUBE_COUNT)
+        {
+            // the size on screen of one model space unit, measured from the nearest point of the box
+            const Bounds& box = this->Scene.worldBounds()[object];
+            float distance = std::max(glm::length(glm::clamp(eye, box.Min, box.Max) - eye), kNEAR_PLANE);
+            glm::vec3 scale = this->Scene.scale(object);
+            float pixels_per_unit = lod_scale * std::max(scale.x, std::max(scale.y, scale.z)) / distance;
+            unsigned int lod = cube_mesh->selectLod(pixels_per_unit, kLOD_PIXEL_ERROR, this->ObjectLods[object]);
+            this->ObjectLods[object] = static_cast<std::uint8_t>(lod);
+            // the instance carries its material's layers, so cubes of every material in a batch share a draw
+            MaterialId material = this->ObjectMaterials[object];
+            instance.MaterialLayers = this->Materials.layers(material);
+            this->VisibleMaterials[material] = 1;
+            this->CubeDraws[this->Materials.batchOf(material) * cube_mesh->lods().size() + lod].Visible.push_back(instance);
+        }
+        else
+            this->LampDraw.Visible.push_back(instance);
+    }
+}
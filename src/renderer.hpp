@@ -0,0 +1,217 @@
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "asset_streamer.hpp"
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "clustered_lighting.hpp"
+#include "gbuffer.hpp"
+#include "gl_state.hpp"
+#include "hiz_buffer.hpp"
+#include "instance_buffer.hpp"
+#include "material_library.hpp"
+#include "model.hpp"
+#include "render_queue.hpp"
+#include "scene_store.hpp"
+#include "shader_program.hpp"
+#include "shader_variants.hpp"
+#include "stream_buffer.hpp"
+#include "texture_manager.hpp"
+#include "uniform_blocks.hpp"
+#include "uniform_buffer.hpp"
+
+class ThreadPool;
+
+/*
+    Owns the demo scene and everything needed to draw it.
+    The same renderer is driven by the interactive window and by the benchmark, so both measure
+    and show exactly the same frame.
+*/
+class Renderer
+{
+public:
+    static constexpr float kNEAR_PLANE = 0.1f;
+    static constexpr float kFAR_PLANE  = 100.0f;
+
+    /* Ways of lighting the scene. Both draw the same image and can be switched between frames. */
+    enum ShadingPath
+    {
+        /* Each fragment is lit as it is drawn, including fragments that are later drawn over. */
+        kSHADING_FORWARD,
+        /* Surfaces are written to a G-buffer first, then each visible pixel is lit once. */
+        kSHADING_DEFERRED
+    };
+
+    /*
+        Construct a Renderer object and set up the scene, with the meshes stored in the given vertex format.
+        Texture loads are started before anything else so they overlap the rest of the setup.
+        The GL context must be current.
+    */
+    explicit Renderer(ThreadPool& thread_pool, VertexFormat vertex_format = kVERTEX_FORMAT_COMPACT);
+    ~Renderer();
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+
+    /* Check if the scene's model files could be read. Meshes and textures may still be streaming in. */
+    bool isLoaded() const { return this->Loaded; }
+    /* Get the number of textures that are still showing their placeholder. */
+    std::size_t pendingTextureCount() const { return this->Textures.pendingCount(); }
+    /* Get the number of meshes near the camera that aren't on the GPU yet. */
+    std::size_t pendingAssetCount() const { return this->Streamer.pendingCount(); }
+    /* Render one frame of the scene from a camera into the currently bound framebuffer. */
+    void render(Camera& camera, int width, int height);
+    /* Choose how the following frames are lit. */
+    void setShadingPath(ShadingPath path) { this->Shading = path; }
+    ShadingPath shadingPath() const { return this->Shading; }
+    /* Choose whether the opaque draws fill the depth buffer in a pass of their own before any shading. */
+    void setDepthPrepass(bool enabled) { this->DepthPrepass = enabled; }
+    bool depthPrepass() const { return this->DepthPrepass; }
+    /* Choose whether objects hidden behind the depth of an earlier frame are culled. */
+    void setOcclusionCulling(bool enabled);
+    bool occlusionCulling() const { return this->OcclusionCulling; }
+    /* Get the culling counts of the last rendered frame. */
+    const CullStats& cullStats() const { return this->LastCullStats; }
+    /* Get the number of objects inside the view frustum that occlusion culling skipped in the last frame. */
+    std::uint32_t occludedCount() const { return this->LastOccludedCount; }
+    /* Get the number of triangles the colour passes of the last frame drew, over every instance. */
+    std::size_t triangleCount() const { return this->LastTriangleCount; }
+    /* Get the number of state changes issued and skipped in the last rendered frame. */
+    const StateChangeStats& stateChangeStats() const { return this->State.stats(); }
+    /* Get the format the scene's vertices are stored in. */
+    VertexFormat vertexFormat() const { return this->Streamer.format(this->CubeMesh); }
+    /* Get the size in bytes of the scene's vertex buffers, or 0 while its mesh isn't resident. */
+    std::size_t vertexBufferSize() const
+    {
+        return this->Streamer.isResident(this->CubeMesh) ? this->Streamer.mesh(this->CubeMesh).vertexBufferSize() : 0;
+    }
+    /* Get the time in milliseconds the last frame waited for the GPU to release per-frame buffer space. */
+    double streamStallTime() const { return this->Stream.stallTime(); }
+    /* Set how many bytes of texture arrays the materials may allocate. Call before the first frame. */
+    void setTextureBudget(std::size_t bytes) { this->Materials.setBudget(bytes); }
+    /* Get the bytes allocated to material texture arrays, and how many layers were evicted to make room. */
+    std::size_t textureMemory() const { return this->Materials.allocatedBytes(); }
+    std::size_t textureEvictions() const { return this->Materials.evictionCount(); }
+    /* Set how many bytes of streamed mesh buffers may stay on the GPU. */
+    void setMeshBudget(std::size_t bytes) { this->Streamer.setBudget(bytes); }
+    /* Get the residency of the streamed meshes, and what streaming did in the last frame. */
+    const StreamingStats& streamingStats() const { return this->Streamer.stats(); }
+
+private:
+    /* Inputs of the cull job. */
+    struct CullParameters
+    {
+        glm::mat4 ViewProj;
+        glm::vec3 Eye;
+        /* Height in pixels of one unit at a distance of one unit. */
+        float LodScale;
+    };
+
+    /* An instanced draw of the visible lamps, or of the visible cubes at one level of detail whose materials are in one batch. */
+    struct CubeDraw
+    {
+        std::unique_ptr<InstanceBuffer> Instances;
+        unsigned int VAO;
+        // reused every frame so culling doesn't allocate
+        std::vector<InstanceData> Visible;
+    };
+
+    /* Fill the light block and add the scene's point and spot lights. */
+    void setupLights(const Camera& camera);
+    /* Add the cubes and lamps to the scene store and the streamer, and build the scene index used to cull them. */
+    void setupInstances(const Bounds& cube_bounds);
+    /*
+        Add the lamp draw, and the cube draws of any material batches that don't have them yet. The
+        draws are dropped while the cube mesh isn't resident, and made again when it is uploaded again.
+    */
+    void createCubeDraws();
+    /* Get the shader features needed for the lights in the scene, whatever the material. */
+    unsigned int sceneShaderFeatures() const;
+    /* Pick the smallest variant of each lit program that covers the scene's lights and the box material. */
+    void selectShaderVariants();
+    /*
+        Gather the instance data of the objects inside the view frustum, sorted by the level of detail
+        each is drawn with. lod_scale is the height in pixels of one unit at a distance of one unit.
+        Touches no GL state, so it can run on any thread.
+    */
+    void cullInstances(const glm::mat4& view_proj, const glm::vec3& eye, float lod_scale);
+    /*
+        Issue the recorded draws with the deferred path: geometry pass, lighting pass, then forward draws
+        such as the lamps. The lit frame is written to the target framebuffer.
+    */
+    void renderDeferred(unsigned int target, const glm::mat4& view_proj);
+    /* Issue the depth pre-pass, then set depth testing so the colour passes only shade what it left visible. */
+    void renderDepthPrepass();
+
+private:
+    ThreadPool& Pool;
+    // declared first so the texture loads are started before the shaders compile
+    TextureManager Textures;
+    MaterialLibrary Materials;
+    MaterialId BoxMaterial;
+
+    // lit programs are compiled per set of shader features, and the variants in use are picked every frame
+    ShaderVariants LightingShaders;
+    ShaderProgram LampShader;
+    unsigned int LightingProgram;
+    // the deferred path
+    ShaderVariants GBufferShaders;
+    ShaderVariants DeferredLightingShaders;
+    unsigned int GBufferProgram;
+    unsigned int DeferredLightingProgram;
+    Uniform<glm::mat4> InverseViewProj;
+    GBuffer GeometryBuffer;
+    // empty, since the full screen triangle of the lighting pass is made in the vertex shader
+    unsigned int FullscreenVAO;
+    ShadingPath Shading;
+    // the depth pre-pass and occlusion culling
+    ShaderProgram DepthShader;
+    ShaderProgram HiZShader;
+    HiZBuffer OcclusionBuffer;
+    bool DepthPrepass;
+    bool OcclusionCulling;
+    // per-frame data, rewritten every frame: the camera block and the instances
+    StreamBuffer Stream;
+    UniformBuffer LightBuffer;
+    ClusteredLighting Lighting;
+    // the cubes and lamps share one streamed mesh
+    AssetStreamer Streamer;
+    AssetId CubeMesh;
+    // upload of the cube mesh the draws' vertex arrays were made from
+    std::uint32_t CubeMeshGeneration;
+    bool Loaded;
+    // The cubes have an instance buffer and vertex array per material batch and level of detail of
+    // their mesh, at index batch * levels + level.
+    std::vector<CubeDraw> CubeDraws;
+    CubeDraw LampDraw;
+
+    // draws are recorded each frame and submitted sorted through the state cache
+    GLStateCache State;
+    RenderQueue Queue;
+
+    // every object in the scene, cubes first and then lamps, indexed by the BVH
+    SceneStore Scene;
+    BoundingVolumeHierarchy SceneIndex;
+    // reused every frame so culling doesn't allocate
+    std::vector<std::uint32_t> VisibleObjects;
+    // material of each cube, and whether each material was drawn this frame
+    std::vector<MaterialId> ObjectMaterials;
+    std::vector<std::uint8_t> VisibleMaterials;
+    // level of detail each object was last drawn with, so switching levels can lag behind the distance
+    std::vector<std::uint8_t> ObjectLods;
+    CullStats LastCullStats;
+    std::uint32_t LastOccludedCount;
+    // objects inside the view frustum skipped because their mesh wasn't resident
+    std::uint32_t LastStalledCount;
+    std::size_t LastTriangleCount;
+
+    LightBlock Lights;
+    LightData SpotLight;
+    unsigned int SpotLightIndex;
+};
+
+#endif  // RENDERER_HPP
@@ -0,0 +1,203 @@
+#include "scene_store.hpp"
+
+#include "frustum.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SCENE_USE_SSE 1
+#include <xmmintrin.h>
+#else
+#define SCENE_USE_SSE 0
+#endif
+
+constexpr unsigned int SceneStore::kGROUP_SIZE;
+constexpr std::size_t SceneStore::kGROUPS_PER_TASK;
+
+namespace
+{
+    /* Matrix elements of a group, one array of kGROUP_SIZE lanes per element. */
+    struct GroupMatrices
+    {
+        // upper 3x3 of the world matrix and the normal matrix, indexed [column][row] like glm
+        float World[3][3][SceneStore::kGROUP_SIZE];
+        float Normal[3][3][SceneStore::kGROUP_SIZE];
+    };
+}
+
+SceneStore::SceneStore()
+{
+}
+
+EntityId SceneStore::create(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, const Bounds& local_bounds)
+{
+    EntityId entity = static_cast<EntityId>(this->Instances.size());
+    if (entity % kGROUP_SIZE == 0)
+    {
+        // start a new group, filled with identity transforms until its entities are created
+        std::size_t padded = entity + kGROUP_SIZE;
+        this->PositionX.resize(padded, 0.0f);
+        this->PositionY.resize(padded, 0.0f);
+        this->PositionZ.resize(padded, 0.0f);
+        this->RotationX.resize(padded, 0.0f);
+        this->RotationY.resize(padded, 0.0f);
+        this->RotationZ.resize(padded, 0.0f);
+        this->RotationW.resize(padded, 1.0f);
+        this->ScaleX.resize(padded, 1.0f);
+        this->ScaleY.resize(padded, 1.0f);
+        this->ScaleZ.resize(padded, 1.0f);
+        this->GroupDirty.push_back(0);
+    }
+    this->LocalBounds.push_back(local_bounds);
+    this->Instances.push_back(InstanceData());
+    this->WorldBounds.push_back(local_bounds);
+
+    setPosition(entity, position);
+    setRotation(entity, rotation);
+    setScale(entity, scale);
+    return entity;
+}
+
+void SceneStore::setPosition(EntityId entity, const glm::vec3& position)
+{
+    this->PositionX[entity] = position.x;
+    this->PositionY[entity] = position.y;
+    this->PositionZ[entity] = position.z;
+    markDirty(entity);
+}
+
+void SceneStore::setRotation(EntityId entity, const glm::quat& rotation)
+{
+    this->RotationX[entity] = rotation.x;
+    this->RotationY[entity] = rotation.y;
+    this->RotationZ[entity] = rotation.z;
+    this->RotationW[entity] = rotation.w;
+    markDirty(entity);
+}
+
+void SceneStore::setScale(EntityId entity, const glm::vec3& scale)
+{
+    this->ScaleX[entity] = scale.x;
+    this->ScaleY[entity] = scale.y;
+    this->ScaleZ[entity] = scale.z;
+    markDirty(entity);
+}
+
+glm::vec3 SceneStore::position(EntityId entity) const
+{
+    return glm::vec3(this->PositionX[entity], this->PositionY[entity], this->PositionZ[entity]);
+}
+
+glm::quat SceneStore::rotation(EntityId entity) const
+{
+    return glm::quat(this->RotationW[entity], this->RotationX[entity], this->RotationY[entity], this->RotationZ[entity]);
+}
+
+glm::vec3 SceneStore::scale(EntityId entity) const
+{
+    return glm::vec3(this->ScaleX[entity], this->ScaleY[entity], this->ScaleZ[entity]);
+}
+
+bool SceneStore::update(ThreadPool& thread_pool)
+{
+    if (this->DirtyGroups.empty())
+        return false;
+
+    // every group is written by exactly one task, so the tasks never share an output
+    thread_pool.parallelFor(this->DirtyGroups.size(), kGROUPS_PER_TASK, [this](std::size_t begin, std::size_t end) {
+        PROFILE_SCOPE("update transforms");
+        for (std::size_t i = begin; i < end; i++)
+            updateGroup(this->DirtyGroups[i]);
+    });
+
+    for (std::size_t i = 0; i < this->DirtyGroups.size(); i++)
+        this->GroupDirty[this->DirtyGroups[i]] = 0;
+    this->DirtyGroups.clear();
+    return true;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void SceneStore::markDirty(EntityId entity)
+{
+    std::size_t group = entity / kGROUP_SIZE;
+    if (this->GroupDirty[group])
+        return;
+    this->GroupDirty[group] = 1;
+    this->DirtyGroups.push_back(group);
+}
+
+void SceneStore::updateGroup(std::size_t group)
+{
+    // World = T * R * S, so the columns of the upper 3x3 are the rotation columns times the scale.
+    // The normal matrix is the inverse transpose of R * S, which is R * S^-1, so no general inverse is needed.
+    std::size_t first = group * kGROUP_SIZE;
+    GroupMatrices matrices;
+#if SCENE_USE_SSE
+    __m128 x = _mm_loadu_ps(&this->RotationX[first]);
+    __m128 y = _mm_loadu_ps(&this->RotationY[first]);
+    __m128 z = _mm_loadu_ps(&this->RotationZ[first]);
+    __m128 w = _mm_loadu_ps(&this->RotationW[first]);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+    __m128 rotation[3][3] = {
+        { _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), _mm_mul_ps(two, _mm_add_ps(xy, wz)), _mm_mul_ps(two, _mm_sub_ps(xz, wy)) },
+        { _mm_mul_ps(two, _mm_sub_ps(xy, wz)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), _mm_mul_ps(two, _mm_add_ps(yz, wx)) },
+        { _mm_mul_ps(two, _mm_add_ps(xz, wy)), _mm_mul_ps(two, _mm_sub_ps(yz, wx)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))) }
+    };
+    __m128 scale[3] = {
+        _mm_loadu_ps(&this->ScaleX[first]),
+        _mm_loadu_ps(&this->ScaleY[first]),
+        _mm_loadu_ps(&this->ScaleZ[first])
+    };
+    for (int column = 0; column < 3; column++)
+    {
+        __m128 inverse_scale = _mm_div_ps(one, scale[column]);
+        for (int row = 0; row < 3; row++)
+        {
+            _mm_storeu_ps(matrices.World[column][row], _mm_mul_ps(rotation[column][row], scale[column]));
+            _mm_storeu_ps(matrices.Normal[column][row], _mm_mul_ps(rotation[column][row], inverse_scale));
+        }
+    }
+#else
+    for (unsigned int lane = 0; lane < kGROUP_SIZE; lane++)
+    {
+        float x = this->RotationX[first + lane], y = this->RotationY[first + lane];
+        float z = this->RotationZ[first + lane], w = this->RotationW[first + lane];
+        float rotation[3][3] = {
+            { 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y) },
+            { 2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x) },
+            { 2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y) }
+        };
+        float scale[3] = { this->ScaleX[first + lane], this->ScaleY[first + lane], this->ScaleZ[first + lane] };
+        for (int column = 0; column < 3; column++)
+        {
+            for (int row = 0; row < 3; row++)
+            {
+                matrices.World[column][row][lane] = rotation[column][row] * scale[column];
+                matrices.Normal[column][row][lane] = rotation[column][row] / scale[column];
+            }
+        }
+    }
+#endif
+
+    // write each entity's results out, skipping the padding at the end of the last group
+    for (unsigned int lane = 0; lane < kGROUP_SIZE && first + lane < this->Instances.size(); lane++)
+    {
+        InstanceData& instance = this->Instances[first + lane];
+        for (int column = 0; column < 3; column++)
+        {
+            for (int row = 0; row < 3; row++)
+            {
+                instance.Model[column][row] = matrices.World[column][row][lane];
+                instance.NormalMatrix[column][row] = matrices.Normal[column][row][lane];
+            }
+            instance.Model[column][3] = 0.0f;
+        }
+        instance.Model[3] = glm::vec4(this->PositionX[first + lane], this->PositionY[first + lane], this->PositionZ[first + lane], 1.0f);
+        this->WorldBounds[first + lane] = transformBounds(this->LocalBounds[first + lane], instance.Model);
+    }
+}
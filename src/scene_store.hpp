@@ -0,0 +1,83 @@
+#ifndef SCENE_STORE_HPP
+#define SCENE_STORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "instance_buffer.hpp"
+#include "mesh.hpp"
+
+class ThreadPool;
+
+/* Index of an entity in a SceneStore. Entities are numbered in the order they were created. */
+typedef std::uint32_t EntityId;
+
+/*
+    Transforms of every entity in the scene, stored as structure-of-arrays.
+    Each component of the position, rotation and scale has its own array, so four neighbouring entities
+    are updated together with SIMD. Changing a transform only marks its group of four dirty; update()
+    recomputes the dirty groups in parallel and writes the results straight into the instance data and
+    world-space boxes the renderer draws and culls with.
+*/
+class SceneStore
+{
+public:
+    /* Number of entities updated together. */
+    static constexpr unsigned int kGROUP_SIZE = 4;
+    /* Number of dirty groups each parallel task updates. */
+    static constexpr std::size_t kGROUPS_PER_TASK = 256;
+
+    /* Construct an empty SceneStore object. */
+    SceneStore();
+    SceneStore(const SceneStore&) = delete;
+    SceneStore& operator=(const SceneStore&) = delete;
+
+    /* Add an entity. Its instance data is valid after the next update(). */
+    EntityId create(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, const Bounds& local_bounds);
+    /* Move, rotate or scale an entity. */
+    void setPosition(EntityId entity, const glm::vec3& position);
+    void setRotation(EntityId entity, const glm::quat& rotation);
+    void setScale(EntityId entity, const glm::vec3& scale);
+    glm::vec3 position(EntityId entity) const;
+    glm::quat rotation(EntityId entity) const;
+    glm::vec3 scale(EntityId entity) const;
+
+    /*
+        Recompute the world and normal matrices and world-space boxes of every entity that changed.
+        Returns false if nothing had changed.
+    */
+    bool update(ThreadPool& thread_pool);
+
+    /* Get the number of entities. */
+    std::size_t size() const { return this->Instances.size(); }
+    /* Get the instance data of every entity, in entity order. */
+    const std::vector<InstanceData>& instances() const { return this->Instances; }
+    /* Get the world-space box of every entity, in entity order. */
+    const std::vector<Bounds>& worldBounds() const { return this->WorldBounds; }
+
+private:
+    /* Mark the group holding an entity as needing an update. */
+    void markDirty(EntityId entity);
+    /* Recompute the transforms of one group of entities. */
+    void updateGroup(std::size_t group);
+
+private:
+    // Transform components, padded with identity transforms to a whole number of groups
+    std::vector<float> PositionX, PositionY, PositionZ;
+    std::vector<float> RotationX, RotationY, RotationZ, RotationW;
+    std::vector<float> ScaleX, ScaleY, ScaleZ;
+    std::vector<Bounds> LocalBounds;
+
+    // cached results, one per entity
+    std::vector<InstanceData> Instances;
+    std::vector<Bounds> WorldBounds;
+
+    /* Whether each group is waiting for an update, and the list of those groups. */
+    std::vector<std::uint8_t> GroupDirty;
+    std::vector<std::size_t> DirtyGroups;
+};
+
+#endif  // SCENE_STORE_HPP
@@ -1,39 +1,196 @@
 #include "shader_program.hpp"
+#include "uniform_blocks.hpp"
+#include "mapped_file.hpp"
 
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <vector>
 
 #include <glad/glad.h>
 #include <glm/ext.hpp>
 
-ShaderProgram::ShaderProgram(const char* vert_path, const char* frag_path)
+namespace
 {
-    /* 1. Read the shader code in from their files. */    
-    std::string vert_str = readFile(vert_path);
-    std::string frag_str = readFile(frag_path);
+    const char kPROGRAM_CACHE_MAGIC[4] = {'E', 'P', 'R', 'G'};
+    const std::uint32_t kPROGRAM_CACHE_VERSION = 1;
+    const std::uint64_t kFNV_OFFSET_BASIS = 14695981039346656037ull;
+    const std::uint64_t kFNV_PRIME = 1099511628211ull;
+    // lets the driver use as many compiler threads as it likes
+    const GLuint kMAX_COMPILER_THREADS = 0xFFFFFFFF;
+
+    /* Layout of the start of a program cache file. The driver's binary follows directly after it. */
+    struct ProgramCacheHeader
+    {
+        char Magic[4];
+        std::uint32_t Version;
+        std::uint64_t Key;
+        std::uint32_t Format;
+        std::uint32_t Length;
+    };
+
+    std::uint64_t hashBytes(std::uint64_t hash, const char* data, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= kFNV_PRIME;
+        }
+        return hash;
+    }
+
+    std::uint64_t hashGLString(std::uint64_t hash, GLenum name)
+    {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        return value ? hashBytes(hash, value, std::strlen(value) + 1) : hash;
+    }
+
+    std::string directoryOf(const char* path)
+    {
+        std::string directory(path);
+        std::string::size_type slash = directory.find_last_of("/\\");
+        return (slash == std::string::npos) ? std::string() : directory.substr(0, slash + 1);
+    }
+
+    bool programBinariesSupported()
+    {
+        bool core = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1);
+        if (!core && !GLAD_GL_ARB_get_program_binary)
+            return false;
+        // some drivers expose the entry points but have no binary formats to offer
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    /* Insert lines after the #version directive, which must stay the first thing in a shader. */
+    std::string insertDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty())
+            return source;
+        std::string::size_type version = source.find("#version");
+        std::string::size_type line_end = (version == std::string::npos) ? std::string::npos : source.find('\n', version);
+        if (line_end == std::string::npos)
+            return defines + source;
+        return source.substr(0, line_end + 1) + defines + source.substr(line_end + 1);
+    }
+
+    bool parallelCompileSupported()
+    {
+        if (!GLAD_GL_KHR_parallel_shader_compile)
+            return false;
+        static bool threads_set = false;
+        if (!threads_set)
+        {
+            glMaxShaderCompilerThreadsKHR(kMAX_COMPILER_THREADS);
+            threads_set = true;
+        }
+        return true;
+    }
+}
+
+ShaderProgram::ShaderProgram(const char* vert_path, const char* frag_path, BuildMode mode, const std::string& defines)
+    :   ProgramID(0),
+        VertexShader(0),
+        FragmentShader(0),
+        CacheKey(0),
+        Finished(false)
+{
+    /* 1. Read the shader code in from their files. The defines become part of the source, and so of the cache key. */    
+    std::string vert_str = insertDefines(readShaderSource(vert_path), defines);
+    std::string frag_str = insertDefines(readShaderSource(frag_path), defines);
     const char* vert_code = vert_str.c_str();
     const char* frag_code = frag_str.c_str();
 
-    /* 2. Compile the shaders. */
-    int success;
-    char info_log[512];
-    unsigned int vertex = compileShader(vert_code, GL_VERTEX_SHADER, success, info_log, sizeof(info_log));
-    unsigned int fragment = compileShader(frag_code, GL_FRAGMENT_SHADER, success, info_log, sizeof(info_log));
+    /* 2. Try the binary cache. A binary is only valid for the driver that produced it, so that is part of the key. */
+    if (programBinariesSupported())
+    {
+        std::uint64_t key = kFNV_OFFSET_BASIS;
+        key = hashBytes(key, vert_code, vert_str.size() + 1);
+        key = hashBytes(key, frag_code, frag_str.size() + 1);
+        key = hashGLString(key, GL_VENDOR);
+        key = hashGLString(key, GL_RENDERER);
+        key = hashGLString(key, GL_VERSION);
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.progbin", static_cast<unsigned long long>(key));
+        this->CacheKey = key;
+        this->CachePath = directoryOf(vert_path) + "cache/" + name;
+
+        if (loadBinary())
+        {
+            if (mode == kBUILD_NOW)
+                finishBuild();
+            return;
+        }
+    }
+
+    /* 3. Start compiling the shaders. Nothing waits on the result until finishBuild(), so with
+          KHR_parallel_shader_compile the driver compiles every pending program at once. */
+    parallelCompileSupported();
+    this->VertexShader = compileShader(vert_code, GL_VERTEX_SHADER);
+    this->FragmentShader = compileShader(frag_code, GL_FRAGMENT_SHADER);
 
-    /* 3. Build the program*/
+    /* 4. Start linking the program. */
     this->ProgramID = glCreateProgram();
-    glAttachShader(this->ProgramID, vertex);
-    glAttachShader(this->ProgramID, fragment);
+    if (!this->CachePath.empty())
+        glProgramParameteri(this->ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(this->ProgramID, this->VertexShader);
+    glAttachShader(this->ProgramID, this->FragmentShader);
     glLinkProgram(this->ProgramID);
+
+    if (mode == kBUILD_NOW)
+        finishBuild();
+}
+
+bool ShaderProgram::isBuildComplete() const
+{
+    if (this->Finished || !parallelCompileSupported())
+        return true;
+    int complete = 0;
+    glGetProgramiv(this->ProgramID, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete != 0;
+}
+
+bool ShaderProgram::finishBuild()
+{
+    /* 1. Wait for the link result. */
+    int success = 0;
     glGetProgramiv(this->ProgramID, GL_LINK_STATUS, &success);
+    if (this->Finished)
+        return success != 0;
+    this->Finished = true;
+
     if (!success)
     {
+        char info_log[512];
+        if (this->VertexShader)
+        {
+            reportShaderErrors(this->VertexShader);
+            reportShaderErrors(this->FragmentShader);
+        }
         glGetProgramInfoLog(this->ProgramID, sizeof(info_log), NULL, info_log);
         std::cerr << "Shader program linking failed.\n" << info_log << std::endl;
     }
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    else if (this->VertexShader && !this->CachePath.empty())
+    {
+        saveBinary();
+    }
+    if (this->VertexShader)
+    {
+        glDeleteShader(this->VertexShader);
+        glDeleteShader(this->FragmentShader);
+        this->VertexShader = 0;
+        this->FragmentShader = 0;
+    }
+
+    /* 2. Reflect the active uniforms so they never have to be looked up by name again. */
+    reflectUniforms();
+
+    /* 3. Attach the uniform blocks to the binding points shared by every program. */
+    bindUniformBlocks();
+    return success != 0;
 }
 
 void ShaderProgram::use()
@@ -41,25 +198,31 @@ void ShaderProgram::use()
     glUseProgram(this->ProgramID);
 }
 
+const ShaderProgram::UniformInfo* ShaderProgram::findUniform(const std::string& name) const
+{
+    std::unordered_map<std::string, UniformInfo>::const_iterator it = this->Uniforms.find(name);
+    return it != this->Uniforms.end() ? &it->second : NULL;
+}
+
 void ShaderProgram::setUniformBool(const std::string& name, bool value)
 {
-    glUniform1i(glGetUniformLocation(this->ProgramID, name.c_str()), int(value));
+    getUniform<bool>(name).set(value);
 }
 void ShaderProgram::setUniformInt(const std::string& name, int value)
 {
-    glUniform1i(glGetUniformLocation(this->ProgramID, name.c_str()), value);
+    getUniform<int>(name).set(value);
 }
 void ShaderProgram::setUniformFloat(const std::string& name, float value)
 {
-    glUniform1f(glGetUniformLocation(this->ProgramID, name.c_str()), value);
+    getUniform<float>(name).set(value);
 }
 void ShaderProgram::setUniformMat4(const std::string& name, glm::mat4 value)
 {
-    glUniformMatrix4fv(glGetUniformLocation(this->ProgramID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+    getUniform<glm::mat4>(name).set(value);
 }
 void ShaderProgram::setUniformVec3(const std::string& name, glm::vec3 value)
 {
-    glUniform3fv(glGetUniformLocation(this->ProgramID, name.c_str()), 1, glm::value_ptr(value));
+    getUniform<glm::vec3>(name).set(value);
 }
 
 // --------------------------------- Private Methods ------------------------------
@@ -78,17 +241,251 @@ std::string ShaderProgram::readFile(const char* path)
     return buffer.str();
 }
 
-unsigned int ShaderProgram::compileShader(const char* code, unsigned int shader_type, int& success, char* info_log, int log_size)
+std::string ShaderProgram::readShaderSource(const char* path)
+{
+    std::string source = readFile(path);
+
+    // resolve #include "file" lines relative to the including file
+    std::string directory = directoryOf(path);
+
+    std::string expanded;
+    std::istringstream lines(source);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        std::string::size_type directive = line.find_first_not_of(" \t");
+        std::string::size_type open_quote = line.find('"');
+        std::string::size_type close_quote = line.rfind('"');
+        if (directive != std::string::npos && line.compare(directive, 8, "#include") == 0 &&
+            open_quote != std::string::npos && open_quote != close_quote)
+        {
+            std::string include_path = directory + line.substr(open_quote + 1, close_quote - open_quote - 1);
+            expanded += readShaderSource(include_path.c_str());
+            expanded += '\n';
+            continue;
+        }
+        expanded += line;
+        expanded += '\n';
+    }
+    return expanded;
+}
+
+unsigned int ShaderProgram::compileShader(const char* code, unsigned int shader_type)
 {
     unsigned int shader = glCreateShader(shader_type);
     glShaderSource(shader, 1, &code, NULL);
     glCompileShader(shader);
+    return shader;
+}
+
+void ShaderProgram::reportShaderErrors(unsigned int shader)
+{
+    int success = 0;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(shader, log_size, NULL, info_log);
+        char info_log[512];
+        glGetShaderInfoLog(shader, sizeof(info_log), NULL, info_log);
         std::cerr << "Shader compilation failed.\n" << info_log << std::endl;
     }
+}
 
-    return shader;
+bool ShaderProgram::loadBinary()
+{
+    MappedFile file;
+    if (!file.open(this->CachePath.c_str()) || file.size() < sizeof(ProgramCacheHeader))
+        return false;
+    const ProgramCacheHeader* header = reinterpret_cast<const ProgramCacheHeader*>(file.data());
+    if (std::memcmp(header->Magic, kPROGRAM_CACHE_MAGIC, sizeof(header->Magic)) != 0 ||
+        header->Version != kPROGRAM_CACHE_VERSION || header->Key != this->CacheKey ||
+        file.size() < sizeof(ProgramCacheHeader) + header->Length)
+        return false;
+
+    this->ProgramID = glCreateProgram();
+    glProgramBinary(this->ProgramID, header->Format, file.data() + sizeof(ProgramCacheHeader), header->Length);
+    int success = 0;
+    glGetProgramiv(this->ProgramID, GL_LINK_STATUS, &success);
+    if (success)
+        return true;
+
+    // drivers may reject an old binary even with a matching version string, so compile it again
+    std::cerr << "Cached shader program was rejected by the driver, recompiling: " << this->CachePath << std::endl;
+    glDeleteProgram(this->ProgramID);
+    this->ProgramID = 0;
+    return false;
+}
+
+void ShaderProgram::saveBinary()
+{
+    int length = 0;
+    glGetProgramiv(this->ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(this->ProgramID, length, &length, &format, binary.data());
+
+    ProgramCacheHeader header;
+    std::memcpy(header.Magic, kPROGRAM_CACHE_MAGIC, sizeof(header.Magic));
+    header.Version = kPROGRAM_CACHE_VERSION;
+    header.Key = this->CacheKey;
+    header.Format = format;
+    header.Length = static_cast<std::uint32_t>(length);
+
+    std::string directory = directoryOf(this->CachePath.c_str());
+    if (!createDirectory(directory.c_str()))
+    {
+        std::cerr << "Failed to create shader cache directory: " << directory << std::endl;
+        return;
+    }
+
+    // write to a temporary file first so a failed write never leaves a truncated cache behind
+    std::string temp_path = makeTempPath(this->CachePath.c_str());
+    std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+    bool written = file != NULL
+                && std::fwrite(&header, sizeof(header), 1, file) == 1
+                && std::fwrite(binary.data(), 1, header.Length, file) == header.Length;
+    written = (file != NULL && std::fclose(file) == 0) && written;
+    if (!replaceFile(temp_path, this->CachePath.c_str(), written))
+    {
+        std::cerr << "Failed to write shader cache: " << this->CachePath << std::endl;
+    }
+}
+
+void ShaderProgram::reflectUniforms()
+{
+    int count = 0;
+    int max_name_length = 0;
+    glGetProgramiv(this->ProgramID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(this->ProgramID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    std::string name(max_name_length > 0 ? max_name_length : 1, '\0');
+    for (int i = 0; i < count; i++)
+    {
+        int length = 0;
+        UniformInfo info;
+        glGetActiveUniform(this->ProgramID, i, max_name_length, &length, &info.Size, &info.Type, &name[0]);
+        std::string uniform_name = name.substr(0, length);
+        info.Location = glGetUniformLocation(this->ProgramID, uniform_name.c_str());
+        // uniforms that live in uniform blocks have no location
+        if (info.Location < 0)
+            continue;
+
+        this->Uniforms[uniform_name] = info;
+        // arrays are reported as "name[0]", so also register the bare name and every element
+        std::string::size_type bracket = uniform_name.rfind("[0]");
+        if (bracket != std::string::npos && bracket + 3 == uniform_name.size())
+        {
+            std::string base = uniform_name.substr(0, bracket);
+            this->Uniforms[base] = info;
+            for (int element = 1; element < info.Size; element++)
+            {
+                std::string element_name = base + "[" + std::to_string(element) + "]";
+                UniformInfo element_info = info;
+                element_info.Location = glGetUniformLocation(this->ProgramID, element_name.c_str());
+                element_info.Size = info.Size - element;
+                this->Uniforms[element_name] = element_info;
+            }
+        }
+    }
+}
+
+void ShaderProgram::bindUniformBlocks()
+{
+    int count = 0;
+    glGetProgramiv(this->ProgramID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+
+    char name[128];
+    for (int i = 0; i < count; i++)
+    {
+        glGetActiveUniformBlockName(this->ProgramID, i, sizeof(name), NULL, name);
+        const UniformBlockInfo* block = findUniformBlock(name);
+        if (!block)
+        {
+            std::cerr << "Shader program uses unknown uniform block '" << name << "'." << std::endl;
+            continue;
+        }
+
+        int size = 0;
+        glGetActiveUniformBlockiv(this->ProgramID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if (static_cast<std::size_t>(size) != block->Size)
+            std::cerr << "Uniform block '" << name << "' is " << size << " bytes but the engine expects "
+                      << block->Size << "." << std::endl;
+
+        glUniformBlockBinding(this->ProgramID, i, block->Binding);
+    }
+}
+
+void ShaderProgram::reportTypeMismatch(const std::string& name, unsigned int gl_type) const
+{
+    std::cerr << "Uniform handle type does not match uniform '" << name << "' (GL type 0x"
+              << std::hex << gl_type << std::dec << ")." << std::endl;
+}
+
+// --------------------------------- Uniform Handles ------------------------------
+
+template <> void Uniform<bool>::set(const bool& value) const
+{
+    glUniform1i(this->Location, int(value));
+}
+template <> void Uniform<int>::set(const int& value) const
+{
+    glUniform1i(this->Location, value);
+}
+template <> void Uniform<float>::set(const float& value) const
+{
+    glUniform1f(this->Location, value);
+}
+template <> void Uniform<glm::vec2>::set(const glm::vec2& value) const
+{
+    glUniform2fv(this->Location, 1, glm::value_ptr(value));
+}
+template <> void Uniform<glm::vec3>::set(const glm::vec3& value) const
+{
+    glUniform3fv(this->Location, 1, glm::value_ptr(value));
+}
+template <> void Uniform<glm::mat4>::set(const glm::mat4& value) const
+{
+    glUniformMatrix4fv(this->Location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+template <> bool Uniform<bool>::acceptsType(unsigned int gl_type)
+{
+    return gl_type == GL_BOOL || gl_type == GL_INT;
+}
+template <> bool Uniform<int>::acceptsType(unsigned int gl_type)
+{
+    switch (gl_type)
+    {
+        case GL_INT:
+        case GL_BOOL:
+        case GL_SAMPLER_1D:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_BUFFER:
+        case GL_INT_SAMPLER_BUFFER:
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+            return true;
+        default:
+            return false;
+    }
+}
+template <> bool Uniform<float>::acceptsType(unsigned int gl_type)
+{
+    return gl_type == GL_FLOAT;
+}
+template <> bool Uniform<glm::vec2>::acceptsType(unsigned int gl_type)
+{
+    return gl_type == GL_FLOAT_VEC2;
+}
+template <> bool Uniform<glm::vec3>::acceptsType(unsigned int gl_type)
+{
+    return gl_type == GL_FLOAT_VEC3;
+}
+template <> bool Uniform<glm::mat4>::acceptsType(unsigned int gl_type)
+{
+    return gl_type == GL_FLOAT_MAT4;
 }
@@ -1,23 +1,111 @@
 #ifndef SHADER_PROGRAM_HPP
 #define SHADER_PROGRAM_HPP
 
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <glm/glm.hpp>
 
+/*
+    A typed handle to a uniform in a linked ShaderProgram.
+    Handles are resolved once with ShaderProgram::getUniform and then set as often as needed
+    without any string building, hashing or driver lookups.
+    The owning program must be in use when set() is called.
+*/
+template <typename T>
+class Uniform
+{
+public:
+    Uniform(int location = -1) : Location(location) {}
+    /* Upload a value to the uniform. Setting a handle that was not found in the program is a no-op. */
+    void set(const T& value) const;
+    /* Check if the handle refers to an active uniform. */
+    bool isValid() const { return this->Location >= 0; }
+    /* Check if a reflected GL uniform type can be set through this handle type. */
+    static bool acceptsType(unsigned int gl_type);
+
+public:
+    int Location;
+};
+
+template <> void Uniform<bool>::set(const bool& value) const;
+template <> void Uniform<int>::set(const int& value) const;
+template <> void Uniform<float>::set(const float& value) const;
+template <> void Uniform<glm::vec2>::set(const glm::vec2& value) const;
+template <> void Uniform<glm::vec3>::set(const glm::vec3& value) const;
+template <> void Uniform<glm::mat4>::set(const glm::mat4& value) const;
+template <> bool Uniform<bool>::acceptsType(unsigned int gl_type);
+template <> bool Uniform<int>::acceptsType(unsigned int gl_type);
+template <> bool Uniform<float>::acceptsType(unsigned int gl_type);
+template <> bool Uniform<glm::vec2>::acceptsType(unsigned int gl_type);
+template <> bool Uniform<glm::vec3>::acceptsType(unsigned int gl_type);
+template <> bool Uniform<glm::mat4>::acceptsType(unsigned int gl_type);
+
 class ShaderProgram
 {
 public:
+    /* Reflected information about an active uniform, gathered once after linking. */
+    struct UniformInfo
+    {
+        int Location;
+        unsigned int Type;
+        int Size;
+    };
+
+    /* Whether the constructor waits for the program to be built or leaves that to finishBuild(). */
+    enum BuildMode
+    {
+        kBUILD_NOW,
+        kBUILD_DEFERRED
+    };
+
     /*
         Construct a ShaderProgram object.
         Takes parameters pointing to the location of the shader code for each shader in the program.
-        The code is read in from those files, then compiled.
+        The code is read in from those files, then the program is loaded from the binary cache or compiled.
+        With kBUILD_DEFERRED the compile is only started, so several programs can be compiled by the
+        driver in parallel; finishBuild() must then be called before the program is used.
+        Any defines, given as "#define NAME value" lines, are inserted after the #version line of
+        both shaders, so one pair of files can be compiled into several specialised programs.
+    */
+    ShaderProgram(const char* vert_path, const char* frag_path, BuildMode mode = kBUILD_NOW,
+                  const std::string& defines = std::string());
+    /*
+        Check, without blocking, if the driver has finished compiling and linking the program.
+        Always true when the driver can't compile in the background.
     */
-    ShaderProgram(const char* vert_path, const char* frag_path);
+    bool isBuildComplete() const;
+    /*
+        Wait for the program to link, then reflect it and store its binary in the cache.
+        Returns false if the build failed. Calling it again after the first time does nothing.
+    */
+    bool finishBuild();
     /*
         Tell OpenGL that we want this shader program to be used.
         This must be called before any of the uniform setting functions are called.
     */
     void use();
+    /* Get the OpenGL name of the program, for binding it through a GLStateCache. */
+    unsigned int id() const { return this->ProgramID; }
+    /*
+        Get a pre-resolved handle to a uniform.
+        Returns an invalid handle if the uniform is not active in the program. In debug builds the
+        requested handle type is checked against the reflected GL type of the uniform.
+    */
+    template <typename T>
+    Uniform<T> getUniform(const std::string& name) const
+    {
+        const UniformInfo* info = findUniform(name);
+        if (!info)
+            return Uniform<T>();
+#ifndef NDEBUG
+        if (!Uniform<T>::acceptsType(info->Type))
+            reportTypeMismatch(name, info->Type);
+#endif
+        return Uniform<T>(info->Location);
+    }
+    /* Look up the reflected information for a uniform, or NULL if it is not active. */
+    const UniformInfo* findUniform(const std::string& name) const;
     /* Set a Boolean Uniform in the shader program */
     void setUniformBool(const std::string& name, bool value);
     /* Set an Integer Uniform in the shader program */
@@ -32,13 +120,37 @@ public:
 private:
     /* Helper function to read a file into a string */
     std::string readFile(const char* path);
-    /* Helper function to compile GLSL shaders */
-    unsigned int compileShader(const char* code, unsigned int shader_type, int& success, char* info_log, int log_size);
+    /* Helper function to read a shader file, expanding any #include "file" lines */
+    std::string readShaderSource(const char* path);
+    /* Helper function to start compiling a GLSL shader without waiting for the result */
+    unsigned int compileShader(const char* code, unsigned int shader_type);
+    /* Report the compile log of a shader that failed to compile. */
+    void reportShaderErrors(unsigned int shader);
+    /* Create the program from the cached binary. Returns false on a miss or if the driver rejects it. */
+    bool loadBinary();
+    /* Store the binary of the linked program in the cache. */
+    void saveBinary();
+    /* Enumerate the active uniforms of the linked program and fill the uniform table. */
+    void reflectUniforms();
+    /* Attach each active uniform block to its fixed binding point. */
+    void bindUniformBlocks();
+    /* Report a handle whose type does not match the reflected uniform type. */
+    void reportTypeMismatch(const std::string& name, unsigned int gl_type) const;
 
 private:
     /* Hold the ID of the shader program used by OpenGL */
     unsigned int ProgramID;
+    /* Shaders kept until the link result has been checked. 0 when the program came from the cache. */
+    unsigned int VertexShader;
+    unsigned int FragmentShader;
+    /* Location of the cached binary, named after a hash of the sources and the driver. */
+    std::string CachePath;
+    /* The same hash, stored in the cache file to detect collisions. */
+    std::uint64_t CacheKey;
+    bool Finished;
+    /* Active uniforms by name. Array uniforms are stored under both "name" and "name[i]". */
+    std::unordered_map<std::string, UniformInfo> Uniforms;
 };
 
 
-#endif  // SHADER_PROGRAM_HPP
\ No newline at end of file
+#endif  // SHADER_PROGRAM_HPP
@@ -0,0 +1,70 @@
+#include "shader_variants.hpp"
+
+namespace
+{
+    struct FeatureName
+    {
+        ShaderFeature Feature;
+        const char* Define;
+    };
+
+    const FeatureName kFEATURE_NAMES[] = {
+        { kSHADER_DIRECTIONAL_LIGHT,    "DIRECTIONAL_LIGHT" },
+        { kSHADER_LOCAL_LIGHTS,         "LOCAL_LIGHTS" },
+        { kSHADER_SPOT_LIGHTS,          "SPOT_LIGHTS" },
+        { kSHADER_SPECULAR_MAP,         "SPECULAR_MAP" }
+    };
+}
+
+std::string getShaderFeatureDefines(unsigned int features)
+{
+    std::string defines;
+    for (std::size_t i = 0; i < sizeof(kFEATURE_NAMES) / sizeof(kFEATURE_NAMES[0]); i++)
+    {
+        if (features & kFEATURE_NAMES[i].Feature)
+            defines += std::string("#define ") + kFEATURE_NAMES[i].Define + "\n";
+    }
+    return defines;
+}
+
+ShaderVariants::ShaderVariants(const char* vert_path, const char* frag_path, SetupFunction setup)
+    :   VertexPath(vert_path),
+        FragmentPath(frag_path),
+        Setup(setup)
+{
+}
+
+void ShaderVariants::prepare(unsigned int features)
+{
+    findOrStart(features);
+}
+
+ShaderProgram& ShaderVariants::get(unsigned int features)
+{
+    Variant& variant = findOrStart(features);
+    if (!variant.Ready)
+    {
+        variant.Program->finishBuild();
+        if (this->Setup)
+        {
+            variant.Program->use();
+            this->Setup(*variant.Program);
+        }
+        variant.Ready = true;
+    }
+    return *variant.Program;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+ShaderVariants::Variant& ShaderVariants::findOrStart(unsigned int features)
+{
+    std::unordered_map<unsigned int, Variant>::iterator it = this->Variants.find(features);
+    if (it != this->Variants.end())
+        return it->second;
+    Variant& variant = this->Variants[features];
+    variant.Program.reset(new ShaderProgram(this->VertexPath.c_str(), this->FragmentPath.c_str(),
+                                            ShaderProgram::kBUILD_DEFERRED, getShaderFeatureDefines(features)));
+    variant.Ready = false;
+    return variant;
+}
@@ -0,0 +1,75 @@
+#ifndef SHADER_VARIANTS_HPP
+#define SHADER_VARIANTS_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "shader_program.hpp"
+
+/*
+    Optional parts of the lit shaders. A set of them, ORed together, selects a variant of a program
+    in which only those parts are compiled. Keep in sync with the #ifdefs in shaders/shading.glsl,
+    shaders/lighting.frag and shaders/gbuffer.frag.
+*/
+enum ShaderFeature
+{
+    /* The directional light. */
+    kSHADER_DIRECTIONAL_LIGHT   = 1 << 0,
+    /* Point and spot lights, read from the clustered light lists. */
+    kSHADER_LOCAL_LIGHTS        = 1 << 1,
+    /* Cones of spot lights. Without it every local light is lit as a point light. */
+    kSHADER_SPOT_LIGHTS         = 1 << 2,
+    /* A specular map. Without it the surface has no specular highlights. */
+    kSHADER_SPECULAR_MAP        = 1 << 3
+};
+
+/* Get the #define lines that enable a set of shader features. */
+std::string getShaderFeatureDefines(unsigned int features);
+
+/*
+    The variants of one pair of shader files, built the first time each set of features is asked for
+    and kept by that set.
+    The shaders read the features as preprocessor symbols, so parts that aren't needed are removed
+    by the compiler instead of being branched over for every fragment.
+*/
+class ShaderVariants
+{
+public:
+    /* Set the uniforms of a newly built variant that never change. The program is in use when it is called. */
+    typedef std::function<void(ShaderProgram&)> SetupFunction;
+
+    /* Construct a ShaderVariants object. Nothing is compiled until a variant is asked for. */
+    ShaderVariants(const char* vert_path, const char* frag_path, SetupFunction setup = SetupFunction());
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    /* Start compiling a variant without waiting for it, so several can be compiled in parallel. */
+    void prepare(unsigned int features);
+    /*
+        Get a variant, building it first if needed. Waiting for a new variant to finish building
+        uses its program, so call this before relying on the current program binding.
+    */
+    ShaderProgram& get(unsigned int features);
+    /* Get the number of variants started so far. */
+    std::size_t variantCount() const { return this->Variants.size(); }
+
+private:
+    struct Variant
+    {
+        std::unique_ptr<ShaderProgram> Program;
+        /* Set once the build has been finished and the setup function has run. */
+        bool Ready;
+    };
+
+    Variant& findOrStart(unsigned int features);
+
+private:
+    std::string VertexPath;
+    std::string FragmentPath;
+    SetupFunction Setup;
+    std::unordered_map<unsigned int, Variant> Variants;
+};
+
+#endif  // SHADER_VARIANTS_HPP
@@ -0,0 +1,157 @@
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include "profiler.hpp"
+
+constexpr double Simulation::kTICK_RATE;
+constexpr double Simulation::kTICK_SECONDS;
+constexpr unsigned int Simulation::kMAX_CATCH_UP_TICKS;
+constexpr std::size_t Simulation::kINPUT_QUEUE_SIZE;
+constexpr unsigned int Simulation::kFRESH;
+
+Simulation::Simulation(const Camera& camera)
+    :   Running(false),
+        SimulatedCamera(camera),
+        PendingInputTime(0.0),
+        Ready(1),
+        WriteIndex(0),
+        ReadIndex(2)
+{
+    for (unsigned int i = 0; i <= Camera::DOWN; i++)
+        this->Moving[i] = false;
+    // every slot starts at rest on the starting pose
+    Snapshot initial;
+    initial.Previous = captureState();
+    initial.Current = initial.Previous;
+    initial.Time = now();
+    initial.InputTime = 0.0;
+    for (unsigned int i = 0; i < 3; i++)
+        this->Snapshots[i] = initial;
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start()
+{
+    if (this->Running.exchange(true))
+        return;
+    this->Thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    this->Running.store(false);
+    if (this->Thread.joinable())
+        this->Thread.join();
+}
+
+bool Simulation::pushInput(const InputEvent& event)
+{
+    return this->Inputs.push(event);
+}
+
+double Simulation::interpolate(double time, Camera& camera)
+{
+    double input_time = 0.0;
+    if (this->Ready.load(std::memory_order_relaxed) & kFRESH)
+    {
+        this->ReadIndex = this->Ready.exchange(this->ReadIndex, std::memory_order_acq_rel) & ~kFRESH;
+        input_time = this->Snapshots[this->ReadIndex].InputTime;
+    }
+
+    // one tick behind: the previous state is shown as the tick ends, blending towards the current one
+    const Snapshot& snapshot = this->Snapshots[this->ReadIndex];
+    float t = static_cast<float>(std::min(std::max((time - snapshot.Time) / kTICK_SECONDS, 0.0), 1.0));
+    const CameraState& a = snapshot.Previous;
+    const CameraState& b = snapshot.Current;
+    camera.SetPose(glm::mix(a.Position, b.Position, t), a.Yaw + (b.Yaw - a.Yaw) * t, a.Pitch + (b.Pitch - a.Pitch) * t);
+    camera.FoV = a.FoV + (b.FoV - a.FoV) * t;
+    return input_time;
+}
+
+double Simulation::now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void Simulation::run()
+{
+    double next_tick = now() + kTICK_SECONDS;
+    while (this->Running.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(next_tick))));
+
+        PROFILE_SCOPE("simulation tick");
+        unsigned int ticks = 0;
+        double time = now();
+        while (next_tick <= time && ticks < kMAX_CATCH_UP_TICKS)
+        {
+            tick(next_tick);
+            next_tick += kTICK_SECONDS;
+            ticks++;
+        }
+        // after a long stall, carry on from now instead of replaying every missed tick
+        if (next_tick <= time)
+            next_tick = time + kTICK_SECONDS;
+        if (ticks > 0)
+            publish();
+    }
+}
+
+void Simulation::tick(double time)
+{
+    Snapshot& snapshot = this->Snapshots[this->WriteIndex];
+    snapshot.Previous = captureState();
+
+    // events up to the end of the tick; anything newer waits for the next one
+    InputEvent event;
+    while (this->Inputs.peek(event) && event.Time <= time)
+    {
+        this->Inputs.pop(event);
+        if (this->PendingInputTime == 0.0 || event.Time < this->PendingInputTime)
+            this->PendingInputTime = event.Time;
+        switch (event.EventType)
+        {
+            case InputEvent::kMOVE_START:   { this->Moving[event.Movement] = true; } break;
+            case InputEvent::kMOVE_STOP:    { this->Moving[event.Movement] = false; } break;
+            case InputEvent::kLOOK:         { this->SimulatedCamera.UpdateLookDirection(event.X, event.Y); } break;
+            case InputEvent::kZOOM:         { this->SimulatedCamera.UpdateFoV(event.Y); } break;
+        }
+    }
+    for (unsigned int movement = 0; movement <= Camera::DOWN; movement++)
+    {
+        if (this->Moving[movement])
+            this->SimulatedCamera.Move(static_cast<Camera::CameraMovement>(movement), static_cast<float>(kTICK_SECONDS));
+    }
+
+    snapshot.Current = captureState();
+    snapshot.Time = time;
+    snapshot.InputTime = this->PendingInputTime;
+}
+
+void Simulation::publish()
+{
+    unsigned int previous = this->Ready.exchange(this->WriteIndex | kFRESH, std::memory_order_acq_rel);
+    this->WriteIndex = previous & ~kFRESH;
+    // The input is reported by whichever snapshot the render thread picks up first. A snapshot it
+    // never read is about to be overwritten, so its input is carried over to the next one.
+    this->PendingInputTime = (previous & kFRESH) ? this->Snapshots[this->WriteIndex].InputTime : 0.0;
+}
+
+CameraState Simulation::captureState() const
+{
+    CameraState state;
+    state.Position = this->SimulatedCamera.Position;
+    state.Yaw = this->SimulatedCamera.GetYaw();
+    state.Pitch = this->SimulatedCamera.GetPitch();
+    state.FoV = this->SimulatedCamera.FoV;
+    return state;
+}
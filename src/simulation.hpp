@@ -0,0 +1,124 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include <atomic>
+#include <thread>
+#include <glm/glm.hpp>
+
+#include "camera.hpp"
+#include "spsc_queue.hpp"
+
+/* An input event captured by the thread that polls the window, for the simulation thread. */
+struct InputEvent
+{
+    enum Type
+    {
+        /* A movement key was pressed or released. */
+        kMOVE_START,
+        kMOVE_STOP,
+        /* The mouse moved by X, Y. */
+        kLOOK,
+        /* The scroll wheel moved by Y. */
+        kZOOM
+    };
+
+    Type EventType;
+    Camera::CameraMovement Movement;
+    float X;
+    float Y;
+    /* When the event happened, from Simulation::now(). */
+    double Time;
+};
+
+/* The state of the camera at one tick of the simulation. */
+struct CameraState
+{
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+    float FoV;
+};
+
+/*
+    Steps the camera from input on its own thread at a fixed tick rate, so the simulation neither
+    speeds up nor stalls with the frame rate.
+    Input events are timestamped and queued without locks by the thread that polls the window.
+    After each tick the simulation publishes the states before and after it as one snapshot, through
+    a lock-free triple buffer, and the render thread draws the camera interpolated between them. The
+    render thread stays one tick behind the newest state, so it always has two states to blend.
+*/
+class Simulation
+{
+public:
+    static constexpr double kTICK_RATE = 120.0;
+    static constexpr double kTICK_SECONDS = 1.0 / kTICK_RATE;
+    /* Most ticks run in one go after the thread fell behind. Anything more is skipped. */
+    static constexpr unsigned int kMAX_CATCH_UP_TICKS = 8;
+    static constexpr std::size_t kINPUT_QUEUE_SIZE = 1024;
+
+    /* Construct a Simulation object that starts from the pose of a camera. The thread isn't started yet. */
+    explicit Simulation(const Camera& camera);
+    /* Stop the thread if it is running. */
+    ~Simulation();
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    /* Start ticking on a new thread. */
+    void start();
+    /* Stop ticking and join the thread. */
+    void stop();
+
+    /* Queue an input event. Only call from one thread. Returns false if the queue is full and the event was dropped. */
+    bool pushInput(const InputEvent& event);
+    /*
+        Set a camera to the simulated state at a time, blending the last two ticks. Only call from one
+        thread. Returns the time of the oldest input event first shown by this call, or 0 if there
+        is none, for measuring how long input takes to reach the screen.
+    */
+    double interpolate(double time, Camera& camera);
+
+    /* Get the current time in seconds, on the clock used for ticks and input events. */
+    static double now();
+
+private:
+    /* Both ends of one tick, published together so the render thread never blends states from different ticks. */
+    struct Snapshot
+    {
+        CameraState Previous;
+        CameraState Current;
+        /* Time of the current state. The previous state is one tick before it. */
+        double Time;
+        /* Time of the oldest input event applied by this tick, or 0 if there was none. */
+        double InputTime;
+    };
+
+    /* Main loop of the simulation thread. */
+    void run();
+    /* Apply the queued input and advance the camera by one tick. */
+    void tick(double time);
+    /* Make the snapshot being written the newest one. */
+    void publish();
+    CameraState captureState() const;
+
+private:
+    SpscQueue<InputEvent, kINPUT_QUEUE_SIZE> Inputs;
+    std::thread Thread;
+    std::atomic<bool> Running;
+
+    // only touched by the simulation thread
+    Camera SimulatedCamera;
+    bool Moving[Camera::DOWN + 1];
+    double PendingInputTime;
+
+    /*
+        Triple buffer: the simulation thread writes Snapshots[WriteIndex], the render thread reads
+        Snapshots[ReadIndex], and Ready holds the third, with kFRESH set if it is newer than ReadIndex.
+    */
+    static constexpr unsigned int kFRESH = 4;
+    Snapshot Snapshots[3];
+    std::atomic<unsigned int> Ready;
+    unsigned int WriteIndex;
+    unsigned int ReadIndex;
+};
+
+#endif  // SIMULATION_HPP
@@ -0,0 +1,61 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+/*
+    A fixed size, lock-free queue between one producer thread and one consumer thread.
+    Items are copied in and out of a ring of Capacity slots, which must be a power of two. The
+    producer only writes Tail and the consumer only writes Head, so neither ever waits on the other.
+*/
+template <typename T, std::size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : Head(0), Tail(0) {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /* Add an item. Only call from the producer thread. Returns false if the queue is full. */
+    bool push(const T& item)
+    {
+        std::size_t tail = this->Tail.load(std::memory_order_relaxed);
+        if (tail - this->Head.load(std::memory_order_acquire) == Capacity)
+            return false;
+        this->Items[tail & (Capacity - 1)] = item;
+        this->Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Take the oldest item. Only call from the consumer thread. Returns false if the queue is empty. */
+    bool pop(T& item)
+    {
+        std::size_t head = this->Head.load(std::memory_order_relaxed);
+        if (head == this->Tail.load(std::memory_order_acquire))
+            return false;
+        item = this->Items[head & (Capacity - 1)];
+        this->Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Copy the oldest item without taking it. Only call from the consumer thread. Returns false if the queue is empty. */
+    bool peek(T& item) const
+    {
+        std::size_t head = this->Head.load(std::memory_order_relaxed);
+        if (head == this->Tail.load(std::memory_order_acquire))
+            return false;
+        item = this->Items[head & (Capacity - 1)];
+        return true;
+    }
+
+private:
+    T Items[Capacity];
+    // on separate cache lines, so the two threads don't keep taking the line from each other
+    alignas(64) std::atomic<std::size_t> Head;
+    alignas(64) std::atomic<std::size_t> Tail;
+};
+
+#endif  // SPSC_QUEUE_HPP
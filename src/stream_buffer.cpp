@@ -0,0 +1,190 @@
+#include "stream_buffer.hpp"
+
+#include <chrono>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "profiler.hpp"
+
+constexpr unsigned int StreamBuffer::kFRAMES_IN_FLIGHT;
+
+namespace
+{
+    // the buffer is only ever bound here to map it, so this target doesn't disturb any other binding
+    const GLenum kMAP_TARGET = GL_COPY_WRITE_BUFFER;
+    // wait for a fence in slices of this many nanoseconds
+    const GLuint64 kFENCE_WAIT_SLICE = 1000000;
+
+    bool bufferStorageSupported()
+    {
+        return GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4) || GLAD_GL_ARB_buffer_storage;
+    }
+}
+
+StreamBuffer::StreamBuffer(std::size_t frame_size)
+    :   FrameSize(frame_size),
+        UniformAlignment(256),
+        Persistent(bufferStorageSupported()),
+        Mapped(NULL),
+        Region(kFRAMES_IN_FLIGHT - 1),
+        Used(0),
+        FrameStarted(false),
+        ReportedOverflow(false),
+        StallTime(0.0)
+{
+    for (unsigned int i = 0; i < kFRAMES_IN_FLIGHT; i++)
+        this->Fences[i] = NULL;
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment > 0)
+        this->UniformAlignment = static_cast<std::size_t>(alignment);
+
+    GLsizeiptr size = static_cast<GLsizeiptr>(frame_size * kFRAMES_IN_FLIGHT);
+    glGenBuffers(1, &this->BufferID);
+    glBindBuffer(kMAP_TARGET, this->BufferID);
+    if (this->Persistent)
+    {
+        // coherent, so writes reach the GPU without any flushing
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(kMAP_TARGET, size, NULL, flags);
+        this->Mapped = static_cast<unsigned char*>(glMapBufferRange(kMAP_TARGET, 0, size, flags));
+        if (!this->Mapped)
+        {
+            std::cerr << "Failed to map the stream buffer persistently." << std::endl;
+            this->Persistent = false;
+            // immutable storage can't be orphaned, so start over with a mutable buffer
+            glBindBuffer(kMAP_TARGET, 0);
+            glDeleteBuffers(1, &this->BufferID);
+            glGenBuffers(1, &this->BufferID);
+            glBindBuffer(kMAP_TARGET, this->BufferID);
+        }
+    }
+    if (!this->Persistent)
+        glBufferData(kMAP_TARGET, size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(kMAP_TARGET, 0);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    for (unsigned int i = 0; i < kFRAMES_IN_FLIGHT; i++)
+    {
+        if (this->Fences[i])
+            glDeleteSync(static_cast<GLsync>(this->Fences[i]));
+    }
+    if (this->Mapped)
+    {
+        glBindBuffer(kMAP_TARGET, this->BufferID);
+        glUnmapBuffer(kMAP_TARGET);
+        glBindBuffer(kMAP_TARGET, 0);
+    }
+    glDeleteBuffers(1, &this->BufferID);
+}
+
+void StreamBuffer::beginFrame()
+{
+    if (this->FrameStarted)
+    {
+        // a frame that never called commit() would leave the buffer mapped, where the GPU can't read it
+        if (!this->Persistent && this->Mapped)
+            commit();
+        // everything that reads the previous frame's region has been issued by now
+        this->Fences[this->Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    this->FrameStarted = true;
+    this->Region = (this->Region + 1) % kFRAMES_IN_FLIGHT;
+    this->Used = 0;
+    this->StallTime = 0.0;
+
+    GLsync fence = static_cast<GLsync>(this->Fences[this->Region]);
+    if (fence)
+    {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED && this->Persistent)
+        {
+            // the GPU is more than kFRAMES_IN_FLIGHT frames behind, so there is nothing to do but wait
+            PROFILE_SCOPE("stream buffer stall");
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            do
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFENCE_WAIT_SLICE);
+            while (status == GL_TIMEOUT_EXPIRED);
+            this->StallTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        else if (status == GL_TIMEOUT_EXPIRED)
+        {
+            // Give the buffer new storage instead of waiting. The driver frees the old storage once
+            // the GPU is done with it, and nothing is pending on the new one.
+            glBindBuffer(kMAP_TARGET, this->BufferID);
+            glBufferData(kMAP_TARGET, static_cast<GLsizeiptr>(this->FrameSize * kFRAMES_IN_FLIGHT), NULL, GL_STREAM_DRAW);
+            glBindBuffer(kMAP_TARGET, 0);
+            for (unsigned int i = 0; i < kFRAMES_IN_FLIGHT; i++)
+            {
+                if (this->Fences[i] && i != this->Region)
+                    glDeleteSync(static_cast<GLsync>(this->Fences[i]));
+                if (i != this->Region)
+                    this->Fences[i] = NULL;
+            }
+        }
+        glDeleteSync(fence);
+        this->Fences[this->Region] = NULL;
+    }
+    if (!this->Persistent)
+        mapRegion();
+}
+
+StreamAllocation StreamBuffer::allocate(std::size_t size, std::size_t alignment)
+{
+    StreamAllocation allocation;
+    allocation.Data = NULL;
+    allocation.Offset = 0;
+    allocation.Size = size;
+
+    // a failed map has already been reported
+    if (!this->Mapped)
+        return allocation;
+    std::size_t start = (this->Used + alignment - 1) & ~(alignment - 1);
+    if (start + size > this->FrameSize)
+    {
+        if (!this->ReportedOverflow)
+        {
+            std::cerr << "Stream buffer frame of " << this->FrameSize << " bytes is too small for an allocation of "
+                      << size << " bytes." << std::endl;
+            this->ReportedOverflow = true;
+        }
+        return allocation;
+    }
+    this->Used = start + size;
+
+    std::size_t region_start = this->Region * this->FrameSize;
+    allocation.Offset = region_start + start;
+    // a persistent mapping covers the whole buffer, a per-frame mapping only the current region
+    allocation.Data = this->Persistent ? this->Mapped + allocation.Offset : this->Mapped + start;
+    return allocation;
+}
+
+void StreamBuffer::commit()
+{
+    if (this->Persistent || !this->Mapped)
+        return;
+    glBindBuffer(kMAP_TARGET, this->BufferID);
+    if (this->Used > 0)
+        glFlushMappedBufferRange(kMAP_TARGET, 0, static_cast<GLsizeiptr>(this->Used));
+    if (glUnmapBuffer(kMAP_TARGET) == GL_FALSE)
+        std::cerr << "Stream buffer contents were lost while it was mapped." << std::endl;
+    glBindBuffer(kMAP_TARGET, 0);
+    this->Mapped = NULL;
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+void StreamBuffer::mapRegion()
+{
+    // unsynchronized because the fence has already shown the GPU is done with this region
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT;
+    glBindBuffer(kMAP_TARGET, this->BufferID);
+    this->Mapped = static_cast<unsigned char*>(glMapBufferRange(kMAP_TARGET, static_cast<GLintptr>(this->Region * this->FrameSize),
+                                                                static_cast<GLsizeiptr>(this->FrameSize), flags));
+    glBindBuffer(kMAP_TARGET, 0);
+    if (!this->Mapped)
+        std::cerr << "Failed to map the stream buffer." << std::endl;
+}
@@ -0,0 +1,78 @@
+#ifndef STREAM_BUFFER_HPP
+#define STREAM_BUFFER_HPP
+
+#include <cstddef>
+
+/* Space in a StreamBuffer for data written this frame. Data is NULL if the frame's region is full. */
+struct StreamAllocation
+{
+    void* Data;
+    /* Offset of the data from the start of the buffer, for binding it or pointing attributes at it. */
+    std::size_t Offset;
+    std::size_t Size;
+};
+
+/*
+    A ring buffer for data that is written by the CPU every frame, such as uniform blocks and
+    instance data. The buffer is split into one region per frame in flight. Each frame writes
+    straight into its own region while the GPU is still reading the regions of earlier frames, and
+    a fence on each region makes sure it is not overwritten before the GPU is done with it.
+    Where GL_ARB_buffer_storage is supported, the buffer is mapped once and stays mapped. Otherwise
+    each region is mapped unsynchronized for the frame, and the buffer is orphaned instead of
+    waiting when the GPU is still reading the next region.
+*/
+class StreamBuffer
+{
+public:
+    /* Number of frames the CPU can write ahead of the GPU. */
+    static constexpr unsigned int kFRAMES_IN_FLIGHT = 3;
+
+    /* Construct a StreamBuffer object with room for frame_size bytes per frame. The GL context must be current. */
+    explicit StreamBuffer(std::size_t frame_size);
+    ~StreamBuffer();
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    /*
+        Start writing a new frame. Fences the region of the previous frame, then moves to the next
+        region, waiting for the GPU to finish reading it if necessary.
+    */
+    void beginFrame();
+    /* Reserve space in this frame's region. The alignment must be a power of two. */
+    StreamAllocation allocate(std::size_t size, std::size_t alignment);
+    /* Make the data written this frame available to the GPU. Call after the last allocation, before drawing. */
+    void commit();
+
+    /* Get the OpenGL name of the buffer. */
+    unsigned int id() const { return this->BufferID; }
+    /* Get the offset alignment required for binding a range of the buffer as a uniform block. */
+    std::size_t uniformAlignment() const { return this->UniformAlignment; }
+    /* Check if the buffer is persistently mapped. */
+    bool isPersistent() const { return this->Persistent; }
+    /* Get the time in milliseconds the last beginFrame() spent waiting for the GPU. */
+    double stallTime() const { return this->StallTime; }
+
+private:
+    /* Map the current frame's region when the buffer is not persistently mapped. */
+    void mapRegion();
+
+private:
+    /* Hold the ID of the buffer object used by OpenGL */
+    unsigned int BufferID;
+    std::size_t FrameSize;
+    std::size_t UniformAlignment;
+    bool Persistent;
+    /* Start of the mapped memory: the whole buffer when persistent, otherwise the current region. */
+    unsigned char* Mapped;
+    /* GLsync objects guarding each region, or NULL once the GPU is known to be done with it. */
+    void* Fences[kFRAMES_IN_FLIGHT];
+    unsigned int Region;
+    /* Bytes allocated from the current region. */
+    std::size_t Used;
+    bool FrameStarted;
+    /* Set after an allocation doesn't fit, so the error is only reported once. */
+    bool ReportedOverflow;
+    double StallTime;
+};
+
+#endif  // STREAM_BUFFER_HPP
@@ -0,0 +1,172 @@
+#include "texture_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "mapped_file.hpp"
+
+namespace
+{
+    const char kTEXTURE_CACHE_MAGIC[4] = { 'E', 'T', 'E', 'X' };
+    // bump whenever the header, level table or mip filter change
+    const std::uint32_t kTEXTURE_CACHE_VERSION = 1;
+    // more than enough levels for a 2^31 texel wide image
+    const std::uint32_t kMAX_LEVELS = 32;
+    // level data starts on a 16 byte boundary, the largest compressed block size
+    const std::uint64_t kDATA_ALIGNMENT = 16;
+
+    /* Fixed size start of a cache file. The level table follows it, then the level data. */
+    struct TextureCacheHeader
+    {
+        char Magic[4];
+        std::uint32_t Version;
+        std::uint64_t SourceSize;
+        std::int64_t SourceModifiedTime;
+        std::uint32_t InternalFormat;
+        std::uint32_t Format;
+        std::uint32_t Type;
+        std::uint32_t Compressed;
+        std::uint32_t LevelCount;
+        std::uint32_t Padding;
+        std::uint64_t DataOffset;
+    };
+
+    std::uint64_t alignData(std::uint64_t offset)
+    {
+        return (offset + kDATA_ALIGNMENT - 1) & ~(kDATA_ALIGNMENT - 1);
+    }
+}
+
+void buildMipChain(const unsigned char* pixels, int width, int height, int channels,
+                   std::vector<unsigned char>& data, std::vector<TextureLevel>& levels)
+{
+    levels.clear();
+    std::size_t total = 0;
+    for (int w = width, h = height; ; w = w > 1 ? w / 2 : 1, h = h > 1 ? h / 2 : 1)
+    {
+        TextureLevel level;
+        level.Offset = total;
+        level.Size = static_cast<std::uint64_t>(w) * h * channels;
+        level.Width = w;
+        level.Height = h;
+        levels.push_back(level);
+        total += static_cast<std::size_t>(level.Size);
+        if (w == 1 && h == 1)
+            break;
+    }
+
+    data.resize(total);
+    std::memcpy(data.data(), pixels, static_cast<std::size_t>(levels[0].Size));
+    for (std::size_t i = 1; i < levels.size(); i++)
+    {
+        const TextureLevel& src_level = levels[i - 1];
+        const TextureLevel& dst_level = levels[i];
+        const unsigned char* src = data.data() + src_level.Offset;
+        unsigned char* dst = data.data() + dst_level.Offset;
+        std::size_t src_stride = static_cast<std::size_t>(src_level.Width) * channels;
+
+        for (std::uint32_t y = 0; y < dst_level.Height; y++)
+        {
+            // odd sizes clamp to the last row/column instead of reading past the edge
+            std::uint32_t y0 = y * 2;
+            std::uint32_t y1 = y0 + 1 < src_level.Height ? y0 + 1 : y0;
+            for (std::uint32_t x = 0; x < dst_level.Width; x++)
+            {
+                std::uint32_t x0 = x * 2;
+                std::uint32_t x1 = x0 + 1 < src_level.Width ? x0 + 1 : x0;
+                for (int c = 0; c < channels; c++)
+                {
+                    unsigned int sum = src[y0 * src_stride + x0 * channels + c] + src[y0 * src_stride + x1 * channels + c]
+                                     + src[y1 * src_stride + x0 * channels + c] + src[y1 * src_stride + x1 * channels + c];
+                    dst[(static_cast<std::size_t>(y) * dst_level.Width + x) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+bool writeTextureCache(const char* path, const TextureImage& image, const FileStamp& source)
+{
+    if (image.Levels.empty() || image.Levels.size() > kMAX_LEVELS)
+        return false;
+
+    TextureCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.Magic, kTEXTURE_CACHE_MAGIC, sizeof(header.Magic));
+    header.Version = kTEXTURE_CACHE_VERSION;
+    header.SourceSize = source.Size;
+    header.SourceModifiedTime = source.ModifiedTime;
+    header.InternalFormat = image.InternalFormat;
+    header.Format = image.Format;
+    header.Type = image.Type;
+    header.Compressed = image.Compressed ? 1 : 0;
+    header.LevelCount = static_cast<std::uint32_t>(image.Levels.size());
+    header.DataOffset = alignData(sizeof(header) + image.Levels.size() * sizeof(TextureLevel));
+
+    // level offsets in the file are relative to the data section, each level aligned
+    std::vector<TextureLevel> levels(image.Levels);
+    std::uint64_t data_size = 0;
+    for (std::size_t i = 0; i < levels.size(); i++)
+    {
+        levels[i].Offset = data_size;
+        data_size = alignData(data_size + levels[i].Size);
+    }
+
+    // Write to a temporary file first so a failed write never leaves a truncated cache behind. Two
+    // workers can bake the same texture at once, so each writes a file of its own.
+    std::string temp_path = makeTempPath(path);
+    std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file)
+        return false;
+    static const char padding[kDATA_ALIGNMENT] = {};
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+                && std::fwrite(levels.data(), sizeof(TextureLevel), levels.size(), file) == levels.size();
+    std::uint64_t position = sizeof(header) + levels.size() * sizeof(TextureLevel);
+    written = written && std::fwrite(padding, 1, static_cast<std::size_t>(header.DataOffset - position), file) == header.DataOffset - position;
+    for (std::size_t i = 0; written && i < levels.size(); i++)
+    {
+        std::size_t size = static_cast<std::size_t>(levels[i].Size);
+        std::size_t pad = static_cast<std::size_t>(alignData(size) - size);
+        written = std::fwrite(image.Data + image.Levels[i].Offset, 1, size, file) == size
+               && std::fwrite(padding, 1, pad, file) == pad;
+    }
+    written = (std::fclose(file) == 0) && written;
+    return replaceFile(temp_path, path, written);
+}
+
+bool readTextureCache(const MappedFile& file, const FileStamp& source, TextureImage& image)
+{
+    if (file.size() < sizeof(TextureCacheHeader))
+        return false;
+    TextureCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.Magic, kTEXTURE_CACHE_MAGIC, sizeof(header.Magic)) != 0
+        || header.Version != kTEXTURE_CACHE_VERSION
+        || header.LevelCount == 0 || header.LevelCount > kMAX_LEVELS)
+        return false;
+    if (header.SourceSize != source.Size || header.SourceModifiedTime != source.ModifiedTime)
+        return false;
+
+    std::uint64_t file_size = file.size();
+    if (sizeof(header) + header.LevelCount * sizeof(TextureLevel) > file_size || header.DataOffset > file_size)
+        return false;
+
+    image.Levels.resize(header.LevelCount);
+    std::memcpy(image.Levels.data(), file.data() + sizeof(header), header.LevelCount * sizeof(TextureLevel));
+    std::uint64_t data_size = file_size - header.DataOffset;
+    for (std::size_t i = 0; i < image.Levels.size(); i++)
+    {
+        const TextureLevel& level = image.Levels[i];
+        if (level.Offset > data_size || level.Size > data_size - level.Offset)
+            return false;
+    }
+
+    image.InternalFormat = header.InternalFormat;
+    image.Format = header.Format;
+    image.Type = header.Type;
+    image.Compressed = header.Compressed != 0;
+    image.Data = file.data() + header.DataOffset;
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MappedFile;
+struct FileStamp;
+
+/* One mip level of a texture image: where its data starts and how big it is. */
+struct TextureLevel
+{
+    std::uint64_t Offset;
+    std::uint64_t Size;
+    std::uint32_t Width;
+    std::uint32_t Height;
+};
+
+/*
+    A texture with every mip level in its final GL format, ready to hand to glTexImage2D or
+    glCompressedTexImage2D one level at a time.
+    The level data lives in one block that the image does not own, such as a mapped cache file.
+*/
+struct TextureImage
+{
+    std::uint32_t InternalFormat;
+    /* Pixel format and type of uncompressed levels. Unused for compressed images. */
+    std::uint32_t Format;
+    std::uint32_t Type;
+    bool Compressed;
+    std::vector<TextureLevel> Levels;
+    const unsigned char* Data;
+};
+
+/*
+    Build the full mip chain of an 8 bit image with a 2x2 box filter.
+    Level 0 is a copy of the source pixels and each level is tightly packed after the last.
+*/
+void buildMipChain(const unsigned char* pixels, int width, int height, int channels,
+                   std::vector<unsigned char>& data, std::vector<TextureLevel>& levels);
+
+/* Write a texture image to a cache file, tagged with the stamp of its source image. */
+bool writeTextureCache(const char* path, const TextureImage& image, const FileStamp& source);
+/*
+    Validate a mapped cache file and describe the texture inside it. The image data points into
+    the mapping. Returns false if the file is not a texture cache, was written by a different
+    version, or is out of date with the source image.
+*/
+bool readTextureCache(const MappedFile& file, const FileStamp& source, TextureImage& image);
+
+#endif  // TEXTURE_CACHE_HPP
@@ -0,0 +1,550 @@
+#include "texture_manager.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+#include <stbi/stb_image.h>
+
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+
+// not in every GL 3.3 loader, but core since 4.2
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+constexpr std::size_t TextureManager::kUPLOAD_BUDGET;
+
+namespace
+{
+    // mid grey, so untextured surfaces still pick up lighting while they wait
+    const unsigned char kPLACEHOLDER_PIXEL[4] = { 128, 128, 128, 255 };
+    const char* kTEXTURE_CACHE_EXTENSION = ".texcache";
+
+    GLenum formatForChannels(int channels)
+    {
+        if (channels == 1)  return GL_RED;
+        if (channels == 2)  return GL_RG;
+        if (channels == 3)  return GL_RGB;
+        return GL_RGBA;
+    }
+
+    bool isCompressedFormat(unsigned int internal_format)
+    {
+        return internal_format == GL_COMPRESSED_RED_RGTC1 || internal_format == GL_COMPRESSED_RG_RGTC2
+            || internal_format == GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+
+    bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    std::size_t imageBytes(const TextureImage& image)
+    {
+        const TextureLevel& last = image.Levels.back();
+        return static_cast<std::size_t>(last.Offset + last.Size);
+    }
+}
+
+TextureManager::TextureManager(ThreadPool& pool, bool compress)
+    :   Pool(pool),
+        CompressRG(false),
+        CompressRGBA(false),
+        PendingPool("textures"),
+        TasksInFlight(0)
+{
+    if (compress)
+    {
+        // RGTC is core since GL 3.0, BPTC needs GL 4.2 or the ARB extension
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        this->CompressRG = true;
+        this->CompressRGBA = major > 4 || (major == 4 && minor >= 2) || hasExtension("GL_ARB_texture_compression_bptc");
+    }
+}
+
+TextureManager::~TextureManager()
+{
+    {
+        std::unique_lock<std::mutex> lock(this->Mutex);
+        this->TasksFinished.wait(lock, [this] { return this->TasksInFlight == 0; });
+    }
+
+    for (std::size_t i = 0; i < this->Pending.size(); i++)
+    {
+        PendingTexture& texture = *this->Pending[i];
+        unmapPixelBuffer(texture);
+        if (texture.LayerTarget && texture.Texture)
+            glDeleteTextures(1, &texture.Texture);
+        if (texture.Fence)
+            glDeleteSync(static_cast<GLsync>(texture.Fence));
+        if (texture.PixelBuffer)
+            this->FreePixelBuffers.push_back(texture.PixelBuffer);
+        this->PendingPool.destroy(&texture);
+    }
+    for (std::size_t i = 0; i < this->BusyPixelBuffers.size(); i++)
+    {
+        glDeleteSync(static_cast<GLsync>(this->BusyPixelBuffers[i].Fence));
+        this->FreePixelBuffers.push_back(this->BusyPixelBuffers[i].PixelBuffer);
+    }
+    if (!this->FreePixelBuffers.empty())
+        glDeleteBuffers(static_cast<GLsizei>(this->FreePixelBuffers.size()), this->FreePixelBuffers.data());
+    if (!this->Textures.empty())
+        glDeleteTextures(static_cast<GLsizei>(this->Textures.size()), this->Textures.data());
+}
+
+unsigned int TextureManager::load(const char* path)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, kPLACEHOLDER_PIXEL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // no mipmaps yet, so the placeholder must not use a mipmap filter or it would be incomplete
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    this->Textures.push_back(texture);
+
+    PendingTexture* pending = this->PendingPool.create();
+    pending->Texture = texture;
+    pending->LayerTarget = NULL;
+    pending->Request = 0;
+    pending->ArrayTexture = 0;
+    pending->Layer = 0;
+    pending->Placed = false;
+    pending->Path = path;
+    pending->Stage = kLOADING;
+    pending->PixelBuffer = 0;
+    pending->Mapped = NULL;
+    pending->Fence = NULL;
+    submitTask(pending, &TextureManager::loadImage);
+    this->Pending.push_back(pending);
+
+    return texture;
+}
+
+void TextureManager::loadLayer(const char* path, TextureLayerTarget& target, std::uint32_t request)
+{
+    // nothing is created until the image's format and size are known and the target has found it a layer
+    PendingTexture* pending = this->PendingPool.create();
+    pending->Texture = 0;
+    pending->LayerTarget = &target;
+    pending->Request = request;
+    pending->ArrayTexture = 0;
+    pending->Layer = 0;
+    pending->Placed = false;
+    pending->Path = path;
+    pending->Stage = kLOADING;
+    pending->PixelBuffer = 0;
+    pending->Mapped = NULL;
+    pending->Fence = NULL;
+    submitTask(pending, &TextureManager::loadImage);
+    this->Pending.push_back(pending);
+}
+
+void TextureManager::update()
+{
+    recyclePixelBuffers();
+    if (this->Pending.empty())
+        return;
+
+    // snapshot the stages so workers are never held up by GL calls
+    FrameVector<LoadStage> stages(this->Pending.size());
+    {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        for (std::size_t i = 0; i < this->Pending.size(); i++)
+            stages[i] = this->Pending[i]->Stage;
+    }
+
+    // limit how much is uploaded per frame, but always let one texture through so large ones
+    // still make progress
+    std::size_t staged_bytes = 0;
+    for (std::size_t i = 0; i < this->Pending.size(); i++)
+    {
+        PendingTexture& texture = *this->Pending[i];
+        LoadStage next = stages[i];
+        if (stages[i] == kCACHED || stages[i] == kDECODED)
+        {
+            std::size_t size = imageBytes(texture.Image);
+            if (staged_bytes > 0 && staged_bytes + size > kUPLOAD_BUDGET)
+                continue;
+            staged_bytes += size;
+        }
+
+        switch (stages[i])
+        {
+        case kCACHED:
+            // baked levels go straight from the mapped file to GL
+            if (texture.LayerTarget)
+            {
+                next = uploadLayer(texture, texture.Image.Data) ? kFINISHED : kFAILED;
+            }
+            else
+            {
+                uploadLevels(texture, texture.Image.Data);
+                next = kFINISHED;
+            }
+            texture.Cache.close();
+            break;
+        case kDECODED:
+            next = stageTexture(texture) ? kCOPYING : kFAILED;
+            break;
+        case kCOPIED:
+            next = uploadStagedTexture(texture);
+            break;
+        case kREADBACK:
+            next = finishReadback(texture);
+            break;
+        case kWRITING:
+            // the worker hands the texture back as finished once the cache is written
+            break;
+        default:
+            break;
+        }
+
+        if (next != stages[i])
+        {
+            // no worker owns a texture in these stages, so the render thread can move it on
+            std::lock_guard<std::mutex> lock(this->Mutex);
+            texture.Stage = next;
+            stages[i] = next;
+        }
+        if (next == kCOPYING)
+            submitTask(&texture, &TextureManager::copyPixels);
+        else if (next == kWRITING)
+            submitTask(&texture, &TextureManager::writeCache);
+    }
+
+    // drop the textures that are finished with, keeping the rest in order
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < this->Pending.size(); i++)
+    {
+        if (stages[i] == kFINISHED || stages[i] == kFAILED)
+        {
+            if (this->Pending[i]->LayerTarget)
+            {
+                // the scratch texture was only needed to read the compressed levels back for baking
+                if (this->Pending[i]->Texture)
+                    glDeleteTextures(1, &this->Pending[i]->Texture);
+                this->Pending[i]->LayerTarget->layerLoaded(this->Pending[i]->Request, this->Pending[i]->Placed);
+            }
+            unmapPixelBuffer(*this->Pending[i]);
+            if (this->Pending[i]->PixelBuffer)
+                this->FreePixelBuffers.push_back(this->Pending[i]->PixelBuffer);
+            this->PendingPool.destroy(this->Pending[i]);
+            continue;
+        }
+        this->Pending[kept++] = this->Pending[i];
+    }
+    this->Pending.resize(kept);
+}
+
+// ---------------------------- Private Methods ----------------------------
+
+unsigned int TextureManager::acquirePixelBuffer()
+{
+    if (!this->FreePixelBuffers.empty())
+    {
+        unsigned int pixel_buffer = this->FreePixelBuffers.back();
+        this->FreePixelBuffers.pop_back();
+        return pixel_buffer;
+    }
+    unsigned int pixel_buffer;
+    glGenBuffers(1, &pixel_buffer);
+    return pixel_buffer;
+}
+
+void TextureManager::recyclePixelBuffers()
+{
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < this->BusyPixelBuffers.size(); i++)
+    {
+        BusyPixelBuffer& busy = this->BusyPixelBuffers[i];
+        // a zero timeout only polls the fence
+        GLenum status = glClientWaitSync(static_cast<GLsync>(busy.Fence), 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(static_cast<GLsync>(busy.Fence));
+            this->FreePixelBuffers.push_back(busy.PixelBuffer);
+        }
+        else
+        {
+            this->BusyPixelBuffers[kept++] = busy;
+        }
+    }
+    this->BusyPixelBuffers.resize(kept);
+}
+
+void TextureManager::submitTask(PendingTexture* texture, LoadStage (TextureManager::*task)(PendingTexture*))
+{
+    {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        this->TasksInFlight++;
+    }
+    this->Pool.submit([this, texture, task]
+    {
+        LoadStage next = (this->*task)(texture);
+        // the task leaves its results in the texture; publishing the stage hands it back to update()
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        texture->Stage = next;
+        this->TasksInFlight--;
+        this->TasksFinished.notify_all();
+    });
+}
+
+unsigned int TextureManager::chooseInternalFormat(int channels) const
+{
+    if (channels == 1 && this->CompressRG)      return GL_COMPRESSED_RED_RGTC1;
+    if (channels == 2 && this->CompressRG)      return GL_COMPRESSED_RG_RGTC2;
+    if (channels >= 3 && this->CompressRGBA)    return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    return formatForChannels(channels);
+}
+
+bool TextureManager::stageTexture(PendingTexture& texture)
+{
+    std::size_t size = texture.Pixels.size();
+    texture.PixelBuffer = acquirePixelBuffer();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture.PixelBuffer);
+    // re-specifying the storage orphans any previous contents, so mapping never waits on the GPU
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    texture.Mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!texture.Mapped)
+    {
+        std::cerr << "Failed to map pixel buffer for texture: " << texture.Path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void TextureManager::uploadLevels(PendingTexture& texture, const unsigned char* base)
+{
+    const TextureImage& image = texture.Image;
+    glBindTexture(GL_TEXTURE_2D, texture.Texture);
+    // rows of 1 and 3 channel images are tightly packed, not padded to 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (std::size_t i = 0; i < image.Levels.size(); i++)
+    {
+        const TextureLevel& level = image.Levels[i];
+        // with a pixel unpack buffer bound, base is NULL and the pointer is an offset into it
+        const void* data = base ? base + level.Offset : (const void*)static_cast<std::size_t>(level.Offset);
+        GLint level_index = static_cast<GLint>(i);
+        if (image.Compressed)
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level_index, image.InternalFormat, level.Width, level.Height, 0,
+                                   static_cast<GLsizei>(level.Size), data);
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, level_index, image.InternalFormat, level.Width, level.Height, 0,
+                         image.Format, image.Type, data);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.Levels.size() - 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool TextureManager::uploadLayer(PendingTexture& texture, const unsigned char* base)
+{
+    // placing the image can create the array, which must happen with no pixel unpack buffer bound
+    const TextureImage& image = texture.Image;
+    if (!texture.LayerTarget->placeLayer(texture.Request, image, texture.ArrayTexture, texture.Layer))
+        return false;
+    texture.Placed = true;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture.ArrayTexture);
+    if (!base)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture.PixelBuffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLint layer = static_cast<GLint>(texture.Layer);
+    for (std::size_t i = 0; i < image.Levels.size(); i++)
+    {
+        const TextureLevel& level = image.Levels[i];
+        const void* data = base ? base + level.Offset : (const void*)static_cast<std::size_t>(level.Offset);
+        GLint level_index = static_cast<GLint>(i);
+        if (image.Compressed)
+        {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level_index, 0, 0, layer, level.Width, level.Height, 1,
+                                      image.InternalFormat, static_cast<GLsizei>(level.Size), data);
+        }
+        else
+        {
+            // a compressed array is compressed by the driver as it uploads, the same as a texture of its own
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level_index, 0, 0, layer, level.Width, level.Height, 1,
+                            image.Format, image.Type, data);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (!base)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return true;
+}
+
+TextureManager::LoadStage TextureManager::uploadStagedTexture(PendingTexture& texture)
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture.PixelBuffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    texture.Mapped = NULL;
+    if (texture.LayerTarget)
+    {
+        // a layer that can't be placed is still baked, so a later load can use the cache
+        uploadLayer(texture, NULL);
+        // compressed levels can only be read back from a texture of their own, so baking needs a scratch one
+        if (isCompressedFormat(texture.Image.InternalFormat))
+            glGenTextures(1, &texture.Texture);
+    }
+    if (texture.Texture)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture.PixelBuffer);
+        uploadLevels(texture, NULL);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // the buffer can be reused once the GPU has read it
+    BusyPixelBuffer busy;
+    busy.PixelBuffer = texture.PixelBuffer;
+    busy.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    this->BusyPixelBuffers.push_back(busy);
+    texture.PixelBuffer = 0;
+
+    std::vector<unsigned char>().swap(texture.Pixels);
+    // uncompressed images were baked by the worker straight after decoding
+    if (!isCompressedFormat(texture.Image.InternalFormat))
+        return kFINISHED;
+    return startReadback(texture);
+}
+
+TextureManager::LoadStage TextureManager::startReadback(PendingTexture& texture)
+{
+    // the driver compressed the levels on upload; find out how big each one came out
+    TextureImage& image = texture.Image;
+    glBindTexture(GL_TEXTURE_2D, texture.Texture);
+    GLint compressed = GL_FALSE;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    if (!compressed)
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        std::cerr << "Driver did not compress texture, not baking: " << texture.Path << std::endl;
+        return kFINISHED;
+    }
+    std::uint64_t offset = 0;
+    for (std::size_t i = 0; i < image.Levels.size(); i++)
+    {
+        GLint size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, static_cast<GLint>(i), GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        image.Levels[i].Offset = offset;
+        image.Levels[i].Size = static_cast<std::uint64_t>(size);
+        offset += static_cast<std::uint64_t>(size);
+    }
+    image.Compressed = true;
+
+    // read back into a pixel buffer so the copy happens asynchronously, then wait on a fence
+    texture.PixelBuffer = acquirePixelBuffer();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, texture.PixelBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(offset), NULL, GL_STREAM_READ);
+    for (std::size_t i = 0; i < image.Levels.size(); i++)
+        glGetCompressedTexImage(GL_TEXTURE_2D, static_cast<GLint>(i), (void*)static_cast<std::size_t>(image.Levels[i].Offset));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    texture.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return kREADBACK;
+}
+
+TextureManager::LoadStage TextureManager::finishReadback(PendingTexture& texture)
+{
+    GLenum status = glClientWaitSync(static_cast<GLsync>(texture.Fence), 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return kREADBACK;
+    glDeleteSync(static_cast<GLsync>(texture.Fence));
+    texture.Fence = NULL;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, texture.PixelBuffer);
+    texture.Mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(imageBytes(texture.Image)), GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!texture.Mapped)
+        return kFINISHED;
+    texture.Image.Data = static_cast<const unsigned char*>(texture.Mapped);
+    return kWRITING;
+}
+
+void TextureManager::unmapPixelBuffer(PendingTexture& texture)
+{
+    if (!texture.Mapped)
+        return;
+    // the copy read binding works for any buffer regardless of how it was last used
+    glBindBuffer(GL_COPY_READ_BUFFER, texture.PixelBuffer);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    texture.Mapped = NULL;
+}
+
+TextureManager::LoadStage TextureManager::loadImage(PendingTexture* texture)
+{
+    PROFILE_SCOPE("load texture");
+    if (!readFileStamp(texture->Path.c_str(), texture->Source))
+    {
+        std::cerr << "Failed to load texture: " << texture->Path << std::endl;
+        return kFAILED;
+    }
+    std::string cache_path = texture->Path + kTEXTURE_CACHE_EXTENSION;
+    if (texture->Cache.open(cache_path.c_str()))
+    {
+        if (readTextureCache(texture->Cache, texture->Source, texture->Image))
+            return kCACHED;
+        texture->Cache.close();
+    }
+
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(texture->Path.c_str(), &width, &height, &channels, 0);
+    if (!pixels)
+    {
+        std::cerr << "Failed to load texture: " << texture->Path << std::endl;
+        return kFAILED;
+    }
+    buildMipChain(pixels, width, height, channels, texture->Pixels, texture->Image.Levels);
+    stbi_image_free(pixels);
+
+    TextureImage& image = texture->Image;
+    image.InternalFormat = chooseInternalFormat(channels);
+    image.Format = formatForChannels(channels);
+    image.Type = GL_UNSIGNED_BYTE;
+    image.Compressed = false;
+    image.Data = texture->Pixels.data();
+    // uncompressed levels are already in their final form, so they can be baked right away
+    if (!isCompressedFormat(image.InternalFormat) && !writeTextureCache(cache_path.c_str(), image, texture->Source))
+        std::cerr << "Failed to write texture cache: " << cache_path << std::endl;
+    return kDECODED;
+}
+
+TextureManager::LoadStage TextureManager::copyPixels(PendingTexture* texture)
+{
+    PROFILE_SCOPE("stage texture");
+    std::memcpy(texture->Mapped, texture->Pixels.data(), texture->Pixels.size());
+    return kCOPIED;
+}
+
+TextureManager::LoadStage TextureManager::writeCache(PendingTexture* texture)
+{
+    PROFILE_SCOPE("bake texture");
+    std::string cache_path = texture->Path + kTEXTURE_CACHE_EXTENSION;
+    if (!writeTextureCache(cache_path.c_str(), texture->Image, texture->Source))
+        std::cerr << "Failed to write texture cache: " << cache_path << std::endl;
+    return kFINISHED;
+}
@@ -0,0 +1,178 @@
+#ifndef TEXTURE_MANAGER_HPP
+#define TEXTURE_MANAGER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "memory.hpp"
+#include "texture_cache.hpp"
+
+class ThreadPool;
+
+/*
+    Receives the images loaded into layers of texture arrays with TextureManager::loadLayer().
+    Both methods are called on the render thread, from TextureManager::update().
+*/
+class TextureLayerTarget
+{
+public:
+    virtual ~TextureLayerTarget() {}
+
+    /*
+        Pick the texture array and layer an image is uploaded to, once its format and size are known.
+        The array must already have storage of the image's internal format, size and number of levels.
+        Return false to drop the image.
+    */
+    virtual bool placeLayer(std::uint32_t request, const TextureImage& image, unsigned int& texture, unsigned int& layer) = 0;
+    /* Called once a load has finished, with loaded false if the image never reached its layer. */
+    virtual void layerLoaded(std::uint32_t request, bool loaded) = 0;
+};
+
+/*
+    Loads textures without blocking the render thread.
+    Each image is baked once into "<path>.texcache", which holds every mip level in its final GL
+    format, block compressed where the driver supports it. Later loads map the cache and hand each
+    level straight to GL. Images without a cache are decoded on the worker threads of a ThreadPool,
+    streamed into GL through pixel buffer objects, and then baked.
+    A texture can be used as soon as load() returns: it holds a small placeholder image until
+    update() swaps in the real data.
+*/
+class TextureManager
+{
+public:
+    /* Maximum number of bytes of pixel data staged for upload by one call to update(). */
+    static constexpr std::size_t kUPLOAD_BUDGET = 16 * 1024 * 1024;
+
+    /*
+        Construct a TextureManager object that decodes on the given pool.
+        If compress is true, textures are stored with GPU block compression (RGTC for one and two
+        channel images, BPTC for colour images) where the driver supports it.
+    */
+    explicit TextureManager(ThreadPool& pool, bool compress = true);
+    /* Wait for any decodes still running, then release the textures and pixel buffers. */
+    ~TextureManager();
+    TextureManager(const TextureManager&) = delete;
+    TextureManager& operator=(const TextureManager&) = delete;
+
+    /*
+        Start loading a 2D texture from a file and return its OpenGL texture name.
+        The texture holds a placeholder until the image has been loaded and uploaded. If the
+        image can't be loaded it keeps the placeholder.
+    */
+    unsigned int load(const char* path);
+    /*
+        Start loading an image into a layer of a texture array that target picks when it is ready to
+        upload. request is handed back to target to tell its loads apart.
+    */
+    void loadLayer(const char* path, TextureLayerTarget& target, std::uint32_t request);
+    /*
+        Move finished loads along the upload pipeline. Call once per frame on the render thread.
+        Never waits on disk, decoding or the GPU.
+    */
+    void update();
+    /* Get the number of textures that are still loading or baking. */
+    std::size_t pendingCount() const { return this->Pending.size(); }
+
+private:
+    /* Stage of a texture in the loading pipeline. */
+    enum LoadStage
+    {
+        kLOADING,   // cache being mapped, or source image being decoded, on a worker
+        kCACHED,    // cache is mapped and ready to upload
+        kDECODED,   // decoded mip chain is in memory, waiting for a pixel buffer
+        kCOPYING,   // being copied into a mapped pixel buffer on a worker
+        kCOPIED,    // pixel buffer is filled and ready to unmap and upload
+        kREADBACK,  // compressed levels are being read back from the GPU for baking
+        kWRITING,   // cache file being written on a worker
+        kFINISHED,
+        kFAILED
+    };
+
+    struct PendingTexture
+    {
+        /* The texture being loaded, or for layered loads a scratch texture the driver compresses into for baking. */
+        unsigned int Texture;
+        /* Where a layered load goes, or NULL for a texture of its own. */
+        TextureLayerTarget* LayerTarget;
+        std::uint32_t Request;
+        unsigned int ArrayTexture;
+        unsigned int Layer;
+        bool Placed;
+        std::string Path;
+        FileStamp Source;
+        LoadStage Stage;
+        /* The image being loaded. Its data points into Pixels, Cache or a mapped pixel buffer. */
+        TextureImage Image;
+        /* Mip chain of a decoded source image. */
+        std::vector<unsigned char> Pixels;
+        MappedFile Cache;
+        unsigned int PixelBuffer;
+        void* Mapped;
+        void* Fence;
+    };
+
+    /* A pixel buffer whose upload may still be reading from it. */
+    struct BusyPixelBuffer
+    {
+        unsigned int PixelBuffer;
+        void* Fence;
+    };
+
+    /* Get a pixel buffer that the GPU has finished with, creating one if none are free. */
+    unsigned int acquirePixelBuffer();
+    /* Return pixel buffers whose uploads have completed to the free list. */
+    void recyclePixelBuffers();
+    /* Run a task on the pool, tracking it so the destructor can wait for it. The task returns the next stage. */
+    void submitTask(PendingTexture* texture, LoadStage (TextureManager::*task)(PendingTexture*));
+    /* Pick the GL internal format a decoded image is stored in. */
+    unsigned int chooseInternalFormat(int channels) const;
+    /* Map a pixel buffer for a decoded image and start copying into it. */
+    bool stageTexture(PendingTexture& texture);
+    /* Upload every level of a texture from memory or from the bound pixel unpack buffer. */
+    void uploadLevels(PendingTexture& texture, const unsigned char* base);
+    /*
+        Ask the target of a layered load for its layer and upload every level into it, from memory or,
+        if base is NULL, from the texture's pixel buffer. Returns false if the target gave it no layer.
+    */
+    bool uploadLayer(PendingTexture& texture, const unsigned char* base);
+    /* Unmap a filled pixel buffer and copy it into its texture. Returns the next stage. */
+    LoadStage uploadStagedTexture(PendingTexture& texture);
+    /* Start reading the compressed levels of a texture back into a pixel buffer. Returns the next stage. */
+    LoadStage startReadback(PendingTexture& texture);
+    /* Map a finished readback and start writing the cache. Returns the next stage. */
+    LoadStage finishReadback(PendingTexture& texture);
+    /* Release a pixel buffer that is mapped. */
+    void unmapPixelBuffer(PendingTexture& texture);
+
+    /* Worker task: map the cache, or decode the source image and build its mip chain. */
+    LoadStage loadImage(PendingTexture* texture);
+    /* Worker task: copy the mip chain into the mapped pixel buffer. */
+    LoadStage copyPixels(PendingTexture* texture);
+    /* Worker task: write the read back compressed levels to the cache. */
+    LoadStage writeCache(PendingTexture* texture);
+
+private:
+    ThreadPool& Pool;
+    /* Compressed formats the driver can produce, by number of channels. */
+    bool CompressRG;
+    bool CompressRGBA;
+    // textures in flight come and go as they stream in, so they are kept in a pool
+    ObjectPool<PendingTexture> PendingPool;
+    std::vector<PendingTexture*> Pending;
+    std::vector<unsigned int> FreePixelBuffers;
+    std::vector<BusyPixelBuffer> BusyPixelBuffers;
+    std::vector<unsigned int> Textures;
+
+    /* Guards Stage of every pending texture and TasksInFlight, which workers update. */
+    std::mutex Mutex;
+    std::condition_variable TasksFinished;
+    unsigned int TasksInFlight;
+};
+
+#endif  // TEXTURE_MANAGER_HPP
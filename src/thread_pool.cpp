@@ -0,0 +1,422 @@
+#include "thread_pool.hpp"
+
+#include <cstdint>
+
+constexpr unsigned int ThreadPool::kHARDWARE_THREADS;
+constexpr std::size_t ThreadPool::kQUEUE_CAPACITY;
+constexpr std::size_t ThreadPool::kJOBS_PER_THREAD;
+constexpr unsigned int ThreadPool::kMAX_CONTINUATIONS;
+
+struct ThreadPool::Job
+{
+    Job() : Owner(NULL), Parent(NULL), ContinuationCount(0), Unfinished(0) {}
+
+    std::function<void()> Fn;
+    /* The thread whose storage the job lives in. */
+    ThreadState* Owner;
+    Job* Parent;
+    Job* Continuations[kMAX_CONTINUATIONS];
+    unsigned int ContinuationCount;
+    // 1 for the job itself plus 1 per unfinished child; 0 once finished, when the job can be reused
+    std::atomic<int> Unfinished;
+};
+
+/*
+    A thread's job storage and its Chase-Lev deque. The owning thread pushes and pops at the bottom
+    without locking, while other threads steal from the top with a compare-and-swap.
+*/
+struct ThreadPool::ThreadState
+{
+    explicit ThreadState(unsigned int index)
+        :   Index(index),
+            Jobs(kJOBS_PER_THREAD),
+            NextJob(0),
+            Slots(kQUEUE_CAPACITY),
+            Top(0),
+            Bottom(0)
+    {
+        for (std::size_t i = 0; i < this->Jobs.size(); i++)
+            this->Jobs[i].Owner = this;
+    }
+
+    /* Add a job to the bottom of the deque. Only called by the owning thread. Returns false if it is full. */
+    bool push(Job* job)
+    {
+        std::int64_t bottom = this->Bottom.load(std::memory_order_relaxed);
+        std::int64_t top = this->Top.load(std::memory_order_acquire);
+        if (bottom - top >= static_cast<std::int64_t>(kQUEUE_CAPACITY))
+            return false;
+        this->Slots[bottom & (kQUEUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        this->Bottom.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Take the newest job from the bottom of the deque. Only called by the owning thread. */
+    Job* pop()
+    {
+        // claim the bottom slot first, so a thief that sees the new bottom won't take it too
+        std::int64_t bottom = this->Bottom.load(std::memory_order_relaxed) - 1;
+        this->Bottom.store(bottom, std::memory_order_seq_cst);
+        std::int64_t top = this->Top.load(std::memory_order_seq_cst);
+        if (top > bottom)
+        {
+            this->Bottom.store(bottom + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+        Job* job = this->Slots[bottom & (kQUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // the last job may be stolen at the same time, the compare-and-swap decides who gets it
+            if (!this->Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = NULL;
+            this->Bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    /* Take the oldest job from the top of the deque. Called by any other thread, and may fail under contention. */
+    Job* steal()
+    {
+        std::int64_t top = this->Top.load(std::memory_order_seq_cst);
+        std::int64_t bottom = this->Bottom.load(std::memory_order_seq_cst);
+        if (top >= bottom)
+            return NULL;
+        Job* job = this->Slots[top & (kQUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!this->Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return NULL;
+        return job;
+    }
+
+    unsigned int Index;
+    /* Jobs created by this thread, reused round robin once they have finished. */
+    std::vector<Job> Jobs;
+    std::size_t NextJob;
+    std::vector<std::atomic<Job*>> Slots;
+    std::atomic<std::int64_t> Top;
+    std::atomic<std::int64_t> Bottom;
+};
+
+namespace
+{
+    // which pool the current thread belongs to, and its index in that pool
+    thread_local ThreadPool* current_pool = NULL;
+    thread_local unsigned int current_thread_index = 0;
+    // slots createJob() checks before helping with other jobs, when a thread has many jobs in flight
+    const std::size_t kJOB_SCAN_LENGTH = 64;
+
+    /* Shared between the caller of parallelFor and the helper jobs it queues. */
+    struct ParallelForState
+    {
+        const std::function<void(std::size_t, std::size_t)>* Fn;
+        std::size_t Count;
+        std::size_t Grain;
+        std::size_t Chunks;
+        std::atomic<std::size_t> NextChunk;
+
+        /* Claim and run chunks until none are left. */
+        void work()
+        {
+            for (std::size_t chunk = this->NextChunk++; chunk < this->Chunks; chunk = this->NextChunk++)
+            {
+                std::size_t begin = chunk * this->Grain;
+                std::size_t end = begin + this->Grain < this->Count ? begin + this->Grain : this->Count;
+                (*this->Fn)(begin, end);
+            }
+        }
+    };
+}
+
+ThreadPool::ThreadPool(unsigned int thread_count)
+    :   External(new ThreadState(0)),
+        ExternalJobs(0),
+        PendingWork(0),
+        SleepingWorkers(0),
+        Stopping(false)
+{
+    if (thread_count == kHARDWARE_THREADS)
+    {
+        unsigned int hardware_threads = std::thread::hardware_concurrency();
+        thread_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+    }
+    // the creating thread has a deque too, and works on jobs whenever it waits for them
+    for (unsigned int i = 0; i <= thread_count; i++)
+        this->Threads.push_back(std::unique_ptr<ThreadState>(new ThreadState(i)));
+    current_pool = this;
+    current_thread_index = 0;
+
+    for (unsigned int i = 0; i < thread_count; i++)
+        this->Workers.push_back(std::thread(&ThreadPool::workerLoop, this, i + 1));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        this->Stopping = true;
+    }
+    this->WorkAvailable.notify_all();
+    for (std::size_t i = 0; i < this->Workers.size(); i++)
+        this->Workers[i].join();
+
+    // without workers, jobs nobody waited for are still in the creating thread's deque
+    ThreadState* thread = currentThread();
+    while (Job* job = findJob(thread))
+        execute(job);
+    if (current_pool == this)
+        current_pool = NULL;
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    if (this->Workers.empty())
+    {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        this->Tasks.push_back(std::move(task));
+        this->PendingWork++;
+    }
+    this->WorkAvailable.notify_one();
+}
+
+ThreadPool::Job* ThreadPool::createJob(std::function<void()> fn, Job* parent)
+{
+    ThreadState* thread = currentThread();
+    std::unique_lock<std::mutex> lock(this->Mutex, std::defer_lock);
+    if (!thread)
+    {
+        // threads outside the pool share one set of jobs
+        lock.lock();
+    }
+    ThreadState* owner = thread ? thread : this->External.get();
+
+    Job* job = NULL;
+    while (!job)
+    {
+        for (std::size_t i = 0; i < kJOB_SCAN_LENGTH && !job; i++)
+        {
+            Job& candidate = owner->Jobs[owner->NextJob];
+            owner->NextJob = (owner->NextJob + 1) % kJOBS_PER_THREAD;
+            if (candidate.Unfinished.load(std::memory_order_acquire) == 0)
+                job = &candidate;
+        }
+        if (job)
+            break;
+        // the jobs nearby are still in flight, so help finish some before looking further
+        if (thread)
+        {
+            Job* other = findJob(thread);
+            if (other)
+            {
+                execute(other);
+                // the job just run is usually one of ours, and saves scanning the whole ring again
+                if (other->Owner == owner && isFinished(other))
+                    job = other;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        else
+        {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+    }
+
+    job->Fn = std::move(fn);
+    job->Parent = parent;
+    job->ContinuationCount = 0;
+    job->Unfinished.store(1, std::memory_order_relaxed);
+    if (parent)
+        parent->Unfinished++;
+    return job;
+}
+
+bool ThreadPool::addContinuation(Job* job, Job* continuation)
+{
+    if (job->ContinuationCount >= kMAX_CONTINUATIONS)
+        return false;
+    job->Continuations[job->ContinuationCount++] = continuation;
+    return true;
+}
+
+void ThreadPool::run(Job* job)
+{
+    ThreadState* thread = currentThread();
+    this->PendingWork++;
+    if (!thread)
+    {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        this->ExternalQueue.push_back(job);
+        this->ExternalJobs++;
+    }
+    else if (!thread->push(job))
+    {
+        // the deque is full, so there is plenty for the other threads to do already
+        this->PendingWork--;
+        execute(job);
+        return;
+    }
+    wakeWorker();
+}
+
+void ThreadPool::wait(const Job* job)
+{
+    ThreadState* thread = currentThread();
+    while (!isFinished(job))
+    {
+        Job* other = findJob(thread);
+        if (other)
+            execute(other);
+        else
+            std::this_thread::yield();
+    }
+}
+
+bool ThreadPool::isFinished(const Job* job) const
+{
+    return job->Unfinished.load(std::memory_order_acquire) == 0;
+}
+
+void ThreadPool::parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& fn)
+{
+    if (count == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+    std::size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || this->Workers.empty())
+    {
+        fn(0, count);
+        return;
+    }
+
+    // the state can live on the stack, every helper job has finished by the time the root has
+    ParallelForState state;
+    state.Fn = &fn;
+    state.Count = count;
+    state.Grain = grain;
+    state.Chunks = chunks;
+    state.NextChunk = 0;
+
+    Job* root = createJob(std::function<void()>());
+    std::size_t helpers = chunks - 1 < this->Workers.size() ? chunks - 1 : this->Workers.size();
+    for (std::size_t i = 0; i < helpers; i++)
+        run(createJob([&state]() { state.work(); }, root));
+
+    state.work();
+    finishJob(root);
+    wait(root);
+}
+
+// --------------------------------- Private Methods ------------------------------
+
+void ThreadPool::workerLoop(unsigned int index)
+{
+    current_pool = this;
+    current_thread_index = index;
+    ThreadState* thread = this->Threads[index].get();
+    for (;;)
+    {
+        Job* job = findJob(thread);
+        if (job)
+        {
+            execute(job);
+            continue;
+        }
+
+        // no jobs anywhere, so run a background task or sleep until there is work
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(this->Mutex);
+            if (this->Tasks.empty())
+            {
+                this->SleepingWorkers++;
+                this->WorkAvailable.wait(lock, [this]() { return this->Stopping || this->PendingWork > 0; });
+                this->SleepingWorkers--;
+                if (this->Stopping && this->PendingWork == 0)
+                    return;
+                continue;
+            }
+            task = std::move(this->Tasks.front());
+            this->Tasks.pop_front();
+            this->PendingWork--;
+        }
+        task();
+    }
+}
+
+ThreadPool::ThreadState* ThreadPool::currentThread() const
+{
+    return current_pool == this ? this->Threads[current_thread_index].get() : NULL;
+}
+
+ThreadPool::Job* ThreadPool::findJob(ThreadState* thread)
+{
+    Job* job = thread ? thread->pop() : NULL;
+    if (!job)
+    {
+        // steal, starting from the next thread along so thieves spread out over their victims
+        std::size_t count = this->Threads.size();
+        std::size_t start = thread ? thread->Index + 1 : 0;
+        for (std::size_t i = 0; i < count && !job; i++)
+        {
+            ThreadState* victim = this->Threads[(start + i) % count].get();
+            if (victim != thread)
+                job = victim->steal();
+        }
+    }
+    if (!job && this->ExternalJobs > 0)
+    {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        if (!this->ExternalQueue.empty())
+        {
+            job = this->ExternalQueue.front();
+            this->ExternalQueue.pop_front();
+            this->ExternalJobs--;
+        }
+    }
+    if (job)
+        this->PendingWork--;
+    return job;
+}
+
+void ThreadPool::execute(Job* job)
+{
+    if (job->Fn)
+        job->Fn();
+    // release anything the function captured now, rather than whenever the job is reused
+    job->Fn = nullptr;
+    finishJob(job);
+}
+
+void ThreadPool::finishJob(Job* job)
+{
+    // copy everything needed first: once the count reaches zero the job may be reused at any moment
+    Job* parent = job->Parent;
+    Job* continuations[kMAX_CONTINUATIONS];
+    unsigned int continuation_count = job->ContinuationCount;
+    for (unsigned int i = 0; i < continuation_count; i++)
+        continuations[i] = job->Continuations[i];
+
+    if (--job->Unfinished != 0)
+        return;
+    for (unsigned int i = 0; i < continuation_count; i++)
+        run(continuations[i]);
+    if (parent)
+        finishJob(parent);
+}
+
+void ThreadPool::wakeWorker()
+{
+    if (this->SleepingWorkers > 0)
+    {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        this->WorkAvailable.notify_one();
+    }
+}
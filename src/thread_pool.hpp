@@ -0,0 +1,115 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    A work-stealing job scheduler.
+    Every thread of the pool, and the thread that created it, has its own deque of jobs. A thread runs
+    the newest job of its own deque first, and when that is empty steals the oldest job of another
+    thread's deque. Jobs can have a parent, which doesn't finish until all of its children have, and
+    continuations, which are queued once the job finishes. Waiting on a job runs other jobs meanwhile,
+    so waits never leave a core idle.
+
+    Background tasks queued with submit() are kept separately, so a thread waiting on frame work never
+    picks up a long-running task such as a file load.
+*/
+class ThreadPool
+{
+public:
+    /* A unit of work. Only ever handled through pointers returned by createJob(). */
+    struct Job;
+
+    /* Thread count that starts one worker per hardware thread, minus the calling thread. */
+    static constexpr unsigned int kHARDWARE_THREADS = 0xFFFFFFFF;
+    /* Jobs each thread can have queued before run() executes jobs immediately instead. */
+    static constexpr std::size_t kQUEUE_CAPACITY = 4096;
+    /*
+        Jobs each thread can have in flight at once. Finished jobs are reused round robin, so a handle
+        must not be kept once its job has finished and the creating thread has moved on to new jobs.
+    */
+    static constexpr std::size_t kJOBS_PER_THREAD = 4096;
+    /* Maximum number of continuations of one job. */
+    static constexpr unsigned int kMAX_CONTINUATIONS = 4;
+
+    /*
+        Construct a ThreadPool object.
+        Starts the given number of worker threads, or one per hardware thread minus the calling
+        thread by default. With no worker threads, every job runs on the threads that wait for it.
+    */
+    explicit ThreadPool(unsigned int thread_count = kHARDWARE_THREADS);
+    /* Finish any queued jobs and tasks and join the worker threads. */
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /* Queue a background task to run on one of the worker threads. Tasks may block. */
+    void submit(std::function<void()> task);
+
+    /*
+        Create a job that calls fn. If a parent is given, the parent doesn't finish until this job has.
+        The job doesn't start until it is passed to run(), or until a job it continues finishes.
+    */
+    Job* createJob(std::function<void()> fn, Job* parent = NULL);
+    /*
+        Queue continuation once job and all of its children have finished. Must be called before job
+        or any of its children are run. Returns false if job already has kMAX_CONTINUATIONS.
+    */
+    bool addContinuation(Job* job, Job* continuation);
+    /* Queue a job on the calling thread's deque, where idle threads can steal it. */
+    void run(Job* job);
+    /* Wait for a job and all of its children to finish, running other jobs in the meantime. */
+    void wait(const Job* job);
+    /* Check, without waiting, if a job and all of its children have finished. */
+    bool isFinished(const Job* job) const;
+
+    /*
+        Run fn(begin, end) over the range [0, count) split into chunks of at most grain items.
+        The calling thread works on chunks too, and the call returns once every chunk is done.
+    */
+    void parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& fn);
+    /* Get the number of worker threads, not counting the calling thread. */
+    unsigned int size() const { return static_cast<unsigned int>(this->Workers.size()); }
+
+private:
+    struct ThreadState;
+
+    /* Main loop of each worker thread. */
+    void workerLoop(unsigned int index);
+    /* Get the state of the calling thread, or NULL if it doesn't belong to the pool. */
+    ThreadState* currentThread() const;
+    /* Take a job from the calling thread's deque, another thread's deque, or the shared queue. */
+    Job* findJob(ThreadState* thread);
+    /* Run a job and mark it finished. */
+    void execute(Job* job);
+    /* Count one piece of a job as finished, and finish its parent and queue its continuations once it is done. */
+    void finishJob(Job* job);
+    /* Wake a sleeping worker, if there is one, after work was queued. */
+    void wakeWorker();
+
+private:
+    std::vector<std::thread> Workers;
+    /* Deques and job storage. Index 0 belongs to the thread that created the pool, then one per worker. */
+    std::vector<std::unique_ptr<ThreadState>> Threads;
+    /* Jobs created by and queued from threads outside the pool, guarded by Mutex. */
+    std::unique_ptr<ThreadState> External;
+    std::deque<Job*> ExternalQueue;
+    std::atomic<int> ExternalJobs;
+    std::deque<std::function<void()>> Tasks;
+    std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    /* Number of queued jobs and tasks, and of workers sleeping until there are some. */
+    std::atomic<int> PendingWork;
+    std::atomic<int> SleepingWorkers;
+    bool Stopping;
+};
+
+#endif  // THREAD_POOL_HPP
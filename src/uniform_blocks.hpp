@@ -0,0 +1,65 @@
+#ifndef UNIFORM_BLOCKS_HPP
+#define UNIFORM_BLOCKS_HPP
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+    C++ mirrors of the std140 uniform blocks declared in shaders/uniform_blocks.glsl.
+    Every vec3 is followed by a float so the members line up with the std140 16-byte vec3 alignment.
+    Keep these in sync with the GLSL declarations; the block sizes are checked when a program links.
+*/
+
+/* Fixed binding points shared by every shader program. */
+enum UniformBlockBinding
+{
+    kCAMERA_BLOCK_BINDING = 0,
+    kLIGHT_BLOCK_BINDING  = 1
+};
+
+struct CameraBlock
+{
+    glm::mat4 View;
+    glm::mat4 Proj;
+    glm::vec3 ViewPos;
+    float Padding;
+};
+
+struct DirLightData
+{
+    glm::vec3 Direction;
+    float Padding0;
+    glm::vec3 Ambient;
+    float Padding1;
+    glm::vec3 Diffuse;
+    float Padding2;
+    glm::vec3 Specular;
+    float Padding3;
+};
+
+/*
+    Point and spot lights are not part of the block. They live in buffer textures managed by
+    ClusteredLighting, which also fills in the cluster grid parameters here.
+*/
+struct LightBlock
+{
+    DirLightData DirLight;
+    glm::uvec4 ClusterSize;     // tiles in x, tiles in y, depth slices, tile size in pixels
+    glm::vec4 ClusterDepth;     // depth slice scale, depth slice bias, near plane, far plane
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock does not match the std140 layout");
+static_assert(sizeof(LightBlock) == 96, "LightBlock does not match the std140 layout");
+
+/* A named uniform block and the binding point it is always attached to. */
+struct UniformBlockInfo
+{
+    const char* Name;
+    unsigned int Binding;
+    std::size_t Size;
+};
+
+/* Find the fixed binding for a uniform block by its GLSL block name, or NULL if the block is unknown. */
+const UniformBlockInfo* findUniformBlock(const char* name);
+
+#endif  // UNIFORM_BLOCKS_HPP
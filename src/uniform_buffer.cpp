@@ -0,0 +1,66 @@
+#include "uniform_buffer.hpp"
+#include "uniform_blocks.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+
+static const UniformBlockInfo kUNIFORM_BLOCKS[] = {
+    { "Camera", kCAMERA_BLOCK_BINDING, sizeof(CameraBlock) },
+    { "Lights", kLIGHT_BLOCK_BINDING,  sizeof(LightBlock) },
+};
+
+const UniformBlockInfo* findUniformBlock(const char* name)
+{
+    for (std::size_t i = 0; i < sizeof(kUNIFORM_BLOCKS) / sizeof(kUNIFORM_BLOCKS[0]); i++)
+    {
+        if (std::strcmp(kUNIFORM_BLOCKS[i].Name, name) == 0)
+            return &kUNIFORM_BLOCKS[i];
+    }
+    return NULL;
+}
+
+UniformBuffer::UniformBuffer(std::size_t size, unsigned int binding)
+    :   Shadow(size),
+        Uninitialised(true)
+{
+    glGenBuffers(1, &this->BufferID);
+    glBindBuffer(GL_UNIFORM_BUFFER, this->BufferID);
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, this->BufferID);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    glDeleteBuffers(1, &this->BufferID);
+}
+
+bool UniformBuffer::update(const void* data, std::size_t size)
+{
+    if (size > this->Shadow.size())
+    {
+        std::cerr << "Uniform buffer update of " << size << " bytes exceeds the buffer size." << std::endl;
+        size = this->Shadow.size();
+    }
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    std::size_t first = 0;
+    std::size_t last = size;
+    if (!this->Uninitialised)
+    {
+        // shrink the upload to the range that actually differs from what the GPU already has
+        while (first < size && bytes[first] == this->Shadow[first]) first++;
+        if (first == size)
+            return false;
+        while (last > first && bytes[last - 1] == this->Shadow[last - 1]) last--;
+    }
+    this->Uninitialised = false;
+
+    std::memcpy(&this->Shadow[first], bytes + first, last - first);
+    glBindBuffer(GL_UNIFORM_BUFFER, this->BufferID);
+    glBufferSubData(GL_UNIFORM_BUFFER, first, last - first, bytes + first);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return true;
+}
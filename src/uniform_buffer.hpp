@@ -0,0 +1,36 @@
+#ifndef UNIFORM_BUFFER_HPP
+#define UNIFORM_BUFFER_HPP
+
+#include <cstddef>
+#include <vector>
+
+class UniformBuffer
+{
+public:
+    /*
+        Construct a UniformBuffer object.
+        Allocates a uniform buffer of the given size and binds it to a fixed binding point,
+        where it stays for the lifetime of the object.
+    */
+    UniformBuffer(std::size_t size, unsigned int binding);
+    ~UniformBuffer();
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    /*
+        Upload new contents for the whole block.
+        The data is compared against a CPU copy of what the buffer already holds and only the changed
+        byte range is sent in a single glBufferSubData call. Returns false if nothing changed.
+    */
+    bool update(const void* data, std::size_t size);
+
+private:
+    /* Hold the ID of the buffer object used by OpenGL */
+    unsigned int BufferID;
+    /* CPU copy of the buffer contents, used to skip redundant uploads. */
+    std::vector<unsigned char> Shadow;
+    /* Set until the first upload so the initial contents are always sent. */
+    bool Uninitialised;
+};
+
+#endif  // UNIFORM_BUFFER_HPP
@@ -0,0 +1,151 @@
+#include "vertex_format.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "mesh.hpp"
+
+constexpr unsigned int VertexLayout::kMAX_ATTRIBUTES;
+
+namespace
+{
+    /* Vertex of the compact format. */
+    struct CompactVertex
+    {
+        std::uint16_t Position[3];
+        std::uint16_t Padding;
+        std::uint32_t Normal;
+        std::uint16_t TexCoords[2];
+    };
+
+    const VertexLayout kFLOAT_LAYOUT = {
+        sizeof(Vertex),
+        {
+            { Mesh::kPOSITION_ATTRIBUTE,   3, GL_FLOAT, false, offsetof(Vertex, Position) },
+            { Mesh::kNORMAL_ATTRIBUTE,     3, GL_FLOAT, false, offsetof(Vertex, Normal) },
+            { Mesh::kTEX_COORDS_ATTRIBUTE, 2, GL_FLOAT, false, offsetof(Vertex, TexCoords) }
+        },
+        3
+    };
+    const VertexLayout kCOMPACT_LAYOUT = {
+        sizeof(CompactVertex),
+        {
+            { Mesh::kPOSITION_ATTRIBUTE,   3, GL_UNSIGNED_SHORT,         true, offsetof(CompactVertex, Position) },
+            { Mesh::kNORMAL_ATTRIBUTE,     4, GL_INT_2_10_10_10_REV,     true, offsetof(CompactVertex, Normal) },
+            { Mesh::kTEX_COORDS_ATTRIBUTE, 2, GL_HALF_FLOAT,             false, offsetof(CompactVertex, TexCoords) }
+        },
+        3
+    };
+
+    /* Round a float to the nearest half float, flushing values too small for a half to zero. */
+    std::uint16_t toHalf(float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        std::uint16_t sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+        std::uint32_t magnitude = bits & 0x7FFFFFFFu;
+        if (magnitude >= 0x7F800000u)
+            return sign | (magnitude > 0x7F800000u ? 0x7E00u : 0x7C00u);
+        // the largest float that rounds to a finite half
+        if (magnitude >= 0x477FF000u)
+            return sign | 0x7C00u;
+        if (magnitude < 0x38800000u)
+        {
+            // below the smallest normal half, rounded into a subnormal
+            float subnormal = std::fabs(value) * 16777216.0f;
+            return sign | static_cast<std::uint16_t>(std::lround(subnormal));
+        }
+        // rebias the exponent and round the mantissa to nearest, ties to even
+        std::uint32_t half = (magnitude - 0x38000000u) >> 13;
+        std::uint32_t remainder = magnitude & 0x1FFFu;
+        if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+            half++;
+        return sign | static_cast<std::uint16_t>(half);
+    }
+
+    /* Pack a unit vector into the signed normalised 10-bit x, y and z of a GL_INT_2_10_10_10_REV value. */
+    std::uint32_t packNormal(const glm::vec3& normal)
+    {
+        std::uint32_t packed = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            int component = static_cast<int>(std::lround(std::min(std::max(normal[i], -1.0f), 1.0f) * 511.0f));
+            packed |= (static_cast<std::uint32_t>(component) & 0x3FFu) << (10 * i);
+        }
+        return packed;
+    }
+
+    /* Size of the box along each axis, with flat axes widened so quantising never divides by zero. */
+    glm::vec3 quantisationExtent(const Bounds& box)
+    {
+        glm::vec3 extent = box.Max - box.Min;
+        for (int i = 0; i < 3; i++)
+        {
+            if (!(extent[i] > 0.0f))
+                extent[i] = 1.0f;
+        }
+        return extent;
+    }
+}
+
+const VertexLayout& getVertexLayout(VertexFormat format)
+{
+    return format == kVERTEX_FORMAT_COMPACT ? kCOMPACT_LAYOUT : kFLOAT_LAYOUT;
+}
+
+const char* getVertexFormatName(VertexFormat format)
+{
+    return format == kVERTEX_FORMAT_COMPACT ? "compact" : "float";
+}
+
+bool findVertexFormat(const char* name, VertexFormat& format)
+{
+    if (std::strcmp(name, "float") == 0)
+        format = kVERTEX_FORMAT_FLOAT;
+    else if (std::strcmp(name, "compact") == 0)
+        format = kVERTEX_FORMAT_COMPACT;
+    else
+        return false;
+    return true;
+}
+
+void packVertices(const Vertex* vertices, std::size_t count, VertexFormat format, const Bounds& box,
+                  std::vector<unsigned char>& packed)
+{
+    packed.resize(count * getVertexLayout(format).Stride);
+    if (format == kVERTEX_FORMAT_FLOAT)
+    {
+        if (count > 0)
+            std::memcpy(packed.data(), vertices, count * sizeof(Vertex));
+        return;
+    }
+
+    glm::vec3 extent = quantisationExtent(box);
+    CompactVertex* out = reinterpret_cast<CompactVertex*>(packed.data());
+    for (std::size_t i = 0; i < count; i++)
+    {
+        glm::vec3 position = (vertices[i].Position - box.Min) / extent;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float clamped = std::min(std::max(position[axis], 0.0f), 1.0f);
+            out[i].Position[axis] = static_cast<std::uint16_t>(std::lround(clamped * 65535.0f));
+        }
+        out[i].Padding = 0;
+        out[i].Normal = packNormal(vertices[i].Normal);
+        out[i].TexCoords[0] = toHalf(vertices[i].TexCoords.x);
+        out[i].TexCoords[1] = toHalf(vertices[i].TexCoords.y);
+    }
+}
+
+glm::mat4 getPositionTransform(VertexFormat format, const Bounds& box)
+{
+    if (format == kVERTEX_FORMAT_FLOAT)
+        return glm::mat4(1.0f);
+    // normalised positions are in [0, 1] across the box
+    return glm::scale(glm::translate(glm::mat4(1.0f), box.Min), quantisationExtent(box));
+}
@@ -0,0 +1,64 @@
+#ifndef VERTEX_FORMAT_HPP
+#define VERTEX_FORMAT_HPP
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Vertex;
+struct Bounds;
+
+/* Ways of storing the vertices of a mesh in its GPU buffer. Both feed the same shader inputs. */
+enum VertexFormat
+{
+    /* 32 bytes: float positions, normals and texture coordinates, exactly as in the Vertex struct. */
+    kVERTEX_FORMAT_FLOAT,
+    /*
+        16 bytes: 16-bit positions quantised to the mesh's bounding box, normals packed into
+        GL_INT_2_10_10_10_REV and half float texture coordinates.
+    */
+    kVERTEX_FORMAT_COMPACT
+};
+
+/* How one vertex attribute is stored, as passed to glVertexAttribPointer. */
+struct VertexAttributeLayout
+{
+    unsigned int Location;
+    int Components;
+    /* GL type of each component, such as GL_FLOAT. */
+    unsigned int Type;
+    /* Whether integer components are mapped to [0, 1] or [-1, 1] instead of converted as they are. */
+    bool Normalized;
+    std::size_t Offset;
+};
+
+/* Interleaved layout of every attribute of a vertex format. */
+struct VertexLayout
+{
+    static constexpr unsigned int kMAX_ATTRIBUTES = 3;
+
+    std::size_t Stride;
+    VertexAttributeLayout Attributes[kMAX_ATTRIBUTES];
+    unsigned int AttributeCount;
+};
+
+/* Get the layout of a vertex format. */
+const VertexLayout& getVertexLayout(VertexFormat format);
+/* Get the name of a vertex format, as used on the command line. */
+const char* getVertexFormatName(VertexFormat format);
+/* Find a vertex format by name. Returns false if there is none with that name. */
+bool findVertexFormat(const char* name, VertexFormat& format);
+
+/*
+    Convert vertices to a vertex format, ready to upload. Compact positions are stored relative to
+    the box, which must hold every vertex.
+*/
+void packVertices(const Vertex* vertices, std::size_t count, VertexFormat format, const Bounds& box,
+                  std::vector<unsigned char>& packed);
+/*
+    Get the matrix that takes the positions stored in a vertex format back to model space. It is the
+    identity for float positions, and is applied by multiplying it onto the model matrix.
+*/
+glm::mat4 getPositionTransform(VertexFormat format, const Bounds& box);
+
+#endif  // VERTEX_FORMAT_HPP